@@ -12,19 +12,27 @@
 #include <stdlib.h>
 #include "arcfour.h"
 
+/****************************** MACROS ******************************/
+// One PRGA step on permutation s with indices i and j, setting k to the output
+// byte. si and sj are scratch.
+#define ARCFOUR_STEP(s,i,j,si,sj,k) \
+	++i; si = s[i]; j += si; sj = s[j]; s[i] = sj; s[j] = si; k = s[(BYTE)(si + sj)];
+
+// One key setup step on permutation s for position i, with key index n.
+#define ARCFOUR_KSA_STEP(s,i,j,t,key,n,len) \
+	j += s[i] + key[n]; if (++n == len) n = 0; t = s[i]; s[i] = s[j]; s[j] = t;
+
 /*********************** FUNCTION DEFINITIONS ***********************/
+// The index arithmetic is modulo 256, which BYTE indices give for free.
 void arcfour_key_setup(BYTE state[], const BYTE key[], int len)
 {
-	int i, j;
-	BYTE t;
+	int i, n;
+	BYTE j, t;
 
 	for (i = 0; i < 256; ++i)
 		state[i] = i;
-	for (i = 0, j = 0; i < 256; ++i) {
-		j = (j + state[i] + key[i % len]) % 256;
-		t = state[i];
-		state[i] = state[j];
-		state[j] = t;
+	for (i = 0, j = 0, n = 0; i < 256; ++i) {
+		ARCFOUR_KSA_STEP(state, i, j, t, key, n, len);
 	}
 }
 
@@ -32,16 +40,142 @@ void arcfour_key_setup(BYTE state[], const BYTE key[], int len)
 // stream starting from the first  output byte.
 void arcfour_generate_stream(BYTE state[], BYTE out[], size_t len)
 {
-	int i, j;
 	size_t idx;
-	BYTE t;
+	BYTE i, j, t;
 
 	for (idx = 0, i = 0, j = 0; idx < len; ++idx)  {
-		i = (i + 1) % 256;
-		j = (j + state[i]) % 256;
+		++i;
+		j += state[i];
 		t = state[i];
 		state[i] = state[j];
 		state[j] = t;
-		out[idx] = state[(state[i] + state[j]) % 256];
+		out[idx] = state[(BYTE)(state[i] + state[j])];
+	}
+}
+
+void arcfour_init(ARCFOUR_CTX *ctx, const BYTE key[], int len)
+{
+	arcfour_key_setup(ctx->s, key, len);
+	ctx->i = 0;
+	ctx->j = 0;
+}
+
+void arcfour_init_drop(ARCFOUR_CTX *ctx, const BYTE key[], int len, size_t drop)
+{
+	BYTE *s = ctx->s;
+	BYTE i, j, t;
+
+	arcfour_init(ctx, key, len);
+	// Only the permutation has to advance, no output byte is formed.
+	for (i = 0, j = 0; drop > 0; --drop) {
+		++i;
+		j += s[i];
+		t = s[i];
+		s[i] = s[j];
+		s[j] = t;
+	}
+	ctx->i = i;
+	ctx->j = j;
+}
+
+void arcfour_update(ARCFOUR_CTX *ctx, const BYTE in[], BYTE out[], size_t len)
+{
+	BYTE *s = ctx->s;
+	size_t idx;
+	BYTE i, j, si, sj, k;
+
+	// Keep the indices in locals so they live in registers across the loop.
+	i = ctx->i;
+	j = ctx->j;
+	for (idx = 0; idx < len; ++idx) {
+		ARCFOUR_STEP(s, i, j, si, sj, k);
+		out[idx] = in[idx] ^ k;
+	}
+	ctx->i = i;
+	ctx->j = j;
+}
+
+void arcfour_stream(ARCFOUR_CTX *ctx, BYTE out[], size_t len)
+{
+	BYTE *s = ctx->s;
+	size_t idx;
+	BYTE i, j, si, sj;
+
+	i = ctx->i;
+	j = ctx->j;
+	for (idx = 0; idx < len; ++idx) {
+		ARCFOUR_STEP(s, i, j, si, sj, out[idx]);
+	}
+	ctx->i = i;
+	ctx->j = j;
+}
+
+// The RC4 state update is one long serial chain per stream. Four independent
+// streams are stepped together so that their chains overlap.
+void arcfour_init_batch(ARCFOUR_CTX ctx[], const BYTE *const keys[], const int lens[], size_t count)
+{
+	BYTE *s0, *s1, *s2, *s3;
+	BYTE j0, j1, j2, j3, t;
+	int i, n0, n1, n2, n3;
+	size_t idx;
+
+	for (idx = 0; idx + 4 <= count; idx += 4) {
+		s0 = ctx[idx].s; s1 = ctx[idx + 1].s; s2 = ctx[idx + 2].s; s3 = ctx[idx + 3].s;
+		for (i = 0; i < 256; ++i)
+			s0[i] = s1[i] = s2[i] = s3[i] = i;
+		j0 = j1 = j2 = j3 = 0;
+		n0 = n1 = n2 = n3 = 0;
+		for (i = 0; i < 256; ++i) {
+			ARCFOUR_KSA_STEP(s0, i, j0, t, keys[idx], n0, lens[idx]);
+			ARCFOUR_KSA_STEP(s1, i, j1, t, keys[idx + 1], n1, lens[idx + 1]);
+			ARCFOUR_KSA_STEP(s2, i, j2, t, keys[idx + 2], n2, lens[idx + 2]);
+			ARCFOUR_KSA_STEP(s3, i, j3, t, keys[idx + 3], n3, lens[idx + 3]);
+		}
+		for (i = 0; i < 4; ++i) {
+			ctx[idx + i].i = 0;
+			ctx[idx + i].j = 0;
+		}
+	}
+	for ( ; idx < count; ++idx)
+		arcfour_init(&ctx[idx], keys[idx], lens[idx]);
+}
+
+void arcfour_update_multi(ARCFOUR_CTX ctx[], const BYTE *const in[], BYTE *const out[], const size_t lens[], size_t count)
+{
+	BYTE *s0, *s1, *s2, *s3, *o0, *o1, *o2, *o3;
+	const BYTE *in0, *in1, *in2, *in3;
+	BYTE i0, i1, i2, i3, j0, j1, j2, j3;
+	BYTE si0, si1, si2, si3, sj0, sj1, sj2, sj3, k0, k1, k2, k3;
+	size_t idx, pos, len, lane;
+
+	for (idx = 0; idx + 4 <= count; idx += 4) {
+		// Step all four streams over their common length, then finish each one alone.
+		len = lens[idx];
+		for (lane = 1; lane < 4; ++lane) {
+			if (lens[idx + lane] < len)
+				len = lens[idx + lane];
+		}
+		s0 = ctx[idx].s; s1 = ctx[idx + 1].s; s2 = ctx[idx + 2].s; s3 = ctx[idx + 3].s;
+		// Byte stores may alias anything, so keep the buffer pointers in locals.
+		in0 = in[idx]; in1 = in[idx + 1]; in2 = in[idx + 2]; in3 = in[idx + 3];
+		o0 = out[idx]; o1 = out[idx + 1]; o2 = out[idx + 2]; o3 = out[idx + 3];
+		i0 = ctx[idx].i; i1 = ctx[idx + 1].i; i2 = ctx[idx + 2].i; i3 = ctx[idx + 3].i;
+		j0 = ctx[idx].j; j1 = ctx[idx + 1].j; j2 = ctx[idx + 2].j; j3 = ctx[idx + 3].j;
+		for (pos = 0; pos < len; ++pos) {
+			ARCFOUR_STEP(s0, i0, j0, si0, sj0, k0);
+			ARCFOUR_STEP(s1, i1, j1, si1, sj1, k1);
+			ARCFOUR_STEP(s2, i2, j2, si2, sj2, k2);
+			ARCFOUR_STEP(s3, i3, j3, si3, sj3, k3);
+			o0[pos] = in0[pos] ^ k0;
+			o1[pos] = in1[pos] ^ k1;
+			o2[pos] = in2[pos] ^ k2;
+			o3[pos] = in3[pos] ^ k3;
+		}
+		ctx[idx].i = i0; ctx[idx + 1].i = i1; ctx[idx + 2].i = i2; ctx[idx + 3].i = i3;
+		ctx[idx].j = j0; ctx[idx + 1].j = j1; ctx[idx + 2].j = j2; ctx[idx + 3].j = j3;
+		for (lane = 0; lane < 4; ++lane)
+			arcfour_update(&ctx[idx + lane], &in[idx + lane][len], &out[idx + lane][len], lens[idx + lane] - len);
 	}
+	for ( ; idx < count; ++idx)
+		arcfour_update(&ctx[idx], in[idx], out[idx], lens[idx]);
 }
@@ -15,6 +15,12 @@
 /**************************** DATA TYPES ****************************/
 typedef unsigned char BYTE;             // 8-bit byte
 
+typedef struct {
+	BYTE s[256];                        // The permutation
+	BYTE i;                             // Indices, carried from one update to the next
+	BYTE j;
+} ARCFOUR_CTX;
+
 /*********************** FUNCTION DECLARATIONS **********************/
 // Input: state - the state used to generate the keystream
 //        key - Key to use to initialize the state
@@ -27,4 +33,32 @@ void arcfour_key_setup(BYTE state[], const BYTE key[], int len);
 //        len - number of bytes to generate
 void arcfour_generate_stream(BYTE state[], BYTE out[], size_t len);
 
+// Streaming interface. The context carries the permutation and both indices,
+// so a stream may be produced in any number of calls.
+// Input: ctx - the context to initialize
+//        key - Key to use to initialize the state
+//        len - length of key in bytes (valid lenth is 1 to 256)
+void arcfour_init(ARCFOUR_CTX *ctx, const BYTE key[], int len);
+
+// RC4-drop[n]: as arcfour_init(), then discards the first "drop" keystream bytes.
+void arcfour_init_drop(ARCFOUR_CTX *ctx, const BYTE key[], int len, size_t drop);
+
+// XORs the next "len" keystream bytes into "in". Encryption and decryption are
+// the same operation. "in" and "out" may be the same buffer.
+void arcfour_update(ARCFOUR_CTX *ctx, const BYTE in[], BYTE out[], size_t len);
+
+// Writes the next "len" keystream bytes to "out".
+void arcfour_stream(ARCFOUR_CTX *ctx, BYTE out[], size_t len);
+
+// Multi-stream interface. Each stream has its own context, key and data; the
+// streams are stepped four at a time for throughput.
+// Input: ctx - "count" contexts to initialize
+//        keys - one key per context
+//        lens - length of each key in bytes (valid lenth is 1 to 256)
+void arcfour_init_batch(ARCFOUR_CTX ctx[], const BYTE *const keys[], const int lens[], size_t count);
+
+// As arcfour_update() on each of the "count" streams. in[n] and out[n] may be
+// the same buffer and hold lens[n] bytes.
+void arcfour_update_multi(ARCFOUR_CTX ctx[], const BYTE *const in[], BYTE *const out[], const size_t lens[], size_t count);
+
 #endif   // ARCFOUR_H
@@ -39,9 +39,82 @@ int rc4_test()
 	return(pass);
 }
 
+int rc4_ctx_test()
+{
+	BYTE state[256];
+	BYTE key[5] = {0x01,0x02,0x03,0x04,0x05};
+	BYTE plaintext[9] = {"Plaintext"};
+	BYTE ciphertext[9] = {0xBB,0xF3,0x16,0xE8,0xD9,0x40,0xAF,0x0A,0xD3};
+	BYTE one_shot[1100], buf[1100];
+	ARCFOUR_CTX ctx;
+	size_t pos, chunk;
+	int pass = 1;
+
+	// In-place XOR update.
+	memcpy(buf, plaintext, sizeof(plaintext));
+	arcfour_init(&ctx, (BYTE *)"Key", 3);
+	arcfour_update(&ctx, buf, buf, sizeof(plaintext));
+	pass = pass && !memcmp(ciphertext, buf, sizeof(ciphertext));
+
+	// The stream produced in uneven chunks matches the one-shot stream.
+	arcfour_key_setup(state, key, sizeof(key));
+	arcfour_generate_stream(state, one_shot, sizeof(one_shot));
+	arcfour_init(&ctx, key, sizeof(key));
+	for (pos = 0, chunk = 1; pos < sizeof(buf); pos += chunk, chunk += 7) {
+		if (chunk > sizeof(buf) - pos)
+			chunk = sizeof(buf) - pos;
+		arcfour_stream(&ctx, &buf[pos], chunk);
+	}
+	pass = pass && !memcmp(one_shot, buf, sizeof(buf));
+
+	// RC4-drop[1024] continues where the full stream would be.
+	arcfour_init_drop(&ctx, key, sizeof(key), 1024);
+	arcfour_stream(&ctx, buf, sizeof(buf) - 1024);
+	pass = pass && !memcmp(&one_shot[1024], buf, sizeof(buf) - 1024);
+
+	return(pass);
+}
+
+int rc4_multi_test()
+{
+	BYTE keys[6][16], data[6][300], buf[6][300], expected[300];
+	const BYTE *key_ptrs[6], *in_ptrs[6];
+	BYTE *out_ptrs[6];
+	int key_lens[6] = {5, 16, 1, 7, 13, 16};
+	size_t lens[6] = {300, 17, 250, 299, 0, 64};
+	ARCFOUR_CTX ctx[6], single;
+	int idx, idx2, pass = 1;
+
+	for (idx = 0; idx < 6; ++idx) {
+		for (idx2 = 0; idx2 < 16; ++idx2)
+			keys[idx][idx2] = (BYTE)(idx * 37 + idx2 * 11);
+		for (idx2 = 0; idx2 < 300; ++idx2)
+			data[idx][idx2] = (BYTE)(idx2 ^ idx);
+		memcpy(buf[idx], data[idx], 300);
+		key_ptrs[idx] = keys[idx];
+		in_ptrs[idx] = buf[idx];
+		out_ptrs[idx] = buf[idx];
+	}
+
+	// Two calls, in place, so the second resumes every stream.
+	arcfour_init_batch(ctx, key_ptrs, key_lens, 6);
+	arcfour_update_multi(ctx, in_ptrs, out_ptrs, lens, 6);
+	arcfour_update_multi(ctx, in_ptrs, out_ptrs, lens, 6);
+	for (idx = 0; idx < 6; ++idx) {
+		arcfour_init(&single, keys[idx], key_lens[idx]);
+		arcfour_update(&single, data[idx], expected, lens[idx]);
+		arcfour_update(&single, expected, expected, lens[idx]);
+		pass = pass && !memcmp(expected, buf[idx], lens[idx]);
+		pass = pass && !memcmp(single.s, ctx[idx].s, 256);
+		pass = pass && single.i == ctx[idx].i && single.j == ctx[idx].j;
+	}
+
+	return(pass);
+}
+
 int main()
 {
-	printf("ARCFOUR tests: %s\n", rc4_test() ? "SUCCEEDED" : "FAILED");
+	printf("ARCFOUR tests: %s\n", rc4_test() && rc4_ctx_test() && rc4_multi_test() ? "SUCCEEDED" : "FAILED");
 
 	return(0);
 }
@@ -4,7 +4,8 @@
 * Copyright:
 * Disclaimer: This code is presented "as is" without any guarantees.
 * Details:    Implementation of the Blowfish encryption algorithm.
-              Modes of operation (such as CBC) are not included.
+              The ECB, CBC and CTR modes of operation are included, as is
+              the bcrypt password hash built on the EksBlowfish key schedule.
               Algorithm specification can be found here:
                * http://www.schneier.com/blowfish.html
 *********************************************************************/
@@ -12,17 +13,65 @@
 /*************************** HEADER FILES ***************************/
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include "blowfish.h"
 
+// Multi-lane kernels using vector gathers for the S-box lookups. They are
+// compiled for AVX2/AVX-512 with target attributes and chosen at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(BLOWFISH_NO_GATHER)
+#define BLOWFISH_GATHER
+#include <immintrin.h>
+#endif
+
 /****************************** MACROS ******************************/
-#define F(x,t) t = keystruct->s[0][(x) >> 24]; \
-               t += keystruct->s[1][((x) >> 16) & 0xff]; \
-               t ^= keystruct->s[2][((x) >> 8) & 0xff]; \
-               t += keystruct->s[3][(x) & 0xff];
+#define F_KS(ks,x,t) t = (ks)->s[0][(x) >> 24]; \
+                     t += (ks)->s[1][((x) >> 16) & 0xff]; \
+                     t ^= (ks)->s[2][((x) >> 8) & 0xff]; \
+                     t += (ks)->s[3][(x) & 0xff];
+#define F(x,t) F_KS(keystruct,x,t)
 #define swap(r,l,t) t = l; l = r; r = t;
 #define ITERATION(l,r,t,pval) l ^= keystruct->p[pval]; F(l,t); r^= t; swap(r,l,t);
 
+// Four independent blocks through one round, kept in the locals l0..l3,
+// r0..r3 and t0..t3. The S-box lookups of the four blocks are independent, so
+// their load latencies overlap.
+#define ITERATION_X4(pval) \
+   l0 ^= keystruct->p[pval]; l1 ^= keystruct->p[pval]; \
+   l2 ^= keystruct->p[pval]; l3 ^= keystruct->p[pval]; \
+   F(l0,t0); F(l1,t1); F(l2,t2); F(l3,t3); \
+   r0 ^= t0; r1 ^= t1; r2 ^= t2; r3 ^= t3; \
+   swap(r0,l0,t0); swap(r1,l1,t1); swap(r2,l2,t2); swap(r3,l3,t3);
+
+// As ITERATION_X4, but each block has its own key schedule in ks[0..3].
+#define ITERATION_KX4(pval) \
+   l0 ^= ks[0].p[pval]; l1 ^= ks[1].p[pval]; \
+   l2 ^= ks[2].p[pval]; l3 ^= ks[3].p[pval]; \
+   F_KS(&ks[0],l0,t0); F_KS(&ks[1],l1,t1); F_KS(&ks[2],l2,t2); F_KS(&ks[3],l3,t3); \
+   r0 ^= t0; r1 ^= t1; r2 ^= t2; r3 ^= t3; \
+   swap(r0,l0,t0); swap(r1,l1,t1); swap(r2,l2,t2); swap(r3,l3,t3);
+
+#define BCRYPT_LANES 4                  // Hashes interleaved by bcrypt_verify_batch()
+
+#define TRUE  1
+#define FALSE 0
+
+// Move a block between its byte form and two big-endian 32-bit halves.
+#define LOAD_HALVES(in,l,r) \
+   l = ((WORD)(in)[0] << 24) | ((in)[1] << 16) | ((in)[2] << 8) | (in)[3]; \
+   r = ((WORD)(in)[4] << 24) | ((in)[5] << 16) | ((in)[6] << 8) | (in)[7];
+#define STORE_HALVES(out,l,r) \
+   (out)[0] = (l) >> 24; (out)[1] = (l) >> 16; (out)[2] = (l) >> 8; (out)[3] = (l); \
+   (out)[4] = (r) >> 24; (out)[5] = (r) >> 16; (out)[6] = (r) >> 8; (out)[7] = (r);
+
 /**************************** VARIABLES *****************************/
+static const char bcrypt_b64[] =
+   "./ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+// "OrpheanBeholderScryDoubt" as big-endian words.
+static const WORD bcrypt_ctext[6] = {
+   0x4F727068,0x65616E42,0x65686F6C,0x64657253,0x63727944,0x6F756274
+};
+
 static const WORD p_perm[18] = {
    0x243F6A88,0x85A308D3,0x13198A2E,0x03707344,0xA4093822,0x299F31D0,0x082EFA98,
    0xEC4E6C89,0x452821E6,0x38D01377,0xBE5466CF,0x34E90C6C,0xC0AC29B7,0xC97C50DD,
@@ -164,12 +213,13 @@ static const WORD s_perm[4][256] = { {
 } };
 
 /*********************** FUNCTION DEFINITIONS ***********************/
-void blowfish_encrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct)
+// Block en/de-cryption on the block held as its two big-endian halves.
+static void blowfish_encrypt_words(WORD *lp, WORD *rp, const BLOWFISH_KEY *keystruct)
 {
-   WORD l,r,t; //,i;
+   WORD l,r,t;
 
-   l = (in[0] << 24) | (in[1] << 16) | (in[2] << 8) | (in[3]);
-   r = (in[4] << 24) | (in[5] << 16) | (in[6] << 8) | (in[7]);
+   l = *lp;
+   r = *rp;
 
    ITERATION(l,r,t,0);
    ITERATION(l,r,t,1);
@@ -190,22 +240,16 @@ void blowfish_encrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct
    r ^= keystruct->p[16];
    l ^= keystruct->p[17];
 
-   out[0] = l >> 24;
-   out[1] = l >> 16;
-   out[2] = l >> 8;
-   out[3] = l;
-   out[4] = r >> 24;
-   out[5] = r >> 16;
-   out[6] = r >> 8;
-   out[7] = r;
+   *lp = l;
+   *rp = r;
 }
 
-void blowfish_decrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct)
+static void blowfish_decrypt_words(WORD *lp, WORD *rp, const BLOWFISH_KEY *keystruct)
 {
-   WORD l,r,t; //,i;
+   WORD l,r,t;
 
-   l = (in[0] << 24) | (in[1] << 16) | (in[2] << 8) | (in[3]);
-   r = (in[4] << 24) | (in[5] << 16) | (in[6] << 8) | (in[7]);
+   l = *lp;
+   r = *rp;
 
    ITERATION(l,r,t,17);
    ITERATION(l,r,t,16);
@@ -226,44 +270,694 @@ void blowfish_decrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct
    r ^= keystruct->p[1];
    l ^= keystruct->p[0];
 
-   out[0] = l >> 24;
-   out[1] = l >> 16;
-   out[2] = l >> 8;
-   out[3] = l;
-   out[4] = r >> 24;
-   out[5] = r >> 16;
-   out[6] = r >> 8;
-   out[7] = r;
+   *lp = l;
+   *rp = r;
 }
 
-void blowfish_key_setup(const BYTE user_key[], BLOWFISH_KEY *keystruct, size_t len)
+void blowfish_encrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct)
 {
-   BYTE block[8];
+   WORD l,r;
+
+   LOAD_HALVES(in,l,r);
+   blowfish_encrypt_words(&l,&r,keystruct);
+   STORE_HALVES(out,l,r);
+}
+
+void blowfish_decrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct)
+{
+   WORD l,r;
+
+   LOAD_HALVES(in,l,r);
+   blowfish_decrypt_words(&l,&r,keystruct);
+   STORE_HALVES(out,l,r);
+}
+
+// Four-block versions of the above. blk[] holds the blocks as l0,r0,l1,r1,...
+static void blowfish_encrypt_x4(WORD blk[], const BLOWFISH_KEY *keystruct)
+{
+   WORD l0,r0,l1,r1,l2,r2,l3,r3,t0,t1,t2,t3;
+   int idx;
+
+   l0 = blk[0]; r0 = blk[1]; l1 = blk[2]; r1 = blk[3];
+   l2 = blk[4]; r2 = blk[5]; l3 = blk[6]; r3 = blk[7];
+
+   for (idx = 0; idx < 16; ++idx) {
+      ITERATION_X4(idx);
+   }
+   // Undo the last swap().
+   swap(r0,l0,t0); swap(r1,l1,t1); swap(r2,l2,t2); swap(r3,l3,t3);
+
+   blk[0] = l0 ^ keystruct->p[17]; blk[1] = r0 ^ keystruct->p[16];
+   blk[2] = l1 ^ keystruct->p[17]; blk[3] = r1 ^ keystruct->p[16];
+   blk[4] = l2 ^ keystruct->p[17]; blk[5] = r2 ^ keystruct->p[16];
+   blk[6] = l3 ^ keystruct->p[17]; blk[7] = r3 ^ keystruct->p[16];
+}
+
+static void blowfish_decrypt_x4(WORD blk[], const BLOWFISH_KEY *keystruct)
+{
+   WORD l0,r0,l1,r1,l2,r2,l3,r3,t0,t1,t2,t3;
+   int idx;
+
+   l0 = blk[0]; r0 = blk[1]; l1 = blk[2]; r1 = blk[3];
+   l2 = blk[4]; r2 = blk[5]; l3 = blk[6]; r3 = blk[7];
+
+   for (idx = 17; idx > 1; --idx) {
+      ITERATION_X4(idx);
+   }
+   // Undo the last swap().
+   swap(r0,l0,t0); swap(r1,l1,t1); swap(r2,l2,t2); swap(r3,l3,t3);
+
+   blk[0] = l0 ^ keystruct->p[0]; blk[1] = r0 ^ keystruct->p[1];
+   blk[2] = l1 ^ keystruct->p[0]; blk[3] = r1 ^ keystruct->p[1];
+   blk[4] = l2 ^ keystruct->p[0]; blk[5] = r2 ^ keystruct->p[1];
+   blk[6] = l3 ^ keystruct->p[0]; blk[7] = r3 ^ keystruct->p[1];
+}
+
+#ifdef BLOWFISH_GATHER
+// Sixteen blocks as two pairs of vectors of left and right halves; the two
+// sets are independent so their gathers overlap. Decryption is the same with
+// the P-array reversed, so p[] is passed in separately.
+#define BF_GATHER_F_AVX2(x,t) \
+   t = _mm256_i32gather_epi32((const int *)keystruct->s[0], _mm256_srli_epi32(x, 24), 4); \
+   t = _mm256_add_epi32(t, _mm256_i32gather_epi32((const int *)keystruct->s[1], \
+                              _mm256_and_si256(_mm256_srli_epi32(x, 16), mask), 4)); \
+   t = _mm256_xor_si256(t, _mm256_i32gather_epi32((const int *)keystruct->s[2], \
+                              _mm256_and_si256(_mm256_srli_epi32(x, 8), mask), 4)); \
+   t = _mm256_add_epi32(t, _mm256_i32gather_epi32((const int *)keystruct->s[3], \
+                              _mm256_and_si256(x, mask), 4));
+
+__attribute__((target("avx2")))
+static void blowfish_encrypt_avx2(WORD lw[], WORD rw[], const WORD p[], const BLOWFISH_KEY *keystruct)
+{
+   const __m256i mask = _mm256_set1_epi32(0xff);
+   __m256i l0,r0,l1,r1,t0,t1,pv;
+   int idx;
+
+   l0 = _mm256_loadu_si256((const __m256i *)lw);
+   l1 = _mm256_loadu_si256((const __m256i *)&lw[8]);
+   r0 = _mm256_loadu_si256((const __m256i *)rw);
+   r1 = _mm256_loadu_si256((const __m256i *)&rw[8]);
+   for (idx = 0; idx < 16; ++idx) {
+      pv = _mm256_set1_epi32((int)p[idx]);
+      l0 = _mm256_xor_si256(l0, pv);
+      l1 = _mm256_xor_si256(l1, pv);
+      BF_GATHER_F_AVX2(l0,t0);
+      BF_GATHER_F_AVX2(l1,t1);
+      r0 = _mm256_xor_si256(r0, t0);
+      r1 = _mm256_xor_si256(r1, t1);
+      t0 = l0; l0 = r0; r0 = t0;
+      t1 = l1; l1 = r1; r1 = t1;
+   }
+   // Undo the last swap.
+   _mm256_storeu_si256((__m256i *)lw, _mm256_xor_si256(r0, _mm256_set1_epi32((int)p[17])));
+   _mm256_storeu_si256((__m256i *)&lw[8], _mm256_xor_si256(r1, _mm256_set1_epi32((int)p[17])));
+   _mm256_storeu_si256((__m256i *)rw, _mm256_xor_si256(l0, _mm256_set1_epi32((int)p[16])));
+   _mm256_storeu_si256((__m256i *)&rw[8], _mm256_xor_si256(l1, _mm256_set1_epi32((int)p[16])));
+}
+
+// The same for thirty-two blocks in two pairs of 512-bit vectors.
+#define BF_GATHER_F_AVX512(x,t) \
+   t = _mm512_i32gather_epi32(_mm512_srli_epi32(x, 24), keystruct->s[0], 4); \
+   t = _mm512_add_epi32(t, _mm512_i32gather_epi32( \
+                              _mm512_and_si512(_mm512_srli_epi32(x, 16), mask), keystruct->s[1], 4)); \
+   t = _mm512_xor_si512(t, _mm512_i32gather_epi32( \
+                              _mm512_and_si512(_mm512_srli_epi32(x, 8), mask), keystruct->s[2], 4)); \
+   t = _mm512_add_epi32(t, _mm512_i32gather_epi32( \
+                              _mm512_and_si512(x, mask), keystruct->s[3], 4));
+
+__attribute__((target("avx512f")))
+static void blowfish_encrypt_avx512(WORD lw[], WORD rw[], const WORD p[], const BLOWFISH_KEY *keystruct)
+{
+   const __m512i mask = _mm512_set1_epi32(0xff);
+   __m512i l0,r0,l1,r1,t0,t1,pv;
+   int idx;
+
+   l0 = _mm512_loadu_si512(lw);
+   l1 = _mm512_loadu_si512(&lw[16]);
+   r0 = _mm512_loadu_si512(rw);
+   r1 = _mm512_loadu_si512(&rw[16]);
+   for (idx = 0; idx < 16; ++idx) {
+      pv = _mm512_set1_epi32((int)p[idx]);
+      l0 = _mm512_xor_si512(l0, pv);
+      l1 = _mm512_xor_si512(l1, pv);
+      BF_GATHER_F_AVX512(l0,t0);
+      BF_GATHER_F_AVX512(l1,t1);
+      r0 = _mm512_xor_si512(r0, t0);
+      r1 = _mm512_xor_si512(r1, t1);
+      t0 = l0; l0 = r0; r0 = t0;
+      t1 = l1; l1 = r1; r1 = t1;
+   }
+   // Undo the last swap.
+   _mm512_storeu_si512(lw, _mm512_xor_si512(r0, _mm512_set1_epi32((int)p[17])));
+   _mm512_storeu_si512(&lw[16], _mm512_xor_si512(r1, _mm512_set1_epi32((int)p[17])));
+   _mm512_storeu_si512(rw, _mm512_xor_si512(l0, _mm512_set1_epi32((int)p[16])));
+   _mm512_storeu_si512(&rw[16], _mm512_xor_si512(l1, _mm512_set1_epi32((int)p[16])));
+}
+
+// The number of blocks the gather kernels take at once, 0 if the CPU has neither.
+static int blowfish_gather_lanes(void)
+{
+   static int lanes = -1;
+
+   if (lanes < 0)
+      lanes = __builtin_cpu_supports("avx512f") ? 32 : __builtin_cpu_supports("avx2") ? 16 : 0;
+   return(lanes);
+}
+
+static void blowfish_gather_encrypt(WORD lw[], WORD rw[], int lanes, const WORD p[], const BLOWFISH_KEY *keystruct)
+{
+   if (lanes == 32)
+      blowfish_encrypt_avx512(lw, rw, p, keystruct);
+   else
+      blowfish_encrypt_avx2(lw, rw, p, keystruct);
+}
+#else
+static int blowfish_gather_lanes(void)
+{
+   return(0);
+}
+
+// Never called, as there are no lanes to fill.
+static void blowfish_gather_encrypt(WORD lw[], WORD rw[], int lanes, const WORD p[], const BLOWFISH_KEY *keystruct)
+{
+   (void)lw;
+   (void)rw;
+   (void)lanes;
+   (void)p;
+   (void)keystruct;
+}
+#endif
+
+/*******************
+* Blowfish - Modes
+*******************/
+// Blocks are kept as 32-bit halves between iterations. ECB, CBC decryption
+// and CTR work on four independent blocks at a time; ECB and CTR use the
+// 16 or 32 lane gather kernels first when the CPU has them.
+static void blowfish_ecb(const BYTE in[], size_t blocks, BYTE out[], const BLOWFISH_KEY *keystruct, int decrypt)
+{
+   WORD blk[8],lw[32],rw[32],p[18];
+   size_t idx;
+   int k,lanes;
+
+   lanes = blowfish_gather_lanes();
+   for (k = 0; k < 18; ++k)
+      p[k] = decrypt ? keystruct->p[17 - k] : keystruct->p[k];
+   for (idx = 0; lanes && idx + lanes <= blocks; idx += lanes) {
+      for (k = 0; k < lanes; ++k) {
+         LOAD_HALVES(&in[(idx + k) * BLOWFISH_BLOCK_SIZE],lw[k],rw[k]);
+      }
+      blowfish_gather_encrypt(lw, rw, lanes, p, keystruct);
+      for (k = 0; k < lanes; ++k) {
+         STORE_HALVES(&out[(idx + k) * BLOWFISH_BLOCK_SIZE],lw[k],rw[k]);
+      }
+   }
+   for ( ; idx + 4 <= blocks; idx += 4) {
+      for (k = 0; k < 4; ++k) {
+         LOAD_HALVES(&in[(idx + k) * BLOWFISH_BLOCK_SIZE],blk[2 * k],blk[2 * k + 1]);
+      }
+      if (decrypt)
+         blowfish_decrypt_x4(blk, keystruct);
+      else
+         blowfish_encrypt_x4(blk, keystruct);
+      for (k = 0; k < 4; ++k) {
+         STORE_HALVES(&out[(idx + k) * BLOWFISH_BLOCK_SIZE],blk[2 * k],blk[2 * k + 1]);
+      }
+   }
+   for ( ; idx < blocks; ++idx) {
+      if (decrypt)
+         blowfish_decrypt(&in[idx * BLOWFISH_BLOCK_SIZE], &out[idx * BLOWFISH_BLOCK_SIZE], keystruct);
+      else
+         blowfish_encrypt(&in[idx * BLOWFISH_BLOCK_SIZE], &out[idx * BLOWFISH_BLOCK_SIZE], keystruct);
+   }
+}
+
+int blowfish_encrypt_ecb(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct)
+{
+   if (in_len % BLOWFISH_BLOCK_SIZE != 0)
+      return(FALSE);
+   blowfish_ecb(in, in_len / BLOWFISH_BLOCK_SIZE, out, keystruct, FALSE);
+   return(TRUE);
+}
+
+int blowfish_decrypt_ecb(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct)
+{
+   if (in_len % BLOWFISH_BLOCK_SIZE != 0)
+      return(FALSE);
+   blowfish_ecb(in, in_len / BLOWFISH_BLOCK_SIZE, out, keystruct, TRUE);
+   return(TRUE);
+}
+
+int blowfish_encrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct, const BYTE iv[])
+{
+   WORD l,r,cl,cr;
+   size_t idx;
+
+   if (in_len % BLOWFISH_BLOCK_SIZE != 0)
+      return(FALSE);
+
+   LOAD_HALVES(iv,cl,cr);
+   for (idx = 0; idx < in_len; idx += BLOWFISH_BLOCK_SIZE) {
+      LOAD_HALVES(&in[idx],l,r);
+      cl ^= l;
+      cr ^= r;
+      blowfish_encrypt_words(&cl,&cr,keystruct);
+      STORE_HALVES(&out[idx],cl,cr);
+   }
+
+   return(TRUE);
+}
+
+int blowfish_decrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct, const BYTE iv[])
+{
+   WORD blk[8],ct[8],cl,cr;
+   size_t blocks,idx;
+   int k;
+
+   if (in_len % BLOWFISH_BLOCK_SIZE != 0)
+      return(FALSE);
+
+   blocks = in_len / BLOWFISH_BLOCK_SIZE;
+   // The previous ciphertext is kept in cl/cr, so in and out may overlap.
+   LOAD_HALVES(iv,cl,cr);
+   for (idx = 0; idx + 4 <= blocks; idx += 4) {
+      for (k = 0; k < 4; ++k) {
+         LOAD_HALVES(&in[(idx + k) * BLOWFISH_BLOCK_SIZE],ct[2 * k],ct[2 * k + 1]);
+         blk[2 * k] = ct[2 * k];
+         blk[2 * k + 1] = ct[2 * k + 1];
+      }
+      blowfish_decrypt_x4(blk, keystruct);
+      for (k = 0; k < 4; ++k) {
+         blk[2 * k] ^= cl;
+         blk[2 * k + 1] ^= cr;
+         cl = ct[2 * k];
+         cr = ct[2 * k + 1];
+         STORE_HALVES(&out[(idx + k) * BLOWFISH_BLOCK_SIZE],blk[2 * k],blk[2 * k + 1]);
+      }
+   }
+   for ( ; idx < blocks; ++idx) {
+      LOAD_HALVES(&in[idx * BLOWFISH_BLOCK_SIZE],ct[0],ct[1]);
+      blk[0] = ct[0];
+      blk[1] = ct[1];
+      blowfish_decrypt_words(&blk[0],&blk[1],keystruct);
+      blk[0] ^= cl;
+      blk[1] ^= cr;
+      cl = ct[0];
+      cr = ct[1];
+      STORE_HALVES(&out[idx * BLOWFISH_BLOCK_SIZE],blk[0],blk[1]);
+   }
+
+   return(TRUE);
+}
+
+// Performs the encryption in-place, the input and output buffers may be the same.
+// Input may be an arbitrary length (in bytes). The whole IV block is treated
+// as a big-endian counter.
+void blowfish_encrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct, const BYTE iv[])
+{
+   WORD blk[8],lw[32],rw[32],hi,lo;
+   BYTE ks[32 * BLOWFISH_BLOCK_SIZE];
+   size_t idx,k,chunk;
+   int lanes;
+
+   lanes = blowfish_gather_lanes();
+   LOAD_HALVES(iv,hi,lo);
+   for (idx = 0; idx < in_len; idx += chunk) {
+      // A gather pass only pays when all of its keystream is used.
+      if (lanes && in_len - idx >= (size_t)lanes * BLOWFISH_BLOCK_SIZE) {
+         chunk = lanes;
+         for (k = 0; k < chunk; ++k) {
+            lw[k] = hi;
+            rw[k] = lo;
+            hi += (++lo == 0);
+         }
+         blowfish_gather_encrypt(lw, rw, lanes, keystruct->p, keystruct);
+         for (k = 0; k < chunk; ++k) {
+            STORE_HALVES(&ks[k * BLOWFISH_BLOCK_SIZE],lw[k],rw[k]);
+         }
+      }
+      else {
+         chunk = 4;
+         for (k = 0; k < chunk; ++k) {
+            blk[2 * k] = hi;
+            blk[2 * k + 1] = lo;
+            hi += (++lo == 0);
+         }
+         blowfish_encrypt_x4(blk, keystruct);
+         for (k = 0; k < chunk; ++k) {
+            STORE_HALVES(&ks[k * BLOWFISH_BLOCK_SIZE],blk[2 * k],blk[2 * k + 1]);
+         }
+      }
+      chunk *= BLOWFISH_BLOCK_SIZE;
+      for (k = 0; k < chunk && idx + k < in_len; ++k)
+         out[idx + k] = in[idx + k] ^ ks[k];
+   }
+}
+
+void blowfish_decrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct, const BYTE iv[])
+{
+   // CTR encryption is its own inverse function.
+   blowfish_encrypt_ctr(in, in_len, out, keystruct, iv);
+}
+
+// The key cycled into the 18 words that are XORed into the P-array.
+static void blowfish_key_words(const BYTE user_key[], size_t len, WORD key[18])
+{
+   size_t pos = 0;
    int idx,idx2;
 
+   for (idx = 0; idx < 18; ++idx) {
+      key[idx] = 0;
+      for (idx2 = 0; idx2 < 4; ++idx2) {
+         key[idx] = (key[idx] << 8) | user_key[pos];
+         if (++pos == len)
+            pos = 0;
+      }
+   }
+}
+
+// XORs the key words into the P-array and regenerates P and S by chained
+// encryption, keeping the block in two words across all 521 encryptions.
+// This is EksBlowfish's ExpandKey(); salt is NULL for a plain key setup.
+static void blowfish_expand_key(BLOWFISH_KEY *keystruct, const WORD key[18], const WORD salt[4])
+{
+   WORD l = 0, r = 0;
+   int idx,idx2,pos = 0;
+
+   for (idx = 0; idx < 18; ++idx)
+      keystruct->p[idx] ^= key[idx];
+   for (idx = 0; idx < 18; idx += 2, pos += 2) {
+      if (salt) {
+         l ^= salt[pos % 4];
+         r ^= salt[(pos + 1) % 4];
+      }
+      blowfish_encrypt_words(&l,&r,keystruct);
+      keystruct->p[idx] = l;
+      keystruct->p[idx+1] = r;
+   }
+   for (idx = 0; idx < 4; ++idx) {
+      for (idx2 = 0; idx2 < 256; idx2 += 2, pos += 2) {
+         if (salt) {
+            l ^= salt[pos % 4];
+            r ^= salt[(pos + 1) % 4];
+         }
+         blowfish_encrypt_words(&l,&r,keystruct);
+         keystruct->s[idx][idx2] = l;
+         keystruct->s[idx][idx2+1] = r;
+      }
+   }
+}
+
+// Four independent key schedules, each with its own chained block, expanded
+// together so the S-box loads of the four chains overlap.
+static void blowfish_expand_key_x4(BLOWFISH_KEY ks[], const WORD key[][18], const WORD salt[][4])
+{
+   WORD l0,r0,l1,r1,l2,r2,l3,r3,t0,t1,t2,t3;
+   WORD *dst[4];
+   int idx,idx2,lane,round,pos = 0;
+
+   for (lane = 0; lane < 4; ++lane) {
+      for (idx = 0; idx < 18; ++idx)
+         ks[lane].p[idx] ^= key[lane][idx];
+   }
+   l0 = r0 = l1 = r1 = l2 = r2 = l3 = r3 = 0;
+   // Walk the P-array and then each S-box as one sequence of 521 word pairs.
+   for (idx = -1; idx < 4; ++idx) {
+      for (idx2 = 0; idx2 < (idx < 0 ? 18 : 256); idx2 += 2, pos += 2) {
+         for (lane = 0; lane < 4; ++lane)
+            dst[lane] = idx < 0 ? &ks[lane].p[idx2] : &ks[lane].s[idx][idx2];
+         if (salt) {
+            l0 ^= salt[0][pos % 4]; r0 ^= salt[0][(pos + 1) % 4];
+            l1 ^= salt[1][pos % 4]; r1 ^= salt[1][(pos + 1) % 4];
+            l2 ^= salt[2][pos % 4]; r2 ^= salt[2][(pos + 1) % 4];
+            l3 ^= salt[3][pos % 4]; r3 ^= salt[3][(pos + 1) % 4];
+         }
+         for (round = 0; round < 16; ++round) {
+            ITERATION_KX4(round);
+         }
+         // Undo the last swap().
+         swap(r0,l0,t0); swap(r1,l1,t1); swap(r2,l2,t2); swap(r3,l3,t3);
+         r0 ^= ks[0].p[16]; l0 ^= ks[0].p[17];
+         r1 ^= ks[1].p[16]; l1 ^= ks[1].p[17];
+         r2 ^= ks[2].p[16]; l2 ^= ks[2].p[17];
+         r3 ^= ks[3].p[16]; l3 ^= ks[3].p[17];
+         dst[0][0] = l0; dst[0][1] = r0;
+         dst[1][0] = l1; dst[1][1] = r1;
+         dst[2][0] = l2; dst[2][1] = r2;
+         dst[3][0] = l3; dst[3][1] = r3;
+      }
+   }
+}
+
+void blowfish_key_setup(const BYTE user_key[], BLOWFISH_KEY *keystruct, size_t len)
+{
+   WORD key[18];
+
    // Copy over the constant init array vals (so the originals aren't destroyed).
    memcpy(keystruct->p,p_perm,sizeof(WORD) * 18);
    memcpy(keystruct->s,s_perm,sizeof(WORD) * 1024);
 
-   // Combine the key with the P box. Assume key is standard 448 bits (56 bytes) or less.
-   for (idx = 0, idx2 = 0; idx < 18; ++idx, idx2 += 4)
-      keystruct->p[idx] ^= (user_key[idx2 % len] << 24) | (user_key[(idx2+1) % len] << 16)
-                           | (user_key[(idx2+2) % len] << 8) | (user_key[(idx2+3) % len]);
-   // Re-calculate the P box.
-   memset(block, 0, 8);
-   for (idx = 0; idx < 18; idx += 2) {
-      blowfish_encrypt(block,block,keystruct);
-      keystruct->p[idx] = (block[0] << 24) | (block[1] << 16) | (block[2] << 8) | block[3];
-      keystruct->p[idx+1]=(block[4] << 24) | (block[5] << 16) | (block[6] << 8) | block[7];
+   // Assume key is standard 448 bits (56 bytes) or less.
+   blowfish_key_words(user_key, len, key);
+   blowfish_expand_key(keystruct, key, NULL);
+}
+
+void blowfish_key_setup_batch(const BYTE *const user_keys[], const size_t lens[], BLOWFISH_KEY keystructs[], size_t count)
+{
+   WORD key[4][18];
+   size_t idx;
+   int lane;
+
+   for (idx = 0; idx + 4 <= count; idx += 4) {
+      for (lane = 0; lane < 4; ++lane) {
+         memcpy(keystructs[idx + lane].p,p_perm,sizeof(WORD) * 18);
+         memcpy(keystructs[idx + lane].s,s_perm,sizeof(WORD) * 1024);
+         blowfish_key_words(user_keys[idx + lane], lens[idx + lane], key[lane]);
+      }
+      blowfish_expand_key_x4(&keystructs[idx], (const WORD (*)[18])key, NULL);
    }
-   // Recalculate the S-boxes.
-   for (idx = 0; idx < 4; ++idx) {
-      for (idx2 = 0; idx2 < 256; idx2 += 2) {
-         blowfish_encrypt(block,block,keystruct);
-         keystruct->s[idx][idx2] = (block[0] << 24) | (block[1] << 16) |
-                                   (block[2] << 8) | block[3];
-         keystruct->s[idx][idx2+1] = (block[4] << 24) | (block[5] << 16) |
-                                     (block[6] << 8) | block[7];
+   for ( ; idx < count; ++idx)
+      blowfish_key_setup(user_keys[idx], &keystructs[idx], lens[idx]);
+}
+
+/*******************
+* bcrypt
+*******************/
+// bcrypt's base-64 variant: its own alphabet, no padding.
+static void bcrypt_b64_encode(const BYTE in[], size_t len, char out[])
+{
+   size_t idx;
+   int c1,c2;
+
+   for (idx = 0; idx < len; ) {
+      c1 = in[idx++];
+      *out++ = bcrypt_b64[c1 >> 2];
+      c1 = (c1 & 0x03) << 4;
+      if (idx >= len) {
+         *out++ = bcrypt_b64[c1];
+         break;
+      }
+      c2 = in[idx++];
+      *out++ = bcrypt_b64[c1 | (c2 >> 4)];
+      c1 = (c2 & 0x0f) << 2;
+      if (idx >= len) {
+         *out++ = bcrypt_b64[c1];
+         break;
+      }
+      c2 = in[idx++];
+      *out++ = bcrypt_b64[c1 | (c2 >> 6)];
+      *out++ = bcrypt_b64[c2 & 0x3f];
+   }
+   *out = '\0';
+}
+
+static int bcrypt_b64_value(char c)
+{
+   const char *pos;
+
+   if (c == '\0' || (pos = strchr(bcrypt_b64, c)) == NULL)
+      return(-1);
+   return((int)(pos - bcrypt_b64));
+}
+
+// Decodes exactly len bytes. Returns FALSE on a character outside the alphabet.
+static int bcrypt_b64_decode(const char in[], BYTE out[], size_t len)
+{
+   size_t idx = 0;
+   int c1,c2,c3,c4;
+
+   while (idx < len) {
+      if ((c1 = bcrypt_b64_value(in[0])) < 0 || (c2 = bcrypt_b64_value(in[1])) < 0)
+         return(FALSE);
+      out[idx++] = (BYTE)((c1 << 2) | (c2 >> 4));
+      if (idx >= len)
+         break;
+      if ((c3 = bcrypt_b64_value(in[2])) < 0)
+         return(FALSE);
+      out[idx++] = (BYTE)((c2 << 4) | (c3 >> 2));
+      if (idx >= len)
+         break;
+      if ((c4 = bcrypt_b64_value(in[3])) < 0)
+         return(FALSE);
+      out[idx++] = (BYTE)((c3 << 6) | c4);
+      in += 4;
+   }
+   return(TRUE);
+}
+
+// Parses the "$2b$cc$" prefix and the salt of a hash string. The $2a$ and $2y$
+// prefixes are accepted too and hashed as $2b$.
+static int bcrypt_parse(const char hash[], char *minor, int *cost, BYTE salt[])
+{
+   if (strlen(hash) != BCRYPT_HASH_SIZE - 1)
+      return(FALSE);
+   if (hash[0] != '$' || hash[1] != '2' || hash[3] != '$')
+      return(FALSE);
+   if (hash[2] != 'a' && hash[2] != 'b' && hash[2] != 'y')
+      return(FALSE);
+   if (hash[4] < '0' || hash[4] > '9' || hash[5] < '0' || hash[5] > '9' || hash[6] != '$')
+      return(FALSE);
+   *minor = hash[2];
+   *cost = (hash[4] - '0') * 10 + (hash[5] - '0');
+   if (*cost < BCRYPT_MIN_COST || *cost > BCRYPT_MAX_COST)
+      return(FALSE);
+   return(bcrypt_b64_decode(&hash[7], salt, BCRYPT_SALT_SIZE));
+}
+
+// The password, with its terminator and cut to 72 bytes, as key words.
+static void bcrypt_key_words(const char password[], WORD key[18])
+{
+   size_t len;
+
+   len = strlen(password) + 1;
+   if (len > 72)
+      len = 72;
+   blowfish_key_words((const BYTE *)password, len, key);
+}
+
+static void bcrypt_salt_words(const BYTE salt[], WORD words[4], WORD key[18])
+{
+   int idx;
+
+   for (idx = 0; idx < 4; ++idx)
+      words[idx] = ((WORD)salt[4 * idx] << 24) | ((WORD)salt[4 * idx + 1] << 16) |
+                   ((WORD)salt[4 * idx + 2] << 8) | salt[4 * idx + 3];
+   for (idx = 0; idx < 18; ++idx)
+      key[idx] = words[idx % 4];
+}
+
+// Encrypts the magic text with the finished schedule and formats the hash.
+static void bcrypt_output(const BLOWFISH_KEY *keystruct, char minor, int cost, const BYTE salt[], char hash[])
+{
+   WORD ctext[6];
+   BYTE digest[24];
+   int idx,idx2;
+
+   memcpy(ctext, bcrypt_ctext, sizeof(ctext));
+   for (idx = 0; idx < 6; idx += 2) {
+      for (idx2 = 0; idx2 < 64; ++idx2)
+         blowfish_encrypt_words(&ctext[idx],&ctext[idx+1],keystruct);
+      STORE_HALVES(&digest[4 * idx],ctext[idx],ctext[idx+1]);
+   }
+
+   hash[0] = '$'; hash[1] = '2'; hash[2] = minor; hash[3] = '$';
+   hash[4] = (char)('0' + cost / 10); hash[5] = (char)('0' + cost % 10); hash[6] = '$';
+   bcrypt_b64_encode(salt, BCRYPT_SALT_SIZE, &hash[7]);
+   // Only 23 of the 24 bytes are kept.
+   bcrypt_b64_encode(digest, 23, &hash[7 + 22]);
+}
+
+static void bcrypt_compute(const char password[], char minor, int cost, const BYTE salt[], char hash[])
+{
+   BLOWFISH_KEY keystruct;
+   WORD key[18],salt_key[18],salt_words[4];
+   unsigned long rounds,idx;
+
+   bcrypt_key_words(password, key);
+   bcrypt_salt_words(salt, salt_words, salt_key);
+
+   memcpy(keystruct.p,p_perm,sizeof(WORD) * 18);
+   memcpy(keystruct.s,s_perm,sizeof(WORD) * 1024);
+   blowfish_expand_key(&keystruct, key, salt_words);
+   rounds = 1UL << cost;
+   for (idx = 0; idx < rounds; ++idx) {
+      blowfish_expand_key(&keystruct, key, NULL);
+      blowfish_expand_key(&keystruct, salt_key, NULL);
+   }
+   bcrypt_output(&keystruct, minor, cost, salt, hash);
+}
+
+// Compares two hash strings in time independent of where they differ.
+static int bcrypt_equal(const char a[], const char b[])
+{
+   int idx,diff = 0;
+
+   for (idx = 0; idx < BCRYPT_HASH_SIZE - 1; ++idx)
+      diff |= a[idx] ^ b[idx];
+   return(diff == 0);
+}
+
+int bcrypt_hash(const char password[], const BYTE salt[], int cost, char hash[])
+{
+   if (cost < BCRYPT_MIN_COST || cost > BCRYPT_MAX_COST)
+      return(FALSE);
+   bcrypt_compute(password, 'b', cost, salt, hash);
+   return(TRUE);
+}
+
+int bcrypt_verify(const char password[], const char hash[])
+{
+   char computed[BCRYPT_HASH_SIZE],minor;
+   BYTE salt[BCRYPT_SALT_SIZE];
+   int cost;
+
+   if (!bcrypt_parse(hash, &minor, &cost, salt))
+      return(FALSE);
+   bcrypt_compute(password, minor, cost, salt, computed);
+   return(bcrypt_equal(computed, hash));
+}
+
+// Runs of BCRYPT_LANES consecutive entries that share a cost are hashed
+// together by blowfish_expand_key_x4(). Everything else goes through
+// bcrypt_verify() one at a time.
+void bcrypt_verify_batch(const char *const passwords[], const char *const hashes[], int results[], size_t count)
+{
+   BLOWFISH_KEY ks[BCRYPT_LANES];
+   WORD key[BCRYPT_LANES][18],salt_key[BCRYPT_LANES][18],salt_words[BCRYPT_LANES][4];
+   BYTE salt[BCRYPT_LANES][BCRYPT_SALT_SIZE];
+   char computed[BCRYPT_HASH_SIZE],minor[BCRYPT_LANES];
+   int cost[BCRYPT_LANES],lane,ok;
+   unsigned long rounds,round;
+   size_t idx = 0;
+
+   while (idx < count) {
+      ok = idx + BCRYPT_LANES <= count;
+      for (lane = 0; ok && lane < BCRYPT_LANES; ++lane) {
+         ok = bcrypt_parse(hashes[idx + lane], &minor[lane], &cost[lane], salt[lane]) &&
+              cost[lane] == cost[0];
+      }
+      if (!ok) {
+         results[idx] = bcrypt_verify(passwords[idx], hashes[idx]);
+         ++idx;
+         continue;
+      }
+
+      for (lane = 0; lane < BCRYPT_LANES; ++lane) {
+         bcrypt_key_words(passwords[idx + lane], key[lane]);
+         bcrypt_salt_words(salt[lane], salt_words[lane], salt_key[lane]);
+         memcpy(ks[lane].p,p_perm,sizeof(WORD) * 18);
+         memcpy(ks[lane].s,s_perm,sizeof(WORD) * 1024);
+      }
+      blowfish_expand_key_x4(ks, (const WORD (*)[18])key, (const WORD (*)[4])salt_words);
+      rounds = 1UL << cost[0];
+      for (round = 0; round < rounds; ++round) {
+         blowfish_expand_key_x4(ks, (const WORD (*)[18])key, NULL);
+         blowfish_expand_key_x4(ks, (const WORD (*)[18])salt_key, NULL);
+      }
+      for (lane = 0; lane < BCRYPT_LANES; ++lane) {
+         bcrypt_output(&ks[lane], minor[lane], cost[0], salt[lane], computed);
+         results[idx + lane] = bcrypt_equal(computed, hashes[idx + lane]);
       }
+      idx += BCRYPT_LANES;
    }
 }
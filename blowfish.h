@@ -15,6 +15,11 @@
 /****************************** MACROS ******************************/
 #define BLOWFISH_BLOCK_SIZE 8           // Blowfish operates on 8 bytes at a time
 
+#define BCRYPT_SALT_SIZE 16             // Raw salt bytes
+#define BCRYPT_HASH_SIZE 61             // "$2b$cc$" + 22 salt + 31 hash chars + terminator
+#define BCRYPT_MIN_COST  4
+#define BCRYPT_MAX_COST  31
+
 /**************************** DATA TYPES ****************************/
 typedef unsigned char BYTE;             // 8-bit byte
 typedef unsigned int  WORD;             // 32-bit word, change to "long" for 16-bit machines
@@ -25,8 +30,66 @@ typedef struct {
 } BLOWFISH_KEY;
 
 /*********************** FUNCTION DECLARATIONS **********************/
+///////////////////
+// Blowfish
+///////////////////
 void blowfish_key_setup(const BYTE user_key[], BLOWFISH_KEY *keystruct, size_t len);
 void blowfish_encrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct);
 void blowfish_decrypt(const BYTE in[], BYTE out[], const BLOWFISH_KEY *keystruct);
 
+// Sets up count independent keys, as blowfish_key_setup() would for each.
+// Groups of four keys are expanded together with their encryptions interleaved.
+void blowfish_key_setup_batch(const BYTE *const user_keys[],   // The keys
+                              const size_t lens[],             // Length of each key in bytes
+                              BLOWFISH_KEY keystructs[],       // count key schedules
+                              size_t count);
+
+///////////////////
+// Blowfish - Modes
+///////////////////
+// The ECB and CBC functions return False if in_len is not a multiple of
+// BLOWFISH_BLOCK_SIZE. Input and output may be the same buffer.
+int blowfish_encrypt_ecb(const BYTE in[],                // Plaintext
+                         size_t in_len,                  // Must be a multiple of BLOWFISH_BLOCK_SIZE
+                         BYTE out[],                     // Ciphertext, same length as plaintext
+                         const BLOWFISH_KEY *keystruct); // From the key setup
+
+int blowfish_decrypt_ecb(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct);
+
+int blowfish_encrypt_cbc(const BYTE in[],                // Plaintext
+                         size_t in_len,                  // Must be a multiple of BLOWFISH_BLOCK_SIZE
+                         BYTE out[],                     // Ciphertext, same length as plaintext
+                         const BLOWFISH_KEY *keystruct,  // From the key setup
+                         const BYTE iv[]);               // IV, must be BLOWFISH_BLOCK_SIZE bytes long
+
+int blowfish_decrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct, const BYTE iv[]);
+
+// The whole IV block is the big-endian counter. Input may be any byte length.
+void blowfish_encrypt_ctr(const BYTE in[],               // Plaintext
+                          size_t in_len,                 // Any byte length
+                          BYTE out[],                    // Ciphertext, same length as plaintext
+                          const BLOWFISH_KEY *keystruct, // From the key setup
+                          const BYTE iv[]);              // IV, must be BLOWFISH_BLOCK_SIZE bytes long
+
+void blowfish_decrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BLOWFISH_KEY *keystruct, const BYTE iv[]);
+
+///////////////////
+// bcrypt
+///////////////////
+// Produces a "$2b$" hash string. Only the first 72 bytes of the password are
+// used. Returns False if cost is outside BCRYPT_MIN_COST..BCRYPT_MAX_COST.
+int bcrypt_hash(const char password[],        // NUL-terminated password
+                const BYTE salt[],            // BCRYPT_SALT_SIZE random bytes
+                int cost,                     // log2 of the key expansion count
+                char hash[]);                 // BCRYPT_HASH_SIZE bytes, NUL-terminated on return
+
+// Returns True if the password matches the hash. "$2a$", "$2b$" and "$2y$"
+// hashes are accepted; a malformed hash never matches.
+int bcrypt_verify(const char password[], const char hash[]);
+
+// Verifies count independent password/hash pairs, setting results[i] as
+// bcrypt_verify() would. Consecutive pairs with the same cost are hashed
+// several at a time for better throughput.
+void bcrypt_verify_batch(const char *const passwords[], const char *const hashes[], int results[], size_t count);
+
 #endif   // BLOWFISH_H
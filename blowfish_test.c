@@ -17,7 +17,7 @@
 #include "blowfish.h"
 
 /*********************** FUNCTION DEFINITIONS ***********************/
-int blowfish_test()
+int blowfish_block_test()
 {
 	BYTE key1[8]  = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00};
 	BYTE key2[8]  = {0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff};
@@ -60,6 +60,159 @@ int blowfish_test()
 	return(pass);
 }
 
+int blowfish_modes_test()
+{
+	BYTE key1[16] = {0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,
+	                 0xF0,0xE1,0xD2,0xC3,0xB4,0xA5,0x96,0x87};
+	BYTE iv1[BLOWFISH_BLOCK_SIZE] = {0xFE,0xDC,0xBA,0x98,0x76,0x54,0x32,0x10};
+	// "7654321 Now is the time for " with its terminator, zero padded.
+	BYTE plaintext[32] = {0x37,0x36,0x35,0x34,0x33,0x32,0x31,0x20,
+	                      0x4E,0x6F,0x77,0x20,0x69,0x73,0x20,0x74,
+	                      0x68,0x65,0x20,0x74,0x69,0x6D,0x65,0x20,
+	                      0x66,0x6F,0x72,0x20,0x00,0x00,0x00,0x00};
+	BYTE ecb_ciphertext[32] = {0x2A,0xFD,0x7D,0xAA,0x60,0x62,0x6B,0xA3,
+	                           0x86,0x16,0x46,0x8C,0xC2,0x9C,0xF6,0xE1,
+	                           0x29,0x1E,0x81,0x7C,0xC7,0x40,0x98,0x2D,
+	                           0x6F,0x87,0xAC,0x5F,0x17,0x1A,0xAB,0xEA};
+	BYTE cbc_ciphertext[32] = {0x6B,0x77,0xB4,0xD6,0x30,0x06,0xDE,0xE6,
+	                           0x05,0xB1,0x56,0xE2,0x74,0x03,0x97,0x93,
+	                           0x58,0xDE,0xB9,0xE7,0x15,0x46,0x16,0xD9,
+	                           0x59,0xF1,0x65,0x2B,0xD5,0xFF,0x92,0xCC};
+	BYTE long_in[40 * BLOWFISH_BLOCK_SIZE + 5], long_buf[40 * BLOWFISH_BLOCK_SIZE + 5];
+	BYTE ctr[BLOWFISH_BLOCK_SIZE], ks[BLOWFISH_BLOCK_SIZE];
+	BYTE enc_buf[32];
+	BLOWFISH_KEY key;
+	size_t idx;
+	int carry, pass = 1;
+
+	blowfish_key_setup(key1, &key, sizeof(key1));
+
+	// Known answers for ECB and CBC.
+	pass = pass && blowfish_encrypt_ecb(plaintext, 32, enc_buf, &key);
+	pass = pass && !memcmp(ecb_ciphertext, enc_buf, 32);
+	pass = pass && blowfish_decrypt_ecb(ecb_ciphertext, 32, enc_buf, &key);
+	pass = pass && !memcmp(plaintext, enc_buf, 32);
+	pass = pass && blowfish_encrypt_cbc(plaintext, 32, enc_buf, &key, iv1);
+	pass = pass && !memcmp(cbc_ciphertext, enc_buf, 32);
+	pass = pass && blowfish_decrypt_cbc(cbc_ciphertext, 32, enc_buf, &key, iv1);
+	pass = pass && !memcmp(plaintext, enc_buf, 32);
+	pass = pass && !blowfish_encrypt_cbc(plaintext, 31, enc_buf, &key, iv1);
+
+	// Lengths that leave a partial group of blocks, in place.
+	for (idx = 0; idx < sizeof(long_in); ++idx)
+		long_in[idx] = (BYTE)(idx * 7 + 1);
+	memcpy(long_buf, long_in, 39 * BLOWFISH_BLOCK_SIZE);
+	blowfish_encrypt_cbc(long_buf, 39 * BLOWFISH_BLOCK_SIZE, long_buf, &key, iv1);
+	blowfish_decrypt_cbc(long_buf, 39 * BLOWFISH_BLOCK_SIZE, long_buf, &key, iv1);
+	pass = pass && !memcmp(long_in, long_buf, 39 * BLOWFISH_BLOCK_SIZE);
+	blowfish_encrypt_ecb(long_in, 39 * BLOWFISH_BLOCK_SIZE, long_buf, &key);
+	for (idx = 0; idx < 39; ++idx) {
+		blowfish_encrypt(&long_in[idx * BLOWFISH_BLOCK_SIZE], enc_buf, &key);
+		pass = pass && !memcmp(enc_buf, &long_buf[idx * BLOWFISH_BLOCK_SIZE], BLOWFISH_BLOCK_SIZE);
+	}
+	blowfish_decrypt_ecb(long_buf, 39 * BLOWFISH_BLOCK_SIZE, long_buf, &key);
+	pass = pass && !memcmp(long_in, long_buf, 39 * BLOWFISH_BLOCK_SIZE);
+
+	// CTR against the single block function, with a carry across the halves.
+	memset(ctr, 0xFF, BLOWFISH_BLOCK_SIZE);
+	ctr[0] = 0x00;
+	ctr[3] = 0xFE;
+	blowfish_encrypt_ctr(long_in, sizeof(long_in), long_buf, &key, ctr);
+	for (idx = 0; idx < sizeof(long_in); ++idx) {
+		if (idx % BLOWFISH_BLOCK_SIZE == 0) {
+			blowfish_encrypt(ctr, ks, &key);
+			for (carry = BLOWFISH_BLOCK_SIZE - 1; carry >= 0 && ++ctr[carry] == 0; --carry)
+				;
+		}
+		pass = pass && (long_buf[idx] == (long_in[idx] ^ ks[idx % BLOWFISH_BLOCK_SIZE]));
+	}
+	memset(ctr, 0xFF, BLOWFISH_BLOCK_SIZE);
+	ctr[0] = 0x00;
+	ctr[3] = 0xFE;
+	blowfish_decrypt_ctr(long_buf, sizeof(long_buf), long_buf, &key, ctr);
+	pass = pass && !memcmp(long_in, long_buf, sizeof(long_in));
+
+	return(pass);
+}
+
+int blowfish_key_batch_test()
+{
+	BYTE keys[6][24];
+	const BYTE *key_ptrs[6];
+	size_t lens[6] = {8, 24, 4, 16, 24, 1};
+	BLOWFISH_KEY batch[6], single;
+	int idx, idx2, pass = 1;
+
+	for (idx = 0; idx < 6; ++idx) {
+		for (idx2 = 0; idx2 < 24; ++idx2)
+			keys[idx][idx2] = (BYTE)(idx * 31 + idx2 * 7);
+		key_ptrs[idx] = keys[idx];
+	}
+
+	blowfish_key_setup_batch(key_ptrs, lens, batch, 6);
+	for (idx = 0; idx < 6; ++idx) {
+		blowfish_key_setup(keys[idx], &single, lens[idx]);
+		pass = pass && !memcmp(&single, &batch[idx], sizeof(single));
+	}
+
+	return(pass);
+}
+
+int blowfish_bcrypt_test()
+{
+	const char *passwords[6] = {"", "U*U", "abc", "abcdefghijklmnopqrstuvwxyz", "U*U", "wrong"};
+	const char *hashes[6] = {
+		"$2a$06$DCq7YPn5Rq63x1Lad4cll.TV4S6ytwfsfvkgY8jIucDrjc8deX1s.",
+		"$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW",
+		"$2a$06$If6bvum7DFjUnE9p2uDeDu0YHzrHM6tf.iqN8.yx.jNN1ILEf7h0i",
+		"$2a$06$.rCVZVOThsIa97pEDOxvGuRRgzG64bvtJ0938xuqzv18d3ZpQhstC",
+		"$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW",
+		"$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW"
+	};
+	int expected[6] = {1, 1, 1, 1, 1, 0};
+	const char *same_cost[4] = {hashes[1], hashes[4], hashes[5], hashes[1]};
+	const char *same_cost_pw[4] = {"U*U", "U*U", "wrong", "U*V"};
+	BYTE salt[BCRYPT_SALT_SIZE];
+	char hash[BCRYPT_HASH_SIZE];
+	int results[6];
+	int idx, pass = 1;
+
+	for (idx = 0; idx < 6; ++idx)
+		pass = pass && bcrypt_verify(passwords[idx], hashes[idx]) == expected[idx];
+
+	// Mixed costs fall back to one at a time, equal costs are interleaved.
+	bcrypt_verify_batch(passwords, hashes, results, 6);
+	for (idx = 0; idx < 6; ++idx)
+		pass = pass && results[idx] == expected[idx];
+	bcrypt_verify_batch(same_cost_pw, same_cost, results, 4);
+	pass = pass && results[0] && results[1] && !results[2] && !results[3];
+
+	// A fresh $2b$ hash round trips, and malformed hashes never match.
+	for (idx = 0; idx < BCRYPT_SALT_SIZE; ++idx)
+		salt[idx] = (BYTE)(idx * 13);
+	pass = pass && bcrypt_hash("password", salt, 4, hash);
+	pass = pass && !memcmp(hash, "$2b$04$", 7) && hash[BCRYPT_HASH_SIZE - 1] == '\0';
+	pass = pass && bcrypt_verify("password", hash) && !bcrypt_verify("passwore", hash);
+	pass = pass && !bcrypt_hash("password", salt, 3, hash);
+	pass = pass && !bcrypt_verify("U*U", "$2a$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOe");
+	pass = pass && !bcrypt_verify("U*U", "$2x$05$CCCCCCCCCCCCCCCCCCCCC.E5YPO9kmyuRGyh0XouQYb4YMJKvyOeW");
+	pass = pass && !bcrypt_verify("U*U", "$") && !bcrypt_verify("U*U", "$2") && !bcrypt_verify("U*U", "$2b$1");
+
+	return(pass);
+}
+
+int blowfish_test()
+{
+	int pass = 1;
+
+	pass = pass && blowfish_block_test();
+	pass = pass && blowfish_modes_test();
+	pass = pass && blowfish_key_batch_test();
+	pass = pass && blowfish_bcrypt_test();
+
+	return(pass);
+}
+
 int main()
 {
 	printf("Blowfish tests: %s\n", blowfish_test() ? "SUCCEEDED" : "FAILED");
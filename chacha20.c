@@ -0,0 +1,779 @@
+/*********************************************************************
+* Filename:   chacha20.c
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Implementation of the ChaCha20 stream cipher, the Poly1305
+              authenticator and the ChaCha20-Poly1305 AEAD built from
+              them. The block counter can be set to reach any offset of
+              the stream. Whole ChaCha20 blocks are computed 8 at a time
+              with AVX2 or 4 at a time with SSE2, and long Poly1305
+              inputs 4 blocks at a time with AVX2, when the CPU has them.
+              Algorithm specification can be found here:
+               * https://tools.ietf.org/html/rfc8439
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdlib.h>
+#include <memory.h>
+#include "chacha20.h"
+
+// Multi-block kernels, compiled with target attributes and chosen at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(CHACHA20_NO_SIMD)
+#define CHACHA20_SIMD
+#include <immintrin.h>
+#endif
+
+// Poly1305 works on 44-bit limbs when 64x64-bit products are available, and
+// on 26-bit limbs otherwise. The vector path converts between the two.
+#if defined(__SIZEOF_INT128__)
+#define POLY1305_LIMB44
+#if defined(CHACHA20_SIMD)
+#define POLY1305_AVX2
+#endif
+#endif
+
+/****************************** MACROS ******************************/
+#define ROTLEFT(a,b) (((a) << (b)) | ((a) >> (32-(b))))
+
+#define QUARTERROUND(a,b,c,d) \
+	a += b; d ^= a; d = ROTLEFT(d,16); \
+	c += d; b ^= c; b = ROTLEFT(b,12); \
+	a += b; d ^= a; d = ROTLEFT(d,8);  \
+	c += d; b ^= c; b = ROTLEFT(b,7);
+
+#define LOAD32_LE(p)    ((WORD)(p)[0] | ((WORD)(p)[1] << 8) | ((WORD)(p)[2] << 16) | ((WORD)(p)[3] << 24))
+#define STORE32_LE(p,v) (p)[0] = (BYTE)(v); (p)[1] = (BYTE)((v) >> 8); \
+                        (p)[2] = (BYTE)((v) >> 16); (p)[3] = (BYTE)((v) >> 24);
+#define LOAD64_LE(p)    ((unsigned long long)LOAD32_LE(p) | ((unsigned long long)LOAD32_LE((p) + 4) << 32))
+
+#define MASK26 0x3ffffffULL
+#define MASK42 0x3ffffffffffULL
+#define MASK44 0xfffffffffffULL
+
+#define POLY1305_AVX2_MIN_BLOCKS 8      // Shorter runs stay on the scalar path
+#define AEAD_CHUNK 512                  // Bytes encrypted and MACed per pass
+
+#define TRUE  1
+#define FALSE 0
+
+/**************************** DATA TYPES ****************************/
+#ifdef POLY1305_LIMB44
+typedef unsigned __int128 POLY1305_U128;
+#endif
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+// One keystream block from the 16-word input state.
+static void chacha20_core(const WORD state[], BYTE out[])
+{
+	WORD x[16];
+	int idx;
+
+	memcpy(x, state, sizeof(x));
+	for (idx = 0; idx < 10; ++idx) {
+		// Column round.
+		QUARTERROUND(x[0], x[4], x[8],  x[12]);
+		QUARTERROUND(x[1], x[5], x[9],  x[13]);
+		QUARTERROUND(x[2], x[6], x[10], x[14]);
+		QUARTERROUND(x[3], x[7], x[11], x[15]);
+		// Diagonal round.
+		QUARTERROUND(x[0], x[5], x[10], x[15]);
+		QUARTERROUND(x[1], x[6], x[11], x[12]);
+		QUARTERROUND(x[2], x[7], x[8],  x[13]);
+		QUARTERROUND(x[3], x[4], x[9],  x[14]);
+	}
+	for (idx = 0; idx < 16; ++idx) {
+		x[idx] += state[idx];
+		STORE32_LE(&out[idx * 4], x[idx]);
+	}
+}
+
+static void chacha20_setup(WORD state[], const BYTE key[], WORD counter, const BYTE nonce[])
+{
+	int idx;
+
+	// "expand 32-byte k"
+	state[0] = 0x61707865;
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+	for (idx = 0; idx < 8; ++idx)
+		state[4 + idx] = LOAD32_LE(&key[idx * 4]);
+	state[12] = counter;
+	for (idx = 0; idx < 3; ++idx)
+		state[13 + idx] = LOAD32_LE(&nonce[idx * 4]);
+}
+
+#ifdef CHACHA20_SIMD
+// Each vector holds one state word of 4 (SSE2) or 8 (AVX2) consecutive blocks,
+// which differ only in the counter word. After the rounds, 4x4 transposes turn
+// the words back into block order.
+#define ROTLEFT_SSE2(v,n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define QUARTERROUND_SSE2(a,b,c,d) \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTLEFT_SSE2(d, 16); \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTLEFT_SSE2(b, 12); \
+	a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTLEFT_SSE2(d, 8);  \
+	c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTLEFT_SSE2(b, 7);
+
+#define TRANSPOSE4(a,b,c,d,unpacklo32,unpackhi32,unpacklo64,unpackhi64,t0,t1,t2,t3) \
+	t0 = unpacklo32(a, b); t1 = unpacklo32(c, d); \
+	t2 = unpackhi32(a, b); t3 = unpackhi32(c, d); \
+	a = unpacklo64(t0, t1); b = unpackhi64(t0, t1); \
+	c = unpacklo64(t2, t3); d = unpackhi64(t2, t3);
+
+__attribute__((target("sse2")))
+static void chacha20_xor4_sse2(const WORD state[], const BYTE in[], BYTE out[])
+{
+	__m128i x[16],s[16],t0,t1,t2,t3;
+	int idx,blk;
+
+	for (idx = 0; idx < 16; ++idx)
+		s[idx] = x[idx] = _mm_set1_epi32((int)state[idx]);
+	s[12] = x[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+
+	for (idx = 0; idx < 10; ++idx) {
+		QUARTERROUND_SSE2(x[0], x[4], x[8],  x[12]);
+		QUARTERROUND_SSE2(x[1], x[5], x[9],  x[13]);
+		QUARTERROUND_SSE2(x[2], x[6], x[10], x[14]);
+		QUARTERROUND_SSE2(x[3], x[7], x[11], x[15]);
+		QUARTERROUND_SSE2(x[0], x[5], x[10], x[15]);
+		QUARTERROUND_SSE2(x[1], x[6], x[11], x[12]);
+		QUARTERROUND_SSE2(x[2], x[7], x[8],  x[13]);
+		QUARTERROUND_SSE2(x[3], x[4], x[9],  x[14]);
+	}
+
+	for (idx = 0; idx < 16; ++idx)
+		x[idx] = _mm_add_epi32(x[idx], s[idx]);
+	// Words 4g..4g+3 of the four blocks.
+	for (idx = 0; idx < 16; idx += 4) {
+		TRANSPOSE4(x[idx], x[idx + 1], x[idx + 2], x[idx + 3], _mm_unpacklo_epi32, _mm_unpackhi_epi32,
+		           _mm_unpacklo_epi64, _mm_unpackhi_epi64, t0, t1, t2, t3);
+		for (blk = 0; blk < 4; ++blk) {
+			_mm_storeu_si128((__m128i *)&out[blk * CHACHA20_BLOCK_SIZE + idx * 4],
+			                 _mm_xor_si128(x[idx + blk],
+			                 _mm_loadu_si128((const __m128i *)&in[blk * CHACHA20_BLOCK_SIZE + idx * 4])));
+		}
+	}
+}
+
+#define ROTLEFT_AVX2(v,n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+// Rotations by 16 and 8 move whole bytes, which one shuffle does.
+#define QUARTERROUND_AVX2(a,b,c,d) \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTLEFT_AVX2(b, 12); \
+	a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8); \
+	c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = ROTLEFT_AVX2(b, 7);
+
+__attribute__((target("avx2")))
+static void chacha20_xor8_avx2(const WORD state[], const BYTE in[], BYTE out[])
+{
+	const __m256i rot16 = _mm256_set_epi8(13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2,
+	                                      13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2);
+	const __m256i rot8 = _mm256_set_epi8(14,13,12,15, 10,9,8,11, 6,5,4,7, 2,1,0,3,
+	                                     14,13,12,15, 10,9,8,11, 6,5,4,7, 2,1,0,3);
+	__m256i x[16],s[16],t0,t1,t2,t3;
+	int idx,blk;
+
+	for (idx = 0; idx < 16; ++idx)
+		s[idx] = x[idx] = _mm256_set1_epi32((int)state[idx]);
+	s[12] = x[12] = _mm256_add_epi32(s[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+
+	for (idx = 0; idx < 10; ++idx) {
+		QUARTERROUND_AVX2(x[0], x[4], x[8],  x[12]);
+		QUARTERROUND_AVX2(x[1], x[5], x[9],  x[13]);
+		QUARTERROUND_AVX2(x[2], x[6], x[10], x[14]);
+		QUARTERROUND_AVX2(x[3], x[7], x[11], x[15]);
+		QUARTERROUND_AVX2(x[0], x[5], x[10], x[15]);
+		QUARTERROUND_AVX2(x[1], x[6], x[11], x[12]);
+		QUARTERROUND_AVX2(x[2], x[7], x[8],  x[13]);
+		QUARTERROUND_AVX2(x[3], x[4], x[9],  x[14]);
+	}
+
+	for (idx = 0; idx < 16; ++idx)
+		x[idx] = _mm256_add_epi32(x[idx], s[idx]);
+	// The transposes work within each 128-bit half: the low half ends up with
+	// blocks 0-3 and the high half with blocks 4-7.
+	for (idx = 0; idx < 16; idx += 4) {
+		TRANSPOSE4(x[idx], x[idx + 1], x[idx + 2], x[idx + 3], _mm256_unpacklo_epi32, _mm256_unpackhi_epi32,
+		           _mm256_unpacklo_epi64, _mm256_unpackhi_epi64, t0, t1, t2, t3);
+	}
+	// Pair words 4g..4g+3 with 4g+4..4g+7 for 32-byte stores.
+	for (idx = 0; idx < 16; idx += 8) {
+		for (blk = 0; blk < 4; ++blk) {
+			t0 = _mm256_permute2x128_si256(x[idx + blk], x[idx + 4 + blk], 0x20);
+			t1 = _mm256_permute2x128_si256(x[idx + blk], x[idx + 4 + blk], 0x31);
+			_mm256_storeu_si256((__m256i *)&out[blk * CHACHA20_BLOCK_SIZE + idx * 4],
+			                    _mm256_xor_si256(t0,
+			                    _mm256_loadu_si256((const __m256i *)&in[blk * CHACHA20_BLOCK_SIZE + idx * 4])));
+			_mm256_storeu_si256((__m256i *)&out[(blk + 4) * CHACHA20_BLOCK_SIZE + idx * 4],
+			                    _mm256_xor_si256(t1,
+			                    _mm256_loadu_si256((const __m256i *)&in[(blk + 4) * CHACHA20_BLOCK_SIZE + idx * 4])));
+		}
+	}
+}
+
+// The number of blocks the kernels take at once, 0 if the CPU has neither.
+static int chacha20_simd_blocks(void)
+{
+	static int blocks = -1;
+
+	if (blocks < 0)
+		blocks = __builtin_cpu_supports("avx2") ? 8 : __builtin_cpu_supports("sse2") ? 4 : 0;
+	return(blocks);
+}
+
+static void chacha20_xor_blocks(const WORD state[], const BYTE in[], BYTE out[], int blocks)
+{
+	if (blocks == 8)
+		chacha20_xor8_avx2(state, in, out);
+	else
+		chacha20_xor4_sse2(state, in, out);
+}
+#else
+static int chacha20_simd_blocks(void)
+{
+	return(0);
+}
+
+// Never called, as there are no blocks to run side by side.
+static void chacha20_xor_blocks(const WORD state[], const BYTE in[], BYTE out[], int blocks)
+{
+	(void)state;
+	(void)in;
+	(void)out;
+	(void)blocks;
+}
+#endif
+
+void chacha20_block(const BYTE key[], WORD counter, const BYTE nonce[], BYTE out[])
+{
+	WORD state[16];
+
+	chacha20_setup(state, key, counter, nonce);
+	chacha20_core(state, out);
+}
+
+void chacha20_init(CHACHA20_CTX *ctx, const BYTE key[], const BYTE nonce[], WORD counter)
+{
+	chacha20_setup(ctx->state, key, counter, nonce);
+	ctx->first_counter = counter;
+	ctx->pos = CHACHA20_BLOCK_SIZE;
+}
+
+void chacha20_update(CHACHA20_CTX *ctx, const BYTE in[], BYTE out[], size_t len)
+{
+	size_t idx = 0;
+	int blocks,k;
+
+	// Finish the block left over from the last call.
+	for ( ; idx < len && ctx->pos < CHACHA20_BLOCK_SIZE; ++idx)
+		out[idx] = in[idx] ^ ctx->keystream[ctx->pos++];
+
+	blocks = chacha20_simd_blocks();
+	for ( ; blocks && len - idx >= (size_t)blocks * CHACHA20_BLOCK_SIZE; idx += blocks * CHACHA20_BLOCK_SIZE) {
+		chacha20_xor_blocks(ctx->state, &in[idx], &out[idx], blocks);
+		ctx->state[12] += blocks;
+	}
+	for ( ; len - idx >= CHACHA20_BLOCK_SIZE; idx += CHACHA20_BLOCK_SIZE) {
+		chacha20_core(ctx->state, ctx->keystream);
+		++ctx->state[12];
+		for (k = 0; k < CHACHA20_BLOCK_SIZE; ++k)
+			out[idx + k] = in[idx + k] ^ ctx->keystream[k];
+	}
+
+	// Keep the rest of a partial block for the next call.
+	if (idx < len) {
+		chacha20_core(ctx->state, ctx->keystream);
+		++ctx->state[12];
+		ctx->pos = 0;
+		for ( ; idx < len; ++idx)
+			out[idx] = in[idx] ^ ctx->keystream[ctx->pos++];
+	}
+}
+
+void chacha20_seek(CHACHA20_CTX *ctx, unsigned long long offset)
+{
+	ctx->state[12] = ctx->first_counter + (WORD)(offset / CHACHA20_BLOCK_SIZE);
+	ctx->pos = CHACHA20_BLOCK_SIZE;
+	if (offset % CHACHA20_BLOCK_SIZE) {
+		chacha20_core(ctx->state, ctx->keystream);
+		++ctx->state[12];
+		ctx->pos = (unsigned int)(offset % CHACHA20_BLOCK_SIZE);
+	}
+}
+
+void chacha20_encrypt(const BYTE key[], WORD counter, const BYTE nonce[], const BYTE in[], BYTE out[], size_t len)
+{
+	CHACHA20_CTX ctx;
+
+	chacha20_init(&ctx, key, nonce, counter);
+	chacha20_update(&ctx, in, out, len);
+}
+
+void chacha20_decrypt(const BYTE key[], WORD counter, const BYTE nonce[], const BYTE in[], BYTE out[], size_t len)
+{
+	// ChaCha20 encryption is its own inverse function.
+	chacha20_encrypt(key, counter, nonce, in, out, len);
+}
+
+/*******************
+* Poly1305
+*******************/
+#ifdef POLY1305_LIMB44
+// h = h * r mod 2^130 - 5, in 44/44/42-bit limbs. The result is carried but
+// not fully reduced.
+static void poly1305_mul(unsigned long long h[], const unsigned long long r[])
+{
+	POLY1305_U128 d0,d1,d2;
+	unsigned long long s1,s2,c;
+
+	// 2^132 = 4 * 2^130 = 20 mod p, folding the top products back down.
+	s1 = r[1] * 20;
+	s2 = r[2] * 20;
+	d0 = (POLY1305_U128)h[0] * r[0] + (POLY1305_U128)h[1] * s2 + (POLY1305_U128)h[2] * s1;
+	d1 = (POLY1305_U128)h[0] * r[1] + (POLY1305_U128)h[1] * r[0] + (POLY1305_U128)h[2] * s2;
+	d2 = (POLY1305_U128)h[0] * r[2] + (POLY1305_U128)h[1] * r[1] + (POLY1305_U128)h[2] * r[0];
+
+	c = (unsigned long long)(d0 >> 44); h[0] = (unsigned long long)d0 & MASK44;
+	d1 += c; c = (unsigned long long)(d1 >> 44); h[1] = (unsigned long long)d1 & MASK44;
+	d2 += c; c = (unsigned long long)(d2 >> 42); h[2] = (unsigned long long)d2 & MASK42;
+	h[0] += c * 5; c = h[0] >> 44; h[0] &= MASK44;
+	h[1] += c;
+}
+
+static void poly1305_blocks(POLY1305_CTX *ctx, const BYTE in[], size_t blocks, int padded)
+{
+	unsigned long long t0,t1,hibit;
+	size_t idx;
+
+	// Every full block has a 1 appended above its top byte, bit 128 = bit 40 of limb 2.
+	hibit = padded ? 0 : (1ULL << 40);
+	for (idx = 0; idx < blocks; ++idx, in += POLY1305_BLOCK_SIZE) {
+		t0 = LOAD64_LE(in);
+		t1 = LOAD64_LE(in + 8);
+		ctx->h[0] += t0 & MASK44;
+		ctx->h[1] += ((t0 >> 44) | (t1 << 20)) & MASK44;
+		ctx->h[2] += ((t1 >> 24) & MASK42) | hibit;
+		poly1305_mul(ctx->h, ctx->r);
+	}
+}
+
+void poly1305_init(POLY1305_CTX *ctx, const BYTE key[])
+{
+	unsigned long long t0,t1;
+
+	// r is clamped as the specification requires.
+	t0 = LOAD64_LE(key);
+	t1 = LOAD64_LE(key + 8);
+	ctx->r[0] = t0 & 0xffc0fffffffULL;
+	ctx->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+	ctx->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+	ctx->r[3] = ctx->r[4] = 0;
+	memset(ctx->h, 0, sizeof(ctx->h));
+	memcpy(ctx->pad, &key[16], 16);
+	ctx->buf_len = 0;
+	ctx->r_pow_ready = FALSE;
+}
+
+// Fully reduces h mod 2^130 - 5, adds the pad and writes the tag.
+static void poly1305_finish(POLY1305_CTX *ctx, BYTE tag[])
+{
+	unsigned long long h0,h1,h2,g0,g1,g2,c,mask,t0,t1;
+
+	h0 = ctx->h[0]; h1 = ctx->h[1]; h2 = ctx->h[2];
+	c = h1 >> 44; h1 &= MASK44; h2 += c;
+	c = h2 >> 42; h2 &= MASK42; h0 += c * 5;
+	c = h0 >> 44; h0 &= MASK44; h1 += c;
+	c = h1 >> 44; h1 &= MASK44; h2 += c;
+	c = h2 >> 42; h2 &= MASK42; h0 += c * 5;
+	c = h0 >> 44; h0 &= MASK44; h1 += c;
+
+	// g = h + 5 - 2^130 is the reduced value if it doesn't go negative.
+	g0 = h0 + 5; c = g0 >> 44; g0 &= MASK44;
+	g1 = h1 + c; c = g1 >> 44; g1 &= MASK44;
+	g2 = h2 + c - (1ULL << 42);
+	mask = (g2 >> 63) - 1;
+	h0 = (h0 & ~mask) | (g0 & mask);
+	h1 = (h1 & ~mask) | (g1 & mask);
+	h2 = (h2 & ~mask) | (g2 & mask);
+
+	// h + s mod 2^128.
+	t0 = LOAD64_LE(ctx->pad);
+	t1 = LOAD64_LE(ctx->pad + 8);
+	h0 += t0 & MASK44; c = h0 >> 44; h0 &= MASK44;
+	h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c; c = h1 >> 44; h1 &= MASK44;
+	h2 += ((t1 >> 24) & MASK42) + c;
+
+	t0 = h0 | (h1 << 44);
+	t1 = (h1 >> 20) | (h2 << 24);
+	STORE32_LE(tag, (WORD)t0);
+	STORE32_LE(tag + 4, (WORD)(t0 >> 32));
+	STORE32_LE(tag + 8, (WORD)t1);
+	STORE32_LE(tag + 12, (WORD)(t1 >> 32));
+}
+#else
+static void poly1305_blocks(POLY1305_CTX *ctx, const BYTE in[], size_t blocks, int padded)
+{
+	unsigned long long *h = ctx->h, *r = ctx->r;
+	unsigned long long d0,d1,d2,d3,d4,s1,s2,s3,s4,c,hibit;
+	size_t idx;
+
+	s1 = r[1] * 5; s2 = r[2] * 5; s3 = r[3] * 5; s4 = r[4] * 5;
+	hibit = padded ? 0 : (1ULL << 24);
+	for (idx = 0; idx < blocks; ++idx, in += POLY1305_BLOCK_SIZE) {
+		h[0] += LOAD32_LE(in) & MASK26;
+		h[1] += (LOAD32_LE(in + 3) >> 2) & MASK26;
+		h[2] += (LOAD32_LE(in + 6) >> 4) & MASK26;
+		h[3] += (LOAD32_LE(in + 9) >> 6) & MASK26;
+		h[4] += (LOAD32_LE(in + 12) >> 8) | hibit;
+
+		d0 = h[0] * r[0] + h[1] * s4 + h[2] * s3 + h[3] * s2 + h[4] * s1;
+		d1 = h[0] * r[1] + h[1] * r[0] + h[2] * s4 + h[3] * s3 + h[4] * s2;
+		d2 = h[0] * r[2] + h[1] * r[1] + h[2] * r[0] + h[3] * s4 + h[4] * s3;
+		d3 = h[0] * r[3] + h[1] * r[2] + h[2] * r[1] + h[3] * r[0] + h[4] * s4;
+		d4 = h[0] * r[4] + h[1] * r[3] + h[2] * r[2] + h[3] * r[1] + h[4] * r[0];
+
+		c = d0 >> 26; h[0] = d0 & MASK26; d1 += c;
+		c = d1 >> 26; h[1] = d1 & MASK26; d2 += c;
+		c = d2 >> 26; h[2] = d2 & MASK26; d3 += c;
+		c = d3 >> 26; h[3] = d3 & MASK26; d4 += c;
+		c = d4 >> 26; h[4] = d4 & MASK26;
+		h[0] += c * 5; c = h[0] >> 26; h[0] &= MASK26;
+		h[1] += c;
+	}
+}
+
+void poly1305_init(POLY1305_CTX *ctx, const BYTE key[])
+{
+	// r is clamped as the specification requires.
+	ctx->r[0] = LOAD32_LE(key) & 0x3ffffff;
+	ctx->r[1] = (LOAD32_LE(key + 3) >> 2) & 0x3ffff03;
+	ctx->r[2] = (LOAD32_LE(key + 6) >> 4) & 0x3ffc0ff;
+	ctx->r[3] = (LOAD32_LE(key + 9) >> 6) & 0x3f03fff;
+	ctx->r[4] = (LOAD32_LE(key + 12) >> 8) & 0x00fffff;
+	memset(ctx->h, 0, sizeof(ctx->h));
+	memcpy(ctx->pad, &key[16], 16);
+	ctx->buf_len = 0;
+	ctx->r_pow_ready = FALSE;
+}
+
+static void poly1305_finish(POLY1305_CTX *ctx, BYTE tag[])
+{
+	unsigned long long h0,h1,h2,h3,h4,g0,g1,g2,g3,g4,c,mask,f;
+
+	h0 = ctx->h[0]; h1 = ctx->h[1]; h2 = ctx->h[2]; h3 = ctx->h[3]; h4 = ctx->h[4];
+	c = h1 >> 26; h1 &= MASK26; h2 += c;
+	c = h2 >> 26; h2 &= MASK26; h3 += c;
+	c = h3 >> 26; h3 &= MASK26; h4 += c;
+	c = h4 >> 26; h4 &= MASK26; h0 += c * 5;
+	c = h0 >> 26; h0 &= MASK26; h1 += c;
+
+	// g = h + 5 - 2^130 is the reduced value if it doesn't go negative.
+	g0 = h0 + 5; c = g0 >> 26; g0 &= MASK26;
+	g1 = h1 + c; c = g1 >> 26; g1 &= MASK26;
+	g2 = h2 + c; c = g2 >> 26; g2 &= MASK26;
+	g3 = h3 + c; c = g3 >> 26; g3 &= MASK26;
+	g4 = h4 + c - (1ULL << 26);
+	mask = (g4 >> 63) - 1;
+	h0 = (h0 & ~mask) | (g0 & mask);
+	h1 = (h1 & ~mask) | (g1 & mask);
+	h2 = (h2 & ~mask) | (g2 & mask);
+	h3 = (h3 & ~mask) | (g3 & mask);
+	h4 = (h4 & ~mask) | (g4 & mask);
+
+	// Pack into 32-bit words and add s mod 2^128.
+	h0 = (h0 | (h1 << 26)) & 0xffffffff;
+	h1 = ((h1 >> 6) | (h2 << 20)) & 0xffffffff;
+	h2 = ((h2 >> 12) | (h3 << 14)) & 0xffffffff;
+	h3 = ((h3 >> 18) | (h4 << 8)) & 0xffffffff;
+	f = h0 + LOAD32_LE(ctx->pad);                  STORE32_LE(tag, (WORD)f);
+	f = h1 + LOAD32_LE(ctx->pad + 4) + (f >> 32);  STORE32_LE(tag + 4, (WORD)f);
+	f = h2 + LOAD32_LE(ctx->pad + 8) + (f >> 32);  STORE32_LE(tag + 8, (WORD)f);
+	f = h3 + LOAD32_LE(ctx->pad + 12) + (f >> 32); STORE32_LE(tag + 12, (WORD)f);
+}
+#endif
+
+#ifdef POLY1305_AVX2
+// Splits a carried 44-bit limb value into 26-bit limbs.
+static void poly1305_to_26(const unsigned long long h[], unsigned long long l[])
+{
+	unsigned long long h0,h1,h2,c;
+
+	h0 = h[0]; h1 = h[1]; h2 = h[2];
+	c = h0 >> 44; h0 &= MASK44; h1 += c;
+	c = h1 >> 44; h1 &= MASK44; h2 += c;
+	l[0] = h0 & MASK26;
+	l[1] = ((h0 >> 26) | (h1 << 18)) & MASK26;
+	l[2] = (h1 >> 8) & MASK26;
+	l[3] = ((h1 >> 34) | (h2 << 10)) & MASK26;
+	l[4] = h2 >> 16;
+}
+
+// The inverse of poly1305_to_26(), for limbs that may have grown past 26 bits.
+static void poly1305_from_26(const unsigned long long l[], unsigned long long h[])
+{
+	unsigned long long l0,l1,l2,l3,l4,c,v;
+
+	l0 = l[0]; l1 = l[1]; l2 = l[2]; l3 = l[3]; l4 = l[4];
+	c = l0 >> 26; l0 &= MASK26; l1 += c;
+	c = l1 >> 26; l1 &= MASK26; l2 += c;
+	c = l2 >> 26; l2 &= MASK26; l3 += c;
+	c = l3 >> 26; l3 &= MASK26; l4 += c;
+	c = l4 >> 26; l4 &= MASK26; l0 += c * 5;
+	c = l0 >> 26; l0 &= MASK26; l1 += c;
+
+	// Limb bit positions 0, 26, 52, 78 and 104 into 0, 44 and 88.
+	v = l0 + (l1 << 26);               h[0] = v & MASK44;
+	v = (v >> 44) + (l2 << 8) + (l3 << 34); h[1] = v & MASK44;
+	h[2] = (v >> 44) + (l4 << 16);
+}
+
+// h = h * r for four lanes of 26-bit limbs, s = 5 * r, then carried.
+#define POLY1305_MUL_AVX2(h,r,s) \
+	d0 = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[0]), _mm256_mul_epu32(h[1], s[4])), \
+	     _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], s[3]), _mm256_mul_epu32(h[3], s[2])), \
+	                      _mm256_mul_epu32(h[4], s[1]))); \
+	d1 = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[1]), _mm256_mul_epu32(h[1], r[0])), \
+	     _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], s[4]), _mm256_mul_epu32(h[3], s[3])), \
+	                      _mm256_mul_epu32(h[4], s[2]))); \
+	d2 = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[2]), _mm256_mul_epu32(h[1], r[1])), \
+	     _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], r[0]), _mm256_mul_epu32(h[3], s[4])), \
+	                      _mm256_mul_epu32(h[4], s[3]))); \
+	d3 = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[3]), _mm256_mul_epu32(h[1], r[2])), \
+	     _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], r[1]), _mm256_mul_epu32(h[3], r[0])), \
+	                      _mm256_mul_epu32(h[4], s[4]))); \
+	d4 = _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[0], r[4]), _mm256_mul_epu32(h[1], r[3])), \
+	     _mm256_add_epi64(_mm256_add_epi64(_mm256_mul_epu32(h[2], r[2]), _mm256_mul_epu32(h[3], r[1])), \
+	                      _mm256_mul_epu32(h[4], r[0]))); \
+	c = _mm256_srli_epi64(d0, 26); h[0] = _mm256_and_si256(d0, mask); d1 = _mm256_add_epi64(d1, c); \
+	c = _mm256_srli_epi64(d1, 26); h[1] = _mm256_and_si256(d1, mask); d2 = _mm256_add_epi64(d2, c); \
+	c = _mm256_srli_epi64(d2, 26); h[2] = _mm256_and_si256(d2, mask); d3 = _mm256_add_epi64(d3, c); \
+	c = _mm256_srli_epi64(d3, 26); h[3] = _mm256_and_si256(d3, mask); d4 = _mm256_add_epi64(d4, c); \
+	c = _mm256_srli_epi64(d4, 26); h[4] = _mm256_and_si256(d4, mask); \
+	h[0] = _mm256_add_epi64(h[0], _mm256_add_epi64(c, _mm256_slli_epi64(c, 2))); \
+	c = _mm256_srli_epi64(h[0], 26); h[0] = _mm256_and_si256(h[0], mask); h[1] = _mm256_add_epi64(h[1], c);
+
+// Adds four message blocks as 26-bit limbs. The 64-bit unpacks leave the
+// blocks in lanes 0, 2, 1, 3 order, which the final powers of r account for.
+#define POLY1305_ADD_BLOCKS_AVX2(h,in) \
+	a = _mm256_loadu_si256((const __m256i *)(in)); \
+	b = _mm256_loadu_si256((const __m256i *)((in) + 32)); \
+	t0 = _mm256_unpacklo_epi64(a, b); \
+	t1 = _mm256_unpackhi_epi64(a, b); \
+	h[0] = _mm256_add_epi64(h[0], _mm256_and_si256(t0, mask)); \
+	h[1] = _mm256_add_epi64(h[1], _mm256_and_si256(_mm256_srli_epi64(t0, 26), mask)); \
+	h[2] = _mm256_add_epi64(h[2], _mm256_and_si256(_mm256_or_si256(_mm256_srli_epi64(t0, 52), \
+	                                                               _mm256_slli_epi64(t1, 12)), mask)); \
+	h[3] = _mm256_add_epi64(h[3], _mm256_and_si256(_mm256_srli_epi64(t1, 14), mask)); \
+	h[4] = _mm256_add_epi64(h[4], _mm256_or_si256(_mm256_srli_epi64(t1, 40), hibit));
+
+// Four lanes each run Horner's rule with r^4 over every fourth block, then
+// lane k is multiplied by the power of r that brings it in line with the
+// last block. blocks must be a multiple of 4.
+__attribute__((target("avx2")))
+static void poly1305_blocks_avx2(POLY1305_CTX *ctx, const BYTE in[], size_t blocks)
+{
+	const __m256i mask = _mm256_set1_epi64x(MASK26);
+	const __m256i hibit = _mm256_set1_epi64x(1 << 24);
+	__m256i h[5],r4[5],s4[5],rf[5],sf[5],a,b,t0,t1,c,d0,d1,d2,d3,d4;
+	unsigned long long pow[4][3],limbs[5],lanes[4];
+	size_t idx;
+	int k;
+
+	if (!ctx->r_pow_ready) {
+		memcpy(pow[0], ctx->r, sizeof(pow[0]));
+		for (k = 1; k < 4; ++k) {
+			memcpy(pow[k], pow[k - 1], sizeof(pow[k]));
+			poly1305_mul(pow[k], ctx->r);
+		}
+		for (k = 0; k < 4; ++k) {
+			poly1305_to_26(pow[k], limbs);
+			for (idx = 0; idx < 5; ++idx)
+				ctx->r_pow[k][idx] = (WORD)limbs[idx];
+		}
+		ctx->r_pow_ready = TRUE;
+	}
+	for (k = 0; k < 5; ++k) {
+		r4[k] = _mm256_set1_epi64x(ctx->r_pow[3][k]);
+		s4[k] = _mm256_set1_epi64x(ctx->r_pow[3][k] * 5);
+		// Lanes hold blocks 0, 2, 1, 3 of each group: r^4, r^2, r^3, r^1.
+		rf[k] = _mm256_set_epi64x(ctx->r_pow[0][k], ctx->r_pow[2][k], ctx->r_pow[1][k], ctx->r_pow[3][k]);
+		sf[k] = _mm256_set_epi64x(ctx->r_pow[0][k] * 5, ctx->r_pow[2][k] * 5,
+		                          ctx->r_pow[1][k] * 5, ctx->r_pow[3][k] * 5);
+	}
+
+	// The running accumulator joins the first block's lane.
+	poly1305_to_26(ctx->h, limbs);
+	for (k = 0; k < 5; ++k)
+		h[k] = _mm256_set_epi64x(0, 0, 0, limbs[k]);
+	POLY1305_ADD_BLOCKS_AVX2(h, in);
+	for (idx = 4; idx < blocks; idx += 4) {
+		POLY1305_MUL_AVX2(h, r4, s4);
+		POLY1305_ADD_BLOCKS_AVX2(h, &in[idx * POLY1305_BLOCK_SIZE]);
+	}
+	POLY1305_MUL_AVX2(h, rf, sf);
+
+	for (k = 0; k < 5; ++k) {
+		_mm256_storeu_si256((__m256i *)lanes, h[k]);
+		limbs[k] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+	poly1305_from_26(limbs, ctx->h);
+}
+#endif
+
+void poly1305_update(POLY1305_CTX *ctx, const BYTE in[], size_t len)
+{
+	size_t idx = 0, blocks;
+
+	// Complete a partial block from an earlier call first.
+	if (ctx->buf_len) {
+		for ( ; idx < len && ctx->buf_len < POLY1305_BLOCK_SIZE; ++idx)
+			ctx->buf[ctx->buf_len++] = in[idx];
+		if (ctx->buf_len < POLY1305_BLOCK_SIZE)
+			return;
+		poly1305_blocks(ctx, ctx->buf, 1, FALSE);
+		ctx->buf_len = 0;
+	}
+
+	blocks = (len - idx) / POLY1305_BLOCK_SIZE;
+#ifdef POLY1305_AVX2
+	if (blocks >= POLY1305_AVX2_MIN_BLOCKS && chacha20_simd_blocks() == 8) {
+		size_t vec_blocks = blocks & ~(size_t)3;
+
+		poly1305_blocks_avx2(ctx, &in[idx], vec_blocks);
+		idx += vec_blocks * POLY1305_BLOCK_SIZE;
+		blocks -= vec_blocks;
+	}
+#endif
+	poly1305_blocks(ctx, &in[idx], blocks, FALSE);
+	idx += blocks * POLY1305_BLOCK_SIZE;
+
+	for ( ; idx < len; ++idx)
+		ctx->buf[ctx->buf_len++] = in[idx];
+}
+
+void poly1305_final(POLY1305_CTX *ctx, BYTE tag[])
+{
+	// A final partial block is padded with a 1 byte and then zeros.
+	if (ctx->buf_len) {
+		ctx->buf[ctx->buf_len] = 1;
+		memset(&ctx->buf[ctx->buf_len + 1], 0, POLY1305_BLOCK_SIZE - ctx->buf_len - 1);
+		poly1305_blocks(ctx, ctx->buf, 1, TRUE);
+	}
+	poly1305_finish(ctx, tag);
+}
+
+/*******************
+* ChaCha20-Poly1305
+*******************/
+static void aead_pad16(POLY1305_CTX *poly, size_t len)
+{
+	static const BYTE zeros[POLY1305_BLOCK_SIZE] = {0};
+
+	if (len % POLY1305_BLOCK_SIZE)
+		poly1305_update(poly, zeros, POLY1305_BLOCK_SIZE - len % POLY1305_BLOCK_SIZE);
+}
+
+static void aead_lengths(POLY1305_CTX *poly, unsigned long long assoc_len, unsigned long long text_len)
+{
+	BYTE buf[16];
+
+	STORE32_LE(buf, (WORD)assoc_len);
+	STORE32_LE(buf + 4, (WORD)(assoc_len >> 32));
+	STORE32_LE(buf + 8, (WORD)text_len);
+	STORE32_LE(buf + 12, (WORD)(text_len >> 32));
+	poly1305_update(poly, buf, sizeof(buf));
+}
+
+// Sets up both halves of the AEAD: the Poly1305 key is the first half of
+// keystream block 0, and encryption starts at block 1.
+static void aead_init(CHACHA20_CTX *chacha, POLY1305_CTX *poly, const BYTE key[], const BYTE nonce[],
+                      const BYTE assoc[], size_t assoc_len)
+{
+	BYTE block[CHACHA20_BLOCK_SIZE];
+
+	chacha20_block(key, 0, nonce, block);
+	poly1305_init(poly, block);
+	poly1305_update(poly, assoc, assoc_len);
+	aead_pad16(poly, assoc_len);
+	chacha20_init(chacha, key, nonce, 1);
+}
+
+int chacha20_poly1305_encrypt(const BYTE payload[], WORD payload_len, const BYTE assoc[], unsigned short assoc_len,
+                              const BYTE nonce[], unsigned short nonce_len, BYTE out[], WORD *out_len,
+                              WORD mac_len, const BYTE key[], int keysize)
+{
+	CHACHA20_CTX chacha;
+	POLY1305_CTX poly;
+	WORD idx, chunk;
+
+	if (nonce_len != CHACHA20_NONCE_SIZE || mac_len != POLY1305_TAG_SIZE || keysize != 256)
+		return(FALSE);
+
+	aead_init(&chacha, &poly, key, nonce, assoc, assoc_len);
+
+	// One pass over the data: each chunk is MACed right after it is encrypted,
+	// while it is still in the L1 cache.
+	for (idx = 0; idx < payload_len; idx += chunk) {
+		chunk = payload_len - idx < AEAD_CHUNK ? payload_len - idx : AEAD_CHUNK;
+		chacha20_update(&chacha, &payload[idx], &out[idx], chunk);
+		poly1305_update(&poly, &out[idx], chunk);
+	}
+
+	aead_pad16(&poly, payload_len);
+	aead_lengths(&poly, assoc_len, payload_len);
+	poly1305_final(&poly, &out[payload_len]);
+	*out_len = payload_len + mac_len;
+
+	return(TRUE);
+}
+
+int chacha20_poly1305_decrypt(const BYTE ciphertext[], WORD ciphertext_len, const BYTE assoc[], unsigned short assoc_len,
+                              const BYTE nonce[], unsigned short nonce_len, BYTE plaintext[], WORD *plaintext_len,
+                              WORD mac_len, int *mac_auth, const BYTE key[], int keysize)
+{
+	CHACHA20_CTX chacha;
+	POLY1305_CTX poly;
+	BYTE mac[POLY1305_TAG_SIZE];
+	WORD idx, chunk, len;
+	int diff = 0;
+
+	if (nonce_len != CHACHA20_NONCE_SIZE || mac_len != POLY1305_TAG_SIZE || keysize != 256)
+		return(FALSE);
+	if (ciphertext_len < mac_len)
+		return(FALSE);
+
+	len = ciphertext_len - mac_len;
+	aead_init(&chacha, &poly, key, nonce, assoc, assoc_len);
+
+	// MAC each chunk before decrypting it, so in place decryption works.
+	for (idx = 0; idx < len; idx += chunk) {
+		chunk = len - idx < AEAD_CHUNK ? len - idx : AEAD_CHUNK;
+		if (mac_auth != NULL)
+			poly1305_update(&poly, &ciphertext[idx], chunk);
+		chacha20_update(&chacha, &ciphertext[idx], &plaintext[idx], chunk);
+	}
+	*plaintext_len = len;
+
+	// Setting mac_auth to NULL disables the authentication check.
+	if (mac_auth != NULL) {
+		aead_pad16(&poly, len);
+		aead_lengths(&poly, assoc_len, len);
+		poly1305_final(&poly, mac);
+
+		// Compare in time independent of where the MACs differ. Note the
+		// received MAC is read from ciphertext[], which plaintext[] doesn't reach.
+		for (idx = 0; idx < POLY1305_TAG_SIZE; ++idx)
+			diff |= mac[idx] ^ ciphertext[len + idx];
+		if (diff == 0) {
+			*mac_auth = TRUE;
+		}
+		else {
+			*mac_auth = FALSE;
+			memset(plaintext, 0, len);
+		}
+	}
+
+	return(TRUE);
+}
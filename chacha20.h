@@ -0,0 +1,112 @@
+/*********************************************************************
+* Filename:   chacha20.h
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Defines the API for the corresponding ChaCha20 implementation.
+*********************************************************************/
+
+#ifndef CHACHA20_H
+#define CHACHA20_H
+
+/*************************** HEADER FILES ***************************/
+#include <stddef.h>
+
+/****************************** MACROS ******************************/
+#define CHACHA20_KEY_SIZE   32          // 256-bit key
+#define CHACHA20_NONCE_SIZE 12          // 96-bit nonce, as in RFC 8439
+#define CHACHA20_BLOCK_SIZE 64          // ChaCha20 outputs 64 bytes per block counter
+
+#define POLY1305_KEY_SIZE   32          // One-time key: r, then the pad s
+#define POLY1305_BLOCK_SIZE 16
+#define POLY1305_TAG_SIZE   16
+
+/**************************** DATA TYPES ****************************/
+typedef unsigned char BYTE;             // 8-bit byte
+typedef unsigned int  WORD;             // 32-bit word, change to "long" for 16-bit machines
+
+typedef struct {
+	WORD state[16];                     // Constants, key, next block counter, nonce
+	WORD first_counter;                 // Block counter of stream offset 0
+	BYTE keystream[CHACHA20_BLOCK_SIZE];
+	unsigned int pos;                   // Bytes of keystream[] already used
+} CHACHA20_CTX;
+
+typedef struct {
+	unsigned long long r[5];            // Clamped r and the accumulator, in 44-bit limbs
+	unsigned long long h[5];            // (26-bit limbs without a 128-bit integer type)
+	BYTE pad[16];                       // s, added at the end
+	BYTE buf[POLY1305_BLOCK_SIZE];      // Partial block waiting for more input
+	size_t buf_len;
+	WORD r_pow[4][5];                   // r^1..r^4 in 26-bit limbs, for the 4-block path
+	int r_pow_ready;
+} POLY1305_CTX;
+
+/*********************** FUNCTION DECLARATIONS **********************/
+///////////////////
+// ChaCha20
+///////////////////
+// Writes the keystream block for one block counter, the RFC 8439 block function.
+void chacha20_block(const BYTE key[],         // CHACHA20_KEY_SIZE bytes
+                    WORD counter,             // Block counter
+                    const BYTE nonce[],       // CHACHA20_NONCE_SIZE bytes
+                    BYTE out[]);              // CHACHA20_BLOCK_SIZE bytes
+
+// One-shot encryption starting at block "counter". Decryption is the same
+// operation. Input and output may be the same buffer.
+void chacha20_encrypt(const BYTE key[], WORD counter, const BYTE nonce[], const BYTE in[], BYTE out[], size_t len);
+void chacha20_decrypt(const BYTE key[], WORD counter, const BYTE nonce[], const BYTE in[], BYTE out[], size_t len);
+
+// Streaming interface. The stream starts at block "counter" and may be
+// processed in any number of calls, each continuing where the last stopped.
+void chacha20_init(CHACHA20_CTX *ctx, const BYTE key[], const BYTE nonce[], WORD counter);
+
+// XORs the next "len" keystream bytes into "in". Input and output may be the same buffer.
+void chacha20_update(CHACHA20_CTX *ctx, const BYTE in[], BYTE out[], size_t len);
+
+// Moves to any byte offset of the stream, so it can be decrypted directly.
+void chacha20_seek(CHACHA20_CTX *ctx, unsigned long long offset);
+
+///////////////////
+// Poly1305
+///////////////////
+// A one-time authenticator: never use a key for more than one message.
+void poly1305_init(POLY1305_CTX *ctx, const BYTE key[]);   // POLY1305_KEY_SIZE bytes
+void poly1305_update(POLY1305_CTX *ctx, const BYTE in[], size_t len);
+void poly1305_final(POLY1305_CTX *ctx, BYTE tag[]);         // POLY1305_TAG_SIZE bytes
+
+///////////////////
+// ChaCha20-Poly1305
+///////////////////
+// The RFC 8439 AEAD, with the same arguments as aes_encrypt_ccm() so the two can
+// be swapped. The nonce must be CHACHA20_NONCE_SIZE bytes, the MAC
+// POLY1305_TAG_SIZE bytes and the key 256 bits.
+// Returns True if the input parameters do not violate any constraint.
+int chacha20_poly1305_encrypt(const BYTE plaintext[],              // IN  - Plaintext.
+                              WORD plaintext_len,                  // IN  - Plaintext length.
+                              const BYTE associated_data[],        // IN  - Associated Data included in authentication, but not encryption.
+                              unsigned short associated_data_len,  // IN  - Associated Data length in bytes.
+                              const BYTE nonce[],                  // IN  - The Nonce to be used for encryption.
+                              unsigned short nonce_len,            // IN  - Nonce length in bytes, must be CHACHA20_NONCE_SIZE.
+                              BYTE ciphertext[],                   // OUT - Ciphertext, a concatination of the encrypted plaintext and the MAC.
+                              WORD *ciphertext_len,                // OUT - The length of the ciphertext, always plaintext_len + mac_len.
+                              WORD mac_len,                        // IN  - The length of the MAC, must be POLY1305_TAG_SIZE.
+                              const BYTE key[],                    // IN  - The ChaCha20 key.
+                              int keysize);                        // IN  - The length of the key in bits, must be 256.
+
+// Returns True if the input parameters do not violate any constraint.
+// As with aes_decrypt_ccm(), mac_auth reports whether the MAC matched, the
+// plaintext is zeroed out if it did not, and mac_auth = NULL skips the check.
+int chacha20_poly1305_decrypt(const BYTE ciphertext[],             // IN  - Ciphertext, the concatination of encrypted plaintext and MAC.
+                              WORD ciphertext_len,                 // IN  - Ciphertext length in bytes.
+                              const BYTE assoc[],                  // IN  - The Associated Data, required for authentication.
+                              unsigned short assoc_len,            // IN  - Associated Data length in bytes.
+                              const BYTE nonce[],                  // IN  - The Nonce to use for decryption, same one as for encryption.
+                              unsigned short nonce_len,            // IN  - Nonce length in bytes, must be CHACHA20_NONCE_SIZE.
+                              BYTE plaintext[],                    // OUT - The plaintext that was decrypted, ciphertext_len - mac_len bytes.
+                              WORD *plaintext_len,                 // OUT - Length in bytes of the output plaintext, always ciphertext_len - mac_len.
+                              WORD mac_len,                        // IN  - The length of the MAC, must be POLY1305_TAG_SIZE.
+                              int *mac_auth,                       // OUT - TRUE if authentication succeeded, FALSE if it did not. NULL pointer will ignore the authentication.
+                              const BYTE key[],                    // IN  - The ChaCha20 key.
+                              int keysize);                        // IN  - The length of the key in bits, must be 256.
+
+#endif   // CHACHA20_H
@@ -0,0 +1,201 @@
+/*********************************************************************
+* Filename:   chacha20_test.c
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Performs known-answer tests on the corresponding ChaCha20,
+	          Poly1305 and ChaCha20-Poly1305 implementation. These
+	          tests do not encompass the full range of available test
+	          vectors, however, if the tests pass it is very, very
+	          likely that the code is correct and was compiled
+	          properly. This code also serves as example usage of the
+	          functions.
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdio.h>
+#include <memory.h>
+#include "chacha20.h"
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+// RFC 8439 sections 2.3.2 and 2.4.2.
+int chacha20_rfc_test()
+{
+	BYTE key[CHACHA20_KEY_SIZE];
+	BYTE nonce1[CHACHA20_NONCE_SIZE] = {0x00,0x00,0x00,0x09,0x00,0x00,0x00,0x4a,0x00,0x00,0x00,0x00};
+	BYTE nonce2[CHACHA20_NONCE_SIZE] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x4a,0x00,0x00,0x00,0x00};
+	BYTE block[CHACHA20_BLOCK_SIZE] = {
+		0x10,0xf1,0xe7,0xe4,0xd1,0x3b,0x59,0x15,0x50,0x0f,0xdd,0x1f,0xa3,0x20,0x71,0xc4,
+		0xc7,0xd1,0xf4,0xc7,0x33,0xc0,0x68,0x03,0x04,0x22,0xaa,0x9a,0xc3,0xd4,0x6c,0x4e,
+		0xd2,0x82,0x64,0x46,0x07,0x9f,0xaa,0x09,0x14,0xc2,0xd7,0x05,0xd9,0x8b,0x02,0xa2,
+		0xb5,0x12,0x9c,0xd1,0xde,0x16,0x4e,0xb9,0xcb,0xd0,0x83,0xe8,0xa2,0x50,0x3c,0x4e};
+	BYTE plaintext[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for "
+	                   "the future, sunscreen would be it.";
+	BYTE ciphertext[114] = {
+		0x6e,0x2e,0x35,0x9a,0x25,0x68,0xf9,0x80,0x41,0xba,0x07,0x28,0xdd,0x0d,0x69,0x81,
+		0xe9,0x7e,0x7a,0xec,0x1d,0x43,0x60,0xc2,0x0a,0x27,0xaf,0xcc,0xfd,0x9f,0xae,0x0b,
+		0xf9,0x1b,0x65,0xc5,0x52,0x47,0x33,0xab,0x8f,0x59,0x3d,0xab,0xcd,0x62,0xb3,0x57,
+		0x16,0x39,0xd6,0x24,0xe6,0x51,0x52,0xab,0x8f,0x53,0x0c,0x35,0x9f,0x08,0x61,0xd8,
+		0x07,0xca,0x0d,0xbf,0x50,0x0d,0x6a,0x61,0x56,0xa3,0x8e,0x08,0x8a,0x22,0xb6,0x5e,
+		0x52,0xbc,0x51,0x4d,0x16,0xcc,0xf8,0x06,0x81,0x8c,0xe9,0x1a,0xb7,0x79,0x37,0x36,
+		0x5a,0xf9,0x0b,0xbf,0x74,0xa3,0x5b,0xe6,0xb4,0x0b,0x8e,0xed,0xf2,0x78,0x5e,0x42,
+		0x87,0x4d};
+	BYTE buf[114];
+	int idx, pass = 1;
+
+	for (idx = 0; idx < CHACHA20_KEY_SIZE; ++idx)
+		key[idx] = (BYTE)idx;
+
+	chacha20_block(key, 1, nonce1, buf);
+	pass = pass && !memcmp(block, buf, CHACHA20_BLOCK_SIZE);
+
+	chacha20_encrypt(key, 1, nonce2, plaintext, buf, 114);
+	pass = pass && !memcmp(ciphertext, buf, 114);
+	chacha20_decrypt(key, 1, nonce2, buf, buf, 114);
+	pass = pass && !memcmp(plaintext, buf, 114);
+
+	return(pass);
+}
+
+// Long streams go through the multi-block kernels. They must match the block
+// function however the stream is split up or entered.
+int chacha20_stream_test()
+{
+	BYTE key[CHACHA20_KEY_SIZE], nonce[CHACHA20_NONCE_SIZE];
+	BYTE expected[1500], buf[1500], zeros[1500];
+	CHACHA20_CTX ctx;
+	size_t pos, chunk, offsets[4] = {0, 1, 700, 1432};
+	int idx, pass = 1;
+
+	for (idx = 0; idx < CHACHA20_KEY_SIZE; ++idx)
+		key[idx] = (BYTE)(idx * 5 + 3);
+	for (idx = 0; idx < CHACHA20_NONCE_SIZE; ++idx)
+		nonce[idx] = (BYTE)(0xA0 + idx);
+	memset(zeros, 0, sizeof(zeros));
+	// Start just below the 32-bit counter wrap.
+	for (pos = 0; pos < sizeof(expected); pos += CHACHA20_BLOCK_SIZE) {
+		chacha20_block(key, (WORD)(0xFFFFFFF0 + pos / CHACHA20_BLOCK_SIZE), nonce, buf);
+		memcpy(&expected[pos], buf, pos + CHACHA20_BLOCK_SIZE <= sizeof(expected) ?
+		       CHACHA20_BLOCK_SIZE : sizeof(expected) - pos);
+	}
+
+	chacha20_encrypt(key, 0xFFFFFFF0, nonce, zeros, buf, sizeof(buf));
+	pass = pass && !memcmp(expected, buf, sizeof(buf));
+
+	chacha20_init(&ctx, key, nonce, 0xFFFFFFF0);
+	for (pos = 0, chunk = 1; pos < sizeof(buf); pos += chunk, chunk = chunk * 3 + 1) {
+		if (chunk > sizeof(buf) - pos)
+			chunk = sizeof(buf) - pos;
+		chacha20_update(&ctx, &zeros[pos], &buf[pos], chunk);
+	}
+	pass = pass && !memcmp(expected, buf, sizeof(buf));
+
+	for (idx = 0; idx < 4; ++idx) {
+		chacha20_seek(&ctx, offsets[idx]);
+		chacha20_update(&ctx, zeros, buf, sizeof(buf) - offsets[idx]);
+		pass = pass && !memcmp(&expected[offsets[idx]], buf, sizeof(buf) - offsets[idx]);
+	}
+
+	return(pass);
+}
+
+// RFC 8439 section 2.5.2, then a long message fed whole and a byte at a time,
+// which go through the 4-block and the single block paths.
+int poly1305_test()
+{
+	BYTE key[POLY1305_KEY_SIZE] = {
+		0x85,0xd6,0xbe,0x78,0x57,0x55,0x6d,0x33,0x7f,0x44,0x52,0xfe,0x42,0xd5,0x06,0xa8,
+		0x01,0x03,0x80,0x8a,0xfb,0x0d,0xb2,0xfd,0x4a,0xbf,0xf6,0xaf,0x41,0x49,0xf5,0x1b};
+	BYTE msg[] = "Cryptographic Forum Research Group";
+	BYTE tag[POLY1305_TAG_SIZE] = {0xa8,0x06,0x1d,0xc1,0x30,0x51,0x36,0xc6,0xc2,0x2b,0x8b,0xaf,0x0c,0x01,0x27,0xa9};
+	BYTE long_msg[1003], buf[POLY1305_TAG_SIZE], buf2[POLY1305_TAG_SIZE];
+	POLY1305_CTX ctx;
+	size_t idx;
+	int pass = 1;
+
+	poly1305_init(&ctx, key);
+	poly1305_update(&ctx, msg, 34);
+	poly1305_final(&ctx, buf);
+	pass = pass && !memcmp(tag, buf, POLY1305_TAG_SIZE);
+
+	for (idx = 0; idx < sizeof(long_msg); ++idx)
+		long_msg[idx] = (BYTE)(0xFF - idx * 3);
+	poly1305_init(&ctx, key);
+	poly1305_update(&ctx, long_msg, 7);
+	poly1305_update(&ctx, &long_msg[7], sizeof(long_msg) - 7);
+	poly1305_final(&ctx, buf);
+	poly1305_init(&ctx, key);
+	for (idx = 0; idx < sizeof(long_msg); ++idx)
+		poly1305_update(&ctx, &long_msg[idx], 1);
+	poly1305_final(&ctx, buf2);
+	pass = pass && !memcmp(buf, buf2, POLY1305_TAG_SIZE);
+
+	return(pass);
+}
+
+// RFC 8439 section 2.8.2, then round trips through both paths.
+int chacha20_poly1305_test()
+{
+	BYTE key[CHACHA20_KEY_SIZE];
+	BYTE nonce[CHACHA20_NONCE_SIZE] = {0x07,0x00,0x00,0x00,0x40,0x41,0x42,0x43,0x44,0x45,0x46,0x47};
+	BYTE assoc[12] = {0x50,0x51,0x52,0x53,0xc0,0xc1,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7};
+	BYTE plaintext[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for "
+	                   "the future, sunscreen would be it.";
+	BYTE ciphertext[114 + POLY1305_TAG_SIZE] = {
+		0xd3,0x1a,0x8d,0x34,0x64,0x8e,0x60,0xdb,0x7b,0x86,0xaf,0xbc,0x53,0xef,0x7e,0xc2,
+		0xa4,0xad,0xed,0x51,0x29,0x6e,0x08,0xfe,0xa9,0xe2,0xb5,0xa7,0x36,0xee,0x62,0xd6,
+		0x3d,0xbe,0xa4,0x5e,0x8c,0xa9,0x67,0x12,0x82,0xfa,0xfb,0x69,0xda,0x92,0x72,0x8b,
+		0x1a,0x71,0xde,0x0a,0x9e,0x06,0x0b,0x29,0x05,0xd6,0xa5,0xb6,0x7e,0xcd,0x3b,0x36,
+		0x92,0xdd,0xbd,0x7f,0x2d,0x77,0x8b,0x8c,0x98,0x03,0xae,0xe3,0x28,0x09,0x1b,0x58,
+		0xfa,0xb3,0x24,0xe4,0xfa,0xd6,0x75,0x94,0x55,0x85,0x80,0x8b,0x48,0x31,0xd7,0xbc,
+		0x3f,0xf4,0xde,0xf0,0x8e,0x4b,0x7a,0x9d,0xe5,0x76,0xd2,0x65,0x86,0xce,0xc6,0x4b,
+		0x61,0x16,
+		0x1a,0xe1,0x0b,0x59,0x4f,0x09,0xe2,0x6a,0x7e,0x90,0x2e,0xcb,0xd0,0x60,0x06,0x91};
+	BYTE long_text[1500], buf[1500 + POLY1305_TAG_SIZE];
+	WORD out_len;
+	int idx, mac_auth, pass = 1;
+
+	for (idx = 0; idx < CHACHA20_KEY_SIZE; ++idx)
+		key[idx] = (BYTE)(0x80 + idx);
+
+	pass = pass && chacha20_poly1305_encrypt(plaintext, 114, assoc, 12, nonce, 12, buf, &out_len, 16, key, 256);
+	pass = pass && out_len == sizeof(ciphertext) && !memcmp(ciphertext, buf, sizeof(ciphertext));
+	pass = pass && chacha20_poly1305_decrypt(ciphertext, sizeof(ciphertext), assoc, 12, nonce, 12, buf, &out_len,
+	                                         16, &mac_auth, key, 256);
+	pass = pass && mac_auth && out_len == 114 && !memcmp(plaintext, buf, 114);
+
+	// In place, longer than one pass, with a tampered byte.
+	for (idx = 0; idx < (int)sizeof(long_text); ++idx)
+		long_text[idx] = (BYTE)(idx * 11);
+	memcpy(buf, long_text, sizeof(long_text));
+	chacha20_poly1305_encrypt(buf, sizeof(long_text), assoc, 12, nonce, 12, buf, &out_len, 16, key, 256);
+	chacha20_poly1305_decrypt(buf, out_len, assoc, 12, nonce, 12, buf, &out_len, 16, &mac_auth, key, 256);
+	pass = pass && mac_auth && !memcmp(long_text, buf, sizeof(long_text));
+	chacha20_poly1305_encrypt(long_text, sizeof(long_text), assoc, 12, nonce, 12, buf, &out_len, 16, key, 256);
+	buf[700] ^= 0x01;
+	chacha20_poly1305_decrypt(buf, out_len, assoc, 12, nonce, 12, long_text, &out_len, 16, &mac_auth, key, 256);
+	pass = pass && !mac_auth && long_text[0] == 0 && long_text[1499] == 0;
+
+	pass = pass && !chacha20_poly1305_encrypt(plaintext, 114, assoc, 12, nonce, 8, buf, &out_len, 16, key, 256);
+	pass = pass && !chacha20_poly1305_encrypt(plaintext, 114, assoc, 12, nonce, 12, buf, &out_len, 12, key, 256);
+
+	return(pass);
+}
+
+int chacha20_test()
+{
+	int pass = 1;
+
+	pass = pass && chacha20_rfc_test();
+	pass = pass && chacha20_stream_test();
+	pass = pass && poly1305_test();
+	pass = pass && chacha20_poly1305_test();
+
+	return(pass);
+}
+
+int main()
+{
+	printf("ChaCha20 tests: %s\n", chacha20_test() ? "SUCCEEDED" : "FAILED");
+
+	return(0);
+}
@@ -4,7 +4,10 @@
 * Copyright:
 * Disclaimer: This code is presented "as is" without any guarantees.
 * Details:    Implementation of the DES encryption algorithm.
-              Modes of operation (such as CBC) are not included.
+              The ECB, CBC and CTR modes of operation are included, both
+              for DES and 3DES, as is a bitsliced engine for bulk ECB/CTR.
+              The modes are specified by NIST SP 800-38 A, available at:
+               * http://csrc.nist.gov/publications/nistpubs/800-38a/sp800-38a.pdf
               The formal NIST algorithm specification can be found here:
                * http://csrc.nist.gov/publications/fips/fips46-3/fips46-3.pdf
 *********************************************************************/
@@ -14,16 +17,147 @@
 #include <memory.h>
 #include "des.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef DES_THREADS
+#include <pthread.h>
+#endif
+
 /****************************** MACROS ******************************/
 // Obtain bit "b" from the left and shift it "c" places from the right
 #define BITNUM(a,b,c) (((a[(b)/8] >> (7 - (b%8))) & 0x01) << (c))
 #define BITNUMINTR(a,b,c) ((((a) >> (31 - (b))) & 0x00000001) << (c))
 #define BITNUMINTL(a,b,c) ((((a) << (b)) & 0x80000000) >> (c))
 
+#define TRUE  1
+#define FALSE 0
+
+// Move a block between its byte form and two big-endian 32-bit halves.
+#define LOAD_HALVES(in,l,r) \
+	l = ((WORD)(in)[0] << 24) | ((in)[1] << 16) | ((in)[2] << 8) | (in)[3]; \
+	r = ((WORD)(in)[4] << 24) | ((in)[5] << 16) | ((in)[6] << 8) | (in)[7];
+#define STORE_HALVES(out,l,r) \
+	(out)[0] = (l) >> 24; (out)[1] = (l) >> 16; (out)[2] = (l) >> 8; (out)[3] = (l); \
+	(out)[4] = (r) >> 24; (out)[5] = (r) >> 16; (out)[6] = (r) >> 8; (out)[7] = (r);
+
+// Exchange the bits of "b" selected by mask "m" with the bits of "a" selected
+// by "m << n". Five of these implement the initial and final permutations.
+#define DELTA_SWAP(a,b,t,n,m) t = (((a) >> (n)) ^ (b)) & (m); (b) ^= t; (a) ^= (t << (n));
+#define IP_SWAPS(l,r,t) DELTA_SWAP(l,r,t,4,0x0f0f0f0f) DELTA_SWAP(l,r,t,16,0x0000ffff) \
+                        DELTA_SWAP(r,l,t,2,0x33333333) DELTA_SWAP(r,l,t,8,0x00ff00ff) \
+                        DELTA_SWAP(l,r,t,1,0x55555555)
+#define FP_SWAPS(l,r,t) DELTA_SWAP(l,r,t,1,0x55555555) DELTA_SWAP(r,l,t,8,0x00ff00ff) \
+                        DELTA_SWAP(r,l,t,2,0x33333333) DELTA_SWAP(l,r,t,16,0x0000ffff) \
+                        DELTA_SWAP(l,r,t,4,0x0f0f0f0f)
+
+// The 16 DES rounds over the halves l and r, which must already be through IP.
+// The final round doesn't switch sides, so the halves are ready for FP (or for
+// the next DES pass in 3DES).
+#define DES_ROUNDS(l,r,t,idx,key) \
+	for (idx = 0; idx < 15; ++idx) { \
+		t = r; \
+		r = f(r,(key)[idx]) ^ l; \
+		l = t; \
+	} \
+	l = f(r,(key)[15]) ^ l;
+
+// Two independent blocks through the 16 rounds, interleaved so that the two
+// f() dependency chains can overlap.
+#define DES_ROUNDS_X2(l0,r0,l1,r1,t0,t1,idx,key) \
+	for (idx = 0; idx < 15; ++idx) { \
+		t0 = r0; \
+		t1 = r1; \
+		r0 = f(r0,(key)[idx]) ^ l0; \
+		r1 = f(r1,(key)[idx]) ^ l1; \
+		l0 = t0; \
+		l1 = t1; \
+	} \
+	l0 = f(r0,(key)[15]) ^ l0; \
+	l1 = f(r1,(key)[15]) ^ l1;
+
+// One round function through the S/P tables, with the subkey in the compact
+// form: k0 carries the S-box 1, 3, 5 and 7 inputs and k1 those of S-boxes 2,
+// 4, 6 and 8, one 6-bit group per byte. Rotating r lines up its expansion
+// with those groups.
+#define SP_F(r,k0,k1,u,v) \
+	(u = (((r) >> 3) | ((r) << 29)) ^ (k0), v = (((r) << 1) | ((r) >> 31)) ^ (k1), \
+	 des_sp[0][(u >> 24) & 0x3f] ^ des_sp[2][(u >> 16) & 0x3f] ^ \
+	 des_sp[4][(u >> 8) & 0x3f] ^ des_sp[6][u & 0x3f] ^ \
+	 des_sp[1][(v >> 24) & 0x3f] ^ des_sp[3][(v >> 16) & 0x3f] ^ \
+	 des_sp[5][(v >> 8) & 0x3f] ^ des_sp[7][v & 0x3f])
+
+// Number of independent (key, block) pairs three_des_crypt_batch() interleaves.
+#define DES_BATCH_LANES 4
+
 // This macro converts a 6 bit block with the S-Box row defined as the first and last
 // bits to a 6 bit block with the row defined by the first two bits.
 #define SBOXBIT(a) (((a) & 0x20) | (((a) & 0x1f) >> 1) | (((a) & 0x01) << 4))
 
+// Gates for the bitsliced engine. Each BS_WORD carries one bit position of
+// DES_BS_BLOCKS independent blocks. BS_ANDN(a,b) is a & ~b.
+#if defined(__AVX2__)
+#define BS_AND(a,b)  _mm256_and_si256(a,b)
+#define BS_OR(a,b)   _mm256_or_si256(a,b)
+#define BS_XOR(a,b)  _mm256_xor_si256(a,b)
+#define BS_ANDN(a,b) _mm256_andnot_si256(b,a)
+#define BS_NOT(a)    _mm256_xor_si256(a,_mm256_set1_epi32(-1))
+#define BS_ZERO      _mm256_setzero_si256()
+#define BS_ONES      _mm256_set1_epi32(-1)
+#elif defined(__SSE2__)
+#define BS_AND(a,b)  _mm_and_si128(a,b)
+#define BS_OR(a,b)   _mm_or_si128(a,b)
+#define BS_XOR(a,b)  _mm_xor_si128(a,b)
+#define BS_ANDN(a,b) _mm_andnot_si128(b,a)
+#define BS_NOT(a)    _mm_xor_si128(a,_mm_set1_epi32(-1))
+#define BS_ZERO      _mm_setzero_si128()
+#define BS_ONES      _mm_set1_epi32(-1)
+#else
+#define BS_AND(a,b)  ((a) & (b))
+#define BS_OR(a,b)   ((a) | (b))
+#define BS_XOR(a,b)  ((a) ^ (b))
+#define BS_ANDN(a,b) ((a) & ~(b))
+#define BS_NOT(a)    (~(a))
+#define BS_ZERO      0ULL
+#define BS_ONES      0xffffffffffffffffULL
+#endif
+
+// Subkey bit n of the current round as an all-zeros or all-ones slice.
+#define BS_KEY(n) kmask[kbits[n]]
+
+// Blocks per pass of the bitsliced engine: 64 per 64-bit word, times the
+// number of 64-bit lanes in the widest vector unit the code is built for.
+#if defined(__AVX2__)
+#define DES_BS_BLOCKS 256
+#elif defined(__SSE2__)
+#define DES_BS_BLOCKS 128
+#else
+#define DES_BS_BLOCKS 64
+#endif
+
+#define BS_GROUPS (DES_BS_BLOCKS / 64)
+
+// Upper bound on the workers used by the multithreaded functions.
+#define DES_MAX_THREADS 64
+
+/**************************** DATA TYPES ****************************/
+#if defined(__AVX2__)
+typedef __m256i BS_WORD;
+#elif defined(__SSE2__)
+typedef __m128i BS_WORD;
+#else
+typedef unsigned long long BS_WORD;
+#endif
+
+// A slice viewed either as one vector or as its 64-block groups.
+typedef union {
+	BS_WORD v;
+	unsigned long long q[BS_GROUPS];
+} BS_SLICE;
+
 /**************************** VARIABLES *****************************/
 static const BYTE sbox1[64] = {
 	14,  4,  13,  1,   2, 15,  11,  8,   3, 10,   6, 12,   5,  9,   0,  7,
@@ -74,62 +208,346 @@ static const BYTE sbox8[64] = {
 	 2,  1,  14,  7,   4, 10,   8, 13,  15, 12,   9,  0,   3,  5,   6, 11
 };
 
+// The S-boxes with the P-box folded in, for the compact key schedule form.
+// Entry j holds P(sbox(j+1) output << (28 - 4 * j)) for every 6-bit input.
+static const WORD des_sp[8][64] = {
+	{
+		0x00808200,0x00000000,0x00008000,0x00808202,0x00808002,0x00008202,0x00000002,0x00008000,
+		0x00000200,0x00808200,0x00808202,0x00000200,0x00800202,0x00808002,0x00800000,0x00000002,
+		0x00000202,0x00800200,0x00800200,0x00008200,0x00008200,0x00808000,0x00808000,0x00800202,
+		0x00008002,0x00800002,0x00800002,0x00008002,0x00000000,0x00000202,0x00008202,0x00800000,
+		0x00008000,0x00808202,0x00000002,0x00808000,0x00808200,0x00800000,0x00800000,0x00000200,
+		0x00808002,0x00008000,0x00008200,0x00800002,0x00000200,0x00000002,0x00800202,0x00008202,
+		0x00808202,0x00008002,0x00808000,0x00800202,0x00800002,0x00000202,0x00008202,0x00808200,
+		0x00000202,0x00800200,0x00800200,0x00000000,0x00008002,0x00008200,0x00000000,0x00808002
+	},
+	{
+		0x40084010,0x40004000,0x00004000,0x00084010,0x00080000,0x00000010,0x40080010,0x40004010,
+		0x40000010,0x40084010,0x40084000,0x40000000,0x40004000,0x00080000,0x00000010,0x40080010,
+		0x00084000,0x00080010,0x40004010,0x00000000,0x40000000,0x00004000,0x00084010,0x40080000,
+		0x00080010,0x40000010,0x00000000,0x00084000,0x00004010,0x40084000,0x40080000,0x00004010,
+		0x00000000,0x00084010,0x40080010,0x00080000,0x40004010,0x40080000,0x40084000,0x00004000,
+		0x40080000,0x40004000,0x00000010,0x40084010,0x00084010,0x00000010,0x00004000,0x40000000,
+		0x00004010,0x40084000,0x00080000,0x40000010,0x00080010,0x40004010,0x40000010,0x00080010,
+		0x00084000,0x00000000,0x40004000,0x00004010,0x40000000,0x40080010,0x40084010,0x00084000
+	},
+	{
+		0x00000104,0x04010100,0x00000000,0x04010004,0x04000100,0x00000000,0x00010104,0x04000100,
+		0x00010004,0x04000004,0x04000004,0x00010000,0x04010104,0x00010004,0x04010000,0x00000104,
+		0x04000000,0x00000004,0x04010100,0x00000100,0x00010100,0x04010000,0x04010004,0x00010104,
+		0x04000104,0x00010100,0x00010000,0x04000104,0x00000004,0x04010104,0x00000100,0x04000000,
+		0x04010100,0x04000000,0x00010004,0x00000104,0x00010000,0x04010100,0x04000100,0x00000000,
+		0x00000100,0x00010004,0x04010104,0x04000100,0x04000004,0x00000100,0x00000000,0x04010004,
+		0x04000104,0x00010000,0x04000000,0x04010104,0x00000004,0x00010104,0x00010100,0x04000004,
+		0x04010000,0x04000104,0x00000104,0x04010000,0x00010104,0x00000004,0x04010004,0x00010100
+	},
+	{
+		0x80401000,0x80001040,0x80001040,0x00000040,0x00401040,0x80400040,0x80400000,0x80001000,
+		0x00000000,0x00401000,0x00401000,0x80401040,0x80000040,0x00000000,0x00400040,0x80400000,
+		0x80000000,0x00001000,0x00400000,0x80401000,0x00000040,0x00400000,0x80001000,0x00001040,
+		0x80400040,0x80000000,0x00001040,0x00400040,0x00001000,0x00401040,0x80401040,0x80000040,
+		0x00400040,0x80400000,0x00401000,0x80401040,0x80000040,0x00000000,0x00000000,0x00401000,
+		0x00001040,0x00400040,0x80400040,0x80000000,0x80401000,0x80001040,0x80001040,0x00000040,
+		0x80401040,0x80000040,0x80000000,0x00001000,0x80400000,0x80001000,0x00401040,0x80400040,
+		0x80001000,0x00001040,0x00400000,0x80401000,0x00000040,0x00400000,0x00001000,0x00401040
+	},
+	{
+		0x00000080,0x01040080,0x01040000,0x21000080,0x00040000,0x00000080,0x20000000,0x01040000,
+		0x20040080,0x00040000,0x01000080,0x20040080,0x21000080,0x21040000,0x00040080,0x20000000,
+		0x01000000,0x20040000,0x20040000,0x00000000,0x20000080,0x21040080,0x21040080,0x01000080,
+		0x21040000,0x20000080,0x00000000,0x21000000,0x01040080,0x01000000,0x21000000,0x00040080,
+		0x00040000,0x21000080,0x00000080,0x01000000,0x20000000,0x01040000,0x21000080,0x20040080,
+		0x01000080,0x20000000,0x21040000,0x01040080,0x20040080,0x00000080,0x01000000,0x21040000,
+		0x21040080,0x00040080,0x21000000,0x21040080,0x01040000,0x00000000,0x20040000,0x21000000,
+		0x00040080,0x01000080,0x20000080,0x00040000,0x00000000,0x20040000,0x01040080,0x20000080
+	},
+	{
+		0x10000008,0x10200000,0x00002000,0x10202008,0x10200000,0x00000008,0x10202008,0x00200000,
+		0x10002000,0x00202008,0x00200000,0x10000008,0x00200008,0x10002000,0x10000000,0x00002008,
+		0x00000000,0x00200008,0x10002008,0x00002000,0x00202000,0x10002008,0x00000008,0x10200008,
+		0x10200008,0x00000000,0x00202008,0x10202000,0x00002008,0x00202000,0x10202000,0x10000000,
+		0x10002000,0x00000008,0x10200008,0x00202000,0x10202008,0x00200000,0x00002008,0x10000008,
+		0x00200000,0x10002000,0x10000000,0x00002008,0x10000008,0x10202008,0x00202000,0x10200000,
+		0x00202008,0x10202000,0x00000000,0x10200008,0x00000008,0x00002000,0x10200000,0x00202008,
+		0x00002000,0x00200008,0x10002008,0x00000000,0x10202000,0x10000000,0x00200008,0x10002008
+	},
+	{
+		0x00100000,0x02100001,0x02000401,0x00000000,0x00000400,0x02000401,0x00100401,0x02100400,
+		0x02100401,0x00100000,0x00000000,0x02000001,0x00000001,0x02000000,0x02100001,0x00000401,
+		0x02000400,0x00100401,0x00100001,0x02000400,0x02000001,0x02100000,0x02100400,0x00100001,
+		0x02100000,0x00000400,0x00000401,0x02100401,0x00100400,0x00000001,0x02000000,0x00100400,
+		0x02000000,0x00100400,0x00100000,0x02000401,0x02000401,0x02100001,0x02100001,0x00000001,
+		0x00100001,0x02000000,0x02000400,0x00100000,0x02100400,0x00000401,0x00100401,0x02100400,
+		0x00000401,0x02000001,0x02100401,0x02100000,0x00100400,0x00000000,0x00000001,0x02100401,
+		0x00000000,0x00100401,0x02100000,0x00000400,0x02000001,0x02000400,0x00000400,0x00100001
+	},
+	{
+		0x08000820,0x00000800,0x00020000,0x08020820,0x08000000,0x08000820,0x00000020,0x08000000,
+		0x00020020,0x08020000,0x08020820,0x00020800,0x08020800,0x00020820,0x00000800,0x00000020,
+		0x08020000,0x08000020,0x08000800,0x00000820,0x00020800,0x00020020,0x08020020,0x08020800,
+		0x00000820,0x00000000,0x00000000,0x08020020,0x08000020,0x08000800,0x00020820,0x00020000,
+		0x00020820,0x00020000,0x08020800,0x00000800,0x00000020,0x08020020,0x00000800,0x00020820,
+		0x08000800,0x00000020,0x08000020,0x08020000,0x08020020,0x08000000,0x00020000,0x08000820,
+		0x00000000,0x08020820,0x00020020,0x08000020,0x08020000,0x08000800,0x08000820,0x00000000,
+		0x08020820,0x00020800,0x00020800,0x00000820,0x00000820,0x00020020,0x08000000,0x08020800
+	}
+};
+
+// PC-1 and PC-2 split by key nibble. des_pc1_c/d give each key nibble's
+// contribution to C and D (28 bits each, first bit at bit 27), and des_pc2
+// gives each C or D nibble's contribution to the two compact subkey words.
+static const WORD des_pc1_c[16][16] = {
+	{
+		0x00000000,0x00000000,0x00000010,0x00000010,0x00001000,0x00001000,0x00001010,0x00001010,
+		0x00100000,0x00100000,0x00100010,0x00100010,0x00101000,0x00101000,0x00101010,0x00101010
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000000,0x00000020,0x00000020,0x00002000,0x00002000,0x00002020,0x00002020,
+		0x00200000,0x00200000,0x00200020,0x00200020,0x00202000,0x00202000,0x00202020,0x00202020
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000000,0x00000040,0x00000040,0x00004000,0x00004000,0x00004040,0x00004040,
+		0x00400000,0x00400000,0x00400040,0x00400040,0x00404000,0x00404000,0x00404040,0x00404040
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000000,0x00000080,0x00000080,0x00008000,0x00008000,0x00008080,0x00008080,
+		0x00800000,0x00800000,0x00800080,0x00800080,0x00808000,0x00808000,0x00808080,0x00808080
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000001,0x00000100,0x00000101,0x00010000,0x00010001,0x00010100,0x00010101,
+		0x01000000,0x01000001,0x01000100,0x01000101,0x01010000,0x01010001,0x01010100,0x01010101
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000002,0x00000200,0x00000202,0x00020000,0x00020002,0x00020200,0x00020202,
+		0x02000000,0x02000002,0x02000200,0x02000202,0x02020000,0x02020002,0x02020200,0x02020202
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000004,0x00000400,0x00000404,0x00040000,0x00040004,0x00040400,0x00040404,
+		0x04000000,0x04000004,0x04000400,0x04000404,0x04040000,0x04040004,0x04040400,0x04040404
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000008,0x00000800,0x00000808,0x00080000,0x00080008,0x00080800,0x00080808,
+		0x08000000,0x08000008,0x08000800,0x08000808,0x08080000,0x08080008,0x08080800,0x08080808
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	}
+};
+
+static const WORD des_pc1_d[16][16] = {
+	{
+		0x00000000,0x00000001,0x00000000,0x00000001,0x00000000,0x00000001,0x00000000,0x00000001,
+		0x00000000,0x00000001,0x00000000,0x00000001,0x00000000,0x00000001,0x00000000,0x00000001
+	},
+	{
+		0x00000000,0x00000000,0x00100000,0x00100000,0x00001000,0x00001000,0x00101000,0x00101000,
+		0x00000010,0x00000010,0x00100010,0x00100010,0x00001010,0x00001010,0x00101010,0x00101010
+	},
+	{
+		0x00000000,0x00000002,0x00000000,0x00000002,0x00000000,0x00000002,0x00000000,0x00000002,
+		0x00000000,0x00000002,0x00000000,0x00000002,0x00000000,0x00000002,0x00000000,0x00000002
+	},
+	{
+		0x00000000,0x00000000,0x00200000,0x00200000,0x00002000,0x00002000,0x00202000,0x00202000,
+		0x00000020,0x00000020,0x00200020,0x00200020,0x00002020,0x00002020,0x00202020,0x00202020
+	},
+	{
+		0x00000000,0x00000004,0x00000000,0x00000004,0x00000000,0x00000004,0x00000000,0x00000004,
+		0x00000000,0x00000004,0x00000000,0x00000004,0x00000000,0x00000004,0x00000000,0x00000004
+	},
+	{
+		0x00000000,0x00000000,0x00400000,0x00400000,0x00004000,0x00004000,0x00404000,0x00404000,
+		0x00000040,0x00000040,0x00400040,0x00400040,0x00004040,0x00004040,0x00404040,0x00404040
+	},
+	{
+		0x00000000,0x00000008,0x00000000,0x00000008,0x00000000,0x00000008,0x00000000,0x00000008,
+		0x00000000,0x00000008,0x00000000,0x00000008,0x00000000,0x00000008,0x00000000,0x00000008
+	},
+	{
+		0x00000000,0x00000000,0x00800000,0x00800000,0x00008000,0x00008000,0x00808000,0x00808000,
+		0x00000080,0x00000080,0x00800080,0x00800080,0x00008080,0x00008080,0x00808080,0x00808080
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000000,0x01000000,0x01000000,0x00010000,0x00010000,0x01010000,0x01010000,
+		0x00000100,0x00000100,0x01000100,0x01000100,0x00010100,0x00010100,0x01010100,0x01010100
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000000,0x02000000,0x02000000,0x00020000,0x00020000,0x02020000,0x02020000,
+		0x00000200,0x00000200,0x02000200,0x02000200,0x00020200,0x00020200,0x02020200,0x02020200
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000000,0x04000000,0x04000000,0x00040000,0x00040000,0x04040000,0x04040000,
+		0x00000400,0x00000400,0x04000400,0x04000400,0x00040400,0x00040400,0x04040400,0x04040400
+	},
+	{
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,
+		0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000,0x00000000
+	},
+	{
+		0x00000000,0x00000000,0x08000000,0x08000000,0x00080000,0x00080000,0x08080000,0x08080000,
+		0x00000800,0x00000800,0x08000800,0x08000800,0x00080800,0x00080800,0x08080800,0x08080800
+	}
+};
+
+static const WORD des_pc2[14][16][2] = {
+	{
+		{0x00000000,0x00000000},{0x00040000,0x00000000},{0x00000000,0x20000000},{0x00040000,0x20000000},
+		{0x00000000,0x00010000},{0x00040000,0x00010000},{0x00000000,0x20010000},{0x00040000,0x20010000},
+		{0x02000000,0x00000000},{0x02040000,0x00000000},{0x02000000,0x20000000},{0x02040000,0x20000000},
+		{0x02000000,0x00010000},{0x02040000,0x00010000},{0x02000000,0x20010000},{0x02040000,0x20010000}
+	},
+	{
+		{0x00000000,0x00000000},{0x00010000,0x00000000},{0x00000000,0x00100000},{0x00010000,0x00100000},
+		{0x00000000,0x04000000},{0x00010000,0x04000000},{0x00000000,0x04100000},{0x00010000,0x04100000},
+		{0x01000000,0x00000000},{0x01010000,0x00000000},{0x01000000,0x00100000},{0x01010000,0x00100000},
+		{0x01000000,0x04000000},{0x01010000,0x04000000},{0x01000000,0x04100000},{0x01010000,0x04100000}
+	},
+	{
+		{0x00000000,0x00000000},{0x00080000,0x00000000},{0x08000000,0x00000000},{0x08080000,0x00000000},
+		{0x00000000,0x01000000},{0x00080000,0x01000000},{0x08000000,0x01000000},{0x08080000,0x01000000},
+		{0x00000000,0x00000000},{0x00080000,0x00000000},{0x08000000,0x00000000},{0x08080000,0x00000000},
+		{0x00000000,0x01000000},{0x00080000,0x01000000},{0x08000000,0x01000000},{0x08080000,0x01000000}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000000,0x00200000},{0x00000000,0x08000000},{0x00000000,0x08200000},
+		{0x20000000,0x00000000},{0x20000000,0x00200000},{0x20000000,0x08000000},{0x20000000,0x08200000},
+		{0x00000000,0x00020000},{0x00000000,0x00220000},{0x00000000,0x08020000},{0x00000000,0x08220000},
+		{0x20000000,0x00020000},{0x20000000,0x00220000},{0x20000000,0x08020000},{0x20000000,0x08220000}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000000,0x00040000},{0x00100000,0x00000000},{0x00100000,0x00040000},
+		{0x00000000,0x00000000},{0x00000000,0x00040000},{0x00100000,0x00000000},{0x00100000,0x00040000},
+		{0x10000000,0x00000000},{0x10000000,0x00040000},{0x10100000,0x00000000},{0x10100000,0x00040000},
+		{0x10000000,0x00000000},{0x10000000,0x00040000},{0x10100000,0x00000000},{0x10100000,0x00040000}
+	},
+	{
+		{0x00000000,0x00000000},{0x04000000,0x00000000},{0x00200000,0x00000000},{0x04200000,0x00000000},
+		{0x00000000,0x00000000},{0x04000000,0x00000000},{0x00200000,0x00000000},{0x04200000,0x00000000},
+		{0x00000000,0x02000000},{0x04000000,0x02000000},{0x00200000,0x02000000},{0x04200000,0x02000000},
+		{0x00000000,0x02000000},{0x04000000,0x02000000},{0x00200000,0x02000000},{0x04200000,0x02000000}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000000,0x10000000},{0x00000000,0x00080000},{0x00000000,0x10080000},
+		{0x00020000,0x00000000},{0x00020000,0x10000000},{0x00020000,0x00080000},{0x00020000,0x10080000},
+		{0x00000000,0x00000000},{0x00000000,0x10000000},{0x00000000,0x00080000},{0x00000000,0x10080000},
+		{0x00020000,0x00000000},{0x00020000,0x10000000},{0x00020000,0x00080000},{0x00020000,0x10080000}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000000,0x00000001},{0x00000800,0x00000000},{0x00000800,0x00000001},
+		{0x00000000,0x00002000},{0x00000000,0x00002001},{0x00000800,0x00002000},{0x00000800,0x00002001},
+		{0x00000000,0x00000002},{0x00000000,0x00000003},{0x00000800,0x00000002},{0x00000800,0x00000003},
+		{0x00000000,0x00002002},{0x00000000,0x00002003},{0x00000800,0x00002002},{0x00000800,0x00002003}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000000,0x00000004},{0x00000000,0x00000000},{0x00000000,0x00000004},
+		{0x00000002,0x00000000},{0x00000002,0x00000004},{0x00000002,0x00000000},{0x00000002,0x00000004},
+		{0x00000000,0x00000200},{0x00000000,0x00000204},{0x00000000,0x00000200},{0x00000000,0x00000204},
+		{0x00000002,0x00000200},{0x00000002,0x00000204},{0x00000002,0x00000200},{0x00000002,0x00000204}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000000,0x00001000},{0x00000008,0x00000000},{0x00000008,0x00001000},
+		{0x00000000,0x00000000},{0x00000000,0x00001000},{0x00000008,0x00000000},{0x00000008,0x00001000},
+		{0x00000400,0x00000000},{0x00000400,0x00001000},{0x00000408,0x00000000},{0x00000408,0x00001000},
+		{0x00000400,0x00000000},{0x00000400,0x00001000},{0x00000408,0x00000000},{0x00000408,0x00001000}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000020,0x00000000},{0x00000000,0x00000000},{0x00000020,0x00000000},
+		{0x00000000,0x00000010},{0x00000020,0x00000010},{0x00000000,0x00000010},{0x00000020,0x00000010},
+		{0x00002000,0x00000000},{0x00002020,0x00000000},{0x00002000,0x00000000},{0x00002020,0x00000000},
+		{0x00002000,0x00000010},{0x00002020,0x00000010},{0x00002000,0x00000010},{0x00002020,0x00000010}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000000,0x00000100},{0x00000200,0x00000000},{0x00000200,0x00000100},
+		{0x00000000,0x00000020},{0x00000000,0x00000120},{0x00000200,0x00000020},{0x00000200,0x00000120},
+		{0x00000000,0x00000400},{0x00000000,0x00000500},{0x00000200,0x00000400},{0x00000200,0x00000500},
+		{0x00000000,0x00000420},{0x00000000,0x00000520},{0x00000200,0x00000420},{0x00000200,0x00000520}
+	},
+	{
+		{0x00000000,0x00000000},{0x00001000,0x00000000},{0x00000000,0x00000800},{0x00001000,0x00000800},
+		{0x00000000,0x00000008},{0x00001000,0x00000008},{0x00000000,0x00000808},{0x00001000,0x00000808},
+		{0x00000010,0x00000000},{0x00001010,0x00000000},{0x00000010,0x00000800},{0x00001010,0x00000800},
+		{0x00000010,0x00000008},{0x00001010,0x00000008},{0x00000010,0x00000808},{0x00001010,0x00000808}
+	},
+	{
+		{0x00000000,0x00000000},{0x00000004,0x00000000},{0x00000100,0x00000000},{0x00000104,0x00000000},
+		{0x00000000,0x00000000},{0x00000004,0x00000000},{0x00000100,0x00000000},{0x00000104,0x00000000},
+		{0x00000001,0x00000000},{0x00000005,0x00000000},{0x00000101,0x00000000},{0x00000105,0x00000000},
+		{0x00000001,0x00000000},{0x00000005,0x00000000},{0x00000101,0x00000000},{0x00000105,0x00000000}
+	}
+};
+
+// Initial permutation as 0-based source bit indices, used by the bitsliced
+// engine, where permuting bits only means renaming slices.
+static const BYTE des_ip[64] = {
+	57,49,41,33,25,17, 9, 1,59,51,43,35,27,19,11, 3,
+	61,53,45,37,29,21,13, 5,63,55,47,39,31,23,15, 7,
+	56,48,40,32,24,16, 8, 0,58,50,42,34,26,18,10, 2,
+	60,52,44,36,28,20,12, 4,62,54,46,38,30,22,14, 6
+};
+
 /*********************** FUNCTION DEFINITIONS ***********************/
 // Initial (Inv)Permutation step
+// Both permutations are done with five word-level delta swaps on the
+// big-endian halves of the block rather than bit-by-bit.
 void IP(WORD state[], const BYTE in[])
 {
-	state[0] = BITNUM(in,57,31) | BITNUM(in,49,30) | BITNUM(in,41,29) | BITNUM(in,33,28) |
-				  BITNUM(in,25,27) | BITNUM(in,17,26) | BITNUM(in,9,25) | BITNUM(in,1,24) |
-				  BITNUM(in,59,23) | BITNUM(in,51,22) | BITNUM(in,43,21) | BITNUM(in,35,20) |
-				  BITNUM(in,27,19) | BITNUM(in,19,18) | BITNUM(in,11,17) | BITNUM(in,3,16) |
-				  BITNUM(in,61,15) | BITNUM(in,53,14) | BITNUM(in,45,13) | BITNUM(in,37,12) |
-				  BITNUM(in,29,11) | BITNUM(in,21,10) | BITNUM(in,13,9) | BITNUM(in,5,8) |
-				  BITNUM(in,63,7) | BITNUM(in,55,6) | BITNUM(in,47,5) | BITNUM(in,39,4) |
-				  BITNUM(in,31,3) | BITNUM(in,23,2) | BITNUM(in,15,1) | BITNUM(in,7,0);
-
-	state[1] = BITNUM(in,56,31) | BITNUM(in,48,30) | BITNUM(in,40,29) | BITNUM(in,32,28) |
-				  BITNUM(in,24,27) | BITNUM(in,16,26) | BITNUM(in,8,25) | BITNUM(in,0,24) |
-				  BITNUM(in,58,23) | BITNUM(in,50,22) | BITNUM(in,42,21) | BITNUM(in,34,20) |
-				  BITNUM(in,26,19) | BITNUM(in,18,18) | BITNUM(in,10,17) | BITNUM(in,2,16) |
-				  BITNUM(in,60,15) | BITNUM(in,52,14) | BITNUM(in,44,13) | BITNUM(in,36,12) |
-				  BITNUM(in,28,11) | BITNUM(in,20,10) | BITNUM(in,12,9) | BITNUM(in,4,8) |
-				  BITNUM(in,62,7) | BITNUM(in,54,6) | BITNUM(in,46,5) | BITNUM(in,38,4) |
-				  BITNUM(in,30,3) | BITNUM(in,22,2) | BITNUM(in,14,1) | BITNUM(in,6,0);
+	WORD l, r, t;
+
+	LOAD_HALVES(in,l,r);
+	IP_SWAPS(l,r,t);
+	state[0] = l;
+	state[1] = r;
 }
 
 void InvIP(WORD state[], BYTE in[])
 {
-	in[0] = BITNUMINTR(state[1],7,7) | BITNUMINTR(state[0],7,6) | BITNUMINTR(state[1],15,5) |
-			  BITNUMINTR(state[0],15,4) | BITNUMINTR(state[1],23,3) | BITNUMINTR(state[0],23,2) |
-			  BITNUMINTR(state[1],31,1) | BITNUMINTR(state[0],31,0);
+	WORD l, r, t;
 
-	in[1] = BITNUMINTR(state[1],6,7) | BITNUMINTR(state[0],6,6) | BITNUMINTR(state[1],14,5) |
-			  BITNUMINTR(state[0],14,4) | BITNUMINTR(state[1],22,3) | BITNUMINTR(state[0],22,2) |
-			  BITNUMINTR(state[1],30,1) | BITNUMINTR(state[0],30,0);
-
-	in[2] = BITNUMINTR(state[1],5,7) | BITNUMINTR(state[0],5,6) | BITNUMINTR(state[1],13,5) |
-			  BITNUMINTR(state[0],13,4) | BITNUMINTR(state[1],21,3) | BITNUMINTR(state[0],21,2) |
-			  BITNUMINTR(state[1],29,1) | BITNUMINTR(state[0],29,0);
-
-	in[3] = BITNUMINTR(state[1],4,7) | BITNUMINTR(state[0],4,6) | BITNUMINTR(state[1],12,5) |
-			  BITNUMINTR(state[0],12,4) | BITNUMINTR(state[1],20,3) | BITNUMINTR(state[0],20,2) |
-			  BITNUMINTR(state[1],28,1) | BITNUMINTR(state[0],28,0);
-
-	in[4] = BITNUMINTR(state[1],3,7) | BITNUMINTR(state[0],3,6) | BITNUMINTR(state[1],11,5) |
-			  BITNUMINTR(state[0],11,4) | BITNUMINTR(state[1],19,3) | BITNUMINTR(state[0],19,2) |
-			  BITNUMINTR(state[1],27,1) | BITNUMINTR(state[0],27,0);
-
-	in[5] = BITNUMINTR(state[1],2,7) | BITNUMINTR(state[0],2,6) | BITNUMINTR(state[1],10,5) |
-			  BITNUMINTR(state[0],10,4) | BITNUMINTR(state[1],18,3) | BITNUMINTR(state[0],18,2) |
-			  BITNUMINTR(state[1],26,1) | BITNUMINTR(state[0],26,0);
-
-	in[6] = BITNUMINTR(state[1],1,7) | BITNUMINTR(state[0],1,6) | BITNUMINTR(state[1],9,5) |
-			  BITNUMINTR(state[0],9,4) | BITNUMINTR(state[1],17,3) | BITNUMINTR(state[0],17,2) |
-			  BITNUMINTR(state[1],25,1) | BITNUMINTR(state[0],25,0);
-
-	in[7] = BITNUMINTR(state[1],0,7) | BITNUMINTR(state[0],0,6) | BITNUMINTR(state[1],8,5) |
-			  BITNUMINTR(state[0],8,4) | BITNUMINTR(state[1],16,3) | BITNUMINTR(state[0],16,2) |
-			  BITNUMINTR(state[1],24,1) | BITNUMINTR(state[0],24,0);
+	l = state[0];
+	r = state[1];
+	FP_SWAPS(l,r,t);
+	STORE_HALVES(in,l,r);
 }
 
 WORD f(WORD state, const BYTE key[])
@@ -235,15 +653,7 @@ void des_crypt(const BYTE in[], BYTE out[], const BYTE key[][6])
 	WORD state[2],idx,t;
 
 	IP(state,in);
-
-	for (idx=0; idx < 15; ++idx) {
-		t = state[1];
-		state[1] = f(state[1],key[idx]) ^ state[0];
-		state[0] = t;
-	}
-	// Perform the final loop manually as it doesn't switch sides
-	state[0] = f(state[1],key[15]) ^ state[0];
-
+	DES_ROUNDS(state[0],state[1],t,idx,key);
 	InvIP(state,out);
 }
 
@@ -261,9 +671,1584 @@ void three_des_key_setup(const BYTE key[], BYTE schedule[][16][6], DES_MODE mode
 	}
 }
 
+// The three DES passes are fused: the FP/IP pairs between passes cancel out,
+// so the halves stay in the IP domain for all 48 rounds. The schedule is
+// the one produced by three_des_key_setup().
 void three_des_crypt(const BYTE in[], BYTE out[], const BYTE key[][16][6])
 {
-	des_crypt(in,out,key[0]);
-	des_crypt(out,out,key[1]);
-	des_crypt(out,out,key[2]);
+	WORD l,r,idx,t;
+
+	LOAD_HALVES(in,l,r);
+	IP_SWAPS(l,r,t);
+	DES_ROUNDS(l,r,t,idx,key[0]);
+	DES_ROUNDS(l,r,t,idx,key[1]);
+	DES_ROUNDS(l,r,t,idx,key[2]);
+	FP_SWAPS(l,r,t);
+	STORE_HALVES(out,l,r);
+}
+
+/*******************
+* DES - Modes
+*******************/
+// The mode functions are shared by DES and 3DES: "key" holds "passes" (1 or 3)
+// chained schedules. Blocks are carried as 32-bit halves between iterations,
+// and where blocks are independent (ECB, CBC decryption, CTR) two of them go
+// through the rounds at once.
+
+// Run the IP-domain halves of one block through the chained schedules.
+#define DES_PASSES(l,r,t,idx,n,key,passes) \
+	for (n = 0; n < (passes); ++n) { \
+		DES_ROUNDS(l,r,t,idx,(key)[n]); \
+	}
+#define DES_PASSES_X2(l0,r0,l1,r1,t0,t1,idx,n,key,passes) \
+	for (n = 0; n < (passes); ++n) { \
+		DES_ROUNDS_X2(l0,r0,l1,r1,t0,t1,idx,(key)[n]); \
+	}
+
+static void des_ecb(const BYTE in[], BYTE out[], size_t blocks, const BYTE key[][16][6], int passes)
+{
+	WORD l0, r0, l1, r1, t0, t1, idx;
+	size_t blk;
+	int n;
+
+	for (blk = 0; blk + 2 <= blocks; blk += 2, in += 2 * DES_BLOCK_SIZE, out += 2 * DES_BLOCK_SIZE) {
+		LOAD_HALVES(in,l0,r0);
+		LOAD_HALVES(in + DES_BLOCK_SIZE,l1,r1);
+		IP_SWAPS(l0,r0,t0);
+		IP_SWAPS(l1,r1,t1);
+		DES_PASSES_X2(l0,r0,l1,r1,t0,t1,idx,n,key,passes);
+		FP_SWAPS(l0,r0,t0);
+		FP_SWAPS(l1,r1,t1);
+		STORE_HALVES(out,l0,r0);
+		STORE_HALVES(out + DES_BLOCK_SIZE,l1,r1);
+	}
+	if (blk < blocks) {
+		LOAD_HALVES(in,l0,r0);
+		IP_SWAPS(l0,r0,t0);
+		DES_PASSES(l0,r0,t0,idx,n,key,passes);
+		FP_SWAPS(l0,r0,t0);
+		STORE_HALVES(out,l0,r0);
+	}
+}
+
+static void des_encrypt_cbc_blocks(const BYTE in[], BYTE out[], size_t blocks, const BYTE key[][16][6],
+                                   int passes, const BYTE iv[])
+{
+	WORD l, r, cl, cr, t, idx;
+	size_t blk;
+	int n;
+
+	LOAD_HALVES(iv,cl,cr);
+	for (blk = 0; blk < blocks; ++blk, in += DES_BLOCK_SIZE, out += DES_BLOCK_SIZE) {
+		LOAD_HALVES(in,l,r);
+		l ^= cl;
+		r ^= cr;
+		IP_SWAPS(l,r,t);
+		DES_PASSES(l,r,t,idx,n,key,passes);
+		FP_SWAPS(l,r,t);
+		cl = l;
+		cr = r;
+		STORE_HALVES(out,l,r);
+	}
+}
+
+static void des_decrypt_cbc_blocks(const BYTE in[], BYTE out[], size_t blocks, const BYTE key[][16][6],
+                                   int passes, const BYTE iv[])
+{
+	WORD l0, r0, l1, r1, c0l, c0r, c1l, c1r, cl, cr, t0, t1, idx;
+	size_t blk;
+	int n;
+
+	// Keep the previous ciphertext in the halves, so in and out may overlap.
+	LOAD_HALVES(iv,cl,cr);
+	for (blk = 0; blk + 2 <= blocks; blk += 2, in += 2 * DES_BLOCK_SIZE, out += 2 * DES_BLOCK_SIZE) {
+		LOAD_HALVES(in,c0l,c0r);
+		LOAD_HALVES(in + DES_BLOCK_SIZE,c1l,c1r);
+		l0 = c0l;
+		r0 = c0r;
+		l1 = c1l;
+		r1 = c1r;
+		IP_SWAPS(l0,r0,t0);
+		IP_SWAPS(l1,r1,t1);
+		DES_PASSES_X2(l0,r0,l1,r1,t0,t1,idx,n,key,passes);
+		FP_SWAPS(l0,r0,t0);
+		FP_SWAPS(l1,r1,t1);
+		l0 ^= cl;
+		r0 ^= cr;
+		l1 ^= c0l;
+		r1 ^= c0r;
+		cl = c1l;
+		cr = c1r;
+		STORE_HALVES(out,l0,r0);
+		STORE_HALVES(out + DES_BLOCK_SIZE,l1,r1);
+	}
+	if (blk < blocks) {
+		LOAD_HALVES(in,l0,r0);
+		IP_SWAPS(l0,r0,t0);
+		DES_PASSES(l0,r0,t0,idx,n,key,passes);
+		FP_SWAPS(l0,r0,t0);
+		l0 ^= cl;
+		r0 ^= cr;
+		STORE_HALVES(out,l0,r0);
+	}
+}
+
+// The whole IV block is treated as a big-endian counter.
+static void des_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], int passes,
+                    const BYTE iv[])
+{
+	WORD hi, lo, l0, r0, l1, r1, t0, t1, idx;
+	BYTE ks[2 * DES_BLOCK_SIZE];
+	size_t pos, k;
+	int n;
+
+	LOAD_HALVES(iv,hi,lo);
+	for (pos = 0; pos < in_len; pos += k) {
+		l0 = hi;
+		r0 = lo;
+		hi += (++lo == 0);
+		l1 = hi;
+		r1 = lo;
+		hi += (++lo == 0);
+		IP_SWAPS(l0,r0,t0);
+		IP_SWAPS(l1,r1,t1);
+		DES_PASSES_X2(l0,r0,l1,r1,t0,t1,idx,n,key,passes);
+		FP_SWAPS(l0,r0,t0);
+		FP_SWAPS(l1,r1,t1);
+		STORE_HALVES(ks,l0,r0);
+		STORE_HALVES(ks + DES_BLOCK_SIZE,l1,r1);
+		for (k = 0; k < sizeof(ks) && pos + k < in_len; ++k)
+			out[pos + k] = in[pos + k] ^ ks[k];
+	}
+}
+
+int des_crypt_ecb(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6])
+{
+	if (in_len % DES_BLOCK_SIZE != 0)
+		return(FALSE);
+	des_ecb(in, out, in_len / DES_BLOCK_SIZE, (const BYTE (*)[16][6])key, 1);
+	return(TRUE);
+}
+
+int des_encrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6], const BYTE iv[])
+{
+	if (in_len % DES_BLOCK_SIZE != 0)
+		return(FALSE);
+	des_encrypt_cbc_blocks(in, out, in_len / DES_BLOCK_SIZE, (const BYTE (*)[16][6])key, 1, iv);
+	return(TRUE);
+}
+
+int des_decrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6], const BYTE iv[])
+{
+	if (in_len % DES_BLOCK_SIZE != 0)
+		return(FALSE);
+	des_decrypt_cbc_blocks(in, out, in_len / DES_BLOCK_SIZE, (const BYTE (*)[16][6])key, 1, iv);
+	return(TRUE);
+}
+
+void des_encrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6], const BYTE iv[])
+{
+	des_ctr(in, in_len, out, (const BYTE (*)[16][6])key, 1, iv);
+}
+
+void des_decrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6], const BYTE iv[])
+{
+	// CTR encryption is its own inverse function.
+	des_encrypt_ctr(in, in_len, out, key, iv);
+}
+
+int three_des_crypt_ecb(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6])
+{
+	if (in_len % DES_BLOCK_SIZE != 0)
+		return(FALSE);
+	des_ecb(in, out, in_len / DES_BLOCK_SIZE, key, 3);
+	return(TRUE);
+}
+
+int three_des_encrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[])
+{
+	if (in_len % DES_BLOCK_SIZE != 0)
+		return(FALSE);
+	des_encrypt_cbc_blocks(in, out, in_len / DES_BLOCK_SIZE, key, 3, iv);
+	return(TRUE);
+}
+
+int three_des_decrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[])
+{
+	if (in_len % DES_BLOCK_SIZE != 0)
+		return(FALSE);
+	des_decrypt_cbc_blocks(in, out, in_len / DES_BLOCK_SIZE, key, 3, iv);
+	return(TRUE);
+}
+
+void three_des_encrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[])
+{
+	des_ctr(in, in_len, out, key, 3, iv);
+}
+
+void three_des_decrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[])
+{
+	// CTR encryption is its own inverse function.
+	three_des_encrypt_ctr(in, in_len, out, key, iv);
+}
+
+/*******************
+* 3DES - Key-agile batch
+*******************/
+// Derives the 16 subkeys of one DES key in the compact form, using the
+// nibble tables for PC-1 and PC-2 instead of moving bits one at a time.
+// The schedule is stored as ks[round][word][lane] so that several keys'
+// schedules sit side by side.
+static void des_compact_key_setup(const BYTE key[], WORD ks[][2][DES_BATCH_LANES], int lane, DES_MODE mode)
+{
+	static const BYTE key_rnd_shift[16] = {1,1,2,2,2,2,2,2,1,2,2,2,2,2,2,1};
+	WORD c, d, k0, k1;
+	int idx, to_gen;
+
+	for (idx = 0, c = 0, d = 0; idx < 8; ++idx) {
+		c |= des_pc1_c[2 * idx][key[idx] >> 4] | des_pc1_c[2 * idx + 1][key[idx] & 0x0f];
+		d |= des_pc1_d[2 * idx][key[idx] >> 4] | des_pc1_d[2 * idx + 1][key[idx] & 0x0f];
+	}
+
+	for (idx = 0; idx < 16; ++idx) {
+		c = ((c << key_rnd_shift[idx]) | (c >> (28 - key_rnd_shift[idx]))) & 0x0fffffff;
+		d = ((d << key_rnd_shift[idx]) | (d >> (28 - key_rnd_shift[idx]))) & 0x0fffffff;
+
+		k0 = des_pc2[0][c >> 24][0] | des_pc2[1][(c >> 20) & 0x0f][0] |
+		     des_pc2[2][(c >> 16) & 0x0f][0] | des_pc2[3][(c >> 12) & 0x0f][0] |
+		     des_pc2[4][(c >> 8) & 0x0f][0] | des_pc2[5][(c >> 4) & 0x0f][0] |
+		     des_pc2[6][c & 0x0f][0] |
+		     des_pc2[7][d >> 24][0] | des_pc2[8][(d >> 20) & 0x0f][0] |
+		     des_pc2[9][(d >> 16) & 0x0f][0] | des_pc2[10][(d >> 12) & 0x0f][0] |
+		     des_pc2[11][(d >> 8) & 0x0f][0] | des_pc2[12][(d >> 4) & 0x0f][0] |
+		     des_pc2[13][d & 0x0f][0];
+		k1 = des_pc2[0][c >> 24][1] | des_pc2[1][(c >> 20) & 0x0f][1] |
+		     des_pc2[2][(c >> 16) & 0x0f][1] | des_pc2[3][(c >> 12) & 0x0f][1] |
+		     des_pc2[4][(c >> 8) & 0x0f][1] | des_pc2[5][(c >> 4) & 0x0f][1] |
+		     des_pc2[6][c & 0x0f][1] |
+		     des_pc2[7][d >> 24][1] | des_pc2[8][(d >> 20) & 0x0f][1] |
+		     des_pc2[9][(d >> 16) & 0x0f][1] | des_pc2[10][(d >> 12) & 0x0f][1] |
+		     des_pc2[11][(d >> 8) & 0x0f][1] | des_pc2[12][(d >> 4) & 0x0f][1] |
+		     des_pc2[13][d & 0x0f][1];
+
+		// Decryption subkeys are reverse order of encryption subkeys.
+		to_gen = (mode == DES_DECRYPT) ? 15 - idx : idx;
+		ks[to_gen][0][lane] = k0;
+		ks[to_gen][1][lane] = k1;
+	}
+}
+
+// Each of the n operations uses its own 24-byte key. Keys are expanded with
+// des_compact_key_setup() and DES_BATCH_LANES blocks go through the rounds
+// together, each with its own schedule.
+void three_des_crypt_batch(const BYTE keys[], const BYTE in[], BYTE out[], size_t n, DES_MODE mode)
+{
+	WORD ks[3][16][2][DES_BATCH_LANES];
+	WORD l[DES_BATCH_LANES], r[DES_BATCH_LANES], t, u, v;
+	const BYTE *key;
+	size_t blk;
+	int lanes, lane, pass, idx;
+
+	for (blk = 0; blk < n; blk += lanes) {
+		lanes = (n - blk < DES_BATCH_LANES) ? (int)(n - blk) : DES_BATCH_LANES;
+
+		// Unused lanes of a short final group repeat the first pair.
+		for (lane = 0; lane < DES_BATCH_LANES; ++lane) {
+			key = &keys[(blk + (lane < lanes ? lane : 0)) * DES_BLOCK_SIZE * 3];
+			if (mode == DES_ENCRYPT) {
+				des_compact_key_setup(&key[0], ks[0], lane, mode);
+				des_compact_key_setup(&key[8], ks[1], lane, !mode);
+				des_compact_key_setup(&key[16], ks[2], lane, mode);
+			}
+			else /*if (mode == DES_DECRYPT*/ {
+				des_compact_key_setup(&key[16], ks[0], lane, mode);
+				des_compact_key_setup(&key[8], ks[1], lane, !mode);
+				des_compact_key_setup(&key[0], ks[2], lane, mode);
+			}
+			LOAD_HALVES(&in[(blk + (lane < lanes ? lane : 0)) * DES_BLOCK_SIZE],l[lane],r[lane]);
+			IP_SWAPS(l[lane],r[lane],t);
+		}
+
+		for (pass = 0; pass < 3; ++pass) {
+			for (idx = 0; idx < 16; ++idx) {
+				for (lane = 0; lane < DES_BATCH_LANES; ++lane) {
+					t = r[lane];
+					r[lane] = l[lane] ^ SP_F(t,ks[pass][idx][0][lane],ks[pass][idx][1][lane],u,v);
+					l[lane] = t;
+				}
+			}
+			// The last round doesn't switch sides.
+			for (lane = 0; lane < DES_BATCH_LANES; ++lane) {
+				t = l[lane];
+				l[lane] = r[lane];
+				r[lane] = t;
+			}
+		}
+
+		for (lane = 0; lane < lanes; ++lane) {
+			FP_SWAPS(l[lane],r[lane],t);
+			STORE_HALVES(&out[(blk + lane) * DES_BLOCK_SIZE],l[lane],r[lane]);
+		}
+	}
+}
+
+/*******************
+* DES - Bitsliced
+*******************/
+// The bitsliced engine stores bit n of every block in slice n, so one pass
+// runs DES_BS_BLOCKS blocks at once. The expansion, P-box and (inverse)
+// initial permutation become plain renaming of slices, and the S-boxes become
+// the boolean circuits below, which were derived from the sbox tables above.
+// All lanes of a pass share one key schedule.
+
+static void des_bs_s1(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67, x68, x69, x70, x71;
+	BS_WORD x72, x73, x74, x75, x76, x77, x78, x79, x80, x81, x82, x83;
+	BS_WORD x84, x85, x86, x87, x88, x89, x90, x91, x92, x93, x94, x95;
+	BS_WORD x96, x97, x98, x99, x100, x101, x102, x103, x104, x105;
+
+	x0 = BS_NOT(a5);
+	x1 = BS_XOR(x0,a2);
+	x2 = BS_NOT(a2);
+	x3 = BS_AND(x2,a3);
+	x4 = BS_XOR(x1,x3);
+	x5 = BS_AND(a5,a3);
+	x6 = BS_XOR(x1,x5);
+	x7 = BS_XOR(x4,x6);
+	x8 = BS_AND(x7,a4);
+	x9 = BS_XOR(x4,x8);
+	x10 = BS_NOT(x4);
+	x11 = BS_AND(x0,a3);
+	x12 = BS_XOR(a2,x11);
+	x13 = BS_XOR(x10,x12);
+	x14 = BS_AND(x13,a4);
+	x15 = BS_XOR(x10,x14);
+	x16 = BS_XOR(x9,x15);
+	x17 = BS_AND(x16,a6);
+	x18 = BS_XOR(x9,x17);
+	x19 = BS_AND(a5,a2);
+	x20 = BS_NOT(x19);
+	x21 = BS_XOR(x20,x11);
+	x22 = BS_XOR(x12,x21);
+	x23 = BS_AND(x22,a4);
+	x24 = BS_XOR(x12,x23);
+	x25 = BS_NOT(x1);
+	x26 = BS_XOR(x22,x25);
+	x27 = BS_AND(x26,a3);
+	x28 = BS_XOR(x22,x27);
+	x29 = BS_XOR(x1,x19);
+	x30 = BS_AND(x29,a3);
+	x31 = BS_XOR(x1,x30);
+	x32 = BS_XOR(x28,x31);
+	x33 = BS_AND(x32,a4);
+	x34 = BS_XOR(x28,x33);
+	x35 = BS_XOR(x24,x34);
+	x36 = BS_AND(x35,a6);
+	x37 = BS_XOR(x24,x36);
+	x38 = BS_XOR(x18,x37);
+	x39 = BS_AND(x38,a1);
+	x40 = BS_XOR(x18,x39);
+	x41 = BS_NOT(x12);
+	x42 = BS_NOT(x29);
+	x43 = BS_AND(x42,a4);
+	x44 = BS_XOR(x41,x43);
+	x45 = BS_XOR(a5,x3);
+	x46 = BS_AND(x25,a3);
+	x47 = BS_XOR(x20,x46);
+	x48 = BS_XOR(x45,x47);
+	x49 = BS_AND(x48,a4);
+	x50 = BS_XOR(x45,x49);
+	x51 = BS_XOR(x44,x50);
+	x52 = BS_AND(x51,a6);
+	x53 = BS_XOR(x44,x52);
+	x54 = BS_AND(x42,a3);
+	x55 = BS_XOR(x26,x54);
+	x56 = BS_XOR(x1,x27);
+	x57 = BS_XOR(x55,x56);
+	x58 = BS_AND(x57,a4);
+	x59 = BS_XOR(x55,x58);
+	x60 = BS_XOR(x47,a4);
+	x61 = BS_XOR(x59,x60);
+	x62 = BS_AND(x61,a6);
+	x63 = BS_XOR(x59,x62);
+	x64 = BS_XOR(x53,x63);
+	x65 = BS_AND(x64,a1);
+	x66 = BS_XOR(x53,x65);
+	x67 = BS_AND(x4,a4);
+	x68 = BS_XOR(x55,x67);
+	x69 = BS_XOR(x42,x27);
+	x70 = BS_AND(x20,a4);
+	x71 = BS_XOR(x69,x70);
+	x72 = BS_XOR(x68,x71);
+	x73 = BS_AND(x72,a6);
+	x74 = BS_XOR(x68,x73);
+	x75 = BS_NOT(x22);
+	x76 = BS_XOR(x75,x5);
+	x77 = BS_AND(x26,a4);
+	x78 = BS_XOR(x76,x77);
+	x79 = BS_AND(x21,a4);
+	x80 = BS_XOR(x56,x79);
+	x81 = BS_XOR(x78,x80);
+	x82 = BS_AND(x81,a6);
+	x83 = BS_XOR(x78,x82);
+	x84 = BS_XOR(x74,x83);
+	x85 = BS_AND(x84,a1);
+	x86 = BS_XOR(x74,x85);
+	x87 = BS_XOR(x76,x70);
+	x88 = BS_NOT(x55);
+	x89 = BS_XOR(x88,x23);
+	x90 = BS_XOR(x87,x89);
+	x91 = BS_AND(x90,a6);
+	x92 = BS_XOR(x87,x91);
+	x93 = BS_XOR(a2,x5);
+	x94 = BS_XOR(x10,x93);
+	x95 = BS_AND(x94,a4);
+	x96 = BS_XOR(x10,x95);
+	x97 = BS_XOR(x26,a3);
+	x98 = BS_AND(x1,a4);
+	x99 = BS_XOR(x97,x98);
+	x100 = BS_XOR(x96,x99);
+	x101 = BS_AND(x100,a6);
+	x102 = BS_XOR(x96,x101);
+	x103 = BS_XOR(x92,x102);
+	x104 = BS_AND(x103,a1);
+	x105 = BS_XOR(x92,x104);
+
+	*out1 = BS_XOR(*out1,x40);
+	*out2 = BS_XOR(*out2,x66);
+	*out3 = BS_XOR(*out3,x86);
+	*out4 = BS_XOR(*out4,x105);
+}
+
+static void des_bs_s2(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67, x68, x69, x70, x71;
+	BS_WORD x72, x73, x74, x75, x76, x77, x78, x79, x80, x81, x82, x83;
+	BS_WORD x84, x85, x86, x87, x88, x89, x90, x91, x92, x93, x94, x95;
+
+	x0 = BS_NOT(a5);
+	x1 = BS_OR(x0,a3);
+	x2 = BS_XOR(a5,a3);
+	x3 = BS_AND(a3,a6);
+	x4 = BS_XOR(x2,x3);
+	x5 = BS_XOR(x1,x4);
+	x6 = BS_AND(x5,a4);
+	x7 = BS_XOR(x1,x6);
+	x8 = BS_AND(a5,a6);
+	x9 = BS_XOR(x2,x8);
+	x10 = BS_AND(x0,a4);
+	x11 = BS_XOR(x9,x10);
+	x12 = BS_XOR(x7,x11);
+	x13 = BS_AND(x12,a1);
+	x14 = BS_XOR(x7,x13);
+	x15 = BS_NOT(x1);
+	x16 = BS_AND(x2,a6);
+	x17 = BS_XOR(x15,x16);
+	x18 = BS_NOT(x2);
+	x19 = BS_XOR(x18,a6);
+	x20 = BS_XOR(x17,x19);
+	x21 = BS_AND(x20,a4);
+	x22 = BS_XOR(x17,x21);
+	x23 = BS_AND(a5,a3);
+	x24 = BS_NOT(a3);
+	x25 = BS_XOR(x23,x24);
+	x26 = BS_AND(x25,a6);
+	x27 = BS_XOR(x23,x26);
+	x28 = BS_AND(x2,a4);
+	x29 = BS_XOR(x27,x28);
+	x30 = BS_XOR(x22,x29);
+	x31 = BS_AND(x30,a1);
+	x32 = BS_XOR(x22,x31);
+	x33 = BS_XOR(x14,x32);
+	x34 = BS_AND(x33,a2);
+	x35 = BS_XOR(x14,x34);
+	x36 = BS_NOT(x8);
+	x37 = BS_AND(x36,a4);
+	x38 = BS_XOR(x5,x37);
+	x39 = BS_AND(x1,a6);
+	x40 = BS_XOR(x39,a4);
+	x41 = BS_XOR(x38,x40);
+	x42 = BS_AND(x41,a1);
+	x43 = BS_XOR(x38,x42);
+	x44 = BS_XOR(x24,x26);
+	x45 = BS_XOR(x44,x10);
+	x46 = BS_NOT(x25);
+	x47 = BS_AND(x46,a6);
+	x48 = BS_XOR(x1,x47);
+	x49 = BS_XOR(x23,x18);
+	x50 = BS_AND(x49,a6);
+	x51 = BS_XOR(x23,x50);
+	x52 = BS_XOR(x48,x51);
+	x53 = BS_AND(x52,a4);
+	x54 = BS_XOR(x48,x53);
+	x55 = BS_XOR(x45,x54);
+	x56 = BS_AND(x55,a1);
+	x57 = BS_XOR(x45,x56);
+	x58 = BS_XOR(x43,x57);
+	x59 = BS_AND(x58,a2);
+	x60 = BS_XOR(x43,x59);
+	x61 = BS_AND(a5,a4);
+	x62 = BS_XOR(x19,x61);
+	x63 = BS_XOR(x2,x39);
+	x64 = BS_AND(x8,a4);
+	x65 = BS_XOR(x63,x64);
+	x66 = BS_XOR(x62,x65);
+	x67 = BS_AND(x66,a1);
+	x68 = BS_XOR(x62,x67);
+	x69 = BS_XOR(x0,x3);
+	x70 = BS_XOR(x69,a4);
+	x71 = BS_AND(x44,a1);
+	x72 = BS_XOR(x70,x71);
+	x73 = BS_XOR(x68,x72);
+	x74 = BS_AND(x73,a2);
+	x75 = BS_XOR(x68,x74);
+	x76 = BS_AND(x24,a6);
+	x77 = BS_XOR(x0,x76);
+	x78 = BS_XOR(a5,x50);
+	x79 = BS_XOR(x77,x78);
+	x80 = BS_AND(x79,a4);
+	x81 = BS_XOR(x77,x80);
+	x82 = BS_XOR(x81,a1);
+	x83 = BS_XOR(x2,x76);
+	x84 = BS_AND(x39,a4);
+	x85 = BS_XOR(x83,x84);
+	x86 = BS_XOR(x49,x26);
+	x87 = BS_XOR(x86,x5);
+	x88 = BS_AND(x87,a4);
+	x89 = BS_XOR(x86,x88);
+	x90 = BS_XOR(x85,x89);
+	x91 = BS_AND(x90,a1);
+	x92 = BS_XOR(x85,x91);
+	x93 = BS_XOR(x82,x92);
+	x94 = BS_AND(x93,a2);
+	x95 = BS_XOR(x82,x94);
+
+	*out1 = BS_XOR(*out1,x75);
+	*out2 = BS_XOR(*out2,x95);
+	*out3 = BS_XOR(*out3,x35);
+	*out4 = BS_XOR(*out4,x60);
+}
+
+static void des_bs_s3(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67, x68, x69, x70, x71;
+	BS_WORD x72, x73, x74, x75, x76, x77, x78, x79, x80, x81, x82, x83;
+	BS_WORD x84, x85, x86, x87, x88, x89, x90, x91, x92, x93, x94, x95;
+	BS_WORD x96, x97, x98, x99;
+
+	x0 = BS_NOT(a5);
+	x1 = BS_XOR(x0,a2);
+	x2 = BS_NOT(a6);
+	x3 = BS_AND(x2,a5);
+	x4 = BS_NOT(x3);
+	x5 = BS_AND(x4,a2);
+	x6 = BS_XOR(x1,x5);
+	x7 = BS_AND(x6,a3);
+	x8 = BS_XOR(x1,x7);
+	x9 = BS_OR(x2,a5);
+	x10 = BS_AND(x3,a2);
+	x11 = BS_XOR(x9,x10);
+	x12 = BS_XOR(x2,a5);
+	x13 = BS_XOR(x12,a2);
+	x14 = BS_XOR(x11,x13);
+	x15 = BS_AND(x14,a3);
+	x16 = BS_XOR(x11,x15);
+	x17 = BS_XOR(x8,x16);
+	x18 = BS_AND(x17,a4);
+	x19 = BS_XOR(x8,x18);
+	x20 = BS_XOR(x12,x15);
+	x21 = BS_XOR(x20,a4);
+	x22 = BS_XOR(x19,x21);
+	x23 = BS_AND(x22,a1);
+	x24 = BS_XOR(x19,x23);
+	x25 = BS_XOR(x12,x5);
+	x26 = BS_AND(a6,a5);
+	x27 = BS_NOT(x26);
+	x28 = BS_XOR(x27,x12);
+	x29 = BS_AND(x28,a2);
+	x30 = BS_XOR(x27,x29);
+	x31 = BS_XOR(x25,x30);
+	x32 = BS_AND(x31,a3);
+	x33 = BS_XOR(x25,x32);
+	x34 = BS_AND(x26,a2);
+	x35 = BS_XOR(x3,x34);
+	x36 = BS_XOR(x35,a3);
+	x37 = BS_XOR(x33,x36);
+	x38 = BS_AND(x37,a4);
+	x39 = BS_XOR(x33,x38);
+	x40 = BS_AND(x2,a2);
+	x41 = BS_XOR(a5,x40);
+	x42 = BS_NOT(x12);
+	x43 = BS_XOR(x41,x42);
+	x44 = BS_AND(x43,a3);
+	x45 = BS_XOR(x41,x44);
+	x46 = BS_XOR(x12,x29);
+	x47 = BS_XOR(x5,x46);
+	x48 = BS_AND(x47,a3);
+	x49 = BS_XOR(x5,x48);
+	x50 = BS_XOR(x45,x49);
+	x51 = BS_AND(x50,a4);
+	x52 = BS_XOR(x45,x51);
+	x53 = BS_XOR(x39,x52);
+	x54 = BS_AND(x53,a1);
+	x55 = BS_XOR(x39,x54);
+	x56 = BS_XOR(a6,a2);
+	x57 = BS_AND(a5,a3);
+	x58 = BS_XOR(x56,x57);
+	x59 = BS_AND(x0,a4);
+	x60 = BS_XOR(x58,x59);
+	x61 = BS_XOR(x0,x29);
+	x62 = BS_AND(x27,a2);
+	x63 = BS_XOR(a5,x62);
+	x64 = BS_XOR(x61,x63);
+	x65 = BS_AND(x64,a3);
+	x66 = BS_XOR(x61,x65);
+	x67 = BS_NOT(x46);
+	x68 = BS_AND(x9,a2);
+	x69 = BS_XOR(x12,x68);
+	x70 = BS_XOR(x67,x69);
+	x71 = BS_AND(x70,a3);
+	x72 = BS_XOR(x67,x71);
+	x73 = BS_XOR(x66,x72);
+	x74 = BS_AND(x73,a4);
+	x75 = BS_XOR(x66,x74);
+	x76 = BS_XOR(x60,x75);
+	x77 = BS_AND(x76,a1);
+	x78 = BS_XOR(x60,x77);
+	x79 = BS_XOR(a6,x29);
+	x80 = BS_XOR(x79,x13);
+	x81 = BS_AND(x80,a3);
+	x82 = BS_XOR(x79,x81);
+	x83 = BS_AND(x61,a3);
+	x84 = BS_XOR(x14,x83);
+	x85 = BS_XOR(x82,x84);
+	x86 = BS_AND(x85,a4);
+	x87 = BS_XOR(x82,x86);
+	x88 = BS_NOT(x56);
+	x89 = BS_AND(x0,a3);
+	x90 = BS_XOR(x88,x89);
+	x91 = BS_NOT(x41);
+	x92 = BS_AND(x4,a3);
+	x93 = BS_XOR(x91,x92);
+	x94 = BS_XOR(x90,x93);
+	x95 = BS_AND(x94,a4);
+	x96 = BS_XOR(x90,x95);
+	x97 = BS_XOR(x87,x96);
+	x98 = BS_AND(x97,a1);
+	x99 = BS_XOR(x87,x98);
+
+	*out1 = BS_XOR(*out1,x24);
+	*out2 = BS_XOR(*out2,x99);
+	*out3 = BS_XOR(*out3,x55);
+	*out4 = BS_XOR(*out4,x78);
+}
+
+static void des_bs_s4(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67;
+
+	x0 = BS_NOT(a3);
+	x1 = BS_XOR(x0,a4);
+	x2 = BS_AND(a3,a2);
+	x3 = BS_XOR(x1,x2);
+	x4 = BS_AND(x1,a2);
+	x5 = BS_XOR(x0,x4);
+	x6 = BS_XOR(x3,x5);
+	x7 = BS_AND(x6,a5);
+	x8 = BS_XOR(x3,x7);
+	x9 = BS_AND(a3,a4);
+	x10 = BS_NOT(x9);
+	x11 = BS_XOR(a4,x10);
+	x12 = BS_AND(x11,a2);
+	x13 = BS_XOR(a4,x12);
+	x14 = BS_NOT(x1);
+	x15 = BS_AND(x14,a5);
+	x16 = BS_XOR(x13,x15);
+	x17 = BS_XOR(x8,x16);
+	x18 = BS_AND(x17,a1);
+	x19 = BS_XOR(x8,x18);
+	x20 = BS_AND(x10,a2);
+	x21 = BS_XOR(x0,x20);
+	x22 = BS_AND(x11,a5);
+	x23 = BS_XOR(x21,x22);
+	x24 = BS_AND(a4,a2);
+	x25 = BS_XOR(x1,x24);
+	x26 = BS_NOT(x5);
+	x27 = BS_AND(x26,a5);
+	x28 = BS_XOR(x25,x27);
+	x29 = BS_XOR(x23,x28);
+	x30 = BS_AND(x29,a1);
+	x31 = BS_XOR(x23,x30);
+	x32 = BS_XOR(x19,x31);
+	x33 = BS_AND(x32,a6);
+	x34 = BS_XOR(x19,x33);
+	x35 = BS_XOR(a4,x2);
+	x36 = BS_AND(x5,a5);
+	x37 = BS_XOR(x35,x36);
+	x38 = BS_XOR(x10,x1);
+	x39 = BS_AND(x38,a2);
+	x40 = BS_XOR(x10,x39);
+	x41 = BS_XOR(a3,x39);
+	x42 = BS_XOR(x40,x41);
+	x43 = BS_AND(x42,a5);
+	x44 = BS_XOR(x40,x43);
+	x45 = BS_XOR(x37,x44);
+	x46 = BS_AND(x45,a1);
+	x47 = BS_XOR(x37,x46);
+	x48 = BS_AND(x42,a2);
+	x49 = BS_XOR(x0,x48);
+	x50 = BS_XOR(x49,x15);
+	x51 = BS_AND(x0,a2);
+	x52 = BS_XOR(x1,x51);
+	x53 = BS_XOR(x26,x52);
+	x54 = BS_AND(x53,a5);
+	x55 = BS_XOR(x26,x54);
+	x56 = BS_XOR(x50,x55);
+	x57 = BS_AND(x56,a1);
+	x58 = BS_XOR(x50,x57);
+	x59 = BS_XOR(x47,x58);
+	x60 = BS_AND(x59,a6);
+	x61 = BS_XOR(x47,x60);
+	x62 = BS_NOT(x59);
+	x63 = BS_AND(x62,a6);
+	x64 = BS_XOR(x58,x63);
+	x65 = BS_NOT(x32);
+	x66 = BS_AND(x65,a6);
+	x67 = BS_XOR(x31,x66);
+
+	*out1 = BS_XOR(*out1,x61);
+	*out2 = BS_XOR(*out2,x64);
+	*out3 = BS_XOR(*out3,x67);
+	*out4 = BS_XOR(*out4,x34);
+}
+
+static void des_bs_s5(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67, x68, x69, x70, x71;
+	BS_WORD x72, x73, x74, x75, x76, x77, x78, x79, x80, x81, x82, x83;
+	BS_WORD x84, x85, x86, x87, x88, x89, x90, x91, x92, x93, x94, x95;
+	BS_WORD x96, x97, x98, x99, x100, x101, x102, x103, x104, x105, x106;
+
+	x0 = BS_NOT(a3);
+	x1 = BS_AND(x0,a1);
+	x2 = BS_NOT(x1);
+	x3 = BS_XOR(x2,x0);
+	x4 = BS_AND(x3,a6);
+	x5 = BS_XOR(x2,x4);
+	x6 = BS_XOR(a1,x3);
+	x7 = BS_AND(x6,a6);
+	x8 = BS_XOR(a1,x7);
+	x9 = BS_XOR(x5,x8);
+	x10 = BS_AND(x9,a2);
+	x11 = BS_XOR(x5,x10);
+	x12 = BS_XOR(a3,a1);
+	x13 = BS_NOT(x6);
+	x14 = BS_AND(x13,a6);
+	x15 = BS_XOR(x12,x14);
+	x16 = BS_NOT(x9);
+	x17 = BS_XOR(x15,x16);
+	x18 = BS_AND(x17,a2);
+	x19 = BS_XOR(x15,x18);
+	x20 = BS_XOR(x11,x19);
+	x21 = BS_AND(x20,a5);
+	x22 = BS_XOR(x11,x21);
+	x23 = BS_NOT(a1);
+	x24 = BS_AND(x23,a6);
+	x25 = BS_XOR(a3,x24);
+	x26 = BS_NOT(x8);
+	x27 = BS_XOR(x25,x26);
+	x28 = BS_AND(x27,a2);
+	x29 = BS_XOR(x25,x28);
+	x30 = BS_XOR(x12,x7);
+	x31 = BS_XOR(x30,a2);
+	x32 = BS_XOR(x29,x31);
+	x33 = BS_AND(x32,a5);
+	x34 = BS_XOR(x29,x33);
+	x35 = BS_XOR(x22,x34);
+	x36 = BS_AND(x35,a4);
+	x37 = BS_XOR(x22,x36);
+	x38 = BS_AND(a3,a1);
+	x39 = BS_XOR(x38,x14);
+	x40 = BS_NOT(x7);
+	x41 = BS_AND(x40,a2);
+	x42 = BS_XOR(x39,x41);
+	x43 = BS_AND(x12,a6);
+	x44 = BS_XOR(x2,x43);
+	x45 = BS_XOR(x1,x7);
+	x46 = BS_XOR(x44,x45);
+	x47 = BS_AND(x46,a2);
+	x48 = BS_XOR(x44,x47);
+	x49 = BS_XOR(x42,x48);
+	x50 = BS_AND(x49,a5);
+	x51 = BS_XOR(x42,x50);
+	x52 = BS_AND(x1,a6);
+	x53 = BS_XOR(x6,x52);
+	x54 = BS_AND(x0,a6);
+	x55 = BS_XOR(x12,x54);
+	x56 = BS_XOR(x53,x55);
+	x57 = BS_AND(x56,a2);
+	x58 = BS_XOR(x53,x57);
+	x59 = BS_XOR(a1,x54);
+	x60 = BS_XOR(x59,x5);
+	x61 = BS_AND(x60,a2);
+	x62 = BS_XOR(x59,x61);
+	x63 = BS_XOR(x58,x62);
+	x64 = BS_AND(x63,a5);
+	x65 = BS_XOR(x58,x64);
+	x66 = BS_XOR(x51,x65);
+	x67 = BS_AND(x66,a4);
+	x68 = BS_XOR(x51,x67);
+	x69 = BS_AND(x2,a6);
+	x70 = BS_XOR(x3,x69);
+	x71 = BS_XOR(x55,x70);
+	x72 = BS_AND(x71,a2);
+	x73 = BS_XOR(x55,x72);
+	x74 = BS_NOT(x43);
+	x75 = BS_AND(x74,a5);
+	x76 = BS_XOR(x73,x75);
+	x77 = BS_NOT(x12);
+	x78 = BS_XOR(x77,a6);
+	x79 = BS_XOR(x78,a2);
+	x80 = BS_AND(x2,a5);
+	x81 = BS_XOR(x79,x80);
+	x82 = BS_XOR(x76,x81);
+	x83 = BS_AND(x82,a4);
+	x84 = BS_XOR(x76,x83);
+	x85 = BS_XOR(x6,x4);
+	x86 = BS_XOR(x85,x55);
+	x87 = BS_AND(x86,a2);
+	x88 = BS_XOR(x85,x87);
+	x89 = BS_NOT(x60);
+	x90 = BS_AND(x0,a2);
+	x91 = BS_XOR(x89,x90);
+	x92 = BS_XOR(x88,x91);
+	x93 = BS_AND(x92,a5);
+	x94 = BS_XOR(x88,x93);
+	x95 = BS_AND(a1,a6);
+	x96 = BS_XOR(x3,x95);
+	x97 = BS_XOR(x96,x47);
+	x98 = BS_XOR(x0,x69);
+	x99 = BS_AND(x6,a2);
+	x100 = BS_XOR(x98,x99);
+	x101 = BS_XOR(x97,x100);
+	x102 = BS_AND(x101,a5);
+	x103 = BS_XOR(x97,x102);
+	x104 = BS_XOR(x94,x103);
+	x105 = BS_AND(x104,a4);
+	x106 = BS_XOR(x94,x105);
+
+	*out1 = BS_XOR(*out1,x68);
+	*out2 = BS_XOR(*out2,x84);
+	*out3 = BS_XOR(*out3,x37);
+	*out4 = BS_XOR(*out4,x106);
+}
+
+static void des_bs_s6(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67, x68, x69, x70, x71;
+	BS_WORD x72, x73, x74, x75, x76, x77, x78, x79, x80, x81, x82, x83;
+	BS_WORD x84, x85, x86, x87, x88, x89, x90, x91, x92, x93, x94, x95;
+	BS_WORD x96, x97, x98, x99;
+
+	x0 = BS_NOT(a5);
+	x1 = BS_XOR(x0,a2);
+	x2 = BS_AND(a2,a3);
+	x3 = BS_XOR(x1,x2);
+	x4 = BS_NOT(a2);
+	x5 = BS_AND(x1,a3);
+	x6 = BS_XOR(x4,x5);
+	x7 = BS_XOR(x3,x6);
+	x8 = BS_AND(x7,a4);
+	x9 = BS_XOR(x3,x8);
+	x10 = BS_AND(x7,a1);
+	x11 = BS_XOR(x9,x10);
+	x12 = BS_NOT(x2);
+	x13 = BS_AND(x12,a4);
+	x14 = BS_XOR(x6,x13);
+	x15 = BS_ANDN(x0,a2);
+	x16 = BS_XOR(a2,x15);
+	x17 = BS_AND(x16,a3);
+	x18 = BS_XOR(a2,x17);
+	x19 = BS_NOT(x15);
+	x20 = BS_AND(x19,a4);
+	x21 = BS_XOR(x18,x20);
+	x22 = BS_XOR(x14,x21);
+	x23 = BS_AND(x22,a1);
+	x24 = BS_XOR(x14,x23);
+	x25 = BS_XOR(x11,x24);
+	x26 = BS_AND(x25,a6);
+	x27 = BS_XOR(x11,x26);
+	x28 = BS_AND(x0,a3);
+	x29 = BS_XOR(x1,x28);
+	x30 = BS_XOR(a5,a3);
+	x31 = BS_XOR(x29,x30);
+	x32 = BS_AND(x31,a4);
+	x33 = BS_XOR(x29,x32);
+	x34 = BS_NOT(x1);
+	x35 = BS_AND(x19,a3);
+	x36 = BS_XOR(x34,x35);
+	x37 = BS_AND(x15,a4);
+	x38 = BS_XOR(x36,x37);
+	x39 = BS_XOR(x33,x38);
+	x40 = BS_AND(x39,a1);
+	x41 = BS_XOR(x33,x40);
+	x42 = BS_NOT(x29);
+	x43 = BS_XOR(x16,a3);
+	x44 = BS_XOR(x42,x43);
+	x45 = BS_AND(x44,a4);
+	x46 = BS_XOR(x42,x45);
+	x47 = BS_XOR(x1,a3);
+	x48 = BS_AND(x4,a3);
+	x49 = BS_XOR(a5,x48);
+	x50 = BS_XOR(x47,x49);
+	x51 = BS_AND(x50,a4);
+	x52 = BS_XOR(x47,x51);
+	x53 = BS_XOR(x46,x52);
+	x54 = BS_AND(x53,a1);
+	x55 = BS_XOR(x46,x54);
+	x56 = BS_XOR(x41,x55);
+	x57 = BS_AND(x56,a6);
+	x58 = BS_XOR(x41,x57);
+	x59 = BS_AND(a5,a2);
+	x60 = BS_NOT(x59);
+	x61 = BS_XOR(x60,x35);
+	x62 = BS_AND(x60,a4);
+	x63 = BS_XOR(x35,x62);
+	x64 = BS_AND(x60,a3);
+	x65 = BS_XOR(x34,x64);
+	x66 = BS_XOR(x65,a4);
+	x67 = BS_XOR(x63,x66);
+	x68 = BS_AND(x67,a1);
+	x69 = BS_XOR(x63,x68);
+	x70 = BS_AND(x16,a4);
+	x71 = BS_XOR(x61,x70);
+	x72 = BS_AND(a5,a3);
+	x73 = BS_XOR(x19,x72);
+	x74 = BS_XOR(x73,x62);
+	x75 = BS_XOR(x71,x74);
+	x76 = BS_AND(x75,a1);
+	x77 = BS_XOR(x71,x76);
+	x78 = BS_XOR(x69,x77);
+	x79 = BS_AND(x78,a6);
+	x80 = BS_XOR(x69,x79);
+	x81 = BS_NOT(x6);
+	x82 = BS_AND(x81,a4);
+	x83 = BS_XOR(x49,x82);
+	x84 = BS_XOR(x0,x5);
+	x85 = BS_NOT(x3);
+	x86 = BS_AND(x85,a4);
+	x87 = BS_XOR(x84,x86);
+	x88 = BS_XOR(x83,x87);
+	x89 = BS_AND(x88,a1);
+	x90 = BS_XOR(x83,x89);
+	x91 = BS_XOR(x49,x20);
+	x92 = BS_AND(a5,a4);
+	x93 = BS_XOR(x42,x92);
+	x94 = BS_XOR(x91,x93);
+	x95 = BS_AND(x94,a1);
+	x96 = BS_XOR(x91,x95);
+	x97 = BS_XOR(x90,x96);
+	x98 = BS_AND(x97,a6);
+	x99 = BS_XOR(x90,x98);
+
+	*out1 = BS_XOR(*out1,x27);
+	*out2 = BS_XOR(*out2,x58);
+	*out3 = BS_XOR(*out3,x80);
+	*out4 = BS_XOR(*out4,x99);
+}
+
+static void des_bs_s7(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67, x68, x69, x70, x71;
+	BS_WORD x72, x73, x74, x75, x76, x77, x78, x79, x80, x81, x82, x83;
+	BS_WORD x84, x85, x86, x87, x88, x89, x90, x91, x92, x93, x94;
+
+	x0 = BS_NOT(a5);
+	x1 = BS_XOR(x0,a2);
+	x2 = BS_NOT(a2);
+	x3 = BS_AND(x2,a4);
+	x4 = BS_XOR(x1,x3);
+	x5 = BS_AND(a2,a3);
+	x6 = BS_XOR(x4,x5);
+	x7 = BS_AND(a2,a4);
+	x8 = BS_XOR(a5,x7);
+	x9 = BS_AND(a5,a4);
+	x10 = BS_XOR(x1,x9);
+	x11 = BS_XOR(x8,x10);
+	x12 = BS_AND(x11,a3);
+	x13 = BS_XOR(x8,x12);
+	x14 = BS_XOR(x6,x13);
+	x15 = BS_AND(x14,a1);
+	x16 = BS_XOR(x6,x15);
+	x17 = BS_OR(a5,a2);
+	x18 = BS_XOR(x0,x17);
+	x19 = BS_AND(x18,a4);
+	x20 = BS_XOR(x0,x19);
+	x21 = BS_NOT(x17);
+	x22 = BS_AND(x21,a4);
+	x23 = BS_XOR(x1,x22);
+	x24 = BS_XOR(x20,x23);
+	x25 = BS_AND(x24,a3);
+	x26 = BS_XOR(x20,x25);
+	x27 = BS_NOT(x7);
+	x28 = BS_AND(x27,a3);
+	x29 = BS_XOR(x1,x28);
+	x30 = BS_XOR(x26,x29);
+	x31 = BS_AND(x30,a1);
+	x32 = BS_XOR(x26,x31);
+	x33 = BS_XOR(x16,x32);
+	x34 = BS_AND(x33,a6);
+	x35 = BS_XOR(x16,x34);
+	x36 = BS_NOT(x1);
+	x37 = BS_XOR(x36,x18);
+	x38 = BS_AND(x37,a4);
+	x39 = BS_XOR(x36,x38);
+	x40 = BS_XOR(x39,a3);
+	x41 = BS_AND(x1,a4);
+	x42 = BS_XOR(a2,x41);
+	x43 = BS_AND(x17,a3);
+	x44 = BS_XOR(x42,x43);
+	x45 = BS_XOR(x40,x44);
+	x46 = BS_AND(x45,a1);
+	x47 = BS_XOR(x40,x46);
+	x48 = BS_XOR(a2,a4);
+	x49 = BS_AND(x41,a3);
+	x50 = BS_XOR(x48,x49);
+	x51 = BS_XOR(x2,x19);
+	x52 = BS_XOR(x51,a3);
+	x53 = BS_XOR(x50,x52);
+	x54 = BS_AND(x53,a1);
+	x55 = BS_XOR(x50,x54);
+	x56 = BS_XOR(x47,x55);
+	x57 = BS_AND(x56,a6);
+	x58 = BS_XOR(x47,x57);
+	x59 = BS_XOR(a2,x18);
+	x60 = BS_AND(x59,a4);
+	x61 = BS_XOR(a2,x60);
+	x62 = BS_AND(x37,a3);
+	x63 = BS_XOR(x61,x62);
+	x64 = BS_XOR(x13,x63);
+	x65 = BS_AND(x64,a1);
+	x66 = BS_XOR(x13,x65);
+	x67 = BS_NOT(x8);
+	x68 = BS_XOR(x67,a3);
+	x69 = BS_NOT(x37);
+	x70 = BS_AND(x69,a3);
+	x71 = BS_XOR(x39,x70);
+	x72 = BS_XOR(x68,x71);
+	x73 = BS_AND(x72,a1);
+	x74 = BS_XOR(x68,x73);
+	x75 = BS_XOR(x66,x74);
+	x76 = BS_AND(x75,a6);
+	x77 = BS_XOR(x66,x76);
+	x78 = BS_NOT(x10);
+	x79 = BS_XOR(x0,a4);
+	x80 = BS_XOR(x78,x79);
+	x81 = BS_AND(x80,a3);
+	x82 = BS_XOR(x78,x81);
+	x83 = BS_XOR(x82,a1);
+	x84 = BS_AND(x17,a4);
+	x85 = BS_XOR(x1,x84);
+	x86 = BS_XOR(x85,x81);
+	x87 = BS_XOR(x17,x60);
+	x88 = BS_XOR(x87,a3);
+	x89 = BS_XOR(x86,x88);
+	x90 = BS_AND(x89,a1);
+	x91 = BS_XOR(x86,x90);
+	x92 = BS_XOR(x83,x91);
+	x93 = BS_AND(x92,a6);
+	x94 = BS_XOR(x83,x93);
+
+	*out1 = BS_XOR(*out1,x77);
+	*out2 = BS_XOR(*out2,x35);
+	*out3 = BS_XOR(*out3,x58);
+	*out4 = BS_XOR(*out4,x94);
+}
+
+static void des_bs_s8(BS_WORD a1, BS_WORD a2, BS_WORD a3, BS_WORD a4, BS_WORD a5, BS_WORD a6,
+                      BS_WORD *out1, BS_WORD *out2, BS_WORD *out3, BS_WORD *out4)
+{
+	BS_WORD x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11;
+	BS_WORD x12, x13, x14, x15, x16, x17, x18, x19, x20, x21, x22, x23;
+	BS_WORD x24, x25, x26, x27, x28, x29, x30, x31, x32, x33, x34, x35;
+	BS_WORD x36, x37, x38, x39, x40, x41, x42, x43, x44, x45, x46, x47;
+	BS_WORD x48, x49, x50, x51, x52, x53, x54, x55, x56, x57, x58, x59;
+	BS_WORD x60, x61, x62, x63, x64, x65, x66, x67, x68, x69, x70, x71;
+	BS_WORD x72, x73, x74, x75, x76, x77, x78, x79, x80, x81, x82, x83;
+	BS_WORD x84, x85, x86, x87, x88, x89, x90, x91;
+
+	x0 = BS_NOT(a5);
+	x1 = BS_OR(x0,a2);
+	x2 = BS_XOR(x0,a2);
+	x3 = BS_XOR(x1,x2);
+	x4 = BS_AND(x3,a4);
+	x5 = BS_XOR(x1,x4);
+	x6 = BS_NOT(x1);
+	x7 = BS_XOR(x6,x0);
+	x8 = BS_AND(x7,a4);
+	x9 = BS_XOR(x6,x8);
+	x10 = BS_XOR(x5,x9);
+	x11 = BS_AND(x10,a3);
+	x12 = BS_XOR(x5,x11);
+	x13 = BS_XOR(x6,a2);
+	x14 = BS_AND(x13,a4);
+	x15 = BS_XOR(x6,x14);
+	x16 = BS_AND(x0,a3);
+	x17 = BS_XOR(x15,x16);
+	x18 = BS_XOR(x12,x17);
+	x19 = BS_AND(x18,a1);
+	x20 = BS_XOR(x12,x19);
+	x21 = BS_NOT(x2);
+	x22 = BS_AND(x1,a4);
+	x23 = BS_XOR(x21,x22);
+	x24 = BS_XOR(x23,a3);
+	x25 = BS_AND(x2,a4);
+	x26 = BS_XOR(a2,x25);
+	x27 = BS_AND(x13,a3);
+	x28 = BS_XOR(x26,x27);
+	x29 = BS_XOR(x24,x28);
+	x30 = BS_AND(x29,a1);
+	x31 = BS_XOR(x24,x30);
+	x32 = BS_XOR(x20,x31);
+	x33 = BS_AND(x32,a6);
+	x34 = BS_XOR(x20,x33);
+	x35 = BS_NOT(x13);
+	x36 = BS_NOT(x3);
+	x37 = BS_AND(x36,a4);
+	x38 = BS_XOR(x35,x37);
+	x39 = BS_AND(x21,a3);
+	x40 = BS_XOR(x38,x39);
+	x41 = BS_XOR(x2,x11);
+	x42 = BS_XOR(x40,x41);
+	x43 = BS_AND(x42,a1);
+	x44 = BS_XOR(x40,x43);
+	x45 = BS_NOT(x40);
+	x46 = BS_XOR(a2,a4);
+	x47 = BS_XOR(x46,x16);
+	x48 = BS_XOR(x45,x47);
+	x49 = BS_AND(x48,a1);
+	x50 = BS_XOR(x45,x49);
+	x51 = BS_XOR(x44,x50);
+	x52 = BS_AND(x51,a6);
+	x53 = BS_XOR(x44,x52);
+	x54 = BS_AND(a5,a4);
+	x55 = BS_XOR(x21,x54);
+	x56 = BS_XOR(x55,x16);
+	x57 = BS_XOR(x36,a4);
+	x58 = BS_AND(x7,a3);
+	x59 = BS_XOR(x57,x58);
+	x60 = BS_XOR(x56,x59);
+	x61 = BS_AND(x60,a1);
+	x62 = BS_XOR(x56,x61);
+	x63 = BS_AND(x6,a4);
+	x64 = BS_XOR(x36,x63);
+	x65 = BS_XOR(x15,x64);
+	x66 = BS_AND(x65,a3);
+	x67 = BS_XOR(x15,x66);
+	x68 = BS_AND(x21,a4);
+	x69 = BS_XOR(x0,x68);
+	x70 = BS_XOR(x69,x55);
+	x71 = BS_AND(x70,a3);
+	x72 = BS_XOR(x69,x71);
+	x73 = BS_XOR(x67,x72);
+	x74 = BS_AND(x73,a1);
+	x75 = BS_XOR(x67,x74);
+	x76 = BS_XOR(x62,x75);
+	x77 = BS_AND(x76,a6);
+	x78 = BS_XOR(x62,x77);
+	x79 = BS_NOT(x31);
+	x80 = BS_XOR(x64,x9);
+	x81 = BS_AND(x80,a3);
+	x82 = BS_XOR(x64,x81);
+	x83 = BS_NOT(x69);
+	x84 = BS_AND(x83,a3);
+	x85 = BS_XOR(x21,x84);
+	x86 = BS_XOR(x82,x85);
+	x87 = BS_AND(x86,a1);
+	x88 = BS_XOR(x82,x87);
+	x89 = BS_XOR(x79,x88);
+	x90 = BS_AND(x89,a6);
+	x91 = BS_XOR(x79,x90);
+
+	*out1 = BS_XOR(*out1,x34);
+	*out2 = BS_XOR(*out2,x53);
+	*out3 = BS_XOR(*out3,x78);
+	*out4 = BS_XOR(*out4,x91);
+}
+
+// One bitsliced round: l ^= P(S(E(r) ^ subkey)).
+static void des_bs_f(BS_WORD l[], const BS_WORD r[], const BYTE kbits[], const BS_WORD kmask[])
+{
+	des_bs_s1(BS_XOR(r[31],BS_KEY(0)), BS_XOR(r[0],BS_KEY(1)), BS_XOR(r[1],BS_KEY(2)), BS_XOR(r[2],BS_KEY(3)), BS_XOR(r[3],BS_KEY(4)), BS_XOR(r[4],BS_KEY(5)),
+	          &l[8], &l[16], &l[22], &l[30]);
+	des_bs_s2(BS_XOR(r[3],BS_KEY(6)), BS_XOR(r[4],BS_KEY(7)), BS_XOR(r[5],BS_KEY(8)), BS_XOR(r[6],BS_KEY(9)), BS_XOR(r[7],BS_KEY(10)), BS_XOR(r[8],BS_KEY(11)),
+	          &l[12], &l[27], &l[1], &l[17]);
+	des_bs_s3(BS_XOR(r[7],BS_KEY(12)), BS_XOR(r[8],BS_KEY(13)), BS_XOR(r[9],BS_KEY(14)), BS_XOR(r[10],BS_KEY(15)), BS_XOR(r[11],BS_KEY(16)), BS_XOR(r[12],BS_KEY(17)),
+	          &l[23], &l[15], &l[29], &l[5]);
+	des_bs_s4(BS_XOR(r[11],BS_KEY(18)), BS_XOR(r[12],BS_KEY(19)), BS_XOR(r[13],BS_KEY(20)), BS_XOR(r[14],BS_KEY(21)), BS_XOR(r[15],BS_KEY(22)), BS_XOR(r[16],BS_KEY(23)),
+	          &l[25], &l[19], &l[9], &l[0]);
+	des_bs_s5(BS_XOR(r[15],BS_KEY(24)), BS_XOR(r[16],BS_KEY(25)), BS_XOR(r[17],BS_KEY(26)), BS_XOR(r[18],BS_KEY(27)), BS_XOR(r[19],BS_KEY(28)), BS_XOR(r[20],BS_KEY(29)),
+	          &l[7], &l[13], &l[24], &l[2]);
+	des_bs_s6(BS_XOR(r[19],BS_KEY(30)), BS_XOR(r[20],BS_KEY(31)), BS_XOR(r[21],BS_KEY(32)), BS_XOR(r[22],BS_KEY(33)), BS_XOR(r[23],BS_KEY(34)), BS_XOR(r[24],BS_KEY(35)),
+	          &l[3], &l[28], &l[10], &l[18]);
+	des_bs_s7(BS_XOR(r[23],BS_KEY(36)), BS_XOR(r[24],BS_KEY(37)), BS_XOR(r[25],BS_KEY(38)), BS_XOR(r[26],BS_KEY(39)), BS_XOR(r[27],BS_KEY(40)), BS_XOR(r[28],BS_KEY(41)),
+	          &l[31], &l[11], &l[21], &l[6]);
+	des_bs_s8(BS_XOR(r[27],BS_KEY(42)), BS_XOR(r[28],BS_KEY(43)), BS_XOR(r[29],BS_KEY(44)), BS_XOR(r[30],BS_KEY(45)), BS_XOR(r[31],BS_KEY(46)), BS_XOR(r[0],BS_KEY(47)),
+	          &l[4], &l[26], &l[14], &l[20]);
+}
+
+// 64x64 bit matrix transpose, where bit (63 - j) of a[k] trades places with
+// bit (63 - k) of a[j]. This moves between 64 blocks and their 64 slices.
+static void des_bs_transpose(unsigned long long a[])
+{
+	unsigned long long m, t;
+	int j, k;
+
+	for (j = 32, m = 0x00000000ffffffffULL; j != 0; j >>= 1, m ^= (m << j)) {
+		for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+			t = (a[k] ^ (a[k | j] >> j)) & m;
+			a[k] ^= t;
+			a[k | j] ^= t << j;
+		}
+	}
+}
+
+// Unpack a des_key_setup() schedule into one byte per subkey bit.
+static void des_bs_key_bits(const BYTE key[][6], BYTE kbits[][48])
+{
+	int idx, j;
+
+	for (idx = 0; idx < 16; ++idx)
+		for (j = 0; j < 48; ++j)
+			kbits[idx][j] = (key[idx][j / 8] >> (7 - j % 8)) & 0x01;
+}
+
+// Runs DES_BS_BLOCKS blocks through "passes" chained DES operations (1 for DES,
+// 3 for 3DES). As in three_des_crypt(), no FP/IP is done between passes.
+static void des_bs_crypt_pass(const BYTE in[], BYTE out[], const BYTE kbits[][16][48], int passes)
+{
+	BS_SLICE s[64];
+	BS_WORD l[32], r[32], kmask[2], *x, *y, *t;
+	unsigned long long a[64];
+	WORD hi, lo;
+	int g, idx, k, n;
+
+	for (g = 0; g < BS_GROUPS; ++g) {
+		for (k = 0; k < 64; ++k, in += DES_BLOCK_SIZE) {
+			LOAD_HALVES(in,hi,lo);
+			a[k] = ((unsigned long long)hi << 32) | lo;
+		}
+		des_bs_transpose(a);
+		for (idx = 0; idx < 64; ++idx)
+			s[idx].q[g] = a[idx];
+	}
+	for (idx = 0; idx < 32; ++idx) {
+		l[idx] = s[des_ip[idx]].v;
+		r[idx] = s[des_ip[idx + 32]].v;
+	}
+
+	kmask[0] = BS_ZERO;
+	kmask[1] = BS_ONES;
+	x = l;
+	y = r;
+	for (n = 0; n < passes; ++n) {
+		for (idx = 0; idx < 16; idx += 2) {
+			des_bs_f(x, y, kbits[n][idx], kmask);
+			des_bs_f(y, x, kbits[n][idx + 1], kmask);
+		}
+		// The last round doesn't switch sides.
+		t = x;
+		x = y;
+		y = t;
+	}
+
+	for (idx = 0; idx < 32; ++idx) {
+		s[des_ip[idx]].v = x[idx];
+		s[des_ip[idx + 32]].v = y[idx];
+	}
+	for (g = 0; g < BS_GROUPS; ++g) {
+		for (idx = 0; idx < 64; ++idx)
+			a[idx] = s[idx].q[g];
+		des_bs_transpose(a);
+		for (k = 0; k < 64; ++k, out += DES_BLOCK_SIZE) {
+			out[0] = a[k] >> 56;
+			out[1] = a[k] >> 48;
+			out[2] = a[k] >> 40;
+			out[3] = a[k] >> 32;
+			out[4] = a[k] >> 24;
+			out[5] = a[k] >> 16;
+			out[6] = a[k] >> 8;
+			out[7] = a[k];
+		}
+	}
+}
+
+static void des_bs_crypt_blocks(const BYTE in[], BYTE out[], size_t blocks, const BYTE kbits[][16][48], int passes)
+{
+	BYTE buf[DES_BS_BLOCKS * DES_BLOCK_SIZE];
+	size_t idx;
+
+	for (idx = 0; idx + DES_BS_BLOCKS <= blocks; idx += DES_BS_BLOCKS)
+		des_bs_crypt_pass(&in[idx * DES_BLOCK_SIZE], &out[idx * DES_BLOCK_SIZE], kbits, passes);
+
+	// Run a short final batch through a zero-padded pass.
+	if (idx < blocks) {
+		memset(buf, 0, sizeof(buf));
+		memcpy(buf, &in[idx * DES_BLOCK_SIZE], (blocks - idx) * DES_BLOCK_SIZE);
+		des_bs_crypt_pass(buf, buf, kbits, passes);
+		memcpy(&out[idx * DES_BLOCK_SIZE], buf, (blocks - idx) * DES_BLOCK_SIZE);
+	}
+}
+
+// "ctr" is the counter value of the first block.
+static void des_bs_crypt_ctr_blocks(const BYTE in[], size_t in_len, BYTE out[], const BYTE kbits[][16][48],
+                                    int passes, unsigned long long ctr)
+{
+	BYTE buf[DES_BS_BLOCKS * DES_BLOCK_SIZE];
+	size_t idx, len, k;
+
+	memset(buf, 0, sizeof(buf));
+
+	for (idx = 0; idx < in_len; idx += len) {
+		len = in_len - idx < sizeof(buf) ? in_len - idx : sizeof(buf);
+		for (k = 0; k < len; k += DES_BLOCK_SIZE, ++ctr) {
+			buf[k]     = ctr >> 56;
+			buf[k + 1] = ctr >> 48;
+			buf[k + 2] = ctr >> 40;
+			buf[k + 3] = ctr >> 32;
+			buf[k + 4] = ctr >> 24;
+			buf[k + 5] = ctr >> 16;
+			buf[k + 6] = ctr >> 8;
+			buf[k + 7] = ctr;
+		}
+		des_bs_crypt_pass(buf, buf, kbits, passes);
+		for (k = 0; k < len; ++k)
+			out[idx + k] = in[idx + k] ^ buf[k];
+	}
+}
+
+// CBC decryption is parallel over blocks: each pass is decrypted as ECB and
+// then XORed with the ciphertext shifted by one block. "iv" is the ciphertext
+// block that precedes the first one. The ciphertext of a pass is copied
+// first, so in and out may be the same buffer.
+static void des_bs_decrypt_cbc_blocks(const BYTE in[], BYTE out[], size_t blocks, const BYTE kbits[][16][48],
+                                      int passes, const BYTE iv[])
+{
+	BYTE ct[DES_BS_BLOCKS * DES_BLOCK_SIZE], pt[DES_BS_BLOCKS * DES_BLOCK_SIZE], prev[DES_BLOCK_SIZE];
+	size_t idx, len, k;
+
+	memset(ct, 0, sizeof(ct));
+	memcpy(prev, iv, DES_BLOCK_SIZE);
+
+	for (idx = 0; idx < blocks * DES_BLOCK_SIZE; idx += len) {
+		len = blocks * DES_BLOCK_SIZE - idx < sizeof(ct) ? blocks * DES_BLOCK_SIZE - idx : sizeof(ct);
+		memcpy(ct, &in[idx], len);
+		des_bs_crypt_pass(ct, pt, kbits, passes);
+		for (k = 0; k < DES_BLOCK_SIZE; ++k)
+			out[idx + k] = pt[k] ^ prev[k];
+		for ( ; k < len; ++k)
+			out[idx + k] = pt[k] ^ ct[k - DES_BLOCK_SIZE];
+		memcpy(prev, &ct[len - DES_BLOCK_SIZE], DES_BLOCK_SIZE);
+	}
+}
+
+static unsigned long long des_bs_load_ctr(const BYTE iv[])
+{
+	WORD hi, lo;
+
+	LOAD_HALVES(iv,hi,lo);
+	return(((unsigned long long)hi << 32) | lo);
+}
+
+size_t des_bs_blocks(void)
+{
+	return(DES_BS_BLOCKS);
+}
+
+void des_bs_crypt_ecb(const BYTE in[], BYTE out[], size_t blocks, const BYTE key[][6])
+{
+	BYTE kbits[1][16][48];
+
+	des_bs_key_bits(key, kbits[0]);
+	des_bs_crypt_blocks(in, out, blocks, kbits, 1);
+}
+
+void three_des_bs_crypt_ecb(const BYTE in[], BYTE out[], size_t blocks, const BYTE key[][16][6])
+{
+	BYTE kbits[3][16][48];
+
+	des_bs_key_bits(key[0], kbits[0]);
+	des_bs_key_bits(key[1], kbits[1]);
+	des_bs_key_bits(key[2], kbits[2]);
+	des_bs_crypt_blocks(in, out, blocks, kbits, 3);
+}
+
+void des_bs_crypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6], const BYTE iv[])
+{
+	BYTE kbits[1][16][48];
+
+	des_bs_key_bits(key, kbits[0]);
+	des_bs_crypt_ctr_blocks(in, in_len, out, kbits, 1, des_bs_load_ctr(iv));
+}
+
+void three_des_bs_crypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[])
+{
+	BYTE kbits[3][16][48];
+
+	des_bs_key_bits(key[0], kbits[0]);
+	des_bs_key_bits(key[1], kbits[1]);
+	des_bs_key_bits(key[2], kbits[2]);
+	des_bs_crypt_ctr_blocks(in, in_len, out, kbits, 3, des_bs_load_ctr(iv));
+}
+
+/*******************
+* 3DES - Multithreaded
+*******************/
+// The input is cut into one chunk per worker, each a whole number of
+// bitsliced passes except for the last. A chunk's starting state depends only
+// on its offset: the CTR counter is the IV plus the chunk's block offset, and
+// the CBC chaining value is the ciphertext block just before the chunk. So
+// chunks can run in any order, and the output matches the sequential result.
+// Workers are only started when built with DES_THREADS; otherwise the chunks
+// run in turn on the calling thread.
+typedef struct {
+	const BYTE *in;
+	BYTE *out;
+	size_t len;                            // Chunk length in bytes
+	const BYTE (*kbits)[16][48];
+	unsigned long long ctr;                // CTR: counter of the chunk's first block
+	BYTE iv[DES_BLOCK_SIZE];               // CBC: ciphertext block before the chunk
+	int cbc;
+} DES_MT_JOB;
+
+static void *des_mt_worker(void *arg)
+{
+	DES_MT_JOB *job = (DES_MT_JOB *)arg;
+
+	if (job->cbc)
+		des_bs_decrypt_cbc_blocks(job->in, job->out, job->len / DES_BLOCK_SIZE, job->kbits, 3, job->iv);
+	else
+		des_bs_crypt_ctr_blocks(job->in, job->len, job->out, job->kbits, 3, job->ctr);
+	return(NULL);
+}
+
+static void des_mt_run(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6],
+                       const BYTE iv[], int threads, int cbc)
+{
+	DES_MT_JOB job[DES_MAX_THREADS];
+	BYTE kbits[3][16][48];
+	size_t chunk, pos;
+	int jobs, idx;
+#ifdef DES_THREADS
+	pthread_t tid[DES_MAX_THREADS];
+	int started[DES_MAX_THREADS];
+#endif
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > DES_MAX_THREADS)
+		threads = DES_MAX_THREADS;
+
+	des_bs_key_bits(key[0], kbits[0]);
+	des_bs_key_bits(key[1], kbits[1]);
+	des_bs_key_bits(key[2], kbits[2]);
+
+	// Round the chunk size up to whole passes.
+	chunk = (in_len + threads - 1) / threads;
+	chunk = (chunk + DES_BS_BLOCKS * DES_BLOCK_SIZE - 1) / (DES_BS_BLOCKS * DES_BLOCK_SIZE) *
+	        (DES_BS_BLOCKS * DES_BLOCK_SIZE);
+
+	// Set every job up before any of them runs, as an in-place CBC job
+	// overwrites the ciphertext the next job chains from.
+	for (jobs = 0, pos = 0; pos < in_len; ++jobs, pos += chunk) {
+		job[jobs].in = &in[pos];
+		job[jobs].out = &out[pos];
+		job[jobs].len = in_len - pos < chunk ? in_len - pos : chunk;
+		job[jobs].kbits = (const BYTE (*)[16][48])kbits;
+		job[jobs].ctr = des_bs_load_ctr(iv) + pos / DES_BLOCK_SIZE;
+		memcpy(job[jobs].iv, pos == 0 ? iv : &in[pos - DES_BLOCK_SIZE], DES_BLOCK_SIZE);
+		job[jobs].cbc = cbc;
+	}
+
+#ifdef DES_THREADS
+	// The calling thread takes the first chunk itself.
+	for (idx = 1; idx < jobs; ++idx)
+		started[idx] = pthread_create(&tid[idx], NULL, des_mt_worker, &job[idx]) == 0;
+	if (jobs > 0)
+		des_mt_worker(&job[0]);
+	for (idx = 1; idx < jobs; ++idx) {
+		if (started[idx])
+			pthread_join(tid[idx], NULL);
+		else
+			des_mt_worker(&job[idx]);
+	}
+#else
+	for (idx = 0; idx < jobs; ++idx)
+		des_mt_worker(&job[idx]);
+#endif
+}
+
+void three_des_encrypt_ctr_mt(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6],
+                              const BYTE iv[], int threads)
+{
+	des_mt_run(in, in_len, out, key, iv, threads, FALSE);
+}
+
+void three_des_decrypt_ctr_mt(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6],
+                              const BYTE iv[], int threads)
+{
+	// CTR encryption is its own inverse function.
+	three_des_encrypt_ctr_mt(in, in_len, out, key, iv, threads);
+}
+
+int three_des_decrypt_cbc_mt(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6],
+                             const BYTE iv[], int threads)
+{
+	if (in_len % DES_BLOCK_SIZE != 0)
+		return(FALSE);
+	des_mt_run(in, in_len, out, key, iv, threads, TRUE);
+	return(TRUE);
 }
@@ -34,4 +34,101 @@ void des_crypt(const BYTE in[], BYTE out[], const BYTE key[][6]);
 void three_des_key_setup(const BYTE key[], BYTE schedule[][16][6], DES_MODE mode);
 void three_des_crypt(const BYTE in[], BYTE out[], const BYTE key[][16][6]);
 
+///////////////////
+// DES - Modes
+///////////////////
+// The buffer functions return False if in_len is not a multiple of
+// DES_BLOCK_SIZE. As with des_crypt(), ECB en/de-cryption is set by the key
+// setup; CBC decryption needs a DES_DECRYPT schedule and CTR always needs a
+// DES_ENCRYPT one.
+int des_crypt_ecb(const BYTE in[],            // Input
+                  size_t in_len,              // Must be a multiple of DES_BLOCK_SIZE
+                  BYTE out[],                 // Output, same length as input
+                  const BYTE key[][6]);       // From des_key_setup()
+
+int des_encrypt_cbc(const BYTE in[],          // Plaintext
+                    size_t in_len,            // Must be a multiple of DES_BLOCK_SIZE
+                    BYTE out[],               // Ciphertext, same length as plaintext
+                    const BYTE key[][6],      // From des_key_setup() with DES_ENCRYPT
+                    const BYTE iv[]);         // IV, must be DES_BLOCK_SIZE bytes long
+
+int des_decrypt_cbc(const BYTE in[],          // Ciphertext
+                    size_t in_len,            // Must be a multiple of DES_BLOCK_SIZE
+                    BYTE out[],               // Plaintext, same length as ciphertext
+                    const BYTE key[][6],      // From des_key_setup() with DES_DECRYPT
+                    const BYTE iv[]);         // IV, must be DES_BLOCK_SIZE bytes long
+
+// The whole IV block is the big-endian counter. Input may be any byte length.
+void des_encrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6], const BYTE iv[]);
+void des_decrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][6], const BYTE iv[]);
+
+int three_des_crypt_ecb(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6]);
+int three_des_encrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[]);
+int three_des_decrypt_cbc(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[]);
+void three_des_encrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[]);
+void three_des_decrypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[]);
+
+///////////////////
+// 3DES - Key-agile batch
+///////////////////
+// Runs n independent 3DES operations, each one under its own key. Suited to
+// workloads that rekey for every block, as no three_des_key_setup() is needed.
+void three_des_crypt_batch(const BYTE keys[],    // n keys, DES_BLOCK_SIZE * 3 bytes each
+                           const BYTE in[],      // n input blocks
+                           BYTE out[],           // n output blocks, may be the same buffer as in
+                           size_t n,             // Number of (key, block) pairs
+                           DES_MODE mode);       // DES_ENCRYPT or DES_DECRYPT
+
+///////////////////
+// DES - Bitsliced
+///////////////////
+// Bulk entry points for the bitsliced engine, which works on des_bs_blocks()
+// blocks per pass under one key. They take the same schedules as des_crypt()
+// and three_des_crypt(), so the mode is set by the key setup.
+// Blocks per pass, which depends on the vector unit des.c was built for.
+size_t des_bs_blocks(void);
+
+void des_bs_crypt_ecb(const BYTE in[],        // Input blocks
+                      BYTE out[],             // Output blocks, may be the same buffer as in
+                      size_t blocks,          // Number of DES_BLOCK_SIZE blocks
+                      const BYTE key[][6]);   // From des_key_setup()
+
+void three_des_bs_crypt_ecb(const BYTE in[], BYTE out[], size_t blocks, const BYTE key[][16][6]);
+
+// CTR mode. The whole IV block is the big-endian counter. The schedule must be
+// set up for DES_ENCRYPT for both en- and de-cryption.
+void des_bs_crypt_ctr(const BYTE in[],        // Input
+                      size_t in_len,          // Any byte length
+                      BYTE out[],             // Output, same length as input, may be in place
+                      const BYTE key[][6],    // From des_key_setup()
+                      const BYTE iv[]);       // IV, must be DES_BLOCK_SIZE bytes long
+
+void three_des_bs_crypt_ctr(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6], const BYTE iv[]);
+
+///////////////////
+// 3DES - Multithreaded
+///////////////////
+// Split the input across up to "threads" workers running the bitsliced
+// engine. The output is identical to three_des_encrypt_ctr() and
+// three_des_decrypt_cbc(). Workers are threads only if des.c is built with
+// DES_THREADS defined (and linked with pthreads); otherwise the work is done
+// on the calling thread. Input and output may be the same buffer.
+void three_des_encrypt_ctr_mt(const BYTE in[],          // Input
+                              size_t in_len,            // Any byte length
+                              BYTE out[],               // Output, same length as input
+                              const BYTE key[][16][6],  // From three_des_key_setup() with DES_ENCRYPT
+                              const BYTE iv[],          // IV, the whole block is the big-endian counter
+                              int threads);             // Number of workers, including the caller
+
+void three_des_decrypt_ctr_mt(const BYTE in[], size_t in_len, BYTE out[], const BYTE key[][16][6],
+                              const BYTE iv[], int threads);
+
+// Returns False if in_len is not a multiple of DES_BLOCK_SIZE.
+int three_des_decrypt_cbc_mt(const BYTE in[],           // Ciphertext
+                             size_t in_len,             // Must be a multiple of DES_BLOCK_SIZE
+                             BYTE out[],                // Plaintext, same length as ciphertext
+                             const BYTE key[][16][6],   // From three_des_key_setup() with DES_DECRYPT
+                             const BYTE iv[],           // IV, must be DES_BLOCK_SIZE bytes long
+                             int threads);              // Number of workers, including the caller
+
 #endif   // DES_H
@@ -17,7 +17,7 @@
 #include "des.h"
 
 /*********************** FUNCTION DEFINITIONS ***********************/
-int des_test()
+int des_block_test()
 {
 	BYTE pt1[DES_BLOCK_SIZE] = {0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xE7};
 	BYTE pt2[DES_BLOCK_SIZE] = {0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF};
@@ -72,6 +72,216 @@ int des_test()
 	three_des_crypt(ct4, buf, three_schedule);
 	pass = pass && !memcmp(pt3, buf, DES_BLOCK_SIZE);
 
+	// The fused 3DES path must match three chained single DES passes
+	// over the same schedule.
+	three_des_key_setup(three_key2, three_schedule, DES_ENCRYPT);
+	des_crypt(pt3, buf, three_schedule[0]);
+	des_crypt(buf, buf, three_schedule[1]);
+	des_crypt(buf, buf, three_schedule[2]);
+	pass = pass && !memcmp(ct4, buf, DES_BLOCK_SIZE);
+
+	return(pass);
+}
+
+int des_modes_test()
+{
+	// The CBC vector is the example from FIPS 81.
+	BYTE key[DES_BLOCK_SIZE * 3] = {0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,
+	                                0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,
+	                                0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,0x23};
+	BYTE iv[DES_BLOCK_SIZE] = {0x12,0x34,0x56,0x78,0x90,0xAB,0xCD,0xEF};
+	BYTE pt[24] = {"Now is the time for all "};
+	BYTE ct[24] = {0xe5,0xc7,0xcd,0xde,0x87,0x2b,0xf2,0x7c,0x43,0xe9,0x34,0x00,
+	               0x8c,0x38,0x9c,0x0f,0x68,0x37,0x88,0x49,0x9a,0x7c,0x05,0xf6};
+	BYTE schedule[16][6];
+	BYTE three_schedule[3][16][6];
+	BYTE in[77], out[sizeof(in)], ref[sizeof(in)], buf[DES_BLOCK_SIZE];
+	int idx, j;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(in); ++idx)
+		in[idx] = idx * 13 + 1;
+
+	des_key_setup(key, schedule, DES_ENCRYPT);
+	pass = pass && des_encrypt_cbc(pt, sizeof(pt), out, schedule, iv);
+	pass = pass && !memcmp(ct, out, sizeof(ct));
+	pass = pass && !des_encrypt_cbc(pt, sizeof(pt) - 1, out, schedule, iv);
+	des_key_setup(key, schedule, DES_DECRYPT);
+	pass = pass && des_decrypt_cbc(ct, sizeof(ct), out, schedule, iv);
+	pass = pass && !memcmp(pt, out, sizeof(pt));
+
+	// 3DES ECB over an odd number of blocks, against three_des_crypt().
+	three_des_key_setup(key, three_schedule, DES_ENCRYPT);
+	for (idx = 0; idx < 72; idx += DES_BLOCK_SIZE)
+		three_des_crypt(&in[idx], &ref[idx], three_schedule);
+	pass = pass && three_des_crypt_ecb(in, 72, out, three_schedule);
+	pass = pass && !memcmp(ref, out, 72);
+
+	// 3DES CBC, decrypting in place.
+	memcpy(buf, iv, DES_BLOCK_SIZE);
+	for (idx = 0; idx < 72; idx += DES_BLOCK_SIZE) {
+		memcpy(&ref[idx], &in[idx], DES_BLOCK_SIZE);
+		for (j = 0; j < DES_BLOCK_SIZE; ++j)
+			ref[idx + j] ^= buf[j];
+		three_des_crypt(&ref[idx], &ref[idx], three_schedule);
+		memcpy(buf, &ref[idx], DES_BLOCK_SIZE);
+	}
+	pass = pass && three_des_encrypt_cbc(in, 72, out, three_schedule, iv);
+	pass = pass && !memcmp(ref, out, 72);
+	three_des_key_setup(key, three_schedule, DES_DECRYPT);
+	pass = pass && three_des_decrypt_cbc(out, 72, out, three_schedule, iv);
+	pass = pass && !memcmp(in, out, 72);
+
+	// CTR matches the bitsliced CTR path and is its own inverse.
+	three_des_key_setup(key, three_schedule, DES_ENCRYPT);
+	three_des_encrypt_ctr(in, sizeof(in), out, three_schedule, iv);
+	three_des_bs_crypt_ctr(in, sizeof(in), ref, three_schedule, iv);
+	pass = pass && !memcmp(ref, out, sizeof(in));
+	three_des_decrypt_ctr(out, sizeof(in), out, three_schedule, iv);
+	pass = pass && !memcmp(in, out, sizeof(in));
+
+	des_key_setup(key, schedule, DES_ENCRYPT);
+	des_encrypt_ctr(in, sizeof(in), out, schedule, iv);
+	des_bs_crypt_ctr(in, sizeof(in), ref, schedule, iv);
+	pass = pass && !memcmp(ref, out, sizeof(in));
+
+	return(pass);
+}
+
+// Each batch entry must match three_des_crypt() under its own key.
+int des_batch_test()
+{
+	BYTE keys[7][DES_BLOCK_SIZE * 3];
+	BYTE in[7][DES_BLOCK_SIZE], out[7][DES_BLOCK_SIZE], ref[DES_BLOCK_SIZE];
+	BYTE three_schedule[3][16][6];
+	int idx, j;
+	int pass = 1;
+
+	for (idx = 0; idx < 7; ++idx) {
+		for (j = 0; j < DES_BLOCK_SIZE * 3; ++j)
+			keys[idx][j] = idx * 31 + j * 17 + 5;
+		for (j = 0; j < DES_BLOCK_SIZE; ++j)
+			in[idx][j] = idx * 11 + j * 3;
+	}
+
+	three_des_crypt_batch(keys[0], in[0], out[0], 7, DES_ENCRYPT);
+	for (idx = 0; idx < 7; ++idx) {
+		three_des_key_setup(keys[idx], three_schedule, DES_ENCRYPT);
+		three_des_crypt(in[idx], ref, three_schedule);
+		pass = pass && !memcmp(ref, out[idx], DES_BLOCK_SIZE);
+	}
+
+	three_des_crypt_batch(keys[0], out[0], out[0], 7, DES_DECRYPT);
+	pass = pass && !memcmp(in, out, sizeof(in));
+
+	return(pass);
+}
+
+// Check the bitsliced ECB and CTR paths against the single-block functions,
+// including a short final pass and a partial final CTR block.
+int des_bs_test()
+{
+	BYTE key[DES_BLOCK_SIZE * 3] = {0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,
+	                                0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,
+	                                0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,0x23};
+	BYTE iv[DES_BLOCK_SIZE] = {0xf0,0xf1,0xf2,0xf3,0xf4,0xf5,0xff,0xf0};
+	BYTE schedule[16][6];
+	BYTE three_schedule[3][16][6];
+	BYTE in[(256 + 3) * DES_BLOCK_SIZE];     // Over one pass in any build
+	BYTE out[sizeof(in)], ref[sizeof(in)], ctr[DES_BLOCK_SIZE], ks[DES_BLOCK_SIZE];
+	size_t in_len = sizeof(in) - 5;
+	int idx, j;
+	int pass = 1;
+
+	pass = pass && des_bs_blocks() % 64 == 0 && des_bs_blocks() <= 256;
+	for (idx = 0; idx < (int)sizeof(in); ++idx)
+		in[idx] = idx * 7 + 3;
+
+	des_key_setup(key, schedule, DES_ENCRYPT);
+	for (idx = 0; idx < (int)sizeof(in); idx += DES_BLOCK_SIZE)
+		des_crypt(&in[idx], &ref[idx], schedule);
+	des_bs_crypt_ecb(in, out, sizeof(in) / DES_BLOCK_SIZE, schedule);
+	pass = pass && !memcmp(ref, out, sizeof(in));
+
+	des_key_setup(key, schedule, DES_DECRYPT);
+	des_bs_crypt_ecb(out, out, sizeof(in) / DES_BLOCK_SIZE, schedule);
+	pass = pass && !memcmp(in, out, sizeof(in));
+
+	three_des_key_setup(key, three_schedule, DES_ENCRYPT);
+	for (idx = 0; idx < (int)sizeof(in); idx += DES_BLOCK_SIZE)
+		three_des_crypt(&in[idx], &ref[idx], three_schedule);
+	three_des_bs_crypt_ecb(in, out, sizeof(in) / DES_BLOCK_SIZE, three_schedule);
+	pass = pass && !memcmp(ref, out, sizeof(in));
+
+	// CTR, with a counter that carries across bytes.
+	memcpy(ctr, iv, DES_BLOCK_SIZE);
+	for (idx = 0; idx < (int)in_len; idx += DES_BLOCK_SIZE) {
+		three_des_crypt(ctr, ks, three_schedule);
+		for (j = 0; j < DES_BLOCK_SIZE && idx + j < (int)in_len; ++j)
+			ref[idx + j] = in[idx + j] ^ ks[j];
+		for (j = DES_BLOCK_SIZE - 1; j >= 0 && ++ctr[j] == 0; --j)
+			;
+	}
+	three_des_bs_crypt_ctr(in, in_len, out, three_schedule, iv);
+	pass = pass && !memcmp(ref, out, in_len);
+	three_des_bs_crypt_ctr(out, in_len, out, three_schedule, iv);
+	pass = pass && !memcmp(in, out, in_len);
+
+	des_key_setup(key, schedule, DES_ENCRYPT);
+	des_bs_crypt_ctr(in, in_len, out, schedule, iv);
+	des_bs_crypt_ctr(out, in_len, out, schedule, iv);
+	pass = pass && !memcmp(in, out, in_len);
+
+	return(pass);
+}
+
+// The multithreaded paths must give the same output as the sequential ones,
+// in and out of place.
+int des_mt_test()
+{
+	static BYTE in[256 * DES_BLOCK_SIZE * 5 + 3 * DES_BLOCK_SIZE];
+	static BYTE out[sizeof(in)], ref[sizeof(in)];
+	BYTE key[DES_BLOCK_SIZE * 3] = {0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,
+	                                0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,
+	                                0x45,0x67,0x89,0xAB,0xCD,0xEF,0x01,0x23};
+	BYTE iv[DES_BLOCK_SIZE] = {0x00,0x00,0x00,0x00,0xff,0xff,0xff,0xfe};
+	BYTE three_schedule[3][16][6];
+	size_t in_len = sizeof(in) - 3;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(in); ++idx)
+		in[idx] = idx * 29 + 7;
+
+	three_des_key_setup(key, three_schedule, DES_ENCRYPT);
+	three_des_encrypt_ctr(in, in_len, ref, three_schedule, iv);
+	three_des_encrypt_ctr_mt(in, in_len, out, three_schedule, iv, 4);
+	pass = pass && !memcmp(ref, out, in_len);
+	three_des_decrypt_ctr_mt(out, in_len, out, three_schedule, iv, 3);
+	pass = pass && !memcmp(in, out, in_len);
+
+	three_des_key_setup(key, three_schedule, DES_DECRYPT);
+	three_des_decrypt_cbc(in, sizeof(in), ref, three_schedule, iv);
+	pass = pass && three_des_decrypt_cbc_mt(in, sizeof(in), out, three_schedule, iv, 4);
+	pass = pass && !memcmp(ref, out, sizeof(in));
+	memcpy(out, in, sizeof(in));
+	pass = pass && three_des_decrypt_cbc_mt(out, sizeof(in), out, three_schedule, iv, 6);
+	pass = pass && !memcmp(ref, out, sizeof(in));
+	pass = pass && !three_des_decrypt_cbc_mt(in, in_len, out, three_schedule, iv, 4);
+
+	return(pass);
+}
+
+int des_test()
+{
+	int pass = 1;
+
+	pass = pass && des_block_test();
+	pass = pass && des_modes_test();
+	pass = pass && des_batch_test();
+	pass = pass && des_bs_test();
+	pass = pass && des_mt_test();
+
 	return(pass);
 }
 
@@ -0,0 +1,116 @@
+/*********************************************************************
+* Filename:   key_pool.c
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    A pool allocator for key objects such as AES key schedules
+              and BLOWFISH_KEY structures. Slots are cache line aligned
+              and padded to whole cache lines, are carved out of large
+              chunks, and are recycled without going back to malloc().
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include "key_pool.h"
+
+/****************************** MACROS ******************************/
+#define ALIGN_UP(x) (((x) + KEY_POOL_ALIGN - 1) & ~(uintptr_t)(KEY_POOL_ALIGN - 1))
+
+/**************************** DATA TYPES ****************************/
+// Each chunk from malloc() starts with this header. The slots follow from the
+// first aligned address after it.
+typedef struct KEY_POOL_CHUNK {
+	struct KEY_POOL_CHUNK *next;
+} KEY_POOL_CHUNK;
+
+// A released slot holds the link to the next released slot.
+typedef struct KEY_POOL_SLOT {
+	struct KEY_POOL_SLOT *next;
+} KEY_POOL_SLOT;
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+int key_pool_init(KEY_POOL *pool, size_t obj_size, size_t slots_per_chunk)
+{
+	pool->slot_size = 0;
+	pool->slots_per_chunk = 0;
+	pool->free_list = NULL;
+	pool->chunks = NULL;
+	pool->next = NULL;
+	pool->end = NULL;
+
+	if (obj_size < sizeof(KEY_POOL_SLOT))
+		obj_size = sizeof(KEY_POOL_SLOT);
+	if (slots_per_chunk == 0)
+		slots_per_chunk = 1;
+	// A chunk, with its header and alignment slack, must fit in a size_t.
+	if (obj_size > SIZE_MAX - KEY_POOL_ALIGN)
+		return(0);
+	obj_size = ALIGN_UP(obj_size);
+	if (slots_per_chunk > (SIZE_MAX - sizeof(KEY_POOL_CHUNK) - KEY_POOL_ALIGN) / obj_size)
+		return(0);
+	pool->slot_size = obj_size;
+	pool->slots_per_chunk = slots_per_chunk;
+	return(1);
+}
+
+static int key_pool_grow(KEY_POOL *pool)
+{
+	KEY_POOL_CHUNK *chunk;
+	uintptr_t base;
+
+	// Nothing to carve if key_pool_init() failed.
+	if (pool->slot_size == 0)
+		return(0);
+	chunk = malloc(sizeof(KEY_POOL_CHUNK) + KEY_POOL_ALIGN - 1 + pool->slot_size * pool->slots_per_chunk);
+	if (chunk == NULL)
+		return(0);
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+
+	base = ALIGN_UP((uintptr_t)(chunk + 1));
+	pool->next = (BYTE *)base;
+	pool->end = pool->next + pool->slot_size * pool->slots_per_chunk;
+	return(1);
+}
+
+void *key_pool_alloc(KEY_POOL *pool)
+{
+	KEY_POOL_SLOT *slot;
+	void *obj;
+
+	// Reuse the most recently released slot, it is the most likely to be cached.
+	if (pool->free_list) {
+		slot = pool->free_list;
+		pool->free_list = slot->next;
+		return(slot);
+	}
+	if (pool->next == pool->end && !key_pool_grow(pool))
+		return(NULL);
+	obj = pool->next;
+	pool->next += pool->slot_size;
+	return(obj);
+}
+
+void key_pool_free(KEY_POOL *pool, void *obj)
+{
+	KEY_POOL_SLOT *slot = obj;
+
+	if (obj == NULL)
+		return;
+	slot->next = pool->free_list;
+	pool->free_list = slot;
+}
+
+void key_pool_destroy(KEY_POOL *pool)
+{
+	KEY_POOL_CHUNK *chunk,*next;
+
+	for (chunk = pool->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	pool->free_list = NULL;
+	pool->chunks = NULL;
+	pool->next = NULL;
+	pool->end = NULL;
+}
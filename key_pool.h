@@ -0,0 +1,54 @@
+/*********************************************************************
+* Filename:   key_pool.h
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Defines the API for the corresponding key pool implementation.
+*********************************************************************/
+
+#ifndef KEY_POOL_H
+#define KEY_POOL_H
+
+/*************************** HEADER FILES ***************************/
+#include <stddef.h>
+
+/****************************** MACROS ******************************/
+#define KEY_POOL_ALIGN 64               // Slots start on cache line boundaries
+
+// Slot sizes for the key objects of the other algorithms, so that this header
+// doesn't depend on theirs.
+#define KEY_POOL_AES_KEY_SIZE      (60 * 4)           // aes_key_setup() schedule, WORD[60]
+#define KEY_POOL_BLOWFISH_KEY_SIZE ((18 + 1024) * 4)  // sizeof(BLOWFISH_KEY)
+
+/**************************** DATA TYPES ****************************/
+typedef unsigned char BYTE;             // 8-bit byte
+
+typedef struct {
+   size_t slot_size;                    // Object size rounded up to KEY_POOL_ALIGN
+   size_t slots_per_chunk;
+   void *free_list;                     // Released slots, most recently released first
+   void *chunks;                        // Every chunk allocated, for key_pool_destroy()
+   BYTE *next;                          // Unused slots left in the newest chunk
+   BYTE *end;
+} KEY_POOL;
+
+/*********************** FUNCTION DECLARATIONS **********************/
+// A pool belongs to one thread and is not locked. Give each thread its own
+// pool: its chunks are then first touched, and placed, by that thread, and
+// keys of different threads never share a cache line.
+// Returns 0, and leaves an empty pool, if a chunk of that many slots would
+// not fit in a size_t.
+int key_pool_init(KEY_POOL *pool,
+                  size_t obj_size,            // Bytes per key object, e.g. KEY_POOL_AES_KEY_SIZE
+                  size_t slots_per_chunk);    // Slots obtained from malloc() at a time
+
+// Returns a KEY_POOL_ALIGN aligned slot of at least obj_size bytes, or NULL if
+// a new chunk was needed and malloc() failed. The contents are undefined.
+void *key_pool_alloc(KEY_POOL *pool);
+
+// Returns a slot to the pool. It is handed out again before any unused slot.
+void key_pool_free(KEY_POOL *pool, void *obj);
+
+// Releases every chunk. All slots from the pool become invalid.
+void key_pool_destroy(KEY_POOL *pool);
+
+#endif   // KEY_POOL_H
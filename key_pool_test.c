@@ -0,0 +1,63 @@
+/*********************************************************************
+* Filename:   key_pool_test.c
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Performs tests on the corresponding key pool
+              implementation. This code also serves as example usage
+              of the functions.
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdio.h>
+#include <memory.h>
+#include "key_pool.h"
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+int key_pool_test()
+{
+	KEY_POOL pool;
+	BYTE *slots[40], *reused;
+	size_t sizes[2] = {KEY_POOL_AES_KEY_SIZE, KEY_POOL_BLOWFISH_KEY_SIZE};
+	int idx, idx2, size_idx, pass = 1;
+
+	for (size_idx = 0; size_idx < 2; ++size_idx) {
+		// Seven slots per chunk, so several chunks are needed.
+		pass = pass && key_pool_init(&pool, sizes[size_idx], 7);
+		for (idx = 0; idx < 40; ++idx) {
+			slots[idx] = key_pool_alloc(&pool);
+			pass = pass && slots[idx] != NULL;
+			pass = pass && ((size_t)slots[idx] % KEY_POOL_ALIGN) == 0;
+			memset(slots[idx], idx, sizes[size_idx]);
+		}
+		// No slot was overwritten by another.
+		for (idx = 0; idx < 40; ++idx) {
+			for (idx2 = 0; idx2 < (int)sizes[size_idx]; ++idx2)
+				pass = pass && slots[idx][idx2] == (BYTE)idx;
+		}
+
+		// Released slots come back most recent first, before any new one.
+		key_pool_free(&pool, slots[3]);
+		key_pool_free(&pool, slots[17]);
+		reused = key_pool_alloc(&pool);
+		pass = pass && reused == slots[17];
+		reused = key_pool_alloc(&pool);
+		pass = pass && reused == slots[3];
+
+		key_pool_destroy(&pool);
+	}
+
+	// Chunks too large for a size_t are refused.
+	pass = pass && !key_pool_init(&pool, KEY_POOL_AES_KEY_SIZE, (size_t)-1 / 64);
+	pass = pass && !key_pool_init(&pool, (size_t)-1, 1);
+	pass = pass && key_pool_alloc(&pool) == NULL;
+	key_pool_destroy(&pool);
+
+	return(pass);
+}
+
+int main()
+{
+	printf("Key pool tests: %s\n", key_pool_test() ? "SUCCEEDED" : "FAILED");
+
+	return(0);
+}
@@ -14,7 +14,15 @@
 #include <memory.h>
 #include "md5.h"
 
+// Multi-buffer kernels for SSE2/AVX2/AVX-512, chosen at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(MD5_NO_SIMD)
+#define MD5_SIMD
+#endif
+
 /****************************** MACROS ******************************/
+#define TRUE  1
+#define FALSE 0
+
 #define ROTLEFT(a,b) ((a << b) | (a >> (32-b)))
 
 #define F(x,y,z) ((x & y) | (~x & z))
@@ -31,6 +39,127 @@
 #define II(a,b,c,d,m,s,t) { a += I(b,c,d) + m + t; \
                             a = b + ROTLEFT(a,s); }
 
+// One round of a multi-buffer batch, with the usual rotation of a, b, c and d.
+#define MD5_MB_ROUND(i,f) \
+	t = a + (f) + md5_k[i] + m[md5_m[i]]; \
+	a = d; \
+	d = c; \
+	c = b; \
+	b += ROTLEFT(t, md5_r[(i) / 16][(i) % 4]);
+
+// Compresses one block in each of the lanes of a multi-buffer batch. The
+// state is stored transposed, word by lane, so every vector holds the same
+// word of all the messages. The _words variant takes the message words
+// already transposed, for callers that build them in that form.
+#define MD5_MB_KERNEL(name,vec,lanes,isa) \
+__attribute__((target(isa))) \
+static void name##_words(WORD state[][MD5_MB_LANES], const WORD w[][MD5_MB_LANES]) \
+{ \
+	vec a, b, c, d, t, m[16]; \
+	int i; \
+\
+	for (i = 0; i < 16; ++i) \
+		memcpy(&m[i], w[i], sizeof(vec)); \
+	memcpy(&a, state[0], sizeof(vec)); \
+	memcpy(&b, state[1], sizeof(vec)); \
+	memcpy(&c, state[2], sizeof(vec)); \
+	memcpy(&d, state[3], sizeof(vec)); \
+\
+	for (i = 0; i < 16; ++i) { \
+		MD5_MB_ROUND(i, F(b,c,d)); \
+	} \
+	for ( ; i < 32; ++i) { \
+		MD5_MB_ROUND(i, G(b,c,d)); \
+	} \
+	for ( ; i < 48; ++i) { \
+		MD5_MB_ROUND(i, H(b,c,d)); \
+	} \
+	for ( ; i < 64; ++i) { \
+		MD5_MB_ROUND(i, I(b,c,d)); \
+	} \
+\
+	MD5_MB_ADD(state[0], a, t); \
+	MD5_MB_ADD(state[1], b, t); \
+	MD5_MB_ADD(state[2], c, t); \
+	MD5_MB_ADD(state[3], d, t); \
+} \
+\
+__attribute__((target(isa))) \
+static void name(WORD state[][MD5_MB_LANES], const BYTE *const blocks[]) \
+{ \
+	WORD w[16][MD5_MB_LANES]; \
+	int i, l; \
+\
+	for (i = 0; i < 16; ++i) \
+		for (l = 0; l < (lanes); ++l) \
+			memcpy(&w[i][l], &blocks[l][i * 4], 4); \
+	name##_words(state, (const WORD (*)[MD5_MB_LANES])w); \
+}
+
+// Adds v into a row of transposed state, using t as scratch.
+#define MD5_MB_ADD(row,v,t) \
+	memcpy(&(t), row, sizeof(t)); \
+	(t) += (v); \
+	memcpy(row, &(t), sizeof(t));
+
+#define MD5_HMAC_GROUP 64               // Messages per inner/outer pass of a batch HMAC
+#define MD5_MB_LANES 16                 // Lanes of the widest (AVX-512) kernel
+
+/**************************** DATA TYPES ****************************/
+#ifdef MD5_SIMD
+typedef WORD MD5_VEC4 __attribute__((vector_size(16)));
+typedef WORD MD5_VEC8 __attribute__((vector_size(32)));
+typedef WORD MD5_VEC16 __attribute__((vector_size(64)));
+#endif
+
+/**************************** VARIABLES *****************************/
+// The padding that follows a 16-, 20- or 32-byte message, length included.
+static const BYTE pad16[48] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00
+};
+static const BYTE pad20[44] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0xa0,0x00,0x00,0x00,0x00,0x00,0x00,0x00
+};
+static const BYTE pad32[32] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x00,0x00,0x00,0x00,0x00,0x00
+};
+
+#ifdef MD5_SIMD
+// Round constants, message word order and rotation amounts of the 64 rounds,
+// for the multi-buffer kernels that run the rounds in loops.
+static const WORD md5_k[64] = {
+	0xd76aa478,0xe8c7b756,0x242070db,0xc1bdceee,0xf57c0faf,0x4787c62a,0xa8304613,0xfd469501,
+	0x698098d8,0x8b44f7af,0xffff5bb1,0x895cd7be,0x6b901122,0xfd987193,0xa679438e,0x49b40821,
+	0xf61e2562,0xc040b340,0x265e5a51,0xe9b6c7aa,0xd62f105d,0x02441453,0xd8a1e681,0xe7d3fbc8,
+	0x21e1cde6,0xc33707d6,0xf4d50d87,0x455a14ed,0xa9e3e905,0xfcefa3f8,0x676f02d9,0x8d2a4c8a,
+	0xfffa3942,0x8771f681,0x6d9d6122,0xfde5380c,0xa4beea44,0x4bdecfa9,0xf6bb4b60,0xbebfbc70,
+	0x289b7ec6,0xeaa127fa,0xd4ef3085,0x04881d05,0xd9d4d039,0xe6db99e5,0x1fa27cf8,0xc4ac5665,
+	0xf4292244,0x432aff97,0xab9423a7,0xfc93a039,0x655b59c3,0x8f0ccc92,0xffeff47d,0x85845dd1,
+	0x6fa87e4f,0xfe2ce6e0,0xa3014314,0x4e0811a1,0xf7537e82,0xbd3af235,0x2ad7d2bb,0xeb86d391
+};
+
+static const BYTE md5_m[64] = {
+	0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,
+	1,6,11,0,5,10,15,4,9,14,3,8,13,2,7,12,
+	5,8,11,14,1,4,7,10,13,0,3,6,9,12,15,2,
+	0,7,14,5,12,3,10,1,8,15,6,13,4,11,2,9
+};
+
+static const BYTE md5_r[4][4] = {
+	{7,12,17,22},
+	{5,9,14,20},
+	{4,11,16,23},
+	{6,10,15,21}
+};
+
+static const BYTE mb_idle[64];          // Block fed to lanes with no message
+#endif
+
 /*********************** FUNCTION DEFINITIONS ***********************/
 void md5_transform(MD5_CTX *ctx, const BYTE data[])
 {
@@ -131,19 +260,77 @@ void md5_init(MD5_CTX *ctx)
 	ctx->state[3] = 0x10325476;
 }
 
-void md5_update(MD5_CTX *ctx, const BYTE data[], size_t len)
+#ifdef MD5_SIMD
+MD5_MB_KERNEL(md5_mb_sse2, MD5_VEC4, 4, "sse2")
+MD5_MB_KERNEL(md5_mb_avx2, MD5_VEC8, 8, "avx2")
+MD5_MB_KERNEL(md5_mb_avx512, MD5_VEC16, 16, "avx512f")
+
+// The number of messages hashed side by side, 0 if there is no kernel.
+static int md5_mb_lanes(void)
+{
+	static int lanes = -1;
+
+	if (lanes < 0)
+		lanes = __builtin_cpu_supports("avx512f") ? 16 : __builtin_cpu_supports("avx2") ? 8 :
+		        __builtin_cpu_supports("sse2") ? 4 : 0;
+	return(lanes);
+}
+
+static void md5_mb_compress(int lanes, WORD state[][MD5_MB_LANES], const BYTE *const blocks[])
+{
+	if (lanes == 16)
+		md5_mb_avx512(state, blocks);
+	else if (lanes == 8)
+		md5_mb_avx2(state, blocks);
+	else
+		md5_mb_sse2(state, blocks);
+}
+
+static void md5_mb_compress_words(int lanes, WORD state[][MD5_MB_LANES], const WORD w[][MD5_MB_LANES])
+{
+	if (lanes == 16)
+		md5_mb_avx512_words(state, w);
+	else if (lanes == 8)
+		md5_mb_avx2_words(state, w);
+	else
+		md5_mb_sse2_words(state, w);
+}
+#endif
+
+// Hashes whole blocks straight from the caller's buffer.
+static void md5_transform_blocks(MD5_CTX *ctx, const BYTE data[], size_t blocks)
 {
 	size_t i;
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			md5_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
-		}
+	for (i = 0; i < blocks; ++i)
+		md5_transform(ctx, &data[i * 64]);
+	ctx->bitlen += (unsigned long long)blocks * 512;
+}
+
+void md5_update(MD5_CTX *ctx, const BYTE data[], size_t len)
+{
+	size_t i = 0, fill;
+
+	// Top up a partially filled block first.
+	if (ctx->datalen > 0) {
+		fill = 64 - ctx->datalen;
+		if (fill > len)
+			fill = len;
+		memcpy(&ctx->data[ctx->datalen], data, fill);
+		ctx->datalen += fill;
+		if (ctx->datalen < 64)
+			return;
+		md5_transform_blocks(ctx, ctx->data, 1);
+		ctx->datalen = 0;
+		i = fill;
 	}
+
+	md5_transform_blocks(ctx, &data[i], (len - i) / 64);
+	i += (len - i) / 64 * 64;
+
+	// Only the tail is buffered.
+	memcpy(ctx->data, &data[i], len - i);
+	ctx->datalen = len - i;
 }
 
 void md5_final(MD5_CTX *ctx, BYTE hash[])
@@ -187,3 +374,392 @@ void md5_final(MD5_CTX *ctx, BYTE hash[])
 		hash[i + 12] = (ctx->state[3] >> (i * 8)) & 0x000000ff;
 	}
 }
+
+#ifdef MD5_SIMD
+// Starts the next message in a lane of a multi-buffer batch from state iv.
+static void md5_mb_start(WORD state[][MD5_MB_LANES], int lane, const WORD iv[])
+{
+	int i;
+
+	for (i = 0; i < 4; ++i)
+		state[i][lane] = iv[i];
+}
+
+// Builds the one or two final blocks of a message from its tail and its total
+// length in bits, returning how many blocks there are.
+static int md5_mb_pad(BYTE pad[], const BYTE tail[], size_t tail_len, unsigned long long bitlen)
+{
+	int blocks = tail_len < 56 ? 1 : 2;
+	int i;
+
+	memcpy(pad, tail, tail_len);
+	pad[tail_len] = 0x80;
+	memset(&pad[tail_len + 1], 0, blocks * 64 - tail_len - 1);
+	for (i = 0; i < 8; ++i)
+		pad[56 + (blocks - 1) * 64 + i] = bitlen >> (i * 8);
+	return(blocks);
+}
+#endif
+
+// The number of lanes to hash count messages in, or 0 to hash them one at a
+// time. The lanes only pay off once about half of them are filled.
+static int md5_multi_lanes(size_t count)
+{
+	int lanes = 0;
+
+#ifdef MD5_SIMD
+	lanes = md5_mb_lanes();
+#endif
+	return(count * 2 >= (size_t)lanes ? lanes : 0);
+}
+
+// Hashes each message on from the state in start, which must not hold any
+// buffered bytes.
+static void md5_multi_from(const MD5_CTX *start, const BYTE *const data[], const size_t lens[],
+                           BYTE hashes[], size_t count)
+{
+#ifdef MD5_SIMD
+	WORD state[4][MD5_MB_LANES];
+	BYTE pad[MD5_MB_LANES][128];
+	const BYTE *blocks[MD5_MB_LANES];
+	size_t msg[MD5_MB_LANES], pos[MD5_MB_LANES], next = 0;
+	int pad_blocks[MD5_MB_LANES], pad_used[MD5_MB_LANES];
+	int lanes, active = 0, l, i;
+#endif
+	MD5_CTX ctx;
+	size_t idx;
+
+#ifdef MD5_SIMD
+	lanes = md5_multi_lanes(count);
+	if (lanes > 0) {
+		// Each lane works through its message block by block, then through its
+		// padding, and is handed the next message as soon as it is done.
+		for (l = 0; l < lanes; ++l) {
+			msg[l] = next < count ? next++ : count;
+			if (msg[l] < count) {
+				md5_mb_start(state, l, start->state);
+				pos[l] = 0;
+				pad_blocks[l] = 0;
+				active++;
+			}
+		}
+		while (active > 0) {
+			for (l = 0; l < lanes; ++l) {
+				if (msg[l] == count)
+					blocks[l] = mb_idle;
+				else if (pad_blocks[l] == 0 && lens[msg[l]] - pos[l] >= 64) {
+					blocks[l] = &data[msg[l]][pos[l]];
+					pos[l] += 64;
+				}
+				else {
+					if (pad_blocks[l] == 0) {
+						pad_blocks[l] = md5_mb_pad(pad[l], &data[msg[l]][pos[l]], lens[msg[l]] - pos[l],
+						                           start->bitlen + (unsigned long long)lens[msg[l]] * 8);
+						pad_used[l] = 0;
+					}
+					blocks[l] = &pad[l][pad_used[l]++ * 64];
+				}
+			}
+			md5_mb_compress(lanes, state, blocks);
+			for (l = 0; l < lanes; ++l) {
+				if (msg[l] == count || pad_blocks[l] == 0 || pad_used[l] < pad_blocks[l])
+					continue;
+				for (i = 0; i < 4; ++i) {
+					hashes[msg[l] * MD5_BLOCK_SIZE + i * 4]     = state[i][l];
+					hashes[msg[l] * MD5_BLOCK_SIZE + i * 4 + 1] = state[i][l] >> 8;
+					hashes[msg[l] * MD5_BLOCK_SIZE + i * 4 + 2] = state[i][l] >> 16;
+					hashes[msg[l] * MD5_BLOCK_SIZE + i * 4 + 3] = state[i][l] >> 24;
+				}
+				msg[l] = next < count ? next++ : count;
+				if (msg[l] < count) {
+					md5_mb_start(state, l, start->state);
+					pos[l] = 0;
+					pad_blocks[l] = 0;
+				}
+				else
+					active--;
+			}
+		}
+		return;
+	}
+#endif
+	for (idx = 0; idx < count; ++idx) {
+		md5_clone(&ctx, start);
+		md5_update(&ctx, data[idx], lens[idx]);
+		md5_final(&ctx, &hashes[idx * MD5_BLOCK_SIZE]);
+	}
+}
+
+void md5_hash_multi(const BYTE *const data[], const size_t lens[], BYTE hashes[], size_t count)
+{
+	MD5_CTX start;
+
+	md5_init(&start);
+	md5_multi_from(&start, data, lens, hashes, count);
+}
+
+void md5_clone(MD5_CTX *dst, const MD5_CTX *src)
+{
+	memcpy(dst, src, sizeof(MD5_CTX));
+}
+
+// Stores value as bytes most significant first, so the serialized form is the
+// same on every platform.
+static void store_be(BYTE out[], unsigned long long value, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		out[i] = value >> ((bytes - 1 - i) * 8);
+}
+
+static unsigned long long load_be(const BYTE in[], int bytes)
+{
+	unsigned long long value = 0;
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		value = (value << 8) | in[i];
+	return(value);
+}
+
+// The layout is the tag "MD5 ", the format version, the buffered byte count,
+// the bit count of the whole blocks hashed so far, the state words and
+// the block buffer, zero past the buffered bytes. Integers are big endian.
+void md5_serialize(const MD5_CTX *ctx, BYTE out[])
+{
+	int i;
+
+	memcpy(out, "MD5 ", 4);
+	out[4] = MD5_SERIAL_VERSION;
+	out[5] = ctx->datalen;
+	store_be(&out[6], ctx->bitlen, 8);
+	for (i = 0; i < 4; ++i)
+		store_be(&out[14 + i * 4], ctx->state[i], 4);
+	memcpy(&out[30], ctx->data, ctx->datalen);
+	memset(&out[30 + ctx->datalen], 0, 64 - ctx->datalen);
+}
+
+int md5_deserialize(MD5_CTX *ctx, const BYTE in[])
+{
+	unsigned long long bitlen;
+	WORD datalen;
+	int i;
+
+	if (memcmp(in, "MD5 ", 4) != 0 || in[4] != MD5_SERIAL_VERSION)
+		return(FALSE);
+	datalen = in[5];
+	bitlen = load_be(&in[6], 8);
+	if (datalen >= 64 || bitlen % 512 != 0)
+		return(FALSE);
+
+	ctx->datalen = datalen;
+	ctx->bitlen = bitlen;
+	for (i = 0; i < 4; ++i)
+		ctx->state[i] = load_be(&in[14 + i * 4], 4);
+	memcpy(ctx->data, &in[30], 64);
+
+	return(TRUE);
+}
+
+void md5_hmac_key_setup(MD5_HMAC_KEY *hkey, const BYTE key[], size_t key_len)
+{
+	BYTE block[64], hashed[MD5_BLOCK_SIZE];
+	MD5_CTX ctx;
+	size_t i;
+
+	// Keys longer than a block are hashed down first.
+	if (key_len > 64) {
+		md5_init(&ctx);
+		md5_update(&ctx, key, key_len);
+		md5_final(&ctx, hashed);
+		key = hashed;
+		key_len = MD5_BLOCK_SIZE;
+	}
+	memset(block, 0, 64);
+	memcpy(block, key, key_len);
+
+	for (i = 0; i < 64; ++i)
+		block[i] ^= 0x36;
+	md5_init(&hkey->inner);
+	md5_update(&hkey->inner, block, 64);
+
+	for (i = 0; i < 64; ++i)
+		block[i] ^= 0x36 ^ 0x5c;
+	md5_init(&hkey->outer);
+	md5_update(&hkey->outer, block, 64);
+}
+
+void md5_hmac_init(const MD5_HMAC_KEY *hkey, MD5_CTX *ctx)
+{
+	md5_clone(ctx, &hkey->inner);
+}
+
+void md5_hmac_final(const MD5_HMAC_KEY *hkey, MD5_CTX *ctx, BYTE mac[])
+{
+	BYTE inner[MD5_BLOCK_SIZE];
+
+	md5_final(ctx, inner);
+	md5_clone(ctx, &hkey->outer);
+	md5_update(ctx, inner, MD5_BLOCK_SIZE);
+	md5_final(ctx, mac);
+}
+
+void md5_hmac(const MD5_HMAC_KEY *hkey, const BYTE data[], size_t len, BYTE mac[])
+{
+	MD5_CTX ctx;
+
+	md5_hmac_init(hkey, &ctx);
+	md5_update(&ctx, data, len);
+	md5_hmac_final(hkey, &ctx, mac);
+}
+
+void md5_hmac_batch(const MD5_HMAC_KEY *hkey, const BYTE *const data[], const size_t lens[],
+                    BYTE macs[], size_t count)
+{
+	BYTE inner[MD5_HMAC_GROUP * MD5_BLOCK_SIZE];
+	const BYTE *inner_ptrs[MD5_HMAC_GROUP];
+	size_t inner_lens[MD5_HMAC_GROUP];
+	size_t done, group, i;
+
+	// Without lanes to fill, the batch is the single-message path.
+	if (md5_multi_lanes(count) == 0) {
+		for (i = 0; i < count; ++i)
+			md5_hmac(hkey, data[i], lens[i], &macs[i * MD5_BLOCK_SIZE]);
+		return;
+	}
+
+	// The inner hashes of a group of messages run side by side from the inner
+	// midstate, then the outer hashes of those from the outer one.
+	for (done = 0; done < count; done += group) {
+		group = count - done < MD5_HMAC_GROUP ? count - done : MD5_HMAC_GROUP;
+		md5_multi_from(&hkey->inner, &data[done], &lens[done], inner, group);
+		for (i = 0; i < group; ++i) {
+			inner_ptrs[i] = &inner[i * MD5_BLOCK_SIZE];
+			inner_lens[i] = MD5_BLOCK_SIZE;
+		}
+		md5_multi_from(&hkey->outer, inner_ptrs, inner_lens, &macs[done * MD5_BLOCK_SIZE], group);
+	}
+}
+
+// MD5 of one value already laid out with its padding in a single block.
+// The callers copy the value and the padding with constant sizes, which is
+// most of what they save over md5_update().
+static void md5_fixed_block(const BYTE block[], BYTE hash[])
+{
+	MD5_CTX ctx;
+	int i;
+
+	md5_init(&ctx);
+	md5_transform(&ctx, block);
+	for (i = 0; i < 4; ++i) {
+		hash[i]      = (ctx.state[0] >> (i * 8)) & 0x000000ff;
+		hash[i + 4]  = (ctx.state[1] >> (i * 8)) & 0x000000ff;
+		hash[i + 8]  = (ctx.state[2] >> (i * 8)) & 0x000000ff;
+		hash[i + 12] = (ctx.state[3] >> (i * 8)) & 0x000000ff;
+	}
+}
+
+void md5_hash16(const BYTE data[], BYTE hash[])
+{
+	BYTE block[64];
+
+	memcpy(block, data, 16);
+	memcpy(&block[16], pad16, 48);
+	md5_fixed_block(block, hash);
+}
+
+void md5_hash20(const BYTE data[], BYTE hash[])
+{
+	BYTE block[64];
+
+	memcpy(block, data, 20);
+	memcpy(&block[20], pad20, 44);
+	md5_fixed_block(block, hash);
+}
+
+void md5_hash32(const BYTE data[], BYTE hash[])
+{
+	BYTE block[64];
+
+	memcpy(block, data, 32);
+	memcpy(&block[32], pad32, 32);
+	md5_fixed_block(block, hash);
+}
+
+#ifdef MD5_SIMD
+static const BYTE *md5_fixed_pad(size_t len)
+{
+	return(len == 16 ? pad16 : len == 20 ? pad20 : pad32);
+}
+
+// The same for up to one value per lane. The message words of the padding are
+// transposed once, and only the value's own words change between groups. The
+// kernels only run on x86, so the little endian words are copied as they lie.
+static void md5_fixed_mb(int lanes, const BYTE data[], size_t len, BYTE hashes[], size_t count)
+{
+	WORD state[4][MD5_MB_LANES], w[16][MD5_MB_LANES];
+	const BYTE *pad = md5_fixed_pad(len);
+	MD5_CTX start;
+	size_t done;
+	int words = len / 4, group, i, l;
+
+	md5_init(&start);
+	memset(w, 0, sizeof(w));
+	for (i = words; i < 16; ++i)
+		for (l = 0; l < MD5_MB_LANES; ++l)
+			memcpy(&w[i][l], &pad[i * 4 - len], 4);
+
+	for (done = 0; done < count; done += group) {
+		group = count - done < (size_t)lanes ? (int)(count - done) : lanes;
+		for (l = 0; l < lanes; ++l)
+			md5_mb_start(state, l, start.state);
+		for (i = 0; i < words; ++i)
+			for (l = 0; l < group; ++l)
+				memcpy(&w[i][l], &data[(done + l) * len + i * 4], 4);
+		md5_mb_compress_words(lanes, state, (const WORD (*)[MD5_MB_LANES])w);
+
+		for (l = 0; l < group; ++l)
+			for (i = 0; i < 4; ++i)
+				memcpy(&hashes[(done + l) * MD5_BLOCK_SIZE + i * 4], &state[i][l], 4);
+	}
+}
+#endif
+
+static void md5_fixed(const BYTE data[], size_t len, BYTE hashes[], size_t count)
+{
+	size_t idx;
+
+#ifdef MD5_SIMD
+	int lanes = md5_mb_lanes();
+
+	// The lanes win once about half of them are filled.
+	if (lanes > 0 && count * 2 >= (size_t)lanes) {
+		md5_fixed_mb(lanes, data, len, hashes, count);
+		return;
+	}
+#endif
+	for (idx = 0; idx < count; ++idx) {
+		if (len == 16)
+			md5_hash16(&data[idx * len], &hashes[idx * MD5_BLOCK_SIZE]);
+		else if (len == 20)
+			md5_hash20(&data[idx * len], &hashes[idx * MD5_BLOCK_SIZE]);
+		else
+			md5_hash32(&data[idx * len], &hashes[idx * MD5_BLOCK_SIZE]);
+	}
+}
+
+void md5_hash16_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	md5_fixed(data, 16, hashes, count);
+}
+
+void md5_hash20_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	md5_fixed(data, 20, hashes, count);
+}
+
+void md5_hash32_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	md5_fixed(data, 32, hashes, count);
+}
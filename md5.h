@@ -14,6 +14,8 @@
 
 /****************************** MACROS ******************************/
 #define MD5_BLOCK_SIZE 16               // MD5 outputs a 16 byte digest
+#define MD5_SERIAL_SIZE 94              // Bytes written by md5_serialize()
+#define MD5_SERIAL_VERSION 1            // Format version of the serialized state
 
 /**************************** DATA TYPES ****************************/
 typedef unsigned char BYTE;             // 8-bit byte
@@ -26,9 +28,53 @@ typedef struct {
    WORD state[4];
 } MD5_CTX;
 
+typedef struct {
+   MD5_CTX inner;                       // State after hashing the key XOR ipad
+   MD5_CTX outer;                       // State after hashing the key XOR opad
+} MD5_HMAC_KEY;
+
 /*********************** FUNCTION DECLARATIONS **********************/
 void md5_init(MD5_CTX *ctx);
 void md5_update(MD5_CTX *ctx, const BYTE data[], size_t len);
 void md5_final(MD5_CTX *ctx, BYTE hash[]);
 
+// A copy of a context in progress carries on independently of the original,
+// so a shared prefix only has to be hashed once.
+void md5_clone(MD5_CTX *dst, const MD5_CTX *src);
+
+// Saves a context in progress to MD5_SERIAL_SIZE bytes with the same layout
+// on every platform, to be resumed later with md5_deserialize(). The
+// deserialize function returns False if the bytes are not a valid state of
+// the same format version.
+void md5_serialize(const MD5_CTX *ctx, BYTE out[]);
+int md5_deserialize(MD5_CTX *ctx, const BYTE in[]);
+
+// Hashes count independent messages, one per SIMD lane where the CPU allows,
+// and writes their digests one after another to hashes
+// (count * MD5_BLOCK_SIZE bytes). The messages may differ in length.
+void md5_hash_multi(const BYTE *const data[], const size_t lens[], BYTE hashes[], size_t count);
+
+// HMAC. The key is absorbed once into inner and outer midstates, so each
+// message only costs cloning them. Streaming use is hmac_init, md5_update
+// on the context, then hmac_final. The batch function writes count MACs one
+// after another to macs and runs the messages side by side like
+// md5_hash_multi().
+void md5_hmac_key_setup(MD5_HMAC_KEY *hkey, const BYTE key[], size_t key_len);
+void md5_hmac_init(const MD5_HMAC_KEY *hkey, MD5_CTX *ctx);
+void md5_hmac_final(const MD5_HMAC_KEY *hkey, MD5_CTX *ctx, BYTE mac[]);
+void md5_hmac(const MD5_HMAC_KEY *hkey, const BYTE data[], size_t len, BYTE mac[]);
+void md5_hmac_batch(const MD5_HMAC_KEY *hkey, const BYTE *const data[], const size_t lens[],
+                    BYTE macs[], size_t count);
+
+// Fixed-length MD5 of 16-, 20- and 32-byte values, such as other digests
+// and identifiers. The padding is precomputed and nothing is buffered. The
+// batch functions take count values one after another in data and write their
+// digests one after another to hashes (count * MD5_BLOCK_SIZE bytes).
+void md5_hash16(const BYTE data[], BYTE hash[]);
+void md5_hash20(const BYTE data[], BYTE hash[]);
+void md5_hash32(const BYTE data[], BYTE hash[]);
+void md5_hash16_batch(const BYTE data[], BYTE hashes[], size_t count);
+void md5_hash20_batch(const BYTE data[], BYTE hashes[], size_t count);
+void md5_hash32_batch(const BYTE data[], BYTE hashes[], size_t count);
+
 #endif   // MD5_H
@@ -52,9 +52,230 @@ int md5_test()
 	return(pass);
 }
 
+// Whole blocks are hashed straight from the input buffer and only the tail
+// is buffered, so check that a single large update and many uneven ones give
+// the same digest.
+int md5_chunk_test()
+{
+	static BYTE text[1000000];
+	BYTE hash[MD5_BLOCK_SIZE] = {0x77,0x07,0xd6,0xae,0x4e,0x02,0x7c,0x70,0xee,0xa2,0xa9,0x35,0xc2,0x29,0x6f,0x21};
+	BYTE buf[MD5_BLOCK_SIZE];
+	MD5_CTX ctx;
+	size_t idx, len;
+	int pass = 1;
+
+	memset(text, 'a', sizeof(text));
+
+	md5_init(&ctx);
+	md5_update(&ctx, text, sizeof(text));
+	md5_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, MD5_BLOCK_SIZE);
+
+	md5_init(&ctx);
+	for (idx = 0, len = 1; idx < sizeof(text); idx += len, len = len % 150 + 1) {
+		if (len > sizeof(text) - idx)
+			len = sizeof(text) - idx;
+		md5_update(&ctx, &text[idx], len);
+	}
+	md5_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, MD5_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// Messages of many different lengths, so lanes finish and are refilled at
+// different times, must hash the same as they do one at a time.
+int md5_multi_test()
+{
+	static BYTE long_text[100000];
+	BYTE text[40 * 7];
+	BYTE hashes[40 * MD5_BLOCK_SIZE];
+	BYTE buf[MD5_BLOCK_SIZE];
+	const BYTE *data[40];
+	size_t lens[40];
+	MD5_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(text); ++idx)
+		text[idx] = idx * 31 + 7;
+	for (idx = 0; idx < 40; ++idx) {
+		data[idx] = &text[idx % 3];
+		lens[idx] = (idx * 7 * 13) % (sizeof(text) - 2);
+	}
+	md5_hash_multi(data, lens, hashes, 40);
+
+	for (idx = 0; idx < 40; ++idx) {
+		md5_init(&ctx);
+		md5_update(&ctx, data[idx], lens[idx]);
+		md5_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+	}
+
+	// A single message is hashed on its own rather than in one lane of many.
+	for (idx = 0; idx < (int)sizeof(long_text); ++idx)
+		long_text[idx] = idx * 17 + 3;
+	data[0] = long_text;
+	lens[0] = sizeof(long_text);
+	md5_hash_multi(data, lens, hashes, 1);
+	md5_init(&ctx);
+	md5_update(&ctx, long_text, sizeof(long_text));
+	md5_final(&ctx, buf);
+	pass = pass && !memcmp(hashes, buf, MD5_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// A context saved part way through and resumed, and a clone finishing a
+// shared prefix, must both give the same digest as hashing in one go.
+int md5_serialize_test()
+{
+	BYTE text[300];
+	BYTE saved[MD5_SERIAL_SIZE];
+	BYTE hash[MD5_BLOCK_SIZE];
+	BYTE buf[MD5_BLOCK_SIZE];
+	MD5_CTX ctx, resumed, copy;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(text); ++idx)
+		text[idx] = idx * 13 + 5;
+
+	md5_init(&ctx);
+	md5_update(&ctx, text, sizeof(text));
+	md5_final(&ctx, hash);
+
+	md5_init(&ctx);
+	md5_update(&ctx, text, 131);
+	md5_serialize(&ctx, saved);
+	memset(&resumed, 0xff, sizeof(resumed));
+	pass = pass && md5_deserialize(&resumed, saved);
+	md5_update(&resumed, &text[131], sizeof(text) - 131);
+	md5_final(&resumed, buf);
+	pass = pass && !memcmp(hash, buf, MD5_BLOCK_SIZE);
+
+	md5_clone(&copy, &ctx);
+	md5_update(&ctx, &text[131], sizeof(text) - 131);
+	md5_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, MD5_BLOCK_SIZE);
+	md5_update(&copy, &text[131], sizeof(text) - 131);
+	md5_final(&copy, buf);
+	pass = pass && !memcmp(hash, buf, MD5_BLOCK_SIZE);
+
+	// Another format version, or a damaged buffer count, is refused.
+	saved[4]++;
+	pass = pass && !md5_deserialize(&resumed, saved);
+	saved[4]--;
+	saved[5] = 0xff;
+	pass = pass && !md5_deserialize(&resumed, saved);
+
+	return(pass);
+}
+
+int md5_hmac_test()
+{
+	BYTE key1[20], key2[131];
+	BYTE text1[] = {"Hi There"};
+	BYTE text2[] = {"Test Using Larger Than Block-Size Key - Hash Key First"};
+	BYTE mac1[MD5_BLOCK_SIZE] = {0x5c,0xce,0xc3,0x4e,0xa9,0x65,0x63,0x92,0x45,0x7f,0xa1,0xac,0x27,0xf0,0x8f,0xbc};
+	BYTE mac2[MD5_BLOCK_SIZE] = {0xbf,0xec,0xaf,0x4e,0xff,0xf9,0x0a,0x3a,0x66,0x8f,0x39,0x22,0xfe,0xc3,0x76,0x2d};
+	BYTE text3[40 * 5];
+	BYTE macs[40 * MD5_BLOCK_SIZE];
+	BYTE buf[MD5_BLOCK_SIZE];
+	const BYTE *data[40];
+	size_t lens[40];
+	MD5_HMAC_KEY hkey;
+	MD5_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	memset(key1, 0x0b, sizeof(key1));
+	memset(key2, 0xaa, sizeof(key2));
+
+	md5_hmac_key_setup(&hkey, key1, sizeof(key1));
+	md5_hmac(&hkey, text1, strlen(text1), buf);
+	pass = pass && !memcmp(mac1, buf, MD5_BLOCK_SIZE);
+
+	// Keys longer than a block are hashed first. Also try the streaming calls.
+	md5_hmac_key_setup(&hkey, key2, sizeof(key2));
+	md5_hmac_init(&hkey, &ctx);
+	md5_update(&ctx, text2, 10);
+	md5_update(&ctx, &text2[10], strlen(text2) - 10);
+	md5_hmac_final(&hkey, &ctx, buf);
+	pass = pass && !memcmp(mac2, buf, MD5_BLOCK_SIZE);
+
+	// The batch must agree with one message at a time.
+	for (idx = 0; idx < (int)sizeof(text3); ++idx)
+		text3[idx] = idx * 7 + 1;
+	for (idx = 0; idx < 40; ++idx) {
+		data[idx] = &text3[idx];
+		lens[idx] = (idx * 37) % 150;
+	}
+	md5_hmac_batch(&hkey, data, lens, macs, 40);
+	for (idx = 0; idx < 40; ++idx) {
+		md5_hmac(&hkey, data[idx], lens[idx], buf);
+		pass = pass && !memcmp(&macs[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+	}
+
+	// So must a batch too small to fill the lanes.
+	md5_hmac_batch(&hkey, data, lens, macs, 3);
+	for (idx = 0; idx < 3; ++idx) {
+		md5_hmac(&hkey, data[idx], lens[idx], buf);
+		pass = pass && !memcmp(&macs[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+	}
+
+	return(pass);
+}
+
+int md5_fixed_test()
+{
+	BYTE values[37 * 32];
+	BYTE hashes[37 * MD5_BLOCK_SIZE];
+	BYTE buf[MD5_BLOCK_SIZE];
+	MD5_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(values); ++idx)
+		values[idx] = idx * 13 + 5;
+
+	// Each must agree with the general functions, one value and in batches.
+	md5_hash16_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		md5_init(&ctx);
+		md5_update(&ctx, &values[idx * 16], 16);
+		md5_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+		md5_hash16(&values[idx * 16], buf);
+		pass = pass && !memcmp(&hashes[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+	}
+	md5_hash20_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		md5_init(&ctx);
+		md5_update(&ctx, &values[idx * 20], 20);
+		md5_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+		md5_hash20(&values[idx * 20], buf);
+		pass = pass && !memcmp(&hashes[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+	}
+	md5_hash32_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		md5_init(&ctx);
+		md5_update(&ctx, &values[idx * 32], 32);
+		md5_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+		md5_hash32(&values[idx * 32], buf);
+		pass = pass && !memcmp(&hashes[idx * MD5_BLOCK_SIZE], buf, MD5_BLOCK_SIZE);
+	}
+
+	return(pass);
+}
+
 int main()
 {
-	printf("MD5 tests: %s\n", md5_test() ? "SUCCEEDED" : "FAILED");
+	printf("MD5 tests: %s\n", md5_test() && md5_chunk_test() &&
+	       md5_multi_test() && md5_serialize_test() &&
+	       md5_hmac_test() && md5_fixed_test() ? "SUCCEEDED" : "FAILED");
 
 	return(0);
 }
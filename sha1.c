@@ -14,9 +14,150 @@
 #include <memory.h>
 #include "sha1.h"
 
+// Kernels for the x86 SHA extensions, for SSSE3 and for multi-buffer hashing
+// with SSE2/AVX2/AVX-512, chosen at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SHA1_NO_SIMD)
+#define SHA1_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef SHA1_THREADS
+#include <pthread.h>
+#endif
+
 /****************************** MACROS ******************************/
+#define TRUE  1
+#define FALSE 0
+
 #define ROTLEFT(a, b) ((a << b) | (a >> (32 - b)))
 
+// Four rounds of group g with sha1rnds4. e picks up the E term for this group
+// from cur while e_next saves ABCD for the next one. The schedule moves three
+// word groups along at the same time.
+#define SHANI_ROUNDS(g,e,e_next,cur,prev,next,next2) \
+	if ((g) == 0) \
+		e = _mm_add_epi32(e, cur); \
+	else \
+		e = _mm_sha1nexte_epu32(e, cur); \
+	e_next = abcd; \
+	if ((g) >= 3 && (g) <= 18) \
+		next = _mm_sha1msg2_epu32(next, cur); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, (g) / 5); \
+	if ((g) >= 1 && (g) <= 16) \
+		prev = _mm_sha1msg1_epu32(prev, cur); \
+	if ((g) >= 2 && (g) <= 17) \
+		next2 = _mm_xor_si128(next2, cur);
+
+// One round of a multi-buffer batch. From round 16 on, the message word for
+// the round replaces the one 16 rounds back.
+#define SHA1_MB_ROUND(i,f,kv) \
+	if ((i) >= 16) { \
+		t = m[((i) - 3) & 15] ^ m[((i) - 8) & 15] ^ m[((i) - 14) & 15] ^ m[(i) & 15]; \
+		m[(i) & 15] = ROTLEFT(t, 1); \
+	} \
+	t = ROTLEFT(a, 5) + (f) + e + (kv) + m[(i) & 15]; \
+	e = d; \
+	d = c; \
+	c = ROTLEFT(b, 30); \
+	b = a; \
+	a = t;
+
+// Compresses one block in each of the lanes of a multi-buffer batch. The
+// state is stored transposed, word by lane, so every vector holds the same
+// word of all the messages. The _words variant takes the message words
+// already transposed, for callers that build them in that form.
+#define SHA1_MB_KERNEL(name,vec,lanes,isa) \
+__attribute__((target(isa))) \
+static void name##_words(WORD state[][SHA1_MB_LANES], const WORD w[][SHA1_MB_LANES]) \
+{ \
+	vec a, b, c, d, e, t, m[16]; \
+	int i; \
+\
+	for (i = 0; i < 16; ++i) \
+		memcpy(&m[i], w[i], sizeof(vec)); \
+	memcpy(&a, state[0], sizeof(vec)); \
+	memcpy(&b, state[1], sizeof(vec)); \
+	memcpy(&c, state[2], sizeof(vec)); \
+	memcpy(&d, state[3], sizeof(vec)); \
+	memcpy(&e, state[4], sizeof(vec)); \
+\
+	for (i = 0; i < 20; ++i) { \
+		SHA1_MB_ROUND(i, (b & c) ^ (~b & d), k[0]); \
+	} \
+	for ( ; i < 40; ++i) { \
+		SHA1_MB_ROUND(i, b ^ c ^ d, k[1]); \
+	} \
+	for ( ; i < 60; ++i) { \
+		SHA1_MB_ROUND(i, (b & c) ^ (b & d) ^ (c & d), k[2]); \
+	} \
+	for ( ; i < 80; ++i) { \
+		SHA1_MB_ROUND(i, b ^ c ^ d, k[3]); \
+	} \
+\
+	SHA1_MB_ADD(state[0], a, t); \
+	SHA1_MB_ADD(state[1], b, t); \
+	SHA1_MB_ADD(state[2], c, t); \
+	SHA1_MB_ADD(state[3], d, t); \
+	SHA1_MB_ADD(state[4], e, t); \
+} \
+\
+__attribute__((target(isa))) \
+static void name(WORD state[][SHA1_MB_LANES], const BYTE *const blocks[]) \
+{ \
+	WORD w[16][SHA1_MB_LANES]; \
+	int i, l; \
+\
+	for (i = 0; i < 16; ++i) { \
+		for (l = 0; l < (lanes); ++l) { \
+			memcpy(&w[i][l], &blocks[l][i * 4], 4); \
+			w[i][l] = __builtin_bswap32(w[i][l]); \
+		} \
+	} \
+	name##_words(state, (const WORD (*)[SHA1_MB_LANES])w); \
+}
+
+// Adds v into a row of transposed state, using t as scratch.
+#define SHA1_MB_ADD(row,v,t) \
+	memcpy(&(t), row, sizeof(t)); \
+	(t) += (v); \
+	memcpy(row, &(t), sizeof(t));
+
+#define SHA1_HMAC_GROUP 64              // Messages per inner/outer pass of a batch HMAC
+#define SHA1_MB_LANES 16                // Lanes of the widest (AVX-512) kernel
+
+// Upper bound on the workers used by sha1_pbkdf2_batch_mt().
+#define SHA1_MAX_THREADS 64
+
+/**************************** DATA TYPES ****************************/
+#ifdef SHA1_SIMD
+typedef WORD SHA1_VEC4 __attribute__((vector_size(16)));
+typedef WORD SHA1_VEC8 __attribute__((vector_size(32)));
+typedef WORD SHA1_VEC16 __attribute__((vector_size(64)));
+#endif
+
+/**************************** VARIABLES *****************************/
+static const WORD k[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+
+// The padding that follows a 16-, 20- or 32-byte message, length included.
+static const BYTE pad16[48] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x80
+};
+static const BYTE pad20[44] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xa0
+};
+static const BYTE pad32[32] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x00
+};
+
+#ifdef SHA1_SIMD
+static const BYTE mb_idle[64];          // Block fed to lanes with no message
+#endif
+
 /*********************** FUNCTION DEFINITIONS ***********************/
 void sha1_transform(SHA1_CTX *ctx, const BYTE data[])
 {
@@ -36,7 +177,7 @@ void sha1_transform(SHA1_CTX *ctx, const BYTE data[])
 	e = ctx->state[4];
 
 	for (i = 0; i < 20; ++i) {
-		t = ROTLEFT(a, 5) + ((b & c) ^ (~b & d)) + e + ctx->k[0] + m[i];
+		t = ROTLEFT(a, 5) + ((b & c) ^ (~b & d)) + e + k[0] + m[i];
 		e = d;
 		d = c;
 		c = ROTLEFT(b, 30);
@@ -44,7 +185,7 @@ void sha1_transform(SHA1_CTX *ctx, const BYTE data[])
 		a = t;
 	}
 	for ( ; i < 40; ++i) {
-		t = ROTLEFT(a, 5) + (b ^ c ^ d) + e + ctx->k[1] + m[i];
+		t = ROTLEFT(a, 5) + (b ^ c ^ d) + e + k[1] + m[i];
 		e = d;
 		d = c;
 		c = ROTLEFT(b, 30);
@@ -52,7 +193,7 @@ void sha1_transform(SHA1_CTX *ctx, const BYTE data[])
 		a = t;
 	}
 	for ( ; i < 60; ++i) {
-		t = ROTLEFT(a, 5) + ((b & c) ^ (b & d) ^ (c & d))  + e + ctx->k[2] + m[i];
+		t = ROTLEFT(a, 5) + ((b & c) ^ (b & d) ^ (c & d))  + e + k[2] + m[i];
 		e = d;
 		d = c;
 		c = ROTLEFT(b, 30);
@@ -60,7 +201,7 @@ void sha1_transform(SHA1_CTX *ctx, const BYTE data[])
 		a = t;
 	}
 	for ( ; i < 80; ++i) {
-		t = ROTLEFT(a, 5) + (b ^ c ^ d) + e + ctx->k[3] + m[i];
+		t = ROTLEFT(a, 5) + (b ^ c ^ d) + e + k[3] + m[i];
 		e = d;
 		d = c;
 		c = ROTLEFT(b, 30);
@@ -90,21 +231,233 @@ void sha1_init(SHA1_CTX *ctx)
 	ctx->k[3] = 0xca62c1d6;
 }
 
-void sha1_update(SHA1_CTX *ctx, const BYTE data[], size_t len)
+#ifdef SHA1_SIMD
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha1_transform_shani(WORD state[], const BYTE data[], size_t blocks)
 {
-	size_t i;
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1, msg0, msg1, msg2, msg3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1b);
+	e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+	for ( ; blocks > 0; --blocks, data += 64) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[0]), mask);
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[16]), mask);
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[32]), mask);
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[48]), mask);
+
+		SHANI_ROUNDS(0, e0, e1, msg0, msg3, msg1, msg2);
+		SHANI_ROUNDS(1, e1, e0, msg1, msg0, msg2, msg3);
+		SHANI_ROUNDS(2, e0, e1, msg2, msg1, msg3, msg0);
+		SHANI_ROUNDS(3, e1, e0, msg3, msg2, msg0, msg1);
+		SHANI_ROUNDS(4, e0, e1, msg0, msg3, msg1, msg2);
+		SHANI_ROUNDS(5, e1, e0, msg1, msg0, msg2, msg3);
+		SHANI_ROUNDS(6, e0, e1, msg2, msg1, msg3, msg0);
+		SHANI_ROUNDS(7, e1, e0, msg3, msg2, msg0, msg1);
+		SHANI_ROUNDS(8, e0, e1, msg0, msg3, msg1, msg2);
+		SHANI_ROUNDS(9, e1, e0, msg1, msg0, msg2, msg3);
+		SHANI_ROUNDS(10, e0, e1, msg2, msg1, msg3, msg0);
+		SHANI_ROUNDS(11, e1, e0, msg3, msg2, msg0, msg1);
+		SHANI_ROUNDS(12, e0, e1, msg0, msg3, msg1, msg2);
+		SHANI_ROUNDS(13, e1, e0, msg1, msg0, msg2, msg3);
+		SHANI_ROUNDS(14, e0, e1, msg2, msg1, msg3, msg0);
+		SHANI_ROUNDS(15, e1, e0, msg3, msg2, msg0, msg1);
+		SHANI_ROUNDS(16, e0, e1, msg0, msg3, msg1, msg2);
+		SHANI_ROUNDS(17, e1, e0, msg1, msg0, msg2, msg3);
+		SHANI_ROUNDS(18, e0, e1, msg2, msg1, msg3, msg0);
+		SHANI_ROUNDS(19, e1, e0, msg3, msg2, msg0, msg1);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+	}
+
+	_mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1b));
+	state[4] = _mm_extract_epi32(e0, 3);
+}
+
+// Without the SHA extensions the schedule is still worth vectorizing: four
+// words at a time, with the constants folded in, leaving only the rounds
+// to the scalar code.
+__attribute__((target("ssse3")))
+static void sha1_transform_ssse3(WORD state[], const BYTE data[], size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i w[20], t;
+	WORD a, b, c, d, e, i, x, wk[80];
+
+	for ( ; blocks > 0; --blocks, data += 64) {
+		for (i = 0; i < 4; ++i)
+			w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[i * 16]), mask);
+		// w[i] = rol1(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16]) where the last lane's
+		// w[i-3] is the first lane of the same group, so it is patched in after.
+		for ( ; i < 20; ++i) {
+			t = _mm_xor_si128(_mm_srli_si128(w[i - 1], 4), w[i - 2]);
+			t = _mm_xor_si128(t, _mm_alignr_epi8(w[i - 3], w[i - 4], 8));
+			t = _mm_xor_si128(t, w[i - 4]);
+			t = _mm_or_si128(_mm_slli_epi32(t, 1), _mm_srli_epi32(t, 31));
+			x = _mm_cvtsi128_si32(t);
+			t = _mm_xor_si128(t, _mm_set_epi32((x << 1) | (x >> 31), 0, 0, 0));
+			w[i] = t;
+		}
+		for (i = 0; i < 20; ++i)
+			_mm_storeu_si128((__m128i *)&wk[i * 4], _mm_add_epi32(w[i], _mm_set1_epi32(k[i / 5])));
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			sha1_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
+		for (i = 0; i < 20; ++i) {
+			x = ROTLEFT(a, 5) + ((b & c) ^ (~b & d)) + e + wk[i];
+			e = d;
+			d = c;
+			c = ROTLEFT(b, 30);
+			b = a;
+			a = x;
 		}
+		for ( ; i < 40; ++i) {
+			x = ROTLEFT(a, 5) + (b ^ c ^ d) + e + wk[i];
+			e = d;
+			d = c;
+			c = ROTLEFT(b, 30);
+			b = a;
+			a = x;
+		}
+		for ( ; i < 60; ++i) {
+			x = ROTLEFT(a, 5) + ((b & c) ^ (b & d) ^ (c & d)) + e + wk[i];
+			e = d;
+			d = c;
+			c = ROTLEFT(b, 30);
+			b = a;
+			a = x;
+		}
+		for ( ; i < 80; ++i) {
+			x = ROTLEFT(a, 5) + (b ^ c ^ d) + e + wk[i];
+			e = d;
+			d = c;
+			c = ROTLEFT(b, 30);
+			b = a;
+			a = x;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
 	}
 }
 
+// 2 for the SHA extensions, 1 for SSSE3 and 0 for neither, checked on first use.
+static int sha1_simd_kind(void)
+{
+	static int kind = -1;
+
+	if (kind < 0) {
+		if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+			kind = 2;
+		else
+			kind = __builtin_cpu_supports("ssse3") ? 1 : 0;
+	}
+	return(kind);
+}
+#endif
+
+#ifdef SHA1_SIMD
+SHA1_MB_KERNEL(sha1_mb_sse2, SHA1_VEC4, 4, "sse2")
+SHA1_MB_KERNEL(sha1_mb_avx2, SHA1_VEC8, 8, "avx2")
+SHA1_MB_KERNEL(sha1_mb_avx512, SHA1_VEC16, 16, "avx512f")
+
+// The number of messages hashed side by side, 0 if there is no kernel.
+static int sha1_mb_lanes(void)
+{
+	static int lanes = -1;
+
+	if (lanes < 0)
+		lanes = __builtin_cpu_supports("avx512f") ? 16 : __builtin_cpu_supports("avx2") ? 8 :
+		        __builtin_cpu_supports("sse2") ? 4 : 0;
+	return(lanes);
+}
+
+static void sha1_mb_compress(int lanes, WORD state[][SHA1_MB_LANES], const BYTE *const blocks[])
+{
+	if (lanes == 16)
+		sha1_mb_avx512(state, blocks);
+	else if (lanes == 8)
+		sha1_mb_avx2(state, blocks);
+	else
+		sha1_mb_sse2(state, blocks);
+}
+
+static void sha1_mb_compress_words(int lanes, WORD state[][SHA1_MB_LANES], const WORD w[][SHA1_MB_LANES])
+{
+	if (lanes == 16)
+		sha1_mb_avx512_words(state, w);
+	else if (lanes == 8)
+		sha1_mb_avx2_words(state, w);
+	else
+		sha1_mb_sse2_words(state, w);
+}
+#endif
+
+static void sha1_compress(SHA1_CTX *ctx, const BYTE data[], size_t blocks)
+{
+	size_t i;
+
+#ifdef SHA1_SIMD
+	switch (sha1_simd_kind()) {
+	case 2:
+		sha1_transform_shani(ctx->state, data, blocks);
+		return;
+	case 1:
+		sha1_transform_ssse3(ctx->state, data, blocks);
+		return;
+	}
+#endif
+	for (i = 0; i < blocks; ++i)
+		sha1_transform(ctx, &data[i * 64]);
+}
+
+// Hashes whole blocks straight from the caller's buffer.
+static void sha1_transform_blocks(SHA1_CTX *ctx, const BYTE data[], size_t blocks)
+{
+	if (blocks == 0)
+		return;
+	sha1_compress(ctx, data, blocks);
+	ctx->bitlen += (unsigned long long)blocks * 512;
+}
+
+void sha1_update(SHA1_CTX *ctx, const BYTE data[], size_t len)
+{
+	size_t i = 0, fill;
+
+	// Top up a partially filled block first.
+	if (ctx->datalen > 0) {
+		fill = 64 - ctx->datalen;
+		if (fill > len)
+			fill = len;
+		memcpy(&ctx->data[ctx->datalen], data, fill);
+		ctx->datalen += fill;
+		if (ctx->datalen < 64)
+			return;
+		sha1_transform_blocks(ctx, ctx->data, 1);
+		ctx->datalen = 0;
+		i = fill;
+	}
+
+	sha1_transform_blocks(ctx, &data[i], (len - i) / 64);
+	i += (len - i) / 64 * 64;
+
+	// Only the tail is buffered.
+	memcpy(ctx->data, &data[i], len - i);
+	ctx->datalen = len - i;
+}
+
 void sha1_final(SHA1_CTX *ctx, BYTE hash[])
 {
 	WORD i;
@@ -121,7 +474,7 @@ void sha1_final(SHA1_CTX *ctx, BYTE hash[])
 		ctx->data[i++] = 0x80;
 		while (i < 64)
 			ctx->data[i++] = 0x00;
-		sha1_transform(ctx, ctx->data);
+		sha1_compress(ctx, ctx->data, 1);
 		memset(ctx->data, 0, 56);
 	}
 
@@ -135,7 +488,7 @@ void sha1_final(SHA1_CTX *ctx, BYTE hash[])
 	ctx->data[58] = ctx->bitlen >> 40;
 	ctx->data[57] = ctx->bitlen >> 48;
 	ctx->data[56] = ctx->bitlen >> 56;
-	sha1_transform(ctx, ctx->data);
+	sha1_compress(ctx, ctx->data, 1);
 
 	// Since this implementation uses little endian byte ordering and MD uses big endian,
 	// reverse all the bytes when copying the final state to the output hash.
@@ -147,3 +500,611 @@ void sha1_final(SHA1_CTX *ctx, BYTE hash[])
 		hash[i + 16] = (ctx->state[4] >> (24 - i * 8)) & 0x000000ff;
 	}
 }
+
+#ifdef SHA1_SIMD
+// Starts the next message in a lane of a multi-buffer batch from state iv.
+static void sha1_mb_start(WORD state[][SHA1_MB_LANES], int lane, const WORD iv[])
+{
+	int i;
+
+	for (i = 0; i < 5; ++i)
+		state[i][lane] = iv[i];
+}
+
+// Builds the one or two final blocks of a message from its tail and its total
+// length in bits, returning how many blocks there are.
+static int sha1_mb_pad(BYTE pad[], const BYTE tail[], size_t tail_len, unsigned long long bitlen)
+{
+	int blocks = tail_len < 56 ? 1 : 2;
+	int i;
+
+	memcpy(pad, tail, tail_len);
+	pad[tail_len] = 0x80;
+	memset(&pad[tail_len + 1], 0, blocks * 64 - tail_len - 1);
+	for (i = 0; i < 8; ++i)
+		pad[blocks * 64 - 1 - i] = bitlen >> (i * 8);
+	return(blocks);
+}
+#endif
+
+// The number of lanes to hash count messages in, or 0 to hash them one at a
+// time. The lanes only pay off once about half of them are filled, and eight
+// of them lose to the SHA extensions.
+static int sha1_multi_lanes(size_t count)
+{
+	int lanes = 0;
+
+#ifdef SHA1_SIMD
+	lanes = sha1_mb_lanes();
+	if (sha1_simd_kind() == 2 && lanes < 16)
+		lanes = 0;
+#endif
+	return(count * 2 >= (size_t)lanes ? lanes : 0);
+}
+
+// Hashes each message on from the state in start, which must not hold any
+// buffered bytes.
+static void sha1_multi_from(const SHA1_CTX *start, const BYTE *const data[], const size_t lens[],
+                            BYTE hashes[], size_t count)
+{
+#ifdef SHA1_SIMD
+	WORD state[5][SHA1_MB_LANES];
+	BYTE pad[SHA1_MB_LANES][128];
+	const BYTE *blocks[SHA1_MB_LANES];
+	size_t msg[SHA1_MB_LANES], pos[SHA1_MB_LANES], next = 0;
+	int pad_blocks[SHA1_MB_LANES], pad_used[SHA1_MB_LANES];
+	int lanes, active = 0, l, i;
+#endif
+	SHA1_CTX ctx;
+	size_t idx;
+
+#ifdef SHA1_SIMD
+	lanes = sha1_multi_lanes(count);
+	if (lanes > 0) {
+		// Each lane works through its message block by block, then through its
+		// padding, and is handed the next message as soon as it is done.
+		for (l = 0; l < lanes; ++l) {
+			msg[l] = next < count ? next++ : count;
+			if (msg[l] < count) {
+				sha1_mb_start(state, l, start->state);
+				pos[l] = 0;
+				pad_blocks[l] = 0;
+				active++;
+			}
+		}
+		while (active > 0) {
+			for (l = 0; l < lanes; ++l) {
+				if (msg[l] == count)
+					blocks[l] = mb_idle;
+				else if (pad_blocks[l] == 0 && lens[msg[l]] - pos[l] >= 64) {
+					blocks[l] = &data[msg[l]][pos[l]];
+					pos[l] += 64;
+				}
+				else {
+					if (pad_blocks[l] == 0) {
+						pad_blocks[l] = sha1_mb_pad(pad[l], &data[msg[l]][pos[l]], lens[msg[l]] - pos[l],
+						                            start->bitlen + (unsigned long long)lens[msg[l]] * 8);
+						pad_used[l] = 0;
+					}
+					blocks[l] = &pad[l][pad_used[l]++ * 64];
+				}
+			}
+			sha1_mb_compress(lanes, state, blocks);
+			for (l = 0; l < lanes; ++l) {
+				if (msg[l] == count || pad_blocks[l] == 0 || pad_used[l] < pad_blocks[l])
+					continue;
+				for (i = 0; i < 5; ++i) {
+					hashes[msg[l] * SHA1_BLOCK_SIZE + i * 4]     = state[i][l] >> 24;
+					hashes[msg[l] * SHA1_BLOCK_SIZE + i * 4 + 1] = state[i][l] >> 16;
+					hashes[msg[l] * SHA1_BLOCK_SIZE + i * 4 + 2] = state[i][l] >> 8;
+					hashes[msg[l] * SHA1_BLOCK_SIZE + i * 4 + 3] = state[i][l];
+				}
+				msg[l] = next < count ? next++ : count;
+				if (msg[l] < count) {
+					sha1_mb_start(state, l, start->state);
+					pos[l] = 0;
+					pad_blocks[l] = 0;
+				}
+				else
+					active--;
+			}
+		}
+		return;
+	}
+#endif
+	for (idx = 0; idx < count; ++idx) {
+		sha1_clone(&ctx, start);
+		sha1_update(&ctx, data[idx], lens[idx]);
+		sha1_final(&ctx, &hashes[idx * SHA1_BLOCK_SIZE]);
+	}
+}
+
+void sha1_hash_multi(const BYTE *const data[], const size_t lens[], BYTE hashes[], size_t count)
+{
+	SHA1_CTX start;
+
+	sha1_init(&start);
+	sha1_multi_from(&start, data, lens, hashes, count);
+}
+
+void sha1_clone(SHA1_CTX *dst, const SHA1_CTX *src)
+{
+	memcpy(dst, src, sizeof(SHA1_CTX));
+}
+
+// Stores value as bytes most significant first, so the serialized form is the
+// same on every platform.
+static void store_be(BYTE out[], unsigned long long value, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		out[i] = value >> ((bytes - 1 - i) * 8);
+}
+
+static unsigned long long load_be(const BYTE in[], int bytes)
+{
+	unsigned long long value = 0;
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		value = (value << 8) | in[i];
+	return(value);
+}
+
+// The layout is the tag "SHA1", the format version, the buffered byte count,
+// the bit count of the whole blocks hashed so far, the state words and
+// the block buffer, zero past the buffered bytes. Integers are big endian.
+void sha1_serialize(const SHA1_CTX *ctx, BYTE out[])
+{
+	int i;
+
+	memcpy(out, "SHA1", 4);
+	out[4] = SHA1_SERIAL_VERSION;
+	out[5] = ctx->datalen;
+	store_be(&out[6], ctx->bitlen, 8);
+	for (i = 0; i < 5; ++i)
+		store_be(&out[14 + i * 4], ctx->state[i], 4);
+	memcpy(&out[34], ctx->data, ctx->datalen);
+	memset(&out[34 + ctx->datalen], 0, 64 - ctx->datalen);
+}
+
+int sha1_deserialize(SHA1_CTX *ctx, const BYTE in[])
+{
+	unsigned long long bitlen;
+	WORD datalen;
+	int i;
+
+	if (memcmp(in, "SHA1", 4) != 0 || in[4] != SHA1_SERIAL_VERSION)
+		return(FALSE);
+	datalen = in[5];
+	bitlen = load_be(&in[6], 8);
+	if (datalen >= 64 || bitlen % 512 != 0)
+		return(FALSE);
+
+	ctx->datalen = datalen;
+	ctx->bitlen = bitlen;
+	for (i = 0; i < 5; ++i)
+		ctx->state[i] = load_be(&in[14 + i * 4], 4);
+	ctx->k[0] = 0x5a827999;
+	ctx->k[1] = 0x6ed9eba1;
+	ctx->k[2] = 0x8f1bbcdc;
+	ctx->k[3] = 0xca62c1d6;
+	memcpy(ctx->data, &in[34], 64);
+
+	return(TRUE);
+}
+
+void sha1_hmac_key_setup(SHA1_HMAC_KEY *hkey, const BYTE key[], size_t key_len)
+{
+	BYTE block[64], hashed[SHA1_BLOCK_SIZE];
+	SHA1_CTX ctx;
+	size_t i;
+
+	// Keys longer than a block are hashed down first.
+	if (key_len > 64) {
+		sha1_init(&ctx);
+		sha1_update(&ctx, key, key_len);
+		sha1_final(&ctx, hashed);
+		key = hashed;
+		key_len = SHA1_BLOCK_SIZE;
+	}
+	memset(block, 0, 64);
+	memcpy(block, key, key_len);
+
+	for (i = 0; i < 64; ++i)
+		block[i] ^= 0x36;
+	sha1_init(&hkey->inner);
+	sha1_update(&hkey->inner, block, 64);
+
+	for (i = 0; i < 64; ++i)
+		block[i] ^= 0x36 ^ 0x5c;
+	sha1_init(&hkey->outer);
+	sha1_update(&hkey->outer, block, 64);
+}
+
+void sha1_hmac_init(const SHA1_HMAC_KEY *hkey, SHA1_CTX *ctx)
+{
+	sha1_clone(ctx, &hkey->inner);
+}
+
+void sha1_hmac_final(const SHA1_HMAC_KEY *hkey, SHA1_CTX *ctx, BYTE mac[])
+{
+	BYTE inner[SHA1_BLOCK_SIZE];
+
+	sha1_final(ctx, inner);
+	sha1_clone(ctx, &hkey->outer);
+	sha1_update(ctx, inner, SHA1_BLOCK_SIZE);
+	sha1_final(ctx, mac);
+}
+
+void sha1_hmac(const SHA1_HMAC_KEY *hkey, const BYTE data[], size_t len, BYTE mac[])
+{
+	SHA1_CTX ctx;
+
+	sha1_hmac_init(hkey, &ctx);
+	sha1_update(&ctx, data, len);
+	sha1_hmac_final(hkey, &ctx, mac);
+}
+
+void sha1_hmac_batch(const SHA1_HMAC_KEY *hkey, const BYTE *const data[], const size_t lens[],
+                     BYTE macs[], size_t count)
+{
+	BYTE inner[SHA1_HMAC_GROUP * SHA1_BLOCK_SIZE];
+	const BYTE *inner_ptrs[SHA1_HMAC_GROUP];
+	size_t inner_lens[SHA1_HMAC_GROUP];
+	size_t done, group, i;
+
+	// Without lanes to fill, the batch is the single-message path.
+	if (sha1_multi_lanes(count) == 0) {
+		for (i = 0; i < count; ++i)
+			sha1_hmac(hkey, data[i], lens[i], &macs[i * SHA1_BLOCK_SIZE]);
+		return;
+	}
+
+	// The inner hashes of a group of messages run side by side from the inner
+	// midstate, then the outer hashes of those from the outer one.
+	for (done = 0; done < count; done += group) {
+		group = count - done < SHA1_HMAC_GROUP ? count - done : SHA1_HMAC_GROUP;
+		sha1_multi_from(&hkey->inner, &data[done], &lens[done], inner, group);
+		for (i = 0; i < group; ++i) {
+			inner_ptrs[i] = &inner[i * SHA1_BLOCK_SIZE];
+			inner_lens[i] = SHA1_BLOCK_SIZE;
+		}
+		sha1_multi_from(&hkey->outer, inner_ptrs, inner_lens, &macs[done * SHA1_BLOCK_SIZE], group);
+	}
+}
+
+// The iterations after U_1 for one output block. Each U is hashed from a
+// fixed-length message, so its padding is written once into the block and
+// only the digest part changes.
+static void sha1_pbkdf2_iterate(const SHA1_HMAC_KEY *hkey, BYTE acc[], WORD iterations)
+{
+	BYTE block[64];
+	SHA1_CTX ctx;
+	WORD n;
+	int i;
+
+	memcpy(block, acc, SHA1_BLOCK_SIZE);
+	block[SHA1_BLOCK_SIZE] = 0x80;
+	memset(&block[SHA1_BLOCK_SIZE + 1], 0, 64 - SHA1_BLOCK_SIZE - 1);
+	store_be(&block[56], (64 + SHA1_BLOCK_SIZE) * 8, 8);
+
+	for (n = 1; n < iterations; ++n) {
+		memcpy(ctx.state, hkey->inner.state, sizeof(ctx.state));
+		sha1_compress(&ctx, block, 1);
+		for (i = 0; i < 5; ++i)
+			store_be(&block[i * 4], ctx.state[i], 4);
+		memcpy(ctx.state, hkey->outer.state, sizeof(ctx.state));
+		sha1_compress(&ctx, block, 1);
+		for (i = 0; i < 5; ++i) {
+			store_be(&block[i * 4], ctx.state[i], 4);
+			acc[i * 4]     ^= block[i * 4];
+			acc[i * 4 + 1] ^= block[i * 4 + 1];
+			acc[i * 4 + 2] ^= block[i * 4 + 2];
+			acc[i * 4 + 3] ^= block[i * 4 + 3];
+		}
+	}
+}
+
+#ifdef SHA1_SIMD
+// The same for one output block per lane. The message words stay transposed
+// between iterations, so no lane is ever converted back to bytes until the end.
+static void sha1_pbkdf2_iterate_mb(int lanes, const SHA1_HMAC_KEY hkeys[], BYTE accs[], int jobs,
+                                   WORD iterations)
+{
+	WORD inner[5][SHA1_MB_LANES], outer[5][SHA1_MB_LANES], state[5][SHA1_MB_LANES];
+	WORD w[16][SHA1_MB_LANES], acc[5][SHA1_MB_LANES];
+	WORD n;
+	int i, l;
+
+	memset(inner, 0, sizeof(inner));
+	memset(outer, 0, sizeof(outer));
+	memset(w, 0, sizeof(w));
+	for (l = 0; l < jobs; ++l) {
+		sha1_mb_start(inner, l, hkeys[l].inner.state);
+		sha1_mb_start(outer, l, hkeys[l].outer.state);
+		for (i = 0; i < 5; ++i)
+			w[i][l] = load_be(&accs[l * SHA1_BLOCK_SIZE + i * 4], 4);
+	}
+	for (l = 0; l < SHA1_MB_LANES; ++l) {
+		w[5][l] = 0x80000000;
+		w[15][l] = (64 + SHA1_BLOCK_SIZE) * 8;
+	}
+	memcpy(acc, w, sizeof(acc));
+
+	for (n = 1; n < iterations; ++n) {
+		memcpy(state, inner, sizeof(state));
+		sha1_mb_compress_words(lanes, state, (const WORD (*)[SHA1_MB_LANES])w);
+		memcpy(w, state, sizeof(state));
+		memcpy(state, outer, sizeof(state));
+		sha1_mb_compress_words(lanes, state, (const WORD (*)[SHA1_MB_LANES])w);
+		memcpy(w, state, sizeof(state));
+		for (i = 0; i < 5; ++i)
+			for (l = 0; l < SHA1_MB_LANES; ++l)
+				acc[i][l] ^= w[i][l];
+	}
+
+	for (l = 0; l < jobs; ++l)
+		for (i = 0; i < 5; ++i)
+			store_be(&accs[l * SHA1_BLOCK_SIZE + i * 4], acc[i][l], 4);
+}
+#endif
+
+// Every output block of every password is a separate job. Jobs are keyed
+// and given their U_1 a group at a time, then iterated side by side.
+void sha1_pbkdf2_batch(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                       size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count)
+{
+	SHA1_HMAC_KEY hkeys[SHA1_MB_LANES];
+	BYTE accs[SHA1_MB_LANES * SHA1_BLOCK_SIZE], index[4];
+	SHA1_CTX ctx;
+	size_t per_password, total, done, job, offset, len;
+	int width = 1, group, j;
+
+	per_password = (out_len + SHA1_BLOCK_SIZE - 1) / SHA1_BLOCK_SIZE;
+	total = count * per_password;
+
+#ifdef SHA1_SIMD
+	// One job at a time beats the lanes until there are enough jobs to fill
+	// half of them.
+	width = sha1_mb_lanes();
+	if (width == 0 || total * 2 < (size_t)width)
+		width = 1;
+#endif
+
+	for (done = 0; done < total; done += group) {
+		group = total - done < (size_t)width ? (int)(total - done) : width;
+		for (j = 0; j < group; ++j) {
+			job = done + j;
+			store_be(index, job % per_password + 1, 4);
+			sha1_hmac_key_setup(&hkeys[j], passwords[job / per_password], password_lens[job / per_password]);
+			sha1_hmac_init(&hkeys[j], &ctx);
+			sha1_update(&ctx, salt, salt_len);
+			sha1_update(&ctx, index, 4);
+			sha1_hmac_final(&hkeys[j], &ctx, &accs[j * SHA1_BLOCK_SIZE]);
+		}
+
+#ifdef SHA1_SIMD
+		if (width > 1)
+			sha1_pbkdf2_iterate_mb(width, hkeys, accs, group, iterations);
+		else
+#endif
+			sha1_pbkdf2_iterate(&hkeys[0], accs, iterations);
+
+		// The last block of each key is cut to out_len.
+		for (j = 0; j < group; ++j) {
+			job = done + j;
+			offset = job % per_password * SHA1_BLOCK_SIZE;
+			len = out_len - offset < SHA1_BLOCK_SIZE ? out_len - offset : SHA1_BLOCK_SIZE;
+			memcpy(&outs[job / per_password * out_len + offset], &accs[j * SHA1_BLOCK_SIZE], len);
+		}
+	}
+}
+
+void sha1_pbkdf2(const BYTE password[], size_t password_len, const BYTE salt[], size_t salt_len,
+                 WORD iterations, BYTE out[], size_t out_len)
+{
+	sha1_pbkdf2_batch(&password, &password_len, salt, salt_len, iterations, out, out_len, 1);
+}
+
+// Each worker derives a run of whole keys with sha1_pbkdf2_batch(), so
+// the keys never depend on how they were split up. Workers are only started
+// when built with SHA1_THREADS; otherwise the runs go in turn on the calling
+// thread.
+typedef struct {
+	const BYTE *const *passwords;
+	const size_t *password_lens;
+	const BYTE *salt;
+	size_t salt_len;
+	WORD iterations;
+	BYTE *outs;
+	size_t out_len;
+	size_t count;                       // Keys in this run
+} SHA1_PBKDF2_JOB;
+
+static void *sha1_pbkdf2_worker(void *arg)
+{
+	SHA1_PBKDF2_JOB *job = (SHA1_PBKDF2_JOB *)arg;
+
+	sha1_pbkdf2_batch(job->passwords, job->password_lens, job->salt, job->salt_len, job->iterations,
+	                  job->outs, job->out_len, job->count);
+	return(NULL);
+}
+
+void sha1_pbkdf2_batch_mt(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                          size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count,
+                          int threads)
+{
+	SHA1_PBKDF2_JOB job[SHA1_MAX_THREADS];
+	size_t chunk, pos;
+	int jobs, idx;
+#ifdef SHA1_THREADS
+	pthread_t tid[SHA1_MAX_THREADS];
+	int started[SHA1_MAX_THREADS];
+#endif
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > SHA1_MAX_THREADS)
+		threads = SHA1_MAX_THREADS;
+
+#ifdef SHA1_SIMD
+	// Settle the cached CPU checks before any worker reads them.
+	sha1_simd_kind();
+	sha1_mb_lanes();
+#endif
+
+	chunk = (count + threads - 1) / threads;
+	for (jobs = 0, pos = 0; pos < count; ++jobs, pos += chunk) {
+		job[jobs].passwords = &passwords[pos];
+		job[jobs].password_lens = &password_lens[pos];
+		job[jobs].salt = salt;
+		job[jobs].salt_len = salt_len;
+		job[jobs].iterations = iterations;
+		job[jobs].outs = &outs[pos * out_len];
+		job[jobs].out_len = out_len;
+		job[jobs].count = count - pos < chunk ? count - pos : chunk;
+	}
+
+#ifdef SHA1_THREADS
+	// The calling thread takes the first run itself.
+	for (idx = 1; idx < jobs; ++idx)
+		started[idx] = pthread_create(&tid[idx], NULL, sha1_pbkdf2_worker, &job[idx]) == 0;
+	if (jobs > 0)
+		sha1_pbkdf2_worker(&job[0]);
+	for (idx = 1; idx < jobs; ++idx) {
+		if (started[idx])
+			pthread_join(tid[idx], NULL);
+		else
+			sha1_pbkdf2_worker(&job[idx]);
+	}
+#else
+	for (idx = 0; idx < jobs; ++idx)
+		sha1_pbkdf2_worker(&job[idx]);
+#endif
+}
+
+// SHA-1 of one value already laid out with its padding in a single block.
+// The callers copy the value and the padding with constant sizes, which is
+// most of what they save over sha1_update().
+static void sha1_fixed_block(const BYTE block[], BYTE hash[])
+{
+	SHA1_CTX ctx;
+	int i;
+
+	sha1_init(&ctx);
+	sha1_compress(&ctx, block, 1);
+	for (i = 0; i < 5; ++i)
+		store_be(&hash[i * 4], ctx.state[i], 4);
+}
+
+void sha1_hash16(const BYTE data[], BYTE hash[])
+{
+	BYTE block[64];
+
+	memcpy(block, data, 16);
+	memcpy(&block[16], pad16, 48);
+	sha1_fixed_block(block, hash);
+}
+
+void sha1_hash20(const BYTE data[], BYTE hash[])
+{
+	BYTE block[64];
+
+	memcpy(block, data, 20);
+	memcpy(&block[20], pad20, 44);
+	sha1_fixed_block(block, hash);
+}
+
+void sha1_hash32(const BYTE data[], BYTE hash[])
+{
+	BYTE block[64];
+
+	memcpy(block, data, 32);
+	memcpy(&block[32], pad32, 32);
+	sha1_fixed_block(block, hash);
+}
+
+#ifdef SHA1_SIMD
+static const BYTE *sha1_fixed_pad(size_t len)
+{
+	return(len == 16 ? pad16 : len == 20 ? pad20 : pad32);
+}
+
+// The same for up to one value per lane. The message words of the padding are
+// transposed once, and only the value's own words change between groups.
+static void sha1_fixed_mb(int lanes, const BYTE data[], size_t len, BYTE hashes[], size_t count)
+{
+	WORD state[5][SHA1_MB_LANES], w[16][SHA1_MB_LANES];
+	const BYTE *pad = sha1_fixed_pad(len);
+	SHA1_CTX start;
+	size_t done;
+	int words = len / 4, group, i, l;
+
+	sha1_init(&start);
+	memset(w, 0, sizeof(w));
+	for (i = words; i < 16; ++i)
+		for (l = 0; l < SHA1_MB_LANES; ++l)
+			w[i][l] = load_be(&pad[i * 4 - len], 4);
+
+	for (done = 0; done < count; done += group) {
+		group = count - done < (size_t)lanes ? (int)(count - done) : lanes;
+		for (l = 0; l < lanes; ++l)
+			sha1_mb_start(state, l, start.state);
+		for (i = 0; i < words; ++i) {
+			for (l = 0; l < group; ++l) {
+				memcpy(&w[i][l], &data[(done + l) * len + i * 4], 4);
+				w[i][l] = __builtin_bswap32(w[i][l]);
+			}
+		}
+		sha1_mb_compress_words(lanes, state, (const WORD (*)[SHA1_MB_LANES])w);
+
+		for (l = 0; l < group; ++l) {
+			for (i = 0; i < 5; ++i) {
+				state[i][l] = __builtin_bswap32(state[i][l]);
+				memcpy(&hashes[(done + l) * SHA1_BLOCK_SIZE + i * 4], &state[i][l], 4);
+			}
+		}
+	}
+}
+#endif
+
+static void sha1_fixed(const BYTE data[], size_t len, BYTE hashes[], size_t count)
+{
+	size_t idx;
+
+#ifdef SHA1_SIMD
+	int lanes = sha1_mb_lanes();
+
+	// Even against the SHA extensions the lanes win once about half of them
+	// are filled.
+	if (lanes > 0 && count * 2 >= (size_t)lanes) {
+		sha1_fixed_mb(lanes, data, len, hashes, count);
+		return;
+	}
+#endif
+	for (idx = 0; idx < count; ++idx) {
+		if (len == 16)
+			sha1_hash16(&data[idx * len], &hashes[idx * SHA1_BLOCK_SIZE]);
+		else if (len == 20)
+			sha1_hash20(&data[idx * len], &hashes[idx * SHA1_BLOCK_SIZE]);
+		else
+			sha1_hash32(&data[idx * len], &hashes[idx * SHA1_BLOCK_SIZE]);
+	}
+}
+
+void sha1_hash16_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	sha1_fixed(data, 16, hashes, count);
+}
+
+void sha1_hash20_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	sha1_fixed(data, 20, hashes, count);
+}
+
+void sha1_hash32_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	sha1_fixed(data, 32, hashes, count);
+}
@@ -14,6 +14,8 @@
 
 /****************************** MACROS ******************************/
 #define SHA1_BLOCK_SIZE 20              // SHA1 outputs a 20 byte digest
+#define SHA1_SERIAL_SIZE 98             // Bytes written by sha1_serialize()
+#define SHA1_SERIAL_VERSION 1           // Format version of the serialized state
 
 /**************************** DATA TYPES ****************************/
 typedef unsigned char BYTE;             // 8-bit byte
@@ -27,9 +29,71 @@ typedef struct {
 	WORD k[4];
 } SHA1_CTX;
 
+typedef struct {
+	SHA1_CTX inner;                     // State after hashing the key XOR ipad
+	SHA1_CTX outer;                     // State after hashing the key XOR opad
+} SHA1_HMAC_KEY;
+
 /*********************** FUNCTION DECLARATIONS **********************/
 void sha1_init(SHA1_CTX *ctx);
 void sha1_update(SHA1_CTX *ctx, const BYTE data[], size_t len);
 void sha1_final(SHA1_CTX *ctx, BYTE hash[]);
 
+// A copy of a context in progress carries on independently of the original,
+// so a shared prefix only has to be hashed once.
+void sha1_clone(SHA1_CTX *dst, const SHA1_CTX *src);
+
+// Saves a context in progress to SHA1_SERIAL_SIZE bytes with the same layout
+// on every platform, to be resumed later with sha1_deserialize(). The
+// deserialize function returns False if the bytes are not a valid state of
+// the same format version.
+void sha1_serialize(const SHA1_CTX *ctx, BYTE out[]);
+int sha1_deserialize(SHA1_CTX *ctx, const BYTE in[]);
+
+// Hashes count independent messages, one per SIMD lane where the CPU allows,
+// and writes their digests one after another to hashes
+// (count * SHA1_BLOCK_SIZE bytes). The messages may differ in length.
+void sha1_hash_multi(const BYTE *const data[], const size_t lens[], BYTE hashes[], size_t count);
+
+// HMAC. The key is absorbed once into inner and outer midstates, so each
+// message only costs cloning them. Streaming use is hmac_init, sha1_update
+// on the context, then hmac_final. The batch function writes count MACs one
+// after another to macs and runs the messages side by side like
+// sha1_hash_multi().
+void sha1_hmac_key_setup(SHA1_HMAC_KEY *hkey, const BYTE key[], size_t key_len);
+void sha1_hmac_init(const SHA1_HMAC_KEY *hkey, SHA1_CTX *ctx);
+void sha1_hmac_final(const SHA1_HMAC_KEY *hkey, SHA1_CTX *ctx, BYTE mac[]);
+void sha1_hmac(const SHA1_HMAC_KEY *hkey, const BYTE data[], size_t len, BYTE mac[]);
+void sha1_hmac_batch(const SHA1_HMAC_KEY *hkey, const BYTE *const data[], const size_t lens[],
+                     BYTE macs[], size_t count);
+
+// PBKDF2 with HMAC-SHA-1 (RFC 8018). Derives out_len bytes from a password
+// and salt over at least one iteration. The batch function derives count keys
+// with the same salt and iteration count, written one after another to outs
+// (count * out_len bytes), and iterates them side by side where the CPU
+// allows.
+void sha1_pbkdf2(const BYTE password[], size_t password_len, const BYTE salt[], size_t salt_len,
+                 WORD iterations, BYTE out[], size_t out_len);
+void sha1_pbkdf2_batch(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                       size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count);
+
+// The batch split across up to "threads" workers, each deriving a run of the
+// keys. The output is identical to sha1_pbkdf2_batch(). Workers are threads
+// only if sha1.c is built with SHA1_THREADS defined (and linked with pthreads);
+// otherwise the work is done on the calling thread.
+void sha1_pbkdf2_batch_mt(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                          size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count,
+                          int threads);
+
+// Fixed-length SHA-1 of 16-, 20- and 32-byte values, such as other digests
+// and identifiers. The padding is precomputed and nothing is buffered. The
+// batch functions take count values one after another in data and write their
+// digests one after another to hashes (count * SHA1_BLOCK_SIZE bytes).
+void sha1_hash16(const BYTE data[], BYTE hash[]);
+void sha1_hash20(const BYTE data[], BYTE hash[]);
+void sha1_hash32(const BYTE data[], BYTE hash[]);
+void sha1_hash16_batch(const BYTE data[], BYTE hashes[], size_t count);
+void sha1_hash20_batch(const BYTE data[], BYTE hashes[], size_t count);
+void sha1_hash32_batch(const BYTE data[], BYTE hashes[], size_t count);
+
 #endif   // SHA1_H
@@ -50,9 +50,286 @@ int sha1_test()
 	return(pass);
 }
 
+// Whole blocks are hashed straight from the input buffer and only the tail
+// is buffered, so check that a single large update and many uneven ones give
+// the same digest.
+int sha1_chunk_test()
+{
+	static BYTE text[1000000];
+	BYTE hash[SHA1_BLOCK_SIZE] = {0x34,0xaa,0x97,0x3c,0xd4,0xc4,0xda,0xa4,0xf6,0x1e,0xeb,0x2b,0xdb,0xad,0x27,0x31,0x65,0x34,0x01,0x6f};
+	BYTE buf[SHA1_BLOCK_SIZE];
+	SHA1_CTX ctx;
+	size_t idx, len;
+	int pass = 1;
+
+	memset(text, 'a', sizeof(text));
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, text, sizeof(text));
+	sha1_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA1_BLOCK_SIZE);
+
+	sha1_init(&ctx);
+	for (idx = 0, len = 1; idx < sizeof(text); idx += len, len = len % 150 + 1) {
+		if (len > sizeof(text) - idx)
+			len = sizeof(text) - idx;
+		sha1_update(&ctx, &text[idx], len);
+	}
+	sha1_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA1_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// Messages of many different lengths, so lanes finish and are refilled at
+// different times, must hash the same as they do one at a time.
+int sha1_multi_test()
+{
+	static BYTE long_text[100000];
+	BYTE text[40 * 7];
+	BYTE hashes[40 * SHA1_BLOCK_SIZE];
+	BYTE buf[SHA1_BLOCK_SIZE];
+	const BYTE *data[40];
+	size_t lens[40];
+	SHA1_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(text); ++idx)
+		text[idx] = idx * 31 + 7;
+	for (idx = 0; idx < 40; ++idx) {
+		data[idx] = &text[idx % 3];
+		lens[idx] = (idx * 7 * 13) % (sizeof(text) - 2);
+	}
+	sha1_hash_multi(data, lens, hashes, 40);
+
+	for (idx = 0; idx < 40; ++idx) {
+		sha1_init(&ctx);
+		sha1_update(&ctx, data[idx], lens[idx]);
+		sha1_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+	}
+
+	// A single message is hashed on its own rather than in one lane of many.
+	for (idx = 0; idx < (int)sizeof(long_text); ++idx)
+		long_text[idx] = idx * 17 + 3;
+	data[0] = long_text;
+	lens[0] = sizeof(long_text);
+	sha1_hash_multi(data, lens, hashes, 1);
+	sha1_init(&ctx);
+	sha1_update(&ctx, long_text, sizeof(long_text));
+	sha1_final(&ctx, buf);
+	pass = pass && !memcmp(hashes, buf, SHA1_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// A context saved part way through and resumed, and a clone finishing a
+// shared prefix, must both give the same digest as hashing in one go.
+int sha1_serialize_test()
+{
+	BYTE text[300];
+	BYTE saved[SHA1_SERIAL_SIZE];
+	BYTE hash[SHA1_BLOCK_SIZE];
+	BYTE buf[SHA1_BLOCK_SIZE];
+	SHA1_CTX ctx, resumed, copy;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(text); ++idx)
+		text[idx] = idx * 13 + 5;
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, text, sizeof(text));
+	sha1_final(&ctx, hash);
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, text, 131);
+	sha1_serialize(&ctx, saved);
+	memset(&resumed, 0xff, sizeof(resumed));
+	pass = pass && sha1_deserialize(&resumed, saved);
+	sha1_update(&resumed, &text[131], sizeof(text) - 131);
+	sha1_final(&resumed, buf);
+	pass = pass && !memcmp(hash, buf, SHA1_BLOCK_SIZE);
+
+	sha1_clone(&copy, &ctx);
+	sha1_update(&ctx, &text[131], sizeof(text) - 131);
+	sha1_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA1_BLOCK_SIZE);
+	sha1_update(&copy, &text[131], sizeof(text) - 131);
+	sha1_final(&copy, buf);
+	pass = pass && !memcmp(hash, buf, SHA1_BLOCK_SIZE);
+
+	// Another format version, or a damaged buffer count, is refused.
+	saved[4]++;
+	pass = pass && !sha1_deserialize(&resumed, saved);
+	saved[4]--;
+	saved[5] = 0xff;
+	pass = pass && !sha1_deserialize(&resumed, saved);
+
+	return(pass);
+}
+
+int sha1_hmac_test()
+{
+	BYTE key1[20], key2[131];
+	BYTE text1[] = {"Hi There"};
+	BYTE text2[] = {"Test Using Larger Than Block-Size Key - Hash Key First"};
+	BYTE mac1[SHA1_BLOCK_SIZE] = {0xb6,0x17,0x31,0x86,0x55,0x05,0x72,0x64,0xe2,0x8b,0xc0,0xb6,0xfb,0x37,0x8c,0x8e,
+	                              0xf1,0x46,0xbe,0x00};
+	BYTE mac2[SHA1_BLOCK_SIZE] = {0x90,0xd0,0xda,0xce,0x1c,0x1b,0xdc,0x95,0x73,0x39,0x30,0x78,0x03,0x16,0x03,0x35,
+	                              0xbd,0xe6,0xdf,0x2b};
+	BYTE text3[40 * 5];
+	BYTE macs[40 * SHA1_BLOCK_SIZE];
+	BYTE buf[SHA1_BLOCK_SIZE];
+	const BYTE *data[40];
+	size_t lens[40];
+	SHA1_HMAC_KEY hkey;
+	SHA1_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	memset(key1, 0x0b, sizeof(key1));
+	memset(key2, 0xaa, sizeof(key2));
+
+	sha1_hmac_key_setup(&hkey, key1, sizeof(key1));
+	sha1_hmac(&hkey, text1, strlen(text1), buf);
+	pass = pass && !memcmp(mac1, buf, SHA1_BLOCK_SIZE);
+
+	// Keys longer than a block are hashed first. Also try the streaming calls.
+	sha1_hmac_key_setup(&hkey, key2, sizeof(key2));
+	sha1_hmac_init(&hkey, &ctx);
+	sha1_update(&ctx, text2, 10);
+	sha1_update(&ctx, &text2[10], strlen(text2) - 10);
+	sha1_hmac_final(&hkey, &ctx, buf);
+	pass = pass && !memcmp(mac2, buf, SHA1_BLOCK_SIZE);
+
+	// The batch must agree with one message at a time.
+	for (idx = 0; idx < (int)sizeof(text3); ++idx)
+		text3[idx] = idx * 7 + 1;
+	for (idx = 0; idx < 40; ++idx) {
+		data[idx] = &text3[idx];
+		lens[idx] = (idx * 37) % 150;
+	}
+	sha1_hmac_batch(&hkey, data, lens, macs, 40);
+	for (idx = 0; idx < 40; ++idx) {
+		sha1_hmac(&hkey, data[idx], lens[idx], buf);
+		pass = pass && !memcmp(&macs[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+	}
+
+	// So must a batch too small to fill the lanes.
+	sha1_hmac_batch(&hkey, data, lens, macs, 3);
+	for (idx = 0; idx < 3; ++idx) {
+		sha1_hmac(&hkey, data[idx], lens[idx], buf);
+		pass = pass && !memcmp(&macs[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+	}
+
+	return(pass);
+}
+
+int sha1_pbkdf2_test()
+{
+	BYTE pass1[] = {"password"}, salt1[] = {"salt"};
+	BYTE pass2[] = {"passwordPASSWORDpassword"}, salt2[] = {"saltSALTsaltSALTsaltSALTsaltSALTsalt"};
+	BYTE dk1[20] = {0x0c,0x60,0xc8,0x0f,0x96,0x1f,0x0e,0x71,0xf3,0xa9,0xb5,0x24,0xaf,0x60,0x12,0x06,
+	                0x2f,0xe0,0x37,0xa6};
+	BYTE dk2[20] = {0xea,0x6c,0x01,0x4d,0xc7,0x2d,0x6f,0x8c,0xcd,0x1e,0xd9,0x2a,0xce,0x1d,0x41,0xf0,
+	                0xd8,0xde,0x89,0x57};
+	BYTE dk3[20] = {0x4b,0x00,0x79,0x01,0xb7,0x65,0x48,0x9a,0xbe,0xad,0x49,0xd9,0x26,0xf7,0x21,0xd0,
+	                0x65,0xa4,0x29,0xc1};
+	BYTE dk4[25] = {0x3d,0x2e,0xec,0x4f,0xe4,0x1c,0x84,0x9b,0x80,0xc8,0xd8,0x36,0x62,0xc0,0xe4,0x4a,
+	                0x8b,0x29,0x1a,0x96,0x4c,0xf2,0xf0,0x70,0x38};
+	BYTE passwords[20 * 3];
+	BYTE outs[20 * 25], outs_mt[20 * 25];
+	BYTE buf[25];
+	const BYTE *ptrs[20];
+	size_t lens[20];
+	int idx;
+	int pass = 1;
+
+	// RFC 6070 vectors.
+	sha1_pbkdf2(pass1, strlen(pass1), salt1, strlen(salt1), 1, buf, 20);
+	pass = pass && !memcmp(dk1, buf, 20);
+	sha1_pbkdf2(pass1, strlen(pass1), salt1, strlen(salt1), 2, buf, 20);
+	pass = pass && !memcmp(dk2, buf, 20);
+	sha1_pbkdf2(pass1, strlen(pass1), salt1, strlen(salt1), 4096, buf, 20);
+	pass = pass && !memcmp(dk3, buf, 20);
+	sha1_pbkdf2(pass2, strlen(pass2), salt2, strlen(salt2), 4096, buf, 25);
+	pass = pass && !memcmp(dk4, buf, 25);
+
+	// The batch must agree with one password at a time.
+	for (idx = 0; idx < (int)sizeof(passwords); ++idx)
+		passwords[idx] = idx * 11 + 3;
+	for (idx = 0; idx < 20; ++idx) {
+		ptrs[idx] = &passwords[idx * 3];
+		lens[idx] = idx % 4;
+	}
+	sha1_pbkdf2_batch(ptrs, lens, salt1, strlen(salt1), 5, outs, 25, 20);
+	for (idx = 0; idx < 20; ++idx) {
+		sha1_pbkdf2(ptrs[idx], lens[idx], salt1, strlen(salt1), 5, buf, 25);
+		pass = pass && !memcmp(&outs[idx * 25], buf, 25);
+	}
+
+	// However the batch is split between workers, the keys are the same.
+	for (idx = 1; idx <= 7; idx += 3) {
+		memset(outs_mt, 0, sizeof(outs_mt));
+		sha1_pbkdf2_batch_mt(ptrs, lens, salt1, strlen(salt1), 5, outs_mt, 25, 20, idx);
+		pass = pass && !memcmp(outs, outs_mt, sizeof(outs));
+	}
+
+	return(pass);
+}
+
+int sha1_fixed_test()
+{
+	BYTE values[37 * 32];
+	BYTE hashes[37 * SHA1_BLOCK_SIZE];
+	BYTE buf[SHA1_BLOCK_SIZE];
+	SHA1_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(values); ++idx)
+		values[idx] = idx * 13 + 5;
+
+	// Each must agree with the general functions, one value and in batches.
+	sha1_hash16_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		sha1_init(&ctx);
+		sha1_update(&ctx, &values[idx * 16], 16);
+		sha1_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+		sha1_hash16(&values[idx * 16], buf);
+		pass = pass && !memcmp(&hashes[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+	}
+	sha1_hash20_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		sha1_init(&ctx);
+		sha1_update(&ctx, &values[idx * 20], 20);
+		sha1_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+		sha1_hash20(&values[idx * 20], buf);
+		pass = pass && !memcmp(&hashes[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+	}
+	sha1_hash32_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		sha1_init(&ctx);
+		sha1_update(&ctx, &values[idx * 32], 32);
+		sha1_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+		sha1_hash32(&values[idx * 32], buf);
+		pass = pass && !memcmp(&hashes[idx * SHA1_BLOCK_SIZE], buf, SHA1_BLOCK_SIZE);
+	}
+
+	return(pass);
+}
+
 int main()
 {
-	printf("SHA1 tests: %s\n", sha1_test() ? "SUCCEEDED" : "FAILED");
+	printf("SHA1 tests: %s\n", sha1_test() && sha1_chunk_test() &&
+	       sha1_multi_test() && sha1_serialize_test() &&
+	       sha1_hmac_test() && sha1_pbkdf2_test() &&
+	       sha1_fixed_test() ? "SUCCEEDED" : "FAILED");
 
 	return(0);
 }
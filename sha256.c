@@ -5,8 +5,8 @@
 * Disclaimer: This code is presented "as is" without any guarantees.
 * Details:    Implementation of the SHA-256 hashing algorithm.
               SHA-256 is one of the three algorithms in the SHA2
-              specification. The others, SHA-384 and SHA-512, are not
-              offered in this implementation.
+              specification. The others, SHA-384 and SHA-512, are in
+              sha512.c.
               Algorithm specification can be found here:
                * http://csrc.nist.gov/publications/fips/fips180-2/fips180-2withchangenotice.pdf
               This implementation uses little endian byte order.
@@ -17,7 +17,21 @@
 #include <memory.h>
 #include "sha256.h"
 
+// Kernels for the x86 SHA extensions and for multi-buffer hashing with
+// SSE2/AVX2/AVX-512, chosen at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SHA256_NO_SIMD)
+#define SHA256_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef SHA256_THREADS
+#include <pthread.h>
+#endif
+
 /****************************** MACROS ******************************/
+#define TRUE  1
+#define FALSE 0
+
 #define ROTLEFT(a,b) (((a) << (b)) | ((a) >> (32-(b))))
 #define ROTRIGHT(a,b) (((a) >> (b)) | ((a) << (32-(b))))
 
@@ -28,6 +42,127 @@
 #define SIG0(x) (ROTRIGHT(x,7) ^ ROTRIGHT(x,18) ^ ((x) >> 3))
 #define SIG1(x) (ROTRIGHT(x,17) ^ ROTRIGHT(x,19) ^ ((x) >> 10))
 
+// Four rounds of group g. Along the way the schedule finishes the word group
+// after cur (sha256msg2) and starts the one before it (sha256msg1).
+#define SHANI_ROUNDS(g,cur,prev,next) \
+	msg = _mm_add_epi32(cur, _mm_loadu_si128((const __m128i *)&k[(g) * 4])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+	if ((g) >= 3 && (g) <= 14) \
+		next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur); \
+	msg = _mm_shuffle_epi32(msg, 0x0e); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, msg); \
+	if ((g) >= 1 && (g) <= 12) \
+		prev = _mm_sha256msg1_epu32(prev, cur);
+
+// One round with the names rotated instead of the values, so eight calls
+// bring a..h back to where they started.
+#define SHA256_ROUND(a,b,c,d,e,f,g,h,w) \
+	t1 = h + EP1(e) + CH(e,f,g) + (w); \
+	d += t1; \
+	h = t1 + EP0(a) + MAJ(a,b,c);
+
+// SIG0/SIG1 over eight schedule words at once.
+#define AVX2_ROTRIGHT(x,n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define AVX2_SIG0(x) _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTRIGHT(x, 7), AVX2_ROTRIGHT(x, 18)), \
+                                      _mm256_srli_epi32(x, 3))
+#define AVX2_SIG1(x) _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTRIGHT(x, 17), AVX2_ROTRIGHT(x, 19)), \
+                                      _mm256_srli_epi32(x, 10))
+
+// Replaces x0, the oldest four schedule words of each of two blocks, with the
+// next four. Words 2 and 3 depend on words 0 and 1 of the same group, so SIG1
+// is applied in two halves.
+#define AVX2_SCHEDULE(x0,x1,x2,x3) \
+	t = _mm256_add_epi32(_mm256_add_epi32(x0, AVX2_SIG0(_mm256_alignr_epi8(x1, x0, 4))), \
+	                     _mm256_alignr_epi8(x3, x2, 4)); \
+	t = _mm256_add_epi32(t, _mm256_and_si256(AVX2_SIG1(_mm256_shuffle_epi32(x3, 0x0e)), lo)); \
+	x0 = _mm256_add_epi32(t, _mm256_and_si256(AVX2_SIG1(_mm256_shuffle_epi32(t, 0x40)), hi));
+
+// Loads the same four words of two blocks, one per 128-bit half.
+#define AVX2_LOAD2(p,q,mask) \
+	_mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256( \
+	                    _mm_loadu_si128((const __m128i *)(p))), _mm_loadu_si128((const __m128i *)(q)), 1), mask)
+
+// Compresses one block in each of the lanes of a multi-buffer batch. The
+// state is stored transposed, word by lane, so every vector holds the same
+// word of all the messages. The _words variant takes the message words
+// already transposed, for callers that build them in that form.
+#define SHA256_MB_KERNEL(name,vec,lanes,isa) \
+__attribute__((target(isa))) \
+static void name##_words(WORD state[][SHA256_MB_LANES], const WORD w[][SHA256_MB_LANES]) \
+{ \
+	vec a, b, c, d, e, f, g, h, t1, t2, m[16]; \
+	int i; \
+\
+	for (i = 0; i < 16; ++i) \
+		memcpy(&m[i], w[i], sizeof(vec)); \
+	memcpy(&a, state[0], sizeof(vec)); \
+	memcpy(&b, state[1], sizeof(vec)); \
+	memcpy(&c, state[2], sizeof(vec)); \
+	memcpy(&d, state[3], sizeof(vec)); \
+	memcpy(&e, state[4], sizeof(vec)); \
+	memcpy(&f, state[5], sizeof(vec)); \
+	memcpy(&g, state[6], sizeof(vec)); \
+	memcpy(&h, state[7], sizeof(vec)); \
+\
+	for (i = 0; i < 64; ++i) { \
+		if (i >= 16) \
+			m[i & 15] += SIG1(m[(i - 2) & 15]) + m[(i - 7) & 15] + SIG0(m[(i - 15) & 15]); \
+		t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i & 15]; \
+		t2 = EP0(a) + MAJ(a,b,c); \
+		h = g; \
+		g = f; \
+		f = e; \
+		e = d + t1; \
+		d = c; \
+		c = b; \
+		b = a; \
+		a = t1 + t2; \
+	} \
+\
+	SHA256_MB_ADD(state[0], a, t1); \
+	SHA256_MB_ADD(state[1], b, t1); \
+	SHA256_MB_ADD(state[2], c, t1); \
+	SHA256_MB_ADD(state[3], d, t1); \
+	SHA256_MB_ADD(state[4], e, t1); \
+	SHA256_MB_ADD(state[5], f, t1); \
+	SHA256_MB_ADD(state[6], g, t1); \
+	SHA256_MB_ADD(state[7], h, t1); \
+} \
+\
+__attribute__((target(isa))) \
+static void name(WORD state[][SHA256_MB_LANES], const BYTE *const blocks[]) \
+{ \
+	WORD w[16][SHA256_MB_LANES]; \
+	int i, l; \
+\
+	for (i = 0; i < 16; ++i) { \
+		for (l = 0; l < (lanes); ++l) { \
+			memcpy(&w[i][l], &blocks[l][i * 4], 4); \
+			w[i][l] = __builtin_bswap32(w[i][l]); \
+		} \
+	} \
+	name##_words(state, (const WORD (*)[SHA256_MB_LANES])w); \
+}
+
+// Adds v into a row of transposed state, using t as scratch.
+#define SHA256_MB_ADD(row,v,t) \
+	memcpy(&(t), row, sizeof(t)); \
+	(t) += (v); \
+	memcpy(row, &(t), sizeof(t));
+
+#define SHA256_HMAC_GROUP 64            // Messages per inner/outer pass of a batch HMAC
+#define SHA256_MB_LANES 16              // Lanes of the widest (AVX-512) kernel
+
+// Upper bound on the workers used by sha256_pbkdf2_batch_mt().
+#define SHA256_MAX_THREADS 64
+
+/**************************** DATA TYPES ****************************/
+#ifdef SHA256_SIMD
+typedef WORD SHA256_VEC4 __attribute__((vector_size(16)));
+typedef WORD SHA256_VEC8 __attribute__((vector_size(32)));
+typedef WORD SHA256_VEC16 __attribute__((vector_size(64)));
+#endif
+
 /**************************** VARIABLES *****************************/
 static const WORD k[64] = {
 	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
@@ -40,6 +175,23 @@ static const WORD k[64] = {
 	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
 };
 
+// The padding that follows a 32-byte message, and the whole block of it that
+// follows a 64-byte one, lengths included.
+static const BYTE pad32[32] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01,0x00
+};
+static const BYTE pad64[64] = {
+	0x80,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x02,0x00
+};
+
+#ifdef SHA256_SIMD
+static const BYTE mb_idle[64];          // Block fed to lanes with no message
+#endif
+
 /*********************** FUNCTION DEFINITIONS ***********************/
 void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
 {
@@ -96,19 +248,246 @@ void sha256_init(SHA256_CTX *ctx)
 	ctx->state[7] = 0x5be0cd19;
 }
 
-void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
+#ifdef SHA256_SIMD
+// The SHA extensions keep the state as ABEF/CDGH register pairs, so it is
+// shuffled in and out once per call rather than once per block.
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_transform_shani(WORD state[], const BYTE data[], size_t blocks)
 {
-	WORD i;
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, abef, cdgh, msg, msg0, msg1, msg2, msg3, tmp;
+
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	for ( ; blocks > 0; --blocks, data += 64) {
+		abef = state0;
+		cdgh = state1;
+
+		msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[0]), mask);
+		msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[16]), mask);
+		msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[32]), mask);
+		msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&data[48]), mask);
+
+		SHANI_ROUNDS(0, msg0, msg3, msg1);
+		SHANI_ROUNDS(1, msg1, msg0, msg2);
+		SHANI_ROUNDS(2, msg2, msg1, msg3);
+		SHANI_ROUNDS(3, msg3, msg2, msg0);
+		SHANI_ROUNDS(4, msg0, msg3, msg1);
+		SHANI_ROUNDS(5, msg1, msg0, msg2);
+		SHANI_ROUNDS(6, msg2, msg1, msg3);
+		SHANI_ROUNDS(7, msg3, msg2, msg0);
+		SHANI_ROUNDS(8, msg0, msg3, msg1);
+		SHANI_ROUNDS(9, msg1, msg0, msg2);
+		SHANI_ROUNDS(10, msg2, msg1, msg3);
+		SHANI_ROUNDS(11, msg3, msg2, msg0);
+		SHANI_ROUNDS(12, msg0, msg3, msg1);
+		SHANI_ROUNDS(13, msg1, msg0, msg2);
+		SHANI_ROUNDS(14, msg2, msg1, msg3);
+		SHANI_ROUNDS(15, msg3, msg2, msg0);
+
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	_mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xf0));
+	_mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+// The 64 rounds of one block, given its schedule words with k[] already
+// added. They sit in groups of four, interleaved with another block's.
+static void sha256_rounds_wk(WORD state[], const WORD wk[])
+{
+	WORD a, b, c, d, e, f, g, h, i, t1;
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
-		if (ctx->datalen == 64) {
-			sha256_transform(ctx, ctx->data);
-			ctx->bitlen += 512;
-			ctx->datalen = 0;
+	for (i = 0; i < 128; i += 16) {
+		SHA256_ROUND(a,b,c,d,e,f,g,h, wk[i]);
+		SHA256_ROUND(h,a,b,c,d,e,f,g, wk[i + 1]);
+		SHA256_ROUND(g,h,a,b,c,d,e,f, wk[i + 2]);
+		SHA256_ROUND(f,g,h,a,b,c,d,e, wk[i + 3]);
+		SHA256_ROUND(e,f,g,h,a,b,c,d, wk[i + 8]);
+		SHA256_ROUND(d,e,f,g,h,a,b,c, wk[i + 9]);
+		SHA256_ROUND(c,d,e,f,g,h,a,b, wk[i + 10]);
+		SHA256_ROUND(b,c,d,e,f,g,h,a, wk[i + 11]);
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+// Without the SHA extensions, AVX2 still takes the message schedule off the
+// scalar rounds: it expands two consecutive blocks at once, one per 128-bit
+// half, and adds k[] on the way out.
+__attribute__((target("avx2")))
+static void sha256_transform_avx2(WORD state[], const BYTE data[], size_t blocks)
+{
+	const __m256i mask = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+	                                       0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	const __m256i lo = _mm256_set_epi32(0, 0, -1, -1, 0, 0, -1, -1);
+	const __m256i hi = _mm256_set_epi32(-1, -1, 0, 0, -1, -1, 0, 0);
+	__m256i x0, x1, x2, x3, t;
+	WORD wk[128];
+	const BYTE *second;
+	int i, pair;
+
+	while (blocks > 0) {
+		// An odd last block is expanded alongside itself.
+		pair = blocks > 1;
+		second = pair ? &data[64] : data;
+
+		x0 = AVX2_LOAD2(&data[0], &second[0], mask);
+		x1 = AVX2_LOAD2(&data[16], &second[16], mask);
+		x2 = AVX2_LOAD2(&data[32], &second[32], mask);
+		x3 = AVX2_LOAD2(&data[48], &second[48], mask);
+
+		for (i = 0; i < 64; i += 16) {
+			if (i > 0) {
+				AVX2_SCHEDULE(x0, x1, x2, x3);
+				AVX2_SCHEDULE(x1, x2, x3, x0);
+				AVX2_SCHEDULE(x2, x3, x0, x1);
+				AVX2_SCHEDULE(x3, x0, x1, x2);
+			}
+			_mm256_storeu_si256((__m256i *)&wk[i * 2], _mm256_add_epi32(x0,
+			                    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)&k[i]))));
+			_mm256_storeu_si256((__m256i *)&wk[i * 2 + 8], _mm256_add_epi32(x1,
+			                    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)&k[i + 4]))));
+			_mm256_storeu_si256((__m256i *)&wk[i * 2 + 16], _mm256_add_epi32(x2,
+			                    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)&k[i + 8]))));
+			_mm256_storeu_si256((__m256i *)&wk[i * 2 + 24], _mm256_add_epi32(x3,
+			                    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)&k[i + 12]))));
 		}
+
+		sha256_rounds_wk(state, wk);
+		if (pair)
+			sha256_rounds_wk(state, &wk[4]);
+		data += 128;
+		blocks -= pair ? 2 : 1;
+	}
+}
+
+// 2 for the SHA extensions, 1 for AVX2 and 0 for neither, checked on first use.
+static int sha256_simd_kind(void)
+{
+	static int kind = -1;
+
+	if (kind < 0) {
+		if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+			kind = 2;
+		else
+			kind = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return(kind);
+}
+#endif
+
+#ifdef SHA256_SIMD
+SHA256_MB_KERNEL(sha256_mb_sse2, SHA256_VEC4, 4, "sse2")
+SHA256_MB_KERNEL(sha256_mb_avx2, SHA256_VEC8, 8, "avx2")
+SHA256_MB_KERNEL(sha256_mb_avx512, SHA256_VEC16, 16, "avx512f")
+
+// The number of messages hashed side by side, 0 if there is no kernel.
+static int sha256_mb_lanes(void)
+{
+	static int lanes = -1;
+
+	if (lanes < 0)
+		lanes = __builtin_cpu_supports("avx512f") ? 16 : __builtin_cpu_supports("avx2") ? 8 :
+		        __builtin_cpu_supports("sse2") ? 4 : 0;
+	return(lanes);
+}
+
+static void sha256_mb_compress(int lanes, WORD state[][SHA256_MB_LANES], const BYTE *const blocks[])
+{
+	if (lanes == 16)
+		sha256_mb_avx512(state, blocks);
+	else if (lanes == 8)
+		sha256_mb_avx2(state, blocks);
+	else
+		sha256_mb_sse2(state, blocks);
+}
+
+static void sha256_mb_compress_words(int lanes, WORD state[][SHA256_MB_LANES],
+                                     const WORD w[][SHA256_MB_LANES])
+{
+	if (lanes == 16)
+		sha256_mb_avx512_words(state, w);
+	else if (lanes == 8)
+		sha256_mb_avx2_words(state, w);
+	else
+		sha256_mb_sse2_words(state, w);
+}
+#endif
+
+static void sha256_compress(SHA256_CTX *ctx, const BYTE data[], size_t blocks)
+{
+	size_t i;
+
+#ifdef SHA256_SIMD
+	switch (sha256_simd_kind()) {
+	case 2:
+		sha256_transform_shani(ctx->state, data, blocks);
+		return;
+	case 1:
+		sha256_transform_avx2(ctx->state, data, blocks);
+		return;
 	}
+#endif
+	for (i = 0; i < blocks; ++i)
+		sha256_transform(ctx, &data[i * 64]);
+}
+
+// Hashes whole blocks straight from the caller's buffer.
+static void sha256_transform_blocks(SHA256_CTX *ctx, const BYTE data[], size_t blocks)
+{
+	if (blocks == 0)
+		return;
+	sha256_compress(ctx, data, blocks);
+	ctx->bitlen += (unsigned long long)blocks * 512;
+}
+
+void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
+{
+	size_t i = 0, fill;
+
+	// Top up a partially filled block first.
+	if (ctx->datalen > 0) {
+		fill = 64 - ctx->datalen;
+		if (fill > len)
+			fill = len;
+		memcpy(&ctx->data[ctx->datalen], data, fill);
+		ctx->datalen += fill;
+		if (ctx->datalen < 64)
+			return;
+		sha256_transform_blocks(ctx, ctx->data, 1);
+		ctx->datalen = 0;
+		i = fill;
+	}
+
+	sha256_transform_blocks(ctx, &data[i], (len - i) / 64);
+	i += (len - i) / 64 * 64;
+
+	// Only the tail is buffered.
+	memcpy(ctx->data, &data[i], len - i);
+	ctx->datalen = len - i;
 }
 
 void sha256_final(SHA256_CTX *ctx, BYTE hash[])
@@ -127,7 +506,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 		ctx->data[i++] = 0x80;
 		while (i < 64)
 			ctx->data[i++] = 0x00;
-		sha256_transform(ctx, ctx->data);
+		sha256_compress(ctx, ctx->data, 1);
 		memset(ctx->data, 0, 56);
 	}
 
@@ -141,7 +520,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 	ctx->data[58] = ctx->bitlen >> 40;
 	ctx->data[57] = ctx->bitlen >> 48;
 	ctx->data[56] = ctx->bitlen >> 56;
-	sha256_transform(ctx, ctx->data);
+	sha256_compress(ctx, ctx->data, 1);
 
 	// Since this implementation uses little endian byte ordering and SHA uses big endian,
 	// reverse all the bytes when copying the final state to the output hash.
@@ -156,3 +535,633 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 		hash[i + 28] = (ctx->state[7] >> (24 - i * 8)) & 0x000000ff;
 	}
 }
+
+#ifdef SHA256_SIMD
+// Starts the next message in a lane of a multi-buffer batch from state iv.
+static void sha256_mb_start(WORD state[][SHA256_MB_LANES], int lane, const WORD iv[])
+{
+	int i;
+
+	for (i = 0; i < 8; ++i)
+		state[i][lane] = iv[i];
+}
+
+// Builds the one or two final blocks of a message from its tail and its total
+// length in bits, returning how many blocks there are.
+static int sha256_mb_pad(BYTE pad[], const BYTE tail[], size_t tail_len, unsigned long long bitlen)
+{
+	int blocks = tail_len < 56 ? 1 : 2;
+	int i;
+
+	memcpy(pad, tail, tail_len);
+	pad[tail_len] = 0x80;
+	memset(&pad[tail_len + 1], 0, blocks * 64 - tail_len - 1);
+	for (i = 0; i < 8; ++i)
+		pad[blocks * 64 - 1 - i] = bitlen >> (i * 8);
+	return(blocks);
+}
+#endif
+
+// The number of lanes to hash count messages in, or 0 to hash them one at a
+// time. The lanes only pay off once about half of them are filled, and eight
+// of them lose to the SHA extensions.
+static int sha256_multi_lanes(size_t count)
+{
+	int lanes = 0;
+
+#ifdef SHA256_SIMD
+	lanes = sha256_mb_lanes();
+	if (sha256_simd_kind() == 2 && lanes < 16)
+		lanes = 0;
+#endif
+	return(count * 2 >= (size_t)lanes ? lanes : 0);
+}
+
+// Hashes each message on from the state in start, which must not hold any
+// buffered bytes.
+static void sha256_multi_from(const SHA256_CTX *start, const BYTE *const data[], const size_t lens[],
+                              BYTE hashes[], size_t count)
+{
+#ifdef SHA256_SIMD
+	WORD state[8][SHA256_MB_LANES];
+	BYTE pad[SHA256_MB_LANES][128];
+	const BYTE *blocks[SHA256_MB_LANES];
+	size_t msg[SHA256_MB_LANES], pos[SHA256_MB_LANES], next = 0;
+	int pad_blocks[SHA256_MB_LANES], pad_used[SHA256_MB_LANES];
+	int lanes, active = 0, l, i;
+#endif
+	SHA256_CTX ctx;
+	size_t idx;
+
+#ifdef SHA256_SIMD
+	lanes = sha256_multi_lanes(count);
+	if (lanes > 0) {
+		// Each lane works through its message block by block, then through its
+		// padding, and is handed the next message as soon as it is done.
+		for (l = 0; l < lanes; ++l) {
+			msg[l] = next < count ? next++ : count;
+			if (msg[l] < count) {
+				sha256_mb_start(state, l, start->state);
+				pos[l] = 0;
+				pad_blocks[l] = 0;
+				active++;
+			}
+		}
+		while (active > 0) {
+			for (l = 0; l < lanes; ++l) {
+				if (msg[l] == count)
+					blocks[l] = mb_idle;
+				else if (pad_blocks[l] == 0 && lens[msg[l]] - pos[l] >= 64) {
+					blocks[l] = &data[msg[l]][pos[l]];
+					pos[l] += 64;
+				}
+				else {
+					if (pad_blocks[l] == 0) {
+						pad_blocks[l] = sha256_mb_pad(pad[l], &data[msg[l]][pos[l]], lens[msg[l]] - pos[l],
+						                              start->bitlen + (unsigned long long)lens[msg[l]] * 8);
+						pad_used[l] = 0;
+					}
+					blocks[l] = &pad[l][pad_used[l]++ * 64];
+				}
+			}
+			sha256_mb_compress(lanes, state, blocks);
+			for (l = 0; l < lanes; ++l) {
+				if (msg[l] == count || pad_blocks[l] == 0 || pad_used[l] < pad_blocks[l])
+					continue;
+				for (i = 0; i < 8; ++i) {
+					hashes[msg[l] * SHA256_BLOCK_SIZE + i * 4]     = state[i][l] >> 24;
+					hashes[msg[l] * SHA256_BLOCK_SIZE + i * 4 + 1] = state[i][l] >> 16;
+					hashes[msg[l] * SHA256_BLOCK_SIZE + i * 4 + 2] = state[i][l] >> 8;
+					hashes[msg[l] * SHA256_BLOCK_SIZE + i * 4 + 3] = state[i][l];
+				}
+				msg[l] = next < count ? next++ : count;
+				if (msg[l] < count) {
+					sha256_mb_start(state, l, start->state);
+					pos[l] = 0;
+					pad_blocks[l] = 0;
+				}
+				else
+					active--;
+			}
+		}
+		return;
+	}
+#endif
+	for (idx = 0; idx < count; ++idx) {
+		sha256_clone(&ctx, start);
+		sha256_update(&ctx, data[idx], lens[idx]);
+		sha256_final(&ctx, &hashes[idx * SHA256_BLOCK_SIZE]);
+	}
+}
+
+void sha256_hash_multi(const BYTE *const data[], const size_t lens[], BYTE hashes[], size_t count)
+{
+	SHA256_CTX start;
+
+	sha256_init(&start);
+	sha256_multi_from(&start, data, lens, hashes, count);
+}
+
+void sha256_clone(SHA256_CTX *dst, const SHA256_CTX *src)
+{
+	memcpy(dst, src, sizeof(SHA256_CTX));
+}
+
+// Stores value as bytes most significant first, so the serialized form is the
+// same on every platform.
+static void store_be(BYTE out[], unsigned long long value, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		out[i] = value >> ((bytes - 1 - i) * 8);
+}
+
+static unsigned long long load_be(const BYTE in[], int bytes)
+{
+	unsigned long long value = 0;
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		value = (value << 8) | in[i];
+	return(value);
+}
+
+// The layout is the tag "S256", the format version, the buffered byte count,
+// the bit count of the whole blocks hashed so far, the state words and
+// the block buffer, zero past the buffered bytes. Integers are big endian.
+void sha256_serialize(const SHA256_CTX *ctx, BYTE out[])
+{
+	int i;
+
+	memcpy(out, "S256", 4);
+	out[4] = SHA256_SERIAL_VERSION;
+	out[5] = ctx->datalen;
+	store_be(&out[6], ctx->bitlen, 8);
+	for (i = 0; i < 8; ++i)
+		store_be(&out[14 + i * 4], ctx->state[i], 4);
+	memcpy(&out[46], ctx->data, ctx->datalen);
+	memset(&out[46 + ctx->datalen], 0, 64 - ctx->datalen);
+}
+
+int sha256_deserialize(SHA256_CTX *ctx, const BYTE in[])
+{
+	unsigned long long bitlen;
+	WORD datalen;
+	int i;
+
+	if (memcmp(in, "S256", 4) != 0 || in[4] != SHA256_SERIAL_VERSION)
+		return(FALSE);
+	datalen = in[5];
+	bitlen = load_be(&in[6], 8);
+	if (datalen >= 64 || bitlen % 512 != 0)
+		return(FALSE);
+
+	ctx->datalen = datalen;
+	ctx->bitlen = bitlen;
+	for (i = 0; i < 8; ++i)
+		ctx->state[i] = load_be(&in[14 + i * 4], 4);
+	memcpy(ctx->data, &in[46], 64);
+
+	return(TRUE);
+}
+
+void sha256_hmac_key_setup(SHA256_HMAC_KEY *hkey, const BYTE key[], size_t key_len)
+{
+	BYTE block[64], hashed[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+	size_t i;
+
+	// Keys longer than a block are hashed down first.
+	if (key_len > 64) {
+		sha256_init(&ctx);
+		sha256_update(&ctx, key, key_len);
+		sha256_final(&ctx, hashed);
+		key = hashed;
+		key_len = SHA256_BLOCK_SIZE;
+	}
+	memset(block, 0, 64);
+	memcpy(block, key, key_len);
+
+	for (i = 0; i < 64; ++i)
+		block[i] ^= 0x36;
+	sha256_init(&hkey->inner);
+	sha256_update(&hkey->inner, block, 64);
+
+	for (i = 0; i < 64; ++i)
+		block[i] ^= 0x36 ^ 0x5c;
+	sha256_init(&hkey->outer);
+	sha256_update(&hkey->outer, block, 64);
+}
+
+void sha256_hmac_init(const SHA256_HMAC_KEY *hkey, SHA256_CTX *ctx)
+{
+	sha256_clone(ctx, &hkey->inner);
+}
+
+void sha256_hmac_final(const SHA256_HMAC_KEY *hkey, SHA256_CTX *ctx, BYTE mac[])
+{
+	BYTE inner[SHA256_BLOCK_SIZE];
+
+	sha256_final(ctx, inner);
+	sha256_clone(ctx, &hkey->outer);
+	sha256_update(ctx, inner, SHA256_BLOCK_SIZE);
+	sha256_final(ctx, mac);
+}
+
+void sha256_hmac(const SHA256_HMAC_KEY *hkey, const BYTE data[], size_t len, BYTE mac[])
+{
+	SHA256_CTX ctx;
+
+	sha256_hmac_init(hkey, &ctx);
+	sha256_update(&ctx, data, len);
+	sha256_hmac_final(hkey, &ctx, mac);
+}
+
+void sha256_hmac_batch(const SHA256_HMAC_KEY *hkey, const BYTE *const data[], const size_t lens[],
+                       BYTE macs[], size_t count)
+{
+	BYTE inner[SHA256_HMAC_GROUP * SHA256_BLOCK_SIZE];
+	const BYTE *inner_ptrs[SHA256_HMAC_GROUP];
+	size_t inner_lens[SHA256_HMAC_GROUP];
+	size_t done, group, i;
+
+	// Without lanes to fill, the batch is the single-message path.
+	if (sha256_multi_lanes(count) == 0) {
+		for (i = 0; i < count; ++i)
+			sha256_hmac(hkey, data[i], lens[i], &macs[i * SHA256_BLOCK_SIZE]);
+		return;
+	}
+
+	// The inner hashes of a group of messages run side by side from the inner
+	// midstate, then the outer hashes of those from the outer one.
+	for (done = 0; done < count; done += group) {
+		group = count - done < SHA256_HMAC_GROUP ? count - done : SHA256_HMAC_GROUP;
+		sha256_multi_from(&hkey->inner, &data[done], &lens[done], inner, group);
+		for (i = 0; i < group; ++i) {
+			inner_ptrs[i] = &inner[i * SHA256_BLOCK_SIZE];
+			inner_lens[i] = SHA256_BLOCK_SIZE;
+		}
+		sha256_multi_from(&hkey->outer, inner_ptrs, inner_lens, &macs[done * SHA256_BLOCK_SIZE], group);
+	}
+}
+
+// The iterations after U_1 for one output block. Each U is hashed from a
+// fixed-length message, so its padding is written once into the block and
+// only the digest part changes.
+static void sha256_pbkdf2_iterate(const SHA256_HMAC_KEY *hkey, BYTE acc[], WORD iterations)
+{
+	BYTE block[64];
+	SHA256_CTX ctx;
+	WORD n;
+	int i;
+
+	memcpy(block, acc, SHA256_BLOCK_SIZE);
+	block[SHA256_BLOCK_SIZE] = 0x80;
+	memset(&block[SHA256_BLOCK_SIZE + 1], 0, 64 - SHA256_BLOCK_SIZE - 1);
+	store_be(&block[56], (64 + SHA256_BLOCK_SIZE) * 8, 8);
+
+	for (n = 1; n < iterations; ++n) {
+		memcpy(ctx.state, hkey->inner.state, sizeof(ctx.state));
+		sha256_compress(&ctx, block, 1);
+		for (i = 0; i < 8; ++i)
+			store_be(&block[i * 4], ctx.state[i], 4);
+		memcpy(ctx.state, hkey->outer.state, sizeof(ctx.state));
+		sha256_compress(&ctx, block, 1);
+		for (i = 0; i < 8; ++i) {
+			store_be(&block[i * 4], ctx.state[i], 4);
+			acc[i * 4]     ^= block[i * 4];
+			acc[i * 4 + 1] ^= block[i * 4 + 1];
+			acc[i * 4 + 2] ^= block[i * 4 + 2];
+			acc[i * 4 + 3] ^= block[i * 4 + 3];
+		}
+	}
+}
+
+#ifdef SHA256_SIMD
+// The same for one output block per lane. The message words stay transposed
+// between iterations, so no lane is ever converted back to bytes until the end.
+static void sha256_pbkdf2_iterate_mb(int lanes, const SHA256_HMAC_KEY hkeys[], BYTE accs[], int jobs,
+                                     WORD iterations)
+{
+	WORD inner[8][SHA256_MB_LANES], outer[8][SHA256_MB_LANES], state[8][SHA256_MB_LANES];
+	WORD w[16][SHA256_MB_LANES], acc[8][SHA256_MB_LANES];
+	WORD n;
+	int i, l;
+
+	memset(inner, 0, sizeof(inner));
+	memset(outer, 0, sizeof(outer));
+	memset(w, 0, sizeof(w));
+	for (l = 0; l < jobs; ++l) {
+		sha256_mb_start(inner, l, hkeys[l].inner.state);
+		sha256_mb_start(outer, l, hkeys[l].outer.state);
+		for (i = 0; i < 8; ++i)
+			w[i][l] = load_be(&accs[l * SHA256_BLOCK_SIZE + i * 4], 4);
+	}
+	for (l = 0; l < SHA256_MB_LANES; ++l) {
+		w[8][l] = 0x80000000;
+		w[15][l] = (64 + SHA256_BLOCK_SIZE) * 8;
+	}
+	memcpy(acc, w, sizeof(acc));
+
+	for (n = 1; n < iterations; ++n) {
+		memcpy(state, inner, sizeof(state));
+		sha256_mb_compress_words(lanes, state, (const WORD (*)[SHA256_MB_LANES])w);
+		memcpy(w, state, sizeof(state));
+		memcpy(state, outer, sizeof(state));
+		sha256_mb_compress_words(lanes, state, (const WORD (*)[SHA256_MB_LANES])w);
+		memcpy(w, state, sizeof(state));
+		for (i = 0; i < 8; ++i)
+			for (l = 0; l < SHA256_MB_LANES; ++l)
+				acc[i][l] ^= w[i][l];
+	}
+
+	for (l = 0; l < jobs; ++l)
+		for (i = 0; i < 8; ++i)
+			store_be(&accs[l * SHA256_BLOCK_SIZE + i * 4], acc[i][l], 4);
+}
+#endif
+
+// Every output block of every password is a separate job. Jobs are keyed
+// and given their U_1 a group at a time, then iterated side by side.
+void sha256_pbkdf2_batch(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                         size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count)
+{
+	SHA256_HMAC_KEY hkeys[SHA256_MB_LANES];
+	BYTE accs[SHA256_MB_LANES * SHA256_BLOCK_SIZE], index[4];
+	SHA256_CTX ctx;
+	size_t per_password, total, done, job, offset, len;
+	int width = 1, group, j;
+
+	per_password = (out_len + SHA256_BLOCK_SIZE - 1) / SHA256_BLOCK_SIZE;
+	total = count * per_password;
+
+#ifdef SHA256_SIMD
+	// One job at a time beats the lanes until there are enough jobs to fill
+	// half of them.
+	width = sha256_mb_lanes();
+	if (width == 0 || total * 2 < (size_t)width)
+		width = 1;
+#endif
+
+	for (done = 0; done < total; done += group) {
+		group = total - done < (size_t)width ? (int)(total - done) : width;
+		for (j = 0; j < group; ++j) {
+			job = done + j;
+			store_be(index, job % per_password + 1, 4);
+			sha256_hmac_key_setup(&hkeys[j], passwords[job / per_password], password_lens[job / per_password]);
+			sha256_hmac_init(&hkeys[j], &ctx);
+			sha256_update(&ctx, salt, salt_len);
+			sha256_update(&ctx, index, 4);
+			sha256_hmac_final(&hkeys[j], &ctx, &accs[j * SHA256_BLOCK_SIZE]);
+		}
+
+#ifdef SHA256_SIMD
+		if (width > 1)
+			sha256_pbkdf2_iterate_mb(width, hkeys, accs, group, iterations);
+		else
+#endif
+			sha256_pbkdf2_iterate(&hkeys[0], accs, iterations);
+
+		// The last block of each key is cut to out_len.
+		for (j = 0; j < group; ++j) {
+			job = done + j;
+			offset = job % per_password * SHA256_BLOCK_SIZE;
+			len = out_len - offset < SHA256_BLOCK_SIZE ? out_len - offset : SHA256_BLOCK_SIZE;
+			memcpy(&outs[job / per_password * out_len + offset], &accs[j * SHA256_BLOCK_SIZE], len);
+		}
+	}
+}
+
+void sha256_pbkdf2(const BYTE password[], size_t password_len, const BYTE salt[], size_t salt_len,
+                   WORD iterations, BYTE out[], size_t out_len)
+{
+	sha256_pbkdf2_batch(&password, &password_len, salt, salt_len, iterations, out, out_len, 1);
+}
+
+// Each worker derives a run of whole keys with sha256_pbkdf2_batch(), so
+// the keys never depend on how they were split up. Workers are only started
+// when built with SHA256_THREADS; otherwise the runs go in turn on the calling
+// thread.
+typedef struct {
+	const BYTE *const *passwords;
+	const size_t *password_lens;
+	const BYTE *salt;
+	size_t salt_len;
+	WORD iterations;
+	BYTE *outs;
+	size_t out_len;
+	size_t count;                       // Keys in this run
+} SHA256_PBKDF2_JOB;
+
+static void *sha256_pbkdf2_worker(void *arg)
+{
+	SHA256_PBKDF2_JOB *job = (SHA256_PBKDF2_JOB *)arg;
+
+	sha256_pbkdf2_batch(job->passwords, job->password_lens, job->salt, job->salt_len, job->iterations,
+	                    job->outs, job->out_len, job->count);
+	return(NULL);
+}
+
+void sha256_pbkdf2_batch_mt(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                            size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count,
+                            int threads)
+{
+	SHA256_PBKDF2_JOB job[SHA256_MAX_THREADS];
+	size_t chunk, pos;
+	int jobs, idx;
+#ifdef SHA256_THREADS
+	pthread_t tid[SHA256_MAX_THREADS];
+	int started[SHA256_MAX_THREADS];
+#endif
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > SHA256_MAX_THREADS)
+		threads = SHA256_MAX_THREADS;
+
+#ifdef SHA256_SIMD
+	// Settle the cached CPU checks before any worker reads them.
+	sha256_simd_kind();
+	sha256_mb_lanes();
+#endif
+
+	chunk = (count + threads - 1) / threads;
+	for (jobs = 0, pos = 0; pos < count; ++jobs, pos += chunk) {
+		job[jobs].passwords = &passwords[pos];
+		job[jobs].password_lens = &password_lens[pos];
+		job[jobs].salt = salt;
+		job[jobs].salt_len = salt_len;
+		job[jobs].iterations = iterations;
+		job[jobs].outs = &outs[pos * out_len];
+		job[jobs].out_len = out_len;
+		job[jobs].count = count - pos < chunk ? count - pos : chunk;
+	}
+
+#ifdef SHA256_THREADS
+	// The calling thread takes the first run itself.
+	for (idx = 1; idx < jobs; ++idx)
+		started[idx] = pthread_create(&tid[idx], NULL, sha256_pbkdf2_worker, &job[idx]) == 0;
+	if (jobs > 0)
+		sha256_pbkdf2_worker(&job[0]);
+	for (idx = 1; idx < jobs; ++idx) {
+		if (started[idx])
+			pthread_join(tid[idx], NULL);
+		else
+			sha256_pbkdf2_worker(&job[idx]);
+	}
+#else
+	for (idx = 0; idx < jobs; ++idx)
+		sha256_pbkdf2_worker(&job[idx]);
+#endif
+}
+
+// Single or double SHA-256 of one 32- or 64-byte value. A 32-byte value and
+// its padding fit in one block; a 64-byte value is hashed in place and
+// followed by the constant padding block.
+static void sha256_fixed_one(const BYTE data[], size_t len, int passes, BYTE hash[])
+{
+	BYTE block[64];
+	SHA256_CTX ctx;
+	int i;
+
+	memcpy(&block[32], pad32, 32);
+	sha256_init(&ctx);
+	if (len == 64) {
+		sha256_compress(&ctx, data, 1);
+		sha256_compress(&ctx, pad64, 1);
+	}
+	else {
+		memcpy(block, data, 32);
+		sha256_compress(&ctx, block, 1);
+	}
+
+	// The second pass hashes the 32-byte digest the same way.
+	if (passes == 2) {
+		for (i = 0; i < 8; ++i)
+			store_be(&block[i * 4], ctx.state[i], 4);
+		sha256_init(&ctx);
+		sha256_compress(&ctx, block, 1);
+	}
+
+	for (i = 0; i < 8; ++i)
+		store_be(&hash[i * 4], ctx.state[i], 4);
+}
+
+#ifdef SHA256_SIMD
+// The same for up to one value per lane. The message words of the padding are
+// transposed once, and only the value's own words change between groups.
+static void sha256_fixed_mb(int lanes, const BYTE data[], size_t len, int passes, BYTE hashes[], size_t count)
+{
+	WORD state[8][SHA256_MB_LANES], w32[16][SHA256_MB_LANES], w64[16][SHA256_MB_LANES];
+	const BYTE *blocks[SHA256_MB_LANES];
+	SHA256_CTX start;
+	size_t done;
+	int group, i, l;
+
+	sha256_init(&start);
+	memset(w32, 0, sizeof(w32));
+	for (i = 0; i < 16; ++i) {
+		for (l = 0; l < SHA256_MB_LANES; ++l) {
+			if (i >= 8)
+				w32[i][l] = load_be(&pad32[i * 4 - 32], 4);
+			w64[i][l] = load_be(&pad64[i * 4], 4);
+		}
+	}
+
+	for (done = 0; done < count; done += group) {
+		group = count - done < (size_t)lanes ? (int)(count - done) : lanes;
+		for (l = 0; l < lanes; ++l)
+			sha256_mb_start(state, l, start.state);
+
+		if (len == 64) {
+			for (l = 0; l < lanes; ++l)
+				blocks[l] = l < group ? &data[(done + l) * 64] : mb_idle;
+			sha256_mb_compress(lanes, state, blocks);
+			sha256_mb_compress_words(lanes, state, (const WORD (*)[SHA256_MB_LANES])w64);
+		}
+		else {
+			for (i = 0; i < 8; ++i) {
+				for (l = 0; l < group; ++l) {
+					memcpy(&w32[i][l], &data[(done + l) * 32 + i * 4], 4);
+					w32[i][l] = __builtin_bswap32(w32[i][l]);
+				}
+			}
+			sha256_mb_compress_words(lanes, state, (const WORD (*)[SHA256_MB_LANES])w32);
+		}
+
+		if (passes == 2) {
+			memcpy(w32, state, sizeof(state));
+			for (l = 0; l < lanes; ++l)
+				sha256_mb_start(state, l, start.state);
+			sha256_mb_compress_words(lanes, state, (const WORD (*)[SHA256_MB_LANES])w32);
+		}
+
+		for (l = 0; l < group; ++l) {
+			for (i = 0; i < 8; ++i) {
+				state[i][l] = __builtin_bswap32(state[i][l]);
+				memcpy(&hashes[(done + l) * SHA256_BLOCK_SIZE + i * 4], &state[i][l], 4);
+			}
+		}
+	}
+}
+#endif
+
+static void sha256_fixed(const BYTE data[], size_t len, int passes, BYTE hashes[], size_t count)
+{
+	size_t idx;
+
+#ifdef SHA256_SIMD
+	int lanes = sha256_mb_lanes();
+
+	// The SHA extensions beat eight lanes, but not sixteen once about half of
+	// them are filled.
+	if (lanes > 0 && count > 1 &&
+	    (sha256_simd_kind() != 2 || (lanes == 16 && count * 2 >= (size_t)lanes))) {
+		sha256_fixed_mb(lanes, data, len, passes, hashes, count);
+		return;
+	}
+#endif
+	for (idx = 0; idx < count; ++idx)
+		sha256_fixed_one(&data[idx * len], len, passes, &hashes[idx * SHA256_BLOCK_SIZE]);
+}
+
+void sha256_hash32(const BYTE data[], BYTE hash[])
+{
+	sha256_fixed_one(data, 32, 1, hash);
+}
+
+void sha256_hash64(const BYTE data[], BYTE hash[])
+{
+	sha256_fixed_one(data, 64, 1, hash);
+}
+
+void sha256d_hash32(const BYTE data[], BYTE hash[])
+{
+	sha256_fixed_one(data, 32, 2, hash);
+}
+
+void sha256d_hash64(const BYTE data[], BYTE hash[])
+{
+	sha256_fixed_one(data, 64, 2, hash);
+}
+
+void sha256_hash32_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	sha256_fixed(data, 32, 1, hashes, count);
+}
+
+void sha256_hash64_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	sha256_fixed(data, 64, 1, hashes, count);
+}
+
+void sha256d_hash32_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	sha256_fixed(data, 32, 2, hashes, count);
+}
+
+void sha256d_hash64_batch(const BYTE data[], BYTE hashes[], size_t count)
+{
+	sha256_fixed(data, 64, 2, hashes, count);
+}
@@ -14,6 +14,8 @@
 
 /****************************** MACROS ******************************/
 #define SHA256_BLOCK_SIZE 32            // SHA256 outputs a 32 byte digest
+#define SHA256_SERIAL_SIZE 110          // Bytes written by sha256_serialize()
+#define SHA256_SERIAL_VERSION 1         // Format version of the serialized state
 
 /**************************** DATA TYPES ****************************/
 typedef unsigned char BYTE;             // 8-bit byte
@@ -26,9 +28,74 @@ typedef struct {
 	WORD state[8];
 } SHA256_CTX;
 
+typedef struct {
+	SHA256_CTX inner;                   // State after hashing the key XOR ipad
+	SHA256_CTX outer;                   // State after hashing the key XOR opad
+} SHA256_HMAC_KEY;
+
 /*********************** FUNCTION DECLARATIONS **********************/
 void sha256_init(SHA256_CTX *ctx);
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len);
 void sha256_final(SHA256_CTX *ctx, BYTE hash[]);
 
+// A copy of a context in progress carries on independently of the original,
+// so a shared prefix only has to be hashed once.
+void sha256_clone(SHA256_CTX *dst, const SHA256_CTX *src);
+
+// Saves a context in progress to SHA256_SERIAL_SIZE bytes with the same layout
+// on every platform, to be resumed later with sha256_deserialize(). The
+// deserialize function returns False if the bytes are not a valid state of
+// the same format version.
+void sha256_serialize(const SHA256_CTX *ctx, BYTE out[]);
+int sha256_deserialize(SHA256_CTX *ctx, const BYTE in[]);
+
+// Hashes count independent messages, one per SIMD lane where the CPU allows,
+// and writes their digests one after another to hashes
+// (count * SHA256_BLOCK_SIZE bytes). The messages may differ in length.
+void sha256_hash_multi(const BYTE *const data[], const size_t lens[], BYTE hashes[], size_t count);
+
+// HMAC. The key is absorbed once into inner and outer midstates, so each
+// message only costs cloning them. Streaming use is hmac_init, sha256_update
+// on the context, then hmac_final. The batch function writes count MACs one
+// after another to macs and runs the messages side by side like
+// sha256_hash_multi().
+void sha256_hmac_key_setup(SHA256_HMAC_KEY *hkey, const BYTE key[], size_t key_len);
+void sha256_hmac_init(const SHA256_HMAC_KEY *hkey, SHA256_CTX *ctx);
+void sha256_hmac_final(const SHA256_HMAC_KEY *hkey, SHA256_CTX *ctx, BYTE mac[]);
+void sha256_hmac(const SHA256_HMAC_KEY *hkey, const BYTE data[], size_t len, BYTE mac[]);
+void sha256_hmac_batch(const SHA256_HMAC_KEY *hkey, const BYTE *const data[], const size_t lens[],
+                       BYTE macs[], size_t count);
+
+// PBKDF2 with HMAC-SHA-256 (RFC 8018). Derives out_len bytes from a password
+// and salt over at least one iteration. The batch function derives count keys
+// with the same salt and iteration count, written one after another to outs
+// (count * out_len bytes), and iterates them side by side where the CPU
+// allows.
+void sha256_pbkdf2(const BYTE password[], size_t password_len, const BYTE salt[], size_t salt_len,
+                   WORD iterations, BYTE out[], size_t out_len);
+void sha256_pbkdf2_batch(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                         size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count);
+
+// The batch split across up to "threads" workers, each deriving a run of the
+// keys. The output is identical to sha256_pbkdf2_batch(). Workers are threads
+// only if sha256.c is built with SHA256_THREADS defined (and linked with pthreads);
+// otherwise the work is done on the calling thread.
+void sha256_pbkdf2_batch_mt(const BYTE *const passwords[], const size_t password_lens[], const BYTE salt[],
+                            size_t salt_len, WORD iterations, BYTE outs[], size_t out_len, size_t count,
+                            int threads);
+
+// Fixed-length SHA-256 of the 32- and 64-byte values found in hash trees and
+// content addresses. The padding is precomputed and nothing is buffered. The
+// sha256d functions hash the digest a second time (double SHA-256). The batch
+// functions take count values one after another in data and write their
+// digests one after another to hashes (count * SHA256_BLOCK_SIZE bytes).
+void sha256_hash32(const BYTE data[], BYTE hash[]);
+void sha256_hash64(const BYTE data[], BYTE hash[]);
+void sha256d_hash32(const BYTE data[], BYTE hash[]);
+void sha256d_hash64(const BYTE data[], BYTE hash[]);
+void sha256_hash32_batch(const BYTE data[], BYTE hashes[], size_t count);
+void sha256_hash64_batch(const BYTE data[], BYTE hashes[], size_t count);
+void sha256d_hash32_batch(const BYTE data[], BYTE hashes[], size_t count);
+void sha256d_hash64_batch(const BYTE data[], BYTE hashes[], size_t count);
+
 #endif   // SHA256_H
@@ -53,9 +53,290 @@ int sha256_test()
 	return(pass);
 }
 
+// Whole blocks are hashed straight from the input buffer and only the tail
+// is buffered, so check that a single large update and many uneven ones give
+// the same digest.
+int sha256_chunk_test()
+{
+	static BYTE text[1000000];
+	BYTE hash[SHA256_BLOCK_SIZE] = {0xcd,0xc7,0x6e,0x5c,0x99,0x14,0xfb,0x92,0x81,0xa1,0xc7,0xe2,0x84,0xd7,0x3e,0x67,
+	                                0xf1,0x80,0x9a,0x48,0xa4,0x97,0x20,0x0e,0x04,0x6d,0x39,0xcc,0xc7,0x11,0x2c,0xd0};
+	BYTE buf[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+	size_t idx, len;
+	int pass = 1;
+
+	memset(text, 'a', sizeof(text));
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, text, sizeof(text));
+	sha256_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA256_BLOCK_SIZE);
+
+	sha256_init(&ctx);
+	for (idx = 0, len = 1; idx < sizeof(text); idx += len, len = len % 150 + 1) {
+		if (len > sizeof(text) - idx)
+			len = sizeof(text) - idx;
+		sha256_update(&ctx, &text[idx], len);
+	}
+	sha256_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA256_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// Messages of many different lengths, so lanes finish and are refilled at
+// different times, must hash the same as they do one at a time.
+int sha256_multi_test()
+{
+	static BYTE long_text[100000];
+	BYTE text[40 * 7];
+	BYTE hashes[40 * SHA256_BLOCK_SIZE];
+	BYTE buf[SHA256_BLOCK_SIZE];
+	const BYTE *data[40];
+	size_t lens[40];
+	SHA256_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(text); ++idx)
+		text[idx] = idx * 31 + 7;
+	for (idx = 0; idx < 40; ++idx) {
+		data[idx] = &text[idx % 3];
+		lens[idx] = (idx * 7 * 13) % (sizeof(text) - 2);
+	}
+	sha256_hash_multi(data, lens, hashes, 40);
+
+	for (idx = 0; idx < 40; ++idx) {
+		sha256_init(&ctx);
+		sha256_update(&ctx, data[idx], lens[idx]);
+		sha256_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA256_BLOCK_SIZE], buf, SHA256_BLOCK_SIZE);
+	}
+
+	// A single message is hashed on its own rather than in one lane of many.
+	for (idx = 0; idx < (int)sizeof(long_text); ++idx)
+		long_text[idx] = idx * 17 + 3;
+	data[0] = long_text;
+	lens[0] = sizeof(long_text);
+	sha256_hash_multi(data, lens, hashes, 1);
+	sha256_init(&ctx);
+	sha256_update(&ctx, long_text, sizeof(long_text));
+	sha256_final(&ctx, buf);
+	pass = pass && !memcmp(hashes, buf, SHA256_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// A context saved part way through and resumed, and a clone finishing a
+// shared prefix, must both give the same digest as hashing in one go.
+int sha256_serialize_test()
+{
+	BYTE text[300];
+	BYTE saved[SHA256_SERIAL_SIZE];
+	BYTE hash[SHA256_BLOCK_SIZE];
+	BYTE buf[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx, resumed, copy;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(text); ++idx)
+		text[idx] = idx * 13 + 5;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, text, sizeof(text));
+	sha256_final(&ctx, hash);
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, text, 131);
+	sha256_serialize(&ctx, saved);
+	memset(&resumed, 0xff, sizeof(resumed));
+	pass = pass && sha256_deserialize(&resumed, saved);
+	sha256_update(&resumed, &text[131], sizeof(text) - 131);
+	sha256_final(&resumed, buf);
+	pass = pass && !memcmp(hash, buf, SHA256_BLOCK_SIZE);
+
+	sha256_clone(&copy, &ctx);
+	sha256_update(&ctx, &text[131], sizeof(text) - 131);
+	sha256_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA256_BLOCK_SIZE);
+	sha256_update(&copy, &text[131], sizeof(text) - 131);
+	sha256_final(&copy, buf);
+	pass = pass && !memcmp(hash, buf, SHA256_BLOCK_SIZE);
+
+	// Another format version, or a damaged buffer count, is refused.
+	saved[4]++;
+	pass = pass && !sha256_deserialize(&resumed, saved);
+	saved[4]--;
+	saved[5] = 0xff;
+	pass = pass && !sha256_deserialize(&resumed, saved);
+
+	return(pass);
+}
+
+int sha256_hmac_test()
+{
+	BYTE key1[20], key2[131];
+	BYTE text1[] = {"Hi There"};
+	BYTE text2[] = {"Test Using Larger Than Block-Size Key - Hash Key First"};
+	BYTE mac1[SHA256_BLOCK_SIZE] = {0xb0,0x34,0x4c,0x61,0xd8,0xdb,0x38,0x53,0x5c,0xa8,0xaf,0xce,0xaf,0x0b,0xf1,0x2b,
+	                                0x88,0x1d,0xc2,0x00,0xc9,0x83,0x3d,0xa7,0x26,0xe9,0x37,0x6c,0x2e,0x32,0xcf,0xf7};
+	BYTE mac2[SHA256_BLOCK_SIZE] = {0x60,0xe4,0x31,0x59,0x1e,0xe0,0xb6,0x7f,0x0d,0x8a,0x26,0xaa,0xcb,0xf5,0xb7,0x7f,
+	                                0x8e,0x0b,0xc6,0x21,0x37,0x28,0xc5,0x14,0x05,0x46,0x04,0x0f,0x0e,0xe3,0x7f,0x54};
+	BYTE text3[40 * 5];
+	BYTE macs[40 * SHA256_BLOCK_SIZE];
+	BYTE buf[SHA256_BLOCK_SIZE];
+	const BYTE *data[40];
+	size_t lens[40];
+	SHA256_HMAC_KEY hkey;
+	SHA256_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	memset(key1, 0x0b, sizeof(key1));
+	memset(key2, 0xaa, sizeof(key2));
+
+	sha256_hmac_key_setup(&hkey, key1, sizeof(key1));
+	sha256_hmac(&hkey, text1, strlen(text1), buf);
+	pass = pass && !memcmp(mac1, buf, SHA256_BLOCK_SIZE);
+
+	// Keys longer than a block are hashed first. Also try the streaming calls.
+	sha256_hmac_key_setup(&hkey, key2, sizeof(key2));
+	sha256_hmac_init(&hkey, &ctx);
+	sha256_update(&ctx, text2, 10);
+	sha256_update(&ctx, &text2[10], strlen(text2) - 10);
+	sha256_hmac_final(&hkey, &ctx, buf);
+	pass = pass && !memcmp(mac2, buf, SHA256_BLOCK_SIZE);
+
+	// The batch must agree with one message at a time.
+	for (idx = 0; idx < (int)sizeof(text3); ++idx)
+		text3[idx] = idx * 7 + 1;
+	for (idx = 0; idx < 40; ++idx) {
+		data[idx] = &text3[idx];
+		lens[idx] = (idx * 37) % 150;
+	}
+	sha256_hmac_batch(&hkey, data, lens, macs, 40);
+	for (idx = 0; idx < 40; ++idx) {
+		sha256_hmac(&hkey, data[idx], lens[idx], buf);
+		pass = pass && !memcmp(&macs[idx * SHA256_BLOCK_SIZE], buf, SHA256_BLOCK_SIZE);
+	}
+
+	// So must a batch too small to fill the lanes.
+	sha256_hmac_batch(&hkey, data, lens, macs, 3);
+	for (idx = 0; idx < 3; ++idx) {
+		sha256_hmac(&hkey, data[idx], lens[idx], buf);
+		pass = pass && !memcmp(&macs[idx * SHA256_BLOCK_SIZE], buf, SHA256_BLOCK_SIZE);
+	}
+
+	return(pass);
+}
+
+int sha256_pbkdf2_test()
+{
+	BYTE pass1[] = {"password"}, salt1[] = {"salt"};
+	BYTE pass2[] = {"passwordPASSWORDpassword"}, salt2[] = {"saltSALTsaltSALTsaltSALTsaltSALTsalt"};
+	BYTE dk1[32] = {0xae,0x4d,0x0c,0x95,0xaf,0x6b,0x46,0xd3,0x2d,0x0a,0xdf,0xf9,0x28,0xf0,0x6d,0xd0,
+	                0x2a,0x30,0x3f,0x8e,0xf3,0xc2,0x51,0xdf,0xd6,0xe2,0xd8,0x5a,0x95,0x47,0x4c,0x43};
+	BYTE dk2[40] = {0x34,0x8c,0x89,0xdb,0xcb,0xd3,0x2b,0x2f,0x32,0xd8,0x14,0xb8,0x11,0x6e,0x84,0xcf,
+	                0x2b,0x17,0x34,0x7e,0xbc,0x18,0x00,0x18,0x1c,0x4e,0x2a,0x1f,0xb8,0xdd,0x53,0xe1,
+	                0xc6,0x35,0x51,0x8c,0x7d,0xac,0x47,0xe9};
+	BYTE passwords[20 * 3];
+	BYTE outs[20 * 40], outs_mt[20 * 40];
+	BYTE buf[40];
+	const BYTE *ptrs[20];
+	size_t lens[20];
+	int idx;
+	int pass = 1;
+
+	sha256_pbkdf2(pass1, strlen(pass1), salt1, strlen(salt1), 2, buf, 32);
+	pass = pass && !memcmp(dk1, buf, 32);
+
+	// The output spans two blocks, the second cut short.
+	sha256_pbkdf2(pass2, strlen(pass2), salt2, strlen(salt2), 4096, buf, 40);
+	pass = pass && !memcmp(dk2, buf, 40);
+
+	// The batch must agree with one password at a time.
+	for (idx = 0; idx < (int)sizeof(passwords); ++idx)
+		passwords[idx] = idx * 11 + 3;
+	for (idx = 0; idx < 20; ++idx) {
+		ptrs[idx] = &passwords[idx * 3];
+		lens[idx] = idx % 4;
+	}
+	sha256_pbkdf2_batch(ptrs, lens, salt1, strlen(salt1), 5, outs, 40, 20);
+	for (idx = 0; idx < 20; ++idx) {
+		sha256_pbkdf2(ptrs[idx], lens[idx], salt1, strlen(salt1), 5, buf, 40);
+		pass = pass && !memcmp(&outs[idx * 40], buf, 40);
+	}
+
+	// However the batch is split between workers, the keys are the same.
+	for (idx = 1; idx <= 7; idx += 3) {
+		memset(outs_mt, 0, sizeof(outs_mt));
+		sha256_pbkdf2_batch_mt(ptrs, lens, salt1, strlen(salt1), 5, outs_mt, 40, 20, idx);
+		pass = pass && !memcmp(outs, outs_mt, sizeof(outs));
+	}
+
+	return(pass);
+}
+
+int sha256_fixed_test()
+{
+	BYTE zero[64] = {0};
+	BYTE hash1[SHA256_BLOCK_SIZE] = {0x66,0x68,0x7a,0xad,0xf8,0x62,0xbd,0x77,0x6c,0x8f,0xc1,0x8b,0x8e,0x9f,0x8e,0x20,
+	                                 0x08,0x97,0x14,0x85,0x6e,0xe2,0x33,0xb3,0x90,0x2a,0x59,0x1d,0x0d,0x5f,0x29,0x25};
+	BYTE hash2[SHA256_BLOCK_SIZE] = {0xe2,0xf6,0x1c,0x3f,0x71,0xd1,0xde,0xfd,0x3f,0xa9,0x99,0xdf,0xa3,0x69,0x53,0x75,
+	                                 0x5c,0x69,0x06,0x89,0x79,0x99,0x62,0xb4,0x8b,0xeb,0xd8,0x36,0x97,0x4e,0x8c,0xf9};
+	BYTE values[37 * 64];
+	BYTE hashes[37 * SHA256_BLOCK_SIZE];
+	BYTE buf[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	sha256_hash32(zero, buf);
+	pass = pass && !memcmp(hash1, buf, SHA256_BLOCK_SIZE);
+	sha256d_hash64(zero, buf);
+	pass = pass && !memcmp(hash2, buf, SHA256_BLOCK_SIZE);
+
+	// The batches must agree with the general functions.
+	for (idx = 0; idx < (int)sizeof(values); ++idx)
+		values[idx] = idx * 13 + 5;
+
+	sha256_hash32_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		sha256_init(&ctx);
+		sha256_update(&ctx, &values[idx * 32], 32);
+		sha256_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA256_BLOCK_SIZE], buf, SHA256_BLOCK_SIZE);
+	}
+	sha256_hash64_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		sha256_init(&ctx);
+		sha256_update(&ctx, &values[idx * 64], 64);
+		sha256_final(&ctx, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA256_BLOCK_SIZE], buf, SHA256_BLOCK_SIZE);
+	}
+	sha256d_hash32_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		sha256_hash32(&values[idx * 32], buf);
+		sha256_hash32(buf, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA256_BLOCK_SIZE], buf, SHA256_BLOCK_SIZE);
+	}
+	sha256d_hash64_batch(values, hashes, 37);
+	for (idx = 0; idx < 37; ++idx) {
+		sha256_hash64(&values[idx * 64], buf);
+		sha256_hash32(buf, buf);
+		pass = pass && !memcmp(&hashes[idx * SHA256_BLOCK_SIZE], buf, SHA256_BLOCK_SIZE);
+	}
+
+	return(pass);
+}
+
 int main()
 {
-	printf("SHA-256 tests: %s\n", sha256_test() ? "SUCCEEDED" : "FAILED");
+	printf("SHA-256 tests: %s\n", sha256_test() && sha256_chunk_test() &&
+	       sha256_multi_test() && sha256_serialize_test() &&
+	       sha256_hmac_test() && sha256_pbkdf2_test() &&
+	       sha256_fixed_test() ? "SUCCEEDED" : "FAILED");
 
 	return(0);
 }
@@ -0,0 +1,397 @@
+/*********************************************************************
+* Filename:   sha512.c
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Implementation of the SHA-512 hashing algorithm and of
+              SHA-384, SHA-512/224 and SHA-512/256, which are SHA-512
+              with a different initial state and a truncated output.
+              The message schedule is expanded with AVX2 when the CPU
+              has it. Messages are limited to 2^64 - 1 bits, so the high
+              half of the 128-bit length field is always zero.
+              Algorithm specification can be found here:
+               * http://csrc.nist.gov/publications/fips/fips180-4/fips-180-4.pdf
+              This implementation uses little endian byte order.
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdlib.h>
+#include <memory.h>
+#include "sha512.h"
+
+// AVX2 message schedule kernel, chosen at run time.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SHA512_NO_SIMD)
+#define SHA512_SIMD
+#include <immintrin.h>
+#endif
+
+/****************************** MACROS ******************************/
+#define TRUE  1
+#define FALSE 0
+
+#define ROTRIGHT(a,b) (((a) >> (b)) | ((a) << (64-(b))))
+
+#define CH(x,y,z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define EP0(x) (ROTRIGHT(x,28) ^ ROTRIGHT(x,34) ^ ROTRIGHT(x,39))
+#define EP1(x) (ROTRIGHT(x,14) ^ ROTRIGHT(x,18) ^ ROTRIGHT(x,41))
+#define SIG0(x) (ROTRIGHT(x,1) ^ ROTRIGHT(x,8) ^ ((x) >> 7))
+#define SIG1(x) (ROTRIGHT(x,19) ^ ROTRIGHT(x,61) ^ ((x) >> 6))
+
+// One round with the names rotated instead of the values, so eight calls
+// bring a..h back to where they started.
+#define SHA512_ROUND(a,b,c,d,e,f,g,h,w) \
+	t1 = h + EP1(e) + CH(e,f,g) + (w); \
+	d += t1; \
+	h = t1 + EP0(a) + MAJ(a,b,c);
+
+// SIG0/SIG1 over four schedule words at once.
+#define AVX2_ROTRIGHT(x,n) _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define AVX2_SIG0(x) _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTRIGHT(x, 1), AVX2_ROTRIGHT(x, 8)), \
+                                      _mm256_srli_epi64(x, 7))
+#define AVX2_SIG1(x) _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTRIGHT(x, 19), AVX2_ROTRIGHT(x, 61)), \
+                                      _mm256_srli_epi64(x, 6))
+
+// The four words starting one word into x, continuing into y.
+#define AVX2_ALIGN1(y,x) _mm256_alignr_epi8(_mm256_permute2x128_si256(x, y, 0x21), x, 8)
+
+// Replaces x0, the oldest four schedule words, with the next four. Words 2
+// and 3 depend on words 0 and 1 of the same group, so SIG1 is applied in
+// two halves.
+#define AVX2_SCHEDULE(x0,x1,x2,x3) \
+	t = _mm256_add_epi64(_mm256_add_epi64(x0, AVX2_SIG0(AVX2_ALIGN1(x1, x0))), AVX2_ALIGN1(x3, x2)); \
+	t = _mm256_add_epi64(t, _mm256_and_si256(AVX2_SIG1(_mm256_permute4x64_epi64(x3, 0x0e)), lo)); \
+	x0 = _mm256_add_epi64(t, _mm256_and_si256(AVX2_SIG1(_mm256_permute4x64_epi64(t, 0x40)), hi));
+
+/**************************** VARIABLES *****************************/
+static const WORD64 k[80] = {
+	0x428a2f98d728ae22ULL,0x7137449123ef65cdULL,0xb5c0fbcfec4d3b2fULL,0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL,0x59f111f1b605d019ULL,0x923f82a4af194f9bULL,0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL,0x12835b0145706fbeULL,0x243185be4ee4b28cULL,0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL,0x80deb1fe3b1696b1ULL,0x9bdc06a725c71235ULL,0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL,0xefbe4786384f25e3ULL,0x0fc19dc68b8cd5b5ULL,0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL,0x4a7484aa6ea6e483ULL,0x5cb0a9dcbd41fbd4ULL,0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL,0xa831c66d2db43210ULL,0xb00327c898fb213fULL,0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL,0xd5a79147930aa725ULL,0x06ca6351e003826fULL,0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL,0x2e1b21385c26c926ULL,0x4d2c6dfc5ac42aedULL,0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL,0x766a0abb3c77b2a8ULL,0x81c2c92e47edaee6ULL,0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL,0xa81a664bbc423001ULL,0xc24b8b70d0f89791ULL,0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL,0xd69906245565a910ULL,0xf40e35855771202aULL,0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL,0x1e376c085141ab53ULL,0x2748774cdf8eeb99ULL,0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL,0x4ed8aa4ae3418acbULL,0x5b9cca4f7763e373ULL,0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL,0x78a5636f43172f60ULL,0x84c87814a1f0ab72ULL,0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL,0xa4506cebde82bde9ULL,0xbef9a3f7b2c67915ULL,0xc67178f2e372532bULL,
+	0xca273eceea26619cULL,0xd186b8c721c0c207ULL,0xeada7dd6cde0eb1eULL,0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL,0x0a637dc5a2c898a6ULL,0x113f9804bef90daeULL,0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL,0x32caab7b40c72493ULL,0x3c9ebe0a15c9bebcULL,0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL,0x597f299cfc657e2aULL,0x5fcb6fab3ad6faecULL,0x6c44198c4a475817ULL
+};
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+// The 80 rounds of one block, given its schedule words with k[] already added.
+static void sha512_rounds(WORD64 state[], const WORD64 wk[])
+{
+	WORD64 a, b, c, d, e, f, g, h, t1;
+	int i;
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
+
+	for (i = 0; i < 80; i += 8) {
+		SHA512_ROUND(a,b,c,d,e,f,g,h, wk[i]);
+		SHA512_ROUND(h,a,b,c,d,e,f,g, wk[i + 1]);
+		SHA512_ROUND(g,h,a,b,c,d,e,f, wk[i + 2]);
+		SHA512_ROUND(f,g,h,a,b,c,d,e, wk[i + 3]);
+		SHA512_ROUND(e,f,g,h,a,b,c,d, wk[i + 4]);
+		SHA512_ROUND(d,e,f,g,h,a,b,c, wk[i + 5]);
+		SHA512_ROUND(c,d,e,f,g,h,a,b, wk[i + 6]);
+		SHA512_ROUND(b,c,d,e,f,g,h,a, wk[i + 7]);
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+void sha512_transform(SHA512_CTX *ctx, const BYTE data[])
+{
+	WORD64 m[80];
+	int i, j;
+
+	for (i = 0, j = 0; i < 16; ++i, j += 8)
+		m[i] = ((WORD64)data[j] << 56) | ((WORD64)data[j + 1] << 48) |
+		       ((WORD64)data[j + 2] << 40) | ((WORD64)data[j + 3] << 32) |
+		       ((WORD64)data[j + 4] << 24) | ((WORD64)data[j + 5] << 16) |
+		       ((WORD64)data[j + 6] << 8) | ((WORD64)data[j + 7]);
+	for ( ; i < 80; ++i)
+		m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
+	for (i = 0; i < 80; ++i)
+		m[i] += k[i];
+
+	sha512_rounds(ctx->state, m);
+}
+
+#ifdef SHA512_SIMD
+// AVX2 takes the message schedule off the scalar rounds: it expands four
+// words at a time and adds k[] on the way out.
+__attribute__((target("avx2")))
+static void sha512_transform_avx2(WORD64 state[], const BYTE data[], size_t blocks)
+{
+	const __m256i mask = _mm256_set_epi64x(0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL,
+	                                       0x08090a0b0c0d0e0fULL, 0x0001020304050607ULL);
+	const __m256i lo = _mm256_set_epi64x(0, 0, -1, -1);
+	const __m256i hi = _mm256_set_epi64x(-1, -1, 0, 0);
+	__m256i x0, x1, x2, x3, t;
+	WORD64 wk[80];
+	int i;
+
+	for ( ; blocks > 0; --blocks, data += 128) {
+		x0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)&data[0]), mask);
+		x1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)&data[32]), mask);
+		x2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)&data[64]), mask);
+		x3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)&data[96]), mask);
+
+		for (i = 0; i < 80; i += 16) {
+			if (i > 0) {
+				AVX2_SCHEDULE(x0, x1, x2, x3);
+				AVX2_SCHEDULE(x1, x2, x3, x0);
+				AVX2_SCHEDULE(x2, x3, x0, x1);
+				AVX2_SCHEDULE(x3, x0, x1, x2);
+			}
+			_mm256_storeu_si256((__m256i *)&wk[i], _mm256_add_epi64(x0,
+			                    _mm256_loadu_si256((const __m256i *)&k[i])));
+			_mm256_storeu_si256((__m256i *)&wk[i + 4], _mm256_add_epi64(x1,
+			                    _mm256_loadu_si256((const __m256i *)&k[i + 4])));
+			_mm256_storeu_si256((__m256i *)&wk[i + 8], _mm256_add_epi64(x2,
+			                    _mm256_loadu_si256((const __m256i *)&k[i + 8])));
+			_mm256_storeu_si256((__m256i *)&wk[i + 12], _mm256_add_epi64(x3,
+			                    _mm256_loadu_si256((const __m256i *)&k[i + 12])));
+		}
+
+		sha512_rounds(state, wk);
+	}
+}
+
+// Nonzero if the CPU has AVX2, checked on first use.
+static int sha512_have_avx2(void)
+{
+	static int have = -1;
+
+	if (have < 0)
+		have = __builtin_cpu_supports("avx2");
+	return(have);
+}
+#endif
+
+static void sha512_compress(SHA512_CTX *ctx, const BYTE data[], size_t blocks)
+{
+	size_t i;
+
+#ifdef SHA512_SIMD
+	if (sha512_have_avx2()) {
+		sha512_transform_avx2(ctx->state, data, blocks);
+		return;
+	}
+#endif
+	for (i = 0; i < blocks; ++i)
+		sha512_transform(ctx, &data[i * 128]);
+}
+
+static void sha512_init_state(SHA512_CTX *ctx, const WORD64 iv[], WORD hashlen)
+{
+	int i;
+
+	ctx->datalen = 0;
+	ctx->bitlen = 0;
+	for (i = 0; i < 8; ++i)
+		ctx->state[i] = iv[i];
+	ctx->hashlen = hashlen;
+}
+
+void sha512_init(SHA512_CTX *ctx)
+{
+	static const WORD64 iv[8] = {
+		0x6a09e667f3bcc908ULL,0xbb67ae8584caa73bULL,0x3c6ef372fe94f82bULL,0xa54ff53a5f1d36f1ULL,
+		0x510e527fade682d1ULL,0x9b05688c2b3e6c1fULL,0x1f83d9abfb41bd6bULL,0x5be0cd19137e2179ULL
+	};
+
+	sha512_init_state(ctx, iv, SHA512_BLOCK_SIZE);
+}
+
+void sha384_init(SHA512_CTX *ctx)
+{
+	static const WORD64 iv[8] = {
+		0xcbbb9d5dc1059ed8ULL,0x629a292a367cd507ULL,0x9159015a3070dd17ULL,0x152fecd8f70e5939ULL,
+		0x67332667ffc00b31ULL,0x8eb44a8768581511ULL,0xdb0c2e0d64f98fa7ULL,0x47b5481dbefa4fa4ULL
+	};
+
+	sha512_init_state(ctx, iv, SHA384_BLOCK_SIZE);
+}
+
+void sha512_224_init(SHA512_CTX *ctx)
+{
+	static const WORD64 iv[8] = {
+		0x8c3d37c819544da2ULL,0x73e1996689dcd4d6ULL,0x1dfab7ae32ff9c82ULL,0x679dd514582f9fcfULL,
+		0x0f6d2b697bd44da8ULL,0x77e36f7304c48942ULL,0x3f9d85a86a1d36c8ULL,0x1112e6ad91d692a1ULL
+	};
+
+	sha512_init_state(ctx, iv, SHA512_224_BLOCK_SIZE);
+}
+
+void sha512_256_init(SHA512_CTX *ctx)
+{
+	static const WORD64 iv[8] = {
+		0x22312194fc2bf72cULL,0x9f555fa3c84c64c2ULL,0x2393b86b6f53b151ULL,0x963877195940eabdULL,
+		0x96283ee2a88effe3ULL,0xbe5e1e2553863992ULL,0x2b0199fc2c85b8aaULL,0x0eb72ddc81c52ca2ULL
+	};
+
+	sha512_init_state(ctx, iv, SHA512_256_BLOCK_SIZE);
+}
+
+void sha512_update(SHA512_CTX *ctx, const BYTE data[], size_t len)
+{
+	size_t i = 0, fill, blocks;
+
+	// Top up a partially filled block first.
+	if (ctx->datalen > 0) {
+		fill = 128 - ctx->datalen;
+		if (fill > len)
+			fill = len;
+		memcpy(&ctx->data[ctx->datalen], data, fill);
+		ctx->datalen += fill;
+		if (ctx->datalen < 128)
+			return;
+		sha512_compress(ctx, ctx->data, 1);
+		ctx->bitlen += 1024;
+		ctx->datalen = 0;
+		i = fill;
+	}
+
+	// Whole blocks are hashed straight from the caller's buffer.
+	blocks = (len - i) / 128;
+	if (blocks > 0) {
+		sha512_compress(ctx, &data[i], blocks);
+		ctx->bitlen += (unsigned long long)blocks * 1024;
+		i += blocks * 128;
+	}
+
+	// Only the tail is buffered.
+	memcpy(ctx->data, &data[i], len - i);
+	ctx->datalen = len - i;
+}
+
+void sha512_final(SHA512_CTX *ctx, BYTE hash[])
+{
+	WORD i;
+
+	i = ctx->datalen;
+
+	// Pad whatever data is left in the buffer.
+	if (ctx->datalen < 112) {
+		ctx->data[i++] = 0x80;
+		while (i < 112)
+			ctx->data[i++] = 0x00;
+	}
+	else {
+		ctx->data[i++] = 0x80;
+		while (i < 128)
+			ctx->data[i++] = 0x00;
+		sha512_compress(ctx, ctx->data, 1);
+		memset(ctx->data, 0, 112);
+	}
+
+	// Append to the padding the total message's length in bits and transform.
+	// The high 64 bits of the 128-bit length are always zero here.
+	ctx->bitlen += ctx->datalen * 8;
+	for (i = 0; i < 8; ++i) {
+		ctx->data[112 + i] = 0;
+		ctx->data[127 - i] = ctx->bitlen >> (i * 8);
+	}
+	sha512_compress(ctx, ctx->data, 1);
+
+	// Since this implementation uses little endian byte ordering and SHA uses big endian,
+	// reverse all the bytes when copying the final state to the output hash.
+	for (i = 0; i < ctx->hashlen; ++i)
+		hash[i] = ctx->state[i / 8] >> (56 - (i % 8) * 8);
+}
+
+void sha512_clone(SHA512_CTX *dst, const SHA512_CTX *src)
+{
+	memcpy(dst, src, sizeof(SHA512_CTX));
+}
+
+// Stores value as bytes most significant first, so the serialized form is the
+// same on every platform.
+static void store_be(BYTE out[], unsigned long long value, int bytes)
+{
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		out[i] = value >> ((bytes - 1 - i) * 8);
+}
+
+static unsigned long long load_be(const BYTE in[], int bytes)
+{
+	unsigned long long value = 0;
+	int i;
+
+	for (i = 0; i < bytes; ++i)
+		value = (value << 8) | in[i];
+	return(value);
+}
+
+// The layout is the tag "S512", the format version, the buffered byte count,
+// the bit count of the whole blocks hashed so far, the digest length, the
+// state words and the block buffer, zero past the buffered bytes. Integers
+// are big endian.
+void sha512_serialize(const SHA512_CTX *ctx, BYTE out[])
+{
+	int i;
+
+	memcpy(out, "S512", 4);
+	out[4] = SHA512_SERIAL_VERSION;
+	out[5] = ctx->datalen;
+	store_be(&out[6], ctx->bitlen, 8);
+	out[14] = ctx->hashlen;
+	for (i = 0; i < 8; ++i)
+		store_be(&out[15 + i * 8], ctx->state[i], 8);
+	memcpy(&out[79], ctx->data, ctx->datalen);
+	memset(&out[79 + ctx->datalen], 0, 128 - ctx->datalen);
+}
+
+int sha512_deserialize(SHA512_CTX *ctx, const BYTE in[])
+{
+	unsigned long long bitlen;
+	WORD datalen, hashlen;
+	int i;
+
+	if (memcmp(in, "S512", 4) != 0 || in[4] != SHA512_SERIAL_VERSION)
+		return(FALSE);
+	datalen = in[5];
+	bitlen = load_be(&in[6], 8);
+	if (datalen >= 128 || bitlen % 1024 != 0)
+		return(FALSE);
+	hashlen = in[14];
+	if (hashlen != SHA512_BLOCK_SIZE && hashlen != SHA384_BLOCK_SIZE &&
+	    hashlen != SHA512_224_BLOCK_SIZE && hashlen != SHA512_256_BLOCK_SIZE)
+		return(FALSE);
+
+	ctx->datalen = datalen;
+	ctx->bitlen = bitlen;
+	ctx->hashlen = hashlen;
+	for (i = 0; i < 8; ++i)
+		ctx->state[i] = load_be(&in[15 + i * 8], 8);
+	memcpy(ctx->data, &in[79], 128);
+
+	return(TRUE);
+}
@@ -0,0 +1,56 @@
+/*********************************************************************
+* Filename:   sha512.h
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Defines the API for the corresponding SHA-512 implementation.
+*********************************************************************/
+
+#ifndef SHA512_H
+#define SHA512_H
+
+/*************************** HEADER FILES ***************************/
+#include <stddef.h>
+
+/****************************** MACROS ******************************/
+#define SHA512_BLOCK_SIZE 64            // SHA512 outputs a 64 byte digest
+#define SHA384_BLOCK_SIZE 48            // SHA384 outputs a 48 byte digest
+#define SHA512_224_BLOCK_SIZE 28        // SHA512/224 outputs a 28 byte digest
+#define SHA512_256_BLOCK_SIZE 32        // SHA512/256 outputs a 32 byte digest
+#define SHA512_SERIAL_SIZE 207          // Bytes written by sha512_serialize()
+#define SHA512_SERIAL_VERSION 1         // Format version of the serialized state
+
+/**************************** DATA TYPES ****************************/
+typedef unsigned char BYTE;             // 8-bit byte
+typedef unsigned int  WORD;             // 32-bit word, change to "long" for 16-bit machines
+typedef unsigned long long WORD64;      // 64-bit word
+
+typedef struct {
+	BYTE data[128];
+	WORD datalen;
+	unsigned long long bitlen;
+	WORD64 state[8];
+	WORD hashlen;                       // Digest bytes sha512_final() writes
+} SHA512_CTX;
+
+/*********************** FUNCTION DECLARATIONS **********************/
+// All four variants share update and final. They differ only in the initial
+// state, chosen by the init function, and in how much of it final outputs.
+void sha512_init(SHA512_CTX *ctx);
+void sha384_init(SHA512_CTX *ctx);
+void sha512_224_init(SHA512_CTX *ctx);
+void sha512_256_init(SHA512_CTX *ctx);
+void sha512_update(SHA512_CTX *ctx, const BYTE data[], size_t len);
+void sha512_final(SHA512_CTX *ctx, BYTE hash[]);
+
+// A copy of a context in progress carries on independently of the original,
+// so a shared prefix only has to be hashed once.
+void sha512_clone(SHA512_CTX *dst, const SHA512_CTX *src);
+
+// Saves a context in progress to SHA512_SERIAL_SIZE bytes with the same layout
+// on every platform, to be resumed later with sha512_deserialize(). The
+// deserialize function returns False if the bytes are not a valid state of
+// the same format version.
+void sha512_serialize(const SHA512_CTX *ctx, BYTE out[]);
+int sha512_deserialize(SHA512_CTX *ctx, const BYTE in[]);
+
+#endif   // SHA512_H
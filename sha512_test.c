@@ -0,0 +1,225 @@
+/*********************************************************************
+* Filename:   sha512_test.c
+* Copyright:
+* Disclaimer: This code is presented "as is" without any guarantees.
+* Details:    Performs known-answer tests on the corresponding SHA-512
+	          implementation, including SHA-384, SHA-512/224 and
+	          SHA-512/256. These tests do not encompass the full range
+	          of available test vectors, however, if the tests pass it
+	          is very, very likely that the code is correct and was
+	          compiled properly. This code also serves as example usage
+	          of the functions.
+*********************************************************************/
+
+/*************************** HEADER FILES ***************************/
+#include <stdio.h>
+#include <memory.h>
+#include <string.h>
+#include "sha512.h"
+
+/*********************** FUNCTION DEFINITIONS ***********************/
+int sha512_test()
+{
+	BYTE text1[] = {"abc"};
+	BYTE text2[] = {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"};
+	BYTE text3[] = {"aaaaaaaaaa"};
+	BYTE hash1[SHA512_BLOCK_SIZE] = {0xdd,0xaf,0x35,0xa1,0x93,0x61,0x7a,0xba,0xcc,0x41,0x73,0x49,0xae,0x20,0x41,0x31,
+	                                 0x12,0xe6,0xfa,0x4e,0x89,0xa9,0x7e,0xa2,0x0a,0x9e,0xee,0xe6,0x4b,0x55,0xd3,0x9a,
+	                                 0x21,0x92,0x99,0x2a,0x27,0x4f,0xc1,0xa8,0x36,0xba,0x3c,0x23,0xa3,0xfe,0xeb,0xbd,
+	                                 0x45,0x4d,0x44,0x23,0x64,0x3c,0xe8,0x0e,0x2a,0x9a,0xc9,0x4f,0xa5,0x4c,0xa4,0x9f};
+	BYTE hash2[SHA512_BLOCK_SIZE] = {0x8e,0x95,0x9b,0x75,0xda,0xe3,0x13,0xda,0x8c,0xf4,0xf7,0x28,0x14,0xfc,0x14,0x3f,
+	                                 0x8f,0x77,0x79,0xc6,0xeb,0x9f,0x7f,0xa1,0x72,0x99,0xae,0xad,0xb6,0x88,0x90,0x18,
+	                                 0x50,0x1d,0x28,0x9e,0x49,0x00,0xf7,0xe4,0x33,0x1b,0x99,0xde,0xc4,0xb5,0x43,0x3a,
+	                                 0xc7,0xd3,0x29,0xee,0xb6,0xdd,0x26,0x54,0x5e,0x96,0xe5,0x5b,0x87,0x4b,0xe9,0x09};
+	BYTE hash3[SHA512_BLOCK_SIZE] = {0xe7,0x18,0x48,0x3d,0x0c,0xe7,0x69,0x64,0x4e,0x2e,0x42,0xc7,0xbc,0x15,0xb4,0x63,
+	                                 0x8e,0x1f,0x98,0xb1,0x3b,0x20,0x44,0x28,0x56,0x32,0xa8,0x03,0xaf,0xa9,0x73,0xeb,
+	                                 0xde,0x0f,0xf2,0x44,0x87,0x7e,0xa6,0x0a,0x4c,0xb0,0x43,0x2c,0xe5,0x77,0xc3,0x1b,
+	                                 0xeb,0x00,0x9c,0x5c,0x2c,0x49,0xaa,0x2e,0x4e,0xad,0xb2,0x17,0xad,0x8c,0xc0,0x9b};
+	BYTE buf[SHA512_BLOCK_SIZE];
+	SHA512_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	sha512_init(&ctx);
+	sha512_update(&ctx, text1, strlen(text1));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash1, buf, SHA512_BLOCK_SIZE);
+
+	sha512_init(&ctx);
+	sha512_update(&ctx, text2, strlen(text2));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash2, buf, SHA512_BLOCK_SIZE);
+
+	sha512_init(&ctx);
+	for (idx = 0; idx < 100000; ++idx)
+	   sha512_update(&ctx, text3, strlen(text3));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash3, buf, SHA512_BLOCK_SIZE);
+
+	return(pass);
+}
+
+int sha384_test()
+{
+	BYTE text1[] = {"abc"};
+	BYTE text2[] = {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"};
+	BYTE text3[] = {"aaaaaaaaaa"};
+	BYTE hash1[SHA384_BLOCK_SIZE] = {0xcb,0x00,0x75,0x3f,0x45,0xa3,0x5e,0x8b,0xb5,0xa0,0x3d,0x69,0x9a,0xc6,0x50,0x07,
+	                                 0x27,0x2c,0x32,0xab,0x0e,0xde,0xd1,0x63,0x1a,0x8b,0x60,0x5a,0x43,0xff,0x5b,0xed,
+	                                 0x80,0x86,0x07,0x2b,0xa1,0xe7,0xcc,0x23,0x58,0xba,0xec,0xa1,0x34,0xc8,0x25,0xa7};
+	BYTE hash2[SHA384_BLOCK_SIZE] = {0x09,0x33,0x0c,0x33,0xf7,0x11,0x47,0xe8,0x3d,0x19,0x2f,0xc7,0x82,0xcd,0x1b,0x47,
+	                                 0x53,0x11,0x1b,0x17,0x3b,0x3b,0x05,0xd2,0x2f,0xa0,0x80,0x86,0xe3,0xb0,0xf7,0x12,
+	                                 0xfc,0xc7,0xc7,0x1a,0x55,0x7e,0x2d,0xb9,0x66,0xc3,0xe9,0xfa,0x91,0x74,0x60,0x39};
+	BYTE hash3[SHA384_BLOCK_SIZE] = {0x9d,0x0e,0x18,0x09,0x71,0x64,0x74,0xcb,0x08,0x6e,0x83,0x4e,0x31,0x0a,0x4a,0x1c,
+	                                 0xed,0x14,0x9e,0x9c,0x00,0xf2,0x48,0x52,0x79,0x72,0xce,0xc5,0x70,0x4c,0x2a,0x5b,
+	                                 0x07,0xb8,0xb3,0xdc,0x38,0xec,0xc4,0xeb,0xae,0x97,0xdd,0xd8,0x7f,0x3d,0x89,0x85};
+	BYTE buf[SHA384_BLOCK_SIZE];
+	SHA512_CTX ctx;
+	int idx;
+	int pass = 1;
+
+	sha384_init(&ctx);
+	sha512_update(&ctx, text1, strlen(text1));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash1, buf, SHA384_BLOCK_SIZE);
+
+	sha384_init(&ctx);
+	sha512_update(&ctx, text2, strlen(text2));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash2, buf, SHA384_BLOCK_SIZE);
+
+	sha384_init(&ctx);
+	for (idx = 0; idx < 100000; ++idx)
+	   sha512_update(&ctx, text3, strlen(text3));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash3, buf, SHA384_BLOCK_SIZE);
+
+	return(pass);
+}
+
+int sha512_t_test()
+{
+	BYTE text1[] = {"abc"};
+	BYTE text2[] = {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"};
+	BYTE hash1[SHA512_224_BLOCK_SIZE] = {0x46,0x34,0x27,0x0f,0x70,0x7b,0x6a,0x54,0xda,0xae,0x75,0x30,0x46,0x08,0x42,0xe2,
+	                                     0x0e,0x37,0xed,0x26,0x5c,0xee,0xe9,0xa4,0x3e,0x89,0x24,0xaa};
+	BYTE hash2[SHA512_224_BLOCK_SIZE] = {0x23,0xfe,0xc5,0xbb,0x94,0xd6,0x0b,0x23,0x30,0x81,0x92,0x64,0x0b,0x0c,0x45,0x33,
+	                                     0x35,0xd6,0x64,0x73,0x4f,0xe4,0x0e,0x72,0x68,0x67,0x4a,0xf9};
+	BYTE hash3[SHA512_256_BLOCK_SIZE] = {0x53,0x04,0x8e,0x26,0x81,0x94,0x1e,0xf9,0x9b,0x2e,0x29,0xb7,0x6b,0x4c,0x7d,0xab,
+	                                     0xe4,0xc2,0xd0,0xc6,0x34,0xfc,0x6d,0x46,0xe0,0xe2,0xf1,0x31,0x07,0xe7,0xaf,0x23};
+	BYTE hash4[SHA512_256_BLOCK_SIZE] = {0x39,0x28,0xe1,0x84,0xfb,0x86,0x90,0xf8,0x40,0xda,0x39,0x88,0x12,0x1d,0x31,0xbe,
+	                                     0x65,0xcb,0x9d,0x3e,0xf8,0x3e,0xe6,0x14,0x6f,0xea,0xc8,0x61,0xe1,0x9b,0x56,0x3a};
+	BYTE buf[SHA512_256_BLOCK_SIZE];
+	SHA512_CTX ctx;
+	int pass = 1;
+
+	sha512_224_init(&ctx);
+	sha512_update(&ctx, text1, strlen(text1));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash1, buf, SHA512_224_BLOCK_SIZE);
+
+	sha512_224_init(&ctx);
+	sha512_update(&ctx, text2, strlen(text2));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash2, buf, SHA512_224_BLOCK_SIZE);
+
+	sha512_256_init(&ctx);
+	sha512_update(&ctx, text1, strlen(text1));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash3, buf, SHA512_256_BLOCK_SIZE);
+
+	sha512_256_init(&ctx);
+	sha512_update(&ctx, text2, strlen(text2));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash4, buf, SHA512_256_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// Whole blocks are hashed straight from the input buffer and only the tail
+// is buffered, so check that a single large update and many uneven ones give
+// the same digest.
+int sha512_chunk_test()
+{
+	static BYTE text[1000000];
+	BYTE hash[SHA512_BLOCK_SIZE] = {0xe7,0x18,0x48,0x3d,0x0c,0xe7,0x69,0x64,0x4e,0x2e,0x42,0xc7,0xbc,0x15,0xb4,0x63,
+	                                0x8e,0x1f,0x98,0xb1,0x3b,0x20,0x44,0x28,0x56,0x32,0xa8,0x03,0xaf,0xa9,0x73,0xeb,
+	                                0xde,0x0f,0xf2,0x44,0x87,0x7e,0xa6,0x0a,0x4c,0xb0,0x43,0x2c,0xe5,0x77,0xc3,0x1b,
+	                                0xeb,0x00,0x9c,0x5c,0x2c,0x49,0xaa,0x2e,0x4e,0xad,0xb2,0x17,0xad,0x8c,0xc0,0x9b};
+	BYTE buf[SHA512_BLOCK_SIZE];
+	SHA512_CTX ctx;
+	size_t idx, len;
+	int pass = 1;
+
+	memset(text, 'a', sizeof(text));
+
+	sha512_init(&ctx);
+	sha512_update(&ctx, text, sizeof(text));
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA512_BLOCK_SIZE);
+
+	sha512_init(&ctx);
+	for (idx = 0, len = 1; idx < sizeof(text); idx += len, len = len % 300 + 1) {
+		if (len > sizeof(text) - idx)
+			len = sizeof(text) - idx;
+		sha512_update(&ctx, &text[idx], len);
+	}
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA512_BLOCK_SIZE);
+
+	return(pass);
+}
+
+// A context saved part way through and resumed, and a clone finishing a
+// shared prefix, must both give the same digest as hashing in one go.
+int sha512_serialize_test()
+{
+	BYTE text[300];
+	BYTE saved[SHA512_SERIAL_SIZE];
+	BYTE hash[SHA384_BLOCK_SIZE];
+	BYTE buf[SHA384_BLOCK_SIZE];
+	SHA512_CTX ctx, resumed, copy;
+	int idx;
+	int pass = 1;
+
+	for (idx = 0; idx < (int)sizeof(text); ++idx)
+		text[idx] = idx * 13 + 5;
+
+	sha384_init(&ctx);
+	sha512_update(&ctx, text, sizeof(text));
+	sha512_final(&ctx, hash);
+
+	sha384_init(&ctx);
+	sha512_update(&ctx, text, 131);
+	sha512_serialize(&ctx, saved);
+	memset(&resumed, 0xff, sizeof(resumed));
+	pass = pass && sha512_deserialize(&resumed, saved);
+	sha512_update(&resumed, &text[131], sizeof(text) - 131);
+	sha512_final(&resumed, buf);
+	pass = pass && !memcmp(hash, buf, SHA384_BLOCK_SIZE);
+
+	sha512_clone(&copy, &ctx);
+	sha512_update(&ctx, &text[131], sizeof(text) - 131);
+	sha512_final(&ctx, buf);
+	pass = pass && !memcmp(hash, buf, SHA384_BLOCK_SIZE);
+	sha512_update(&copy, &text[131], sizeof(text) - 131);
+	sha512_final(&copy, buf);
+	pass = pass && !memcmp(hash, buf, SHA384_BLOCK_SIZE);
+
+	// Another format version, or a damaged buffer count, is refused.
+	saved[4]++;
+	pass = pass && !sha512_deserialize(&resumed, saved);
+	saved[4]--;
+	saved[5] = 0xff;
+	pass = pass && !sha512_deserialize(&resumed, saved);
+
+	return(pass);
+}
+
+int main()
+{
+	printf("SHA-512 tests: %s\n", sha512_test() && sha384_test() && sha512_t_test() &&
+	       sha512_chunk_test() && sha512_serialize_test() ? "SUCCEEDED" : "FAILED");
+
+	return(0);
+}